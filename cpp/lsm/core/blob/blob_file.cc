@@ -0,0 +1,126 @@
+#include "blob_file.h"
+#include <iostream>
+#include <vector>
+#include <cstring>
+
+namespace lsm {
+
+namespace {
+
+const char kBlobMagic[8] = {'L', 'S', 'M', 'B', 'L', 'O', 'B', '1'};
+
+} // namespace
+
+std::string BlobFileName(const std::string& dbname, int number) {
+    return dbname + "/" + std::to_string(number) + ".blob";
+}
+
+std::string BlobIndex::Encode() const {
+    std::string result(sizeof(file_number) + sizeof(offset) + sizeof(size), '\0');
+    char* p = &result[0];
+    memcpy(p, &file_number, sizeof(file_number));
+    memcpy(p + 8, &offset, sizeof(offset));
+    memcpy(p + 16, &size, sizeof(size));
+    return result;
+}
+
+bool BlobIndex::Decode(const std::string& input) {
+    if (input.size() != sizeof(file_number) + sizeof(offset) + sizeof(size)) return false;
+    memcpy(&file_number, input.data(), sizeof(file_number));
+    memcpy(&offset, input.data() + 8, sizeof(offset));
+    memcpy(&size, input.data() + 16, sizeof(size));
+    return true;
+}
+
+BlobFileBuilder::BlobFileBuilder(Env* env, const std::string& file_path, int number) : _number(number) {
+    _file = env->NewWritableFile(file_path);
+    if (!_file) {
+        std::cerr << "Failed to create blob file: " << file_path << " Error: " << strerror(errno) << std::endl;
+        return;
+    }
+    _ok = _file->Append(kBlobMagic, sizeof(kBlobMagic));
+    _offset = sizeof(kBlobMagic);
+}
+
+BlobIndex BlobFileBuilder::Add(const std::string& key, const std::string& value) {
+    uint32_t klen = key.size();
+    uint32_t vlen = value.size();
+
+    std::vector<char> buffer;
+    buffer.reserve(4 + klen + 4 + vlen);
+    const char* klen_ptr = reinterpret_cast<const char*>(&klen);
+    buffer.insert(buffer.end(), klen_ptr, klen_ptr + 4);
+    buffer.insert(buffer.end(), key.begin(), key.end());
+    const char* vlen_ptr = reinterpret_cast<const char*>(&vlen);
+    buffer.insert(buffer.end(), vlen_ptr, vlen_ptr + 4);
+    buffer.insert(buffer.end(), value.begin(), value.end());
+
+    BlobIndex index;
+    index.file_number = _number;
+    index.offset = _offset + 4 + klen + 4;
+    index.size = vlen;
+
+    if (!_ok) return index;
+    if (!_file->Append(buffer.data(), buffer.size())) {
+        std::cerr << "Failed to write blob file " << _number << ": " << strerror(errno) << std::endl;
+        _ok = false;
+        return index;
+    }
+    _offset += buffer.size();
+    _num_blobs++;
+    _blob_bytes += vlen;
+    return index;
+}
+
+bool BlobFileBuilder::Finish() {
+    if (!_file) return false;
+    // Same durability as the tables referencing it: no fsync, like TableBuilder
+    bool ok = _file->Close() && _ok;
+    _file.reset();
+    return ok;
+}
+
+std::shared_ptr<BlobFileReader> BlobFileReader::Open(Env* env, const std::string& file_path) {
+    auto file = env->NewRandomAccessFile(file_path);
+    if (!file) return nullptr;
+    return std::shared_ptr<BlobFileReader>(new BlobFileReader(std::move(file)));
+}
+
+bool BlobFileReader::Read(const BlobIndex& index, std::string* value) const {
+    value->resize(index.size);
+    size_t done = 0;
+    while (done < index.size) {
+        ssize_t n = _file->Read(index.offset + done, index.size - done, &(*value)[done]);
+        if (n <= 0) return false;
+        done += n;
+    }
+    return true;
+}
+
+BlobFileCache::BlobFileCache(Env* env, const std::string& dbname) : _env(env), _dbname(dbname) {}
+
+bool BlobFileCache::Get(const std::string& encoded_index, std::string* value) {
+    BlobIndex index;
+    if (!index.Decode(encoded_index)) return false;
+
+    std::shared_ptr<BlobFileReader> reader;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _readers.find(index.file_number);
+        if (it != _readers.end()) {
+            reader = it->second;
+        } else {
+            reader = BlobFileReader::Open(_env, BlobFileName(_dbname, index.file_number));
+            if (!reader) return false;
+            _readers[index.file_number] = reader;
+        }
+    }
+    return reader->Read(index, value);
+}
+
+void BlobFileCache::Evict(int file_number) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _readers.erase(file_number);
+}
+
+} // namespace lsm
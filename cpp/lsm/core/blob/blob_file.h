@@ -0,0 +1,96 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+#include "util/env.h"
+
+namespace lsm {
+
+// Values of at least min_blob_size are written by flushes and compactions to
+// append-only <number>.blob files; the SSTable stores a BlobIndex in their
+// place. Compactions then move the small index instead of the value.
+//
+// File layout: magic(8) { klen(4) key vlen(4) value }
+// The key is kept next to the value so a blob file can be inspected on its own.
+
+// Location of one value in a blob file
+struct BlobIndex {
+    uint64_t file_number = 0;
+    uint64_t offset = 0; // Of the value bytes
+    uint64_t size = 0;
+
+    std::string Encode() const;
+    bool Decode(const std::string& input);
+};
+
+// Liveness bookkeeping of a blob file, kept in the MANIFEST. Compactions
+// add to the garbage as they drop or relocate references. Once everything
+// is garbage the file is deleted.
+struct BlobFileMetaData {
+    int number = 0;
+    uint64_t total_count = 0;
+    uint64_t total_bytes = 0;
+    uint64_t garbage_count = 0;
+    uint64_t garbage_bytes = 0;
+
+    double GarbageRatio() const {
+        return total_bytes == 0 ? 0.0 : static_cast<double>(garbage_bytes) / total_bytes;
+    }
+};
+
+class BlobFileBuilder {
+public:
+    BlobFileBuilder(Env* env, const std::string& file_path, int number);
+
+    bool ok() const { return _ok; }
+    // Appends the value and returns where it was written. Check ok() after:
+    // NumBlobs and BlobBytes only count the values written successfully.
+    BlobIndex Add(const std::string& key, const std::string& value);
+    bool Finish();
+
+    int Number() const { return _number; }
+    uint64_t NumBlobs() const { return _num_blobs; }
+    uint64_t BlobBytes() const { return _blob_bytes; }
+
+private:
+    std::unique_ptr<WritableFile> _file;
+    int _number;
+    bool _ok = false;
+    uint64_t _offset = 0;
+    uint64_t _num_blobs = 0;
+    uint64_t _blob_bytes = 0;
+};
+
+// Thread-safe: reads never move a shared file position
+class BlobFileReader {
+public:
+    static std::shared_ptr<BlobFileReader> Open(Env* env, const std::string& file_path);
+
+    bool Read(const BlobIndex& index, std::string* value) const;
+
+private:
+    explicit BlobFileReader(std::unique_ptr<RandomAccessFile> file) : _file(std::move(file)) {}
+    std::unique_ptr<RandomAccessFile> _file;
+};
+
+// Open blob files shared by every Version of a VersionSet. Thread-safe.
+class BlobFileCache {
+public:
+    BlobFileCache(Env* env, const std::string& dbname);
+
+    // Resolves an encoded BlobIndex. Returns false if it cannot be read.
+    bool Get(const std::string& encoded_index, std::string* value);
+    void Evict(int file_number);
+
+private:
+    Env* _env;
+    std::string _dbname;
+    std::mutex _mutex;
+    std::unordered_map<uint64_t, std::shared_ptr<BlobFileReader>> _readers;
+};
+
+std::string BlobFileName(const std::string& dbname, int number);
+
+} // namespace lsm
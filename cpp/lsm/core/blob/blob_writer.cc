@@ -0,0 +1,33 @@
+#include "blob_writer.h"
+
+namespace lsm {
+
+BlobWriter::BlobWriter(const std::string& dir, VersionSet* versions, uint64_t min_blob_size)
+    : _dir(dir), _versions(versions), _min_blob_size(min_blob_size) {}
+
+bool BlobWriter::Add(const std::string& key, const std::string& value, std::string* blob_index) {
+    if (!_builder) {
+        int number = _versions->NewFileNumber();
+        _builder = std::make_unique<BlobFileBuilder>(_versions->env(), BlobFileName(_dir, number), number);
+    }
+    if (!_builder->ok()) return false;
+    *blob_index = _builder->Add(key, value).Encode();
+    return _builder->ok();
+}
+
+bool BlobWriter::Finish(VersionEdit* edit) {
+    if (!_builder) return true;
+    bool ok = _builder->Finish();
+    // Values added before a failure are still referenced by the tables
+    if (_builder->NumBlobs() > 0) {
+        BlobFileMetaData meta;
+        meta.number = _builder->Number();
+        meta.total_count = _builder->NumBlobs();
+        meta.total_bytes = _builder->BlobBytes();
+        edit->AddBlobFile(meta);
+    }
+    _builder.reset();
+    return ok;
+}
+
+} // namespace lsm
@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <cstdint>
+#include "blob_file.h"
+#include "core/version/version.h"
+
+namespace lsm {
+
+// Separates large values into a blob file while a flush or compaction writes
+// its tables. The file is only created once the first value goes in.
+class BlobWriter {
+public:
+    BlobWriter(const std::string& dir, VersionSet* versions, uint64_t min_blob_size);
+
+    // True if value should be stored in a blob file (0 disables separation)
+    bool ShouldSeparate(const std::string& value) const {
+        return _min_blob_size > 0 && value.size() >= _min_blob_size;
+    }
+    // Writes value and returns its encoded BlobIndex through blob_index.
+    // On false the caller keeps the value inline instead.
+    bool Add(const std::string& key, const std::string& value, std::string* blob_index);
+    // Closes the blob file, if one was created, and records it in edit.
+    // Returns false if the file could not be closed cleanly.
+    bool Finish(VersionEdit* edit);
+
+private:
+    std::string _dir;
+    VersionSet* _versions;
+    uint64_t _min_blob_size;
+    std::unique_ptr<BlobFileBuilder> _builder;
+};
+
+} // namespace lsm
@@ -0,0 +1,68 @@
+#include "column_family.h"
+#include <iostream>
+
+namespace lsm {
+
+ColumnFamilyHandle::ColumnFamilyHandle(Env* env, uint32_t id, const std::string& name, const std::string& dir,
+                                       const ColumnFamilyOptions& options, int num_shards,
+                                       std::shared_ptr<WriteBufferManager> write_buffer_manager,
+                                       std::shared_ptr<RowCache> row_cache)
+    : _id(id), _name(name), _dir(dir), _write_buffer_manager(std::move(write_buffer_manager)) {
+    env->CreateDirs(dir);
+    SetOptions(options);
+    _versions = std::make_unique<VersionSet>(env, dir, _options->comparator, std::move(row_cache));
+    for (int i = 0; i < num_shards; ++i) {
+        _mems.push_back(NewMemTable());
+    }
+    _imms.resize(num_shards);
+}
+
+std::unique_ptr<MemTable> ColumnFamilyHandle::NewMemTable() const {
+    return std::make_unique<MemTable>(*GetOptions(), _write_buffer_manager);
+}
+
+void ColumnFamilyHandle::SetOptions(ColumnFamilyOptions options) {
+    if (!options.comparator) options.comparator = BytewiseComparator();
+    std::atomic_store(&_options, std::shared_ptr<const ColumnFamilyOptions>(
+                                     std::make_shared<ColumnFamilyOptions>(std::move(options))));
+}
+
+bool ColumnFamilyRegistry::Load(Env* env, const std::string& dbname) {
+    InputFileStream file(env, dbname + "/COLUMN_FAMILIES");
+    if (!file.is_open()) return false;
+
+    std::string line;
+    if (!std::getline(file, line)) return false;
+    try {
+        next_id = std::stoul(line);
+        families.clear();
+        while (std::getline(file, line)) {
+            size_t tab = line.find('\t');
+            if (tab == std::string::npos) continue;
+            families.push_back({static_cast<uint32_t>(std::stoul(line.substr(0, tab))), line.substr(tab + 1)});
+        }
+    } catch (...) {
+        return false;
+    }
+    return true;
+}
+
+bool ColumnFamilyRegistry::Save(Env* env, const std::string& dbname) const {
+    std::string tmp = dbname + "/COLUMN_FAMILIES.tmp";
+    {
+        OutputFileStream file(env, tmp);
+        if (!file.is_open()) {
+            std::cerr << "Failed to write column family registry: " << tmp << std::endl;
+            return false;
+        }
+        file << next_id << "\n";
+        for (const auto& cf : families) {
+            file << cf.first << "\t" << cf.second << "\n";
+        }
+        file.flush();
+        if (!file) return false;
+    }
+    return env->RenameFile(tmp, dbname + "/COLUMN_FAMILIES");
+}
+
+} // namespace lsm
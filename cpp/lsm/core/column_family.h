@@ -0,0 +1,67 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include "memtable.h"
+#include "options.h"
+#include "core/version/version.h"
+
+namespace lsm {
+
+// An independent keyspace inside a DB: its own memtables, SSTables and
+// options, sharing the DB's WAL and background threads. The default family
+// lives in the DB directory, every other one in its own cf_<id>/ directory,
+// so dropping a family is a directory removal.
+//
+// Handles are owned by the DB and stay valid until the DB is closed, even
+// after DropColumnFamily (operations on a dropped family then throw).
+class ColumnFamilyHandle {
+public:
+    uint32_t GetID() const { return _id; }
+    const std::string& GetName() const { return _name; }
+
+private:
+    friend class DB;
+
+    ColumnFamilyHandle(Env* env, uint32_t id, const std::string& name, const std::string& dir,
+                       const ColumnFamilyOptions& options, int num_shards,
+                       std::shared_ptr<WriteBufferManager> write_buffer_manager,
+                       std::shared_ptr<RowCache> row_cache);
+
+    // An empty memtable charged to the DB's write buffer manager, if any
+    std::unique_ptr<MemTable> NewMemTable() const;
+
+    // A snapshot of the options, which CreateColumnFamily may replace while
+    // the family is in use: keep it for as long as a pointer into it is
+    std::shared_ptr<const ColumnFamilyOptions> GetOptions() const { return std::atomic_load(&_options); }
+    void SetOptions(ColumnFamilyOptions options);
+
+    uint32_t _id;
+    std::string _name;
+    std::string _dir;
+    std::shared_ptr<const ColumnFamilyOptions> _options; // Never changed, only swapped
+    std::shared_ptr<WriteBufferManager> _write_buffer_manager;
+    std::unique_ptr<VersionSet> _versions;
+    // One memtable per write shard, guarded by that shard's mutex
+    std::vector<std::unique_ptr<MemTable>> _mems;
+    // Per shard: the previous memtable while a background flush writes it
+    // to L0, else null. Read-only, so the flush needs no lock to iterate it.
+    std::vector<std::unique_ptr<MemTable>> _imms;
+    std::atomic<bool> _dropped{false};
+};
+
+// The COLUMN_FAMILIES file in the DB directory records the live families:
+//   line 1: next_id
+//   then one "id<TAB>name" line per non-default family
+struct ColumnFamilyRegistry {
+    uint32_t next_id = 1; // 0 is the default family
+    std::vector<std::pair<uint32_t, std::string>> families;
+
+    bool Load(Env* env, const std::string& dbname);
+    // Written to a temp file and renamed, so a crash leaves the old or new copy
+    bool Save(Env* env, const std::string& dbname) const;
+};
+
+} // namespace lsm
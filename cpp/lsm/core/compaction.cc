@@ -0,0 +1,321 @@
+#include "compaction.h"
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include "memtable.h"
+#include "core/sstable/table_builder.h"
+#include "core/blob/blob_writer.h"
+#include "util/clock.h"
+
+namespace lsm {
+
+CompactionJob::CompactionJob(const std::string& dir, VersionSet* versions,
+                             const ColumnFamilyOptions& options, const Compaction& compaction,
+                             ThreadPool* pool, int max_subcompactions)
+    : _dir(dir), _versions(versions), _options(options), _compaction(compaction),
+      _pool(pool), _max_subcompactions(max_subcompactions) {}
+
+std::vector<std::string> CompactionJob::SubcompactionBoundaries() const {
+    if (!_pool || _max_subcompactions <= 1) return {};
+
+    std::vector<std::string> keys;
+    for (const auto& files : _compaction.inputs) {
+        for (const auto& f : files) keys.push_back(f.smallest);
+    }
+    const Comparator* cmp = _options.comparator.get();
+    std::sort(keys.begin(), keys.end(),
+              [cmp](const std::string& a, const std::string& b) { return cmp->Compare(a, b) < 0; });
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    if (keys.size() <= 1) return {};
+    // The first range starts at the smallest key anyway
+    keys.erase(keys.begin());
+
+    // At most max_subcompactions ranges, spread evenly over the candidates
+    size_t n = std::min(keys.size(), static_cast<size_t>(_max_subcompactions - 1));
+    std::vector<std::string> result;
+    for (size_t i = 0; i < n; ++i) {
+        result.push_back(keys[i * keys.size() / n]);
+    }
+    return result;
+}
+
+bool CompactionJob::Run(VersionEdit* edit) {
+    Version* v = _compaction.input_version.get();
+    for (const auto& files : _compaction.inputs) {
+        for (const auto& f : files) {
+            auto table = v->GetTable(f.number);
+            if (!table) {
+                std::cerr << "Compaction input " << f.number << ".sst is unreadable" << std::endl;
+                return false;
+            }
+            _bytes_read += f.file_size;
+
+            // Range tombstones are carried into the outputs unless nothing
+            // they could cover is left below. Entries they cover are skipped
+            // by the merging iterator.
+            for (const auto& t : table->RangeTombstones()) {
+                if (_compaction.IsBaseLevelForRange(t.begin, t.end)) {
+                    _entries_dropped++;
+                } else {
+                    _tombstones.push_back(t);
+                }
+            }
+        }
+    }
+
+    std::vector<std::string> boundaries = SubcompactionBoundaries();
+    std::vector<Subcompaction> subs(boundaries.size() + 1);
+    for (size_t i = 0; i < boundaries.size(); ++i) {
+        subs[i].has_end = true;
+        subs[i].end = boundaries[i];
+        subs[i + 1].has_start = true;
+        subs[i + 1].start = boundaries[i];
+    }
+    _num_subcompactions = static_cast<int>(subs.size());
+
+    if (subs.size() == 1) {
+        RunSubcompaction(&subs[0]);
+    } else {
+        // Pool threads and this one claim ranges until none is left. A helper
+        // that only starts after every range was claimed finds no work, so
+        // this thread never waits for a queued job to get a thread.
+        struct SharedState {
+            std::atomic<size_t> next{0};
+            std::mutex mutex;
+            std::condition_variable cv;
+            size_t done = 0;
+        };
+        auto state = std::make_shared<SharedState>();
+        size_t n = subs.size();
+        Subcompaction* ranges = subs.data();
+        auto work = [this, state, n, ranges]() {
+            size_t i;
+            while ((i = state->next.fetch_add(1)) < n) {
+                RunSubcompaction(&ranges[i]);
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (++state->done == n) state->cv.notify_all();
+            }
+        };
+        for (size_t i = 1; i < subs.size(); ++i) {
+            _pool->Schedule(work);
+        }
+        work();
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->cv.wait(lock, [&] { return state->done == n; });
+    }
+
+    for (auto& sub : subs) {
+        if (!sub.ok) return false;
+        for (const auto& nf : sub.edit.new_files) edit->AddFile(nf.first, nf.second);
+        for (const auto& bf : sub.edit.new_blob_files) edit->AddBlobFile(bf);
+        for (const auto& garbage : sub.edit.blob_garbage) {
+            auto& total = edit->blob_garbage[garbage.first];
+            total.first += garbage.second.first;
+            total.second += garbage.second.second;
+        }
+        _bytes_written += sub.bytes_written;
+        _entries_dropped += sub.entries_dropped;
+        _entries_filtered += sub.entries_filtered;
+    }
+
+    for (size_t i = 0; i < _compaction.inputs.size(); ++i) {
+        int level = _compaction.level + static_cast<int>(i);
+        for (const auto& f : _compaction.inputs[i]) {
+            edit->DeleteFile(level, f.number);
+        }
+    }
+    return true;
+}
+
+void CompactionJob::RunSubcompaction(Subcompaction* sub) {
+    Version* v = _compaction.input_version.get();
+    int output_level = _compaction.output_level;
+    VersionEdit* edit = &sub->edit;
+    const std::string* end = sub->has_end ? &sub->end : nullptr;
+
+    // Children newest first: L0 inputs by descending file number, then the
+    // rest in level order
+    std::vector<std::unique_ptr<InternalIterator>> children;
+    for (size_t i = 0; i < _compaction.inputs.size(); ++i) {
+        std::vector<FileMetaData> files = _compaction.inputs[i];
+        if (_compaction.level == 0 && i == 0) {
+            std::sort(files.begin(), files.end(), [](const FileMetaData& a, const FileMetaData& b) {
+                return a.number > b.number;
+            });
+        }
+        for (const auto& f : files) {
+            auto table = v->GetTable(f.number);
+            if (!table) {
+                sub->ok = false;
+                return;
+            }
+            children.emplace_back(table->NewIterator());
+        }
+    }
+    // Every blob reference the outputs do not carry over becomes garbage of
+    // its file. Entries at or past end belong to the next subcompaction.
+    auto add_blob_garbage = [edit](const std::string& encoded) {
+        BlobIndex index;
+        if (index.Decode(encoded)) edit->AddBlobGarbage(index.file_number, index.size);
+    };
+    const Comparator* cmp = _options.comparator.get();
+    std::unique_ptr<InternalIterator> input(NewMergingIterator(std::move(children), cmp,
+        [&add_blob_garbage, end, cmp](const InternalIterator& skipped) {
+            if (skipped.IsBlobIndex() && (!end || cmp->Compare(skipped.Key(), *end) < 0)) {
+                add_blob_garbage(skipped.Value());
+            }
+        }));
+
+    uint64_t now_ms = NowMillis();
+    const CompactionFilter* filter = _options.compaction_filter.get();
+    BlobWriter blobs(_dir, _versions, _options.min_blob_size);
+    std::unique_ptr<TableBuilder> builder;
+    FileMetaData current;
+    bool current_empty = true;
+    // The outputs finished so far hold all keys of the range below lower, if
+    // it has a lower bound
+    std::string lower = sub->start;
+    bool has_lower = sub->has_start;
+    bool split_pending = false;
+    bool ok = true;
+
+    auto open_output = [&]() {
+        current = FileMetaData();
+        current.number = _versions->NewFileNumber();
+        current_empty = true;
+        std::string fname = _dir + "/" + std::to_string(current.number) + ".sst";
+        builder = std::make_unique<TableBuilder>(fname, _options, _versions->env());
+        return builder->ok();
+    };
+    auto extend = [&](const std::string& smallest, const std::string& largest) {
+        if (current_empty || cmp->Compare(smallest, current.smallest) < 0) current.smallest = smallest;
+        if (current_empty || cmp->Compare(largest, current.largest) > 0) current.largest = largest;
+        current_empty = false;
+    };
+    // The part of t that belongs to the output spanning [lower, upper)
+    auto clip = [&](const RangeTombstone& t, const std::string* upper) {
+        RangeTombstone clipped = t;
+        if (has_lower && cmp->Compare(clipped.begin, lower) < 0) clipped.begin = lower;
+        if (upper && cmp->Compare(*upper, clipped.end) < 0) clipped.end = *upper;
+        return clipped;
+    };
+    // Each output gets the tombstones clipped to its span, so the outputs
+    // stay disjoint. upper == nullptr: the last output, unbounded above.
+    auto finish_output = [&](const std::string* upper) {
+        for (const auto& t : _tombstones) {
+            RangeTombstone clipped = clip(t, upper);
+            if (cmp->Compare(clipped.begin, clipped.end) >= 0) continue;
+            builder->AddRangeTombstone(clipped);
+            extend(clipped.begin, clipped.end);
+        }
+        builder->Finish();
+        current.file_size = builder->FileSize();
+        sub->bytes_written += current.file_size;
+        edit->AddFile(output_level, current);
+        builder.reset();
+    };
+
+    if (sub->has_start) {
+        input->Seek(sub->start);
+    } else {
+        input->SeekToFirst();
+    }
+    for (; input->Valid(); input->Next()) {
+        std::string key = input->Key();
+        if (end && cmp->Compare(key, *end) >= 0) break;
+        std::string value;
+        bool hidden = input->IsDeleted() || IsExpired(input->ExpireAt(), now_ms);
+        // Blob reference of the input entry, garbage unless the output keeps it
+        std::string blob_ref;
+        if (input->IsBlobIndex() && !input->IsDeleted()) blob_ref = input->Value();
+        bool keep_ref = false;
+        if (!hidden) {
+            // Values in mostly-garbage blob files are rewritten so those files can go
+            bool relocate = false;
+            if (!blob_ref.empty()) {
+                BlobIndex index;
+                index.Decode(blob_ref);
+                relocate = v->BlobGarbageRatio(index.file_number) >= _options.blob_gc_garbage_ratio;
+                keep_ref = !relocate;
+            }
+            if (blob_ref.empty()) {
+                value = input->Value();
+            } else if ((filter || relocate) && !v->GetBlob(blob_ref, &value)) {
+                std::cerr << "Compaction failed to read the blob value of " << key << std::endl;
+                ok = false;
+                break;
+            }
+            if (filter) {
+                std::string new_value;
+                switch (filter->Filter(output_level, key, value, &new_value)) {
+                case CompactionFilter::Decision::kKeep:
+                    break;
+                case CompactionFilter::Decision::kRemove:
+                    hidden = true;
+                    keep_ref = false;
+                    sub->entries_filtered++;
+                    break;
+                case CompactionFilter::Decision::kChangeValue:
+                    value.swap(new_value);
+                    keep_ref = false;
+                    sub->entries_filtered++;
+                    break;
+                }
+            }
+        }
+        if (!blob_ref.empty() && !keep_ref) {
+            add_blob_garbage(blob_ref);
+        }
+        if (hidden && _compaction.IsBaseLevelForKey(key)) {
+            sub->entries_dropped++;
+            continue;
+        }
+
+        // Split before this key, now that the bound of the full output is known
+        if (split_pending) {
+            finish_output(&key);
+            lower = key;
+            has_lower = true;
+            split_pending = false;
+        }
+        if (!builder && !open_output()) {
+            ok = false;
+            break;
+        }
+        extend(key, key);
+        std::string blob_index;
+        if (hidden) {
+            builder->Add(key, "", true);
+        } else if (keep_ref) {
+            builder->Add(key, blob_ref, false, input->ExpireAt(), true);
+        } else if (blobs.ShouldSeparate(value) && blobs.Add(key, value, &blob_index)) {
+            builder->Add(key, blob_index, false, input->ExpireAt(), true);
+        } else {
+            builder->Add(key, value, false, input->ExpireAt());
+        }
+
+        if (builder->FileSize() >= _options.target_file_size) {
+            split_pending = true;
+        }
+    }
+    if (ok && !builder) {
+        // No entries after lower, but tombstones may still need a home
+        for (const auto& t : _tombstones) {
+            RangeTombstone clipped = clip(t, end);
+            if (cmp->Compare(clipped.begin, clipped.end) < 0) {
+                ok = open_output();
+                break;
+            }
+        }
+    }
+    if (builder && ok) {
+        finish_output(end);
+    }
+    if (!blobs.Finish(edit)) {
+        std::cerr << "Failed to close the blob file of a compaction in " << _dir << std::endl;
+    }
+    sub->ok = ok;
+}
+
+} // namespace lsm
@@ -0,0 +1,77 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "options.h"
+#include "core/version/version.h"
+#include "util/thread_pool.h"
+
+namespace lsm {
+
+// Merges the inputs of one Compaction into new tables at the output level.
+// Of every key only the newest entry survives. Deletions and expired values
+// are dropped when nothing older can exist below the output level, and
+// otherwise written as (value-less) tombstones. Live values go through the
+// family's CompactionFilter, if any.
+//
+// Blob references that do not make it into the outputs are recorded in the
+// edit as garbage of their blob file. Values of at least min_blob_size bytes
+// go to a new blob file, as do the live values of files due for GC.
+//
+// With a pool and max_subcompactions > 1 the key space is split at input
+// file boundaries into ranges that are compacted in parallel, each into its
+// own output files. Their results are combined into the one edit.
+class CompactionJob {
+public:
+    CompactionJob(const std::string& dir, VersionSet* versions,
+                  const ColumnFamilyOptions& options, const Compaction& compaction,
+                  ThreadPool* pool = nullptr, int max_subcompactions = 1);
+
+    // Writes the output tables and fills edit with the file changes.
+    // Returns false if an output table could not be written.
+    bool Run(VersionEdit* edit);
+
+    uint64_t BytesRead() const { return _bytes_read; }
+    uint64_t BytesWritten() const { return _bytes_written; }
+    uint64_t EntriesDropped() const { return _entries_dropped; }
+    uint64_t EntriesFiltered() const { return _entries_filtered; } // Removed or changed by the filter
+    int NumSubcompactions() const { return _num_subcompactions; }
+
+private:
+    // One key range [start, end) of the compaction. No start: from the
+    // first key; no end: to the last.
+    struct Subcompaction {
+        bool has_start = false;
+        bool has_end = false;
+        std::string start;
+        std::string end;
+
+        VersionEdit edit; // Output tables, blob files and garbage of this range
+        bool ok = true;
+        uint64_t bytes_written = 0;
+        uint64_t entries_dropped = 0;
+        uint64_t entries_filtered = 0;
+    };
+
+    std::string _dir;
+    VersionSet* _versions;
+    ColumnFamilyOptions _options;
+    Compaction _compaction;
+    ThreadPool* _pool;
+    int _max_subcompactions;
+
+    // Range tombstones of the inputs that must be carried into the outputs
+    std::vector<RangeTombstone> _tombstones;
+
+    uint64_t _bytes_read = 0;
+    uint64_t _bytes_written = 0;
+    uint64_t _entries_dropped = 0;
+    uint64_t _entries_filtered = 0;
+    int _num_subcompactions = 1;
+
+    // Split keys between the subcompactions, ascending
+    std::vector<std::string> SubcompactionBoundaries() const;
+    void RunSubcompaction(Subcompaction* sub);
+};
+
+} // namespace lsm
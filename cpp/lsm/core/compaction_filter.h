@@ -0,0 +1,33 @@
+#pragma once
+#include <string>
+
+namespace lsm {
+
+// User hook run on every live value as it is written by a flush (level 0)
+// or a compaction (the output level). It can drop keys or rewrite values in
+// bulk without going through the foreground write path, e.g. to purge a
+// retired tenant's prefix or to trim oversized values.
+//
+// Deleted and expired entries are never passed in. A removed key reads as
+// deleted from then on: it becomes a tombstone, which compaction discards
+// at the base level like any other.
+//
+// Flushes and compactions run concurrently, so Filter must be thread-safe.
+class CompactionFilter {
+public:
+    enum class Decision {
+        kKeep,
+        kRemove,
+        kChangeValue, // Replace the value with *new_value, keeping its expiry
+    };
+
+    virtual ~CompactionFilter() = default;
+
+    virtual Decision Filter(int level, const std::string& key, const std::string& existing_value,
+                            std::string* new_value) const = 0;
+
+    // Identifies the filter in logs
+    virtual const char* Name() const = 0;
+};
+
+} // namespace lsm
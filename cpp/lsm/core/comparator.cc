@@ -0,0 +1,48 @@
+#include "comparator.h"
+
+namespace lsm {
+
+namespace {
+
+// A built-in comparator of kind K, comparing with Order
+template <Comparator::Kind K, typename Order>
+class BuiltinComparator : public Comparator {
+public:
+    explicit BuiltinComparator(const char* name) : Comparator(K), _name(name) {}
+
+    int Compare(std::string_view a, std::string_view b) const override { return Order().Compare(a, b); }
+    std::string Name() const override { return _name; }
+
+private:
+    const char* _name;
+};
+
+} // namespace
+
+std::shared_ptr<const Comparator> BytewiseComparator() {
+    static auto comparator =
+        std::make_shared<BuiltinComparator<Comparator::Kind::kBytewise, BytewiseOrder>>("lsm.BytewiseComparator");
+    return comparator;
+}
+
+std::shared_ptr<const Comparator> ReverseBytewiseComparator() {
+    static auto comparator =
+        std::make_shared<BuiltinComparator<Comparator::Kind::kReverseBytewise, ReverseBytewiseOrder>>(
+            "lsm.ReverseBytewiseComparator");
+    return comparator;
+}
+
+std::shared_ptr<const Comparator> Uint64Comparator() {
+    static auto comparator =
+        std::make_shared<BuiltinComparator<Comparator::Kind::kUint64, Uint64Order>>("lsm.Uint64Comparator");
+    return comparator;
+}
+
+std::shared_ptr<const Comparator> BuiltinComparatorByName(const std::string& name) {
+    for (const auto& comparator : {BytewiseComparator(), ReverseBytewiseComparator(), Uint64Comparator()}) {
+        if (comparator->Name() == name) return comparator;
+    }
+    return nullptr;
+}
+
+} // namespace lsm
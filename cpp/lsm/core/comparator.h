@@ -0,0 +1,95 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+
+namespace lsm {
+
+// Orders the keys of a column family (ColumnFamilyOptions::comparator):
+// memtables, tables, levels and iterators all follow it.
+//
+// Its Name() is recorded in the MANIFEST and in the tables, and a family
+// cannot be reopened with a comparator of another name. Keys are routed to
+// shards and hash indexes by their bytes, so Compare may only return 0 for
+// identical keys. Must be thread-safe.
+class Comparator {
+public:
+    // The built-ins have their own kind, so that search loops can be
+    // instantiated for them with the compare inlined (see WithOrder)
+    enum class Kind { kCustom, kBytewise, kReverseBytewise, kUint64 };
+
+    virtual ~Comparator() = default;
+
+    // Negative, zero or positive as a sorts before, equal to or after b
+    virtual int Compare(std::string_view a, std::string_view b) const = 0;
+    virtual std::string Name() const = 0;
+
+    Kind kind() const { return _kind; }
+    // Keys are in the order of their bytes: the built-ins bytewise and uint64
+    bool IsBytewiseOrder() const { return _kind == Kind::kBytewise || _kind == Kind::kUint64; }
+
+protected:
+    explicit Comparator(Kind kind = Kind::kCustom) : _kind(kind) {}
+
+private:
+    Kind _kind;
+};
+
+// std::string order, the default
+std::shared_ptr<const Comparator> BytewiseComparator();
+std::shared_ptr<const Comparator> ReverseBytewiseComparator();
+// Keys of 8 bytes read as big-endian unsigned integers, e.g. encoded IDs.
+// That is also their bytewise order, but compared with one byte swap and
+// integer compare instead of memcmp. Keys of other lengths compare bytewise.
+std::shared_ptr<const Comparator> Uint64Comparator();
+// The built-in comparator of that Name(), or nullptr
+std::shared_ptr<const Comparator> BuiltinComparatorByName(const std::string& name);
+
+// The built-in orders as plain types, for templates
+struct BytewiseOrder {
+    int Compare(std::string_view a, std::string_view b) const { return a.compare(b); }
+};
+
+struct ReverseBytewiseOrder {
+    int Compare(std::string_view a, std::string_view b) const { return b.compare(a); }
+};
+
+struct Uint64Order {
+    int Compare(std::string_view a, std::string_view b) const {
+        if (a.size() != 8 || b.size() != 8) return a.compare(b);
+        uint64_t x, y;
+        memcpy(&x, a.data(), 8);
+        memcpy(&y, b.data(), 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        x = __builtin_bswap64(x);
+        y = __builtin_bswap64(y);
+#endif
+        return (x > y) - (x < y);
+    }
+};
+
+// Any other comparator, through its virtual Compare
+struct CustomOrder {
+    const Comparator* comparator;
+    int Compare(std::string_view a, std::string_view b) const { return comparator->Compare(a, b); }
+};
+
+// Calls fn with the order type of comparator, so that fn runs as a separate
+// instantiation per built-in, with no virtual call per compare
+template <typename Fn>
+decltype(auto) WithOrder(const Comparator* comparator, Fn&& fn) {
+    switch (comparator->kind()) {
+    case Comparator::Kind::kBytewise:
+        return fn(BytewiseOrder());
+    case Comparator::Kind::kReverseBytewise:
+        return fn(ReverseBytewiseOrder());
+    case Comparator::Kind::kUint64:
+        return fn(Uint64Order());
+    default:
+        return fn(CustomOrder{comparator});
+    }
+}
+
+} // namespace lsm
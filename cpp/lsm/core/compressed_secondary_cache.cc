@@ -0,0 +1,64 @@
+#include "compressed_secondary_cache.h"
+#include "util/compression.h"
+#include "util/hash.h"
+
+namespace lsm {
+
+CompressedSecondaryCache::CompressedSecondaryCache(size_t capacity, bool admit_unread)
+    : _capacity(capacity), _admit_unread(admit_unread) {
+    for (auto& shard : _shards) shard.lru.set_capacity(capacity / kNumShards);
+}
+
+CompressedSecondaryCache::Shard& CompressedSecondaryCache::ShardOf(const std::string& key) {
+    return _shards[Hash(key) % kNumShards];
+}
+
+bool CompressedSecondaryCache::Insert(const std::string& key, const std::string& value, bool was_read) {
+    if (!was_read && !_admit_unread) {
+        _rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    std::string compressed;
+    LZCompress(value.data(), value.size(), &compressed);
+    if (compressed.size() > value.size() - value.size() / kMinSavingFraction) {
+        _rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    size_t charge = key.size() + compressed.size() + kEntryOverhead;
+    Shard& shard = ShardOf(key);
+    if (charge > shard.lru.capacity()) {
+        _rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    size_t before = shard.lru.usage();
+    shard.lru.Insert(key, std::move(compressed), charge);
+    size_t after = shard.lru.usage();
+    _usage.fetch_add(after, std::memory_order_relaxed);
+    _usage.fetch_sub(before, std::memory_order_relaxed);
+    _admitted.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool CompressedSecondaryCache::Lookup(const std::string& key, std::string* value) {
+    std::string compressed;
+    {
+        Shard& shard = ShardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        size_t before = shard.lru.usage();
+        if (!shard.lru.Erase(key, &compressed)) {
+            _misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        _usage.fetch_sub(before - shard.lru.usage(), std::memory_order_relaxed);
+    }
+    if (!LZUncompress(compressed.data(), compressed.size(), value)) {
+        _misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    _hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+} // namespace lsm
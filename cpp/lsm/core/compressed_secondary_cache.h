@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include "util/lru_cache.h"
+
+namespace lsm {
+
+// Second tier of a RowCache: rows evicted from it are kept here compressed
+// (see LZCompress), so the same memory holds several times as many, and a
+// lookup that misses the primary tier costs a decompression instead of a
+// table read. A row found here moves back to the primary tier.
+//
+// Admission: rows that compression does not shrink by at least
+// 1/kMinSavingFraction are rejected, and so are, unless admit_unread, rows
+// never read while in the primary tier. LRU, bounded by capacity bytes of
+// compressed data. Thread-safe.
+class CompressedSecondaryCache {
+public:
+    // admit_unread = false: only rows read at least once while in the
+    // primary tier are admitted, so that scans of cold keys do not flush
+    // the hot ones out of here too
+    explicit CompressedSecondaryCache(size_t capacity, bool admit_unread = false);
+
+    // Offers an evicted row. Returns true if it was admitted.
+    bool Insert(const std::string& key, const std::string& value, bool was_read);
+    // Moves the row of key out of this tier into *value
+    bool Lookup(const std::string& key, std::string* value);
+
+    size_t capacity() const { return _capacity; }
+    size_t usage() const { return _usage.load(std::memory_order_relaxed); }
+    // Lookups served from here: table reads saved
+    uint64_t hits() const { return _hits.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return _misses.load(std::memory_order_relaxed); }
+    uint64_t admitted() const { return _admitted.load(std::memory_order_relaxed); }
+    uint64_t rejected() const { return _rejected.load(std::memory_order_relaxed); }
+
+    static constexpr size_t kMinSavingFraction = 8;
+    static constexpr size_t kEntryOverhead = 64;
+
+private:
+    static constexpr int kNumShards = 16;
+
+    struct Shard {
+        std::mutex mutex;
+        LRUCache<std::string> lru; // Key -> compressed value
+    };
+
+    Shard& ShardOf(const std::string& key);
+
+    const size_t _capacity;
+    const bool _admit_unread;
+    Shard _shards[kNumShards];
+    std::atomic<size_t> _usage{0};
+    std::atomic<uint64_t> _hits{0};
+    std::atomic<uint64_t> _misses{0};
+    std::atomic<uint64_t> _admitted{0};
+    std::atomic<uint64_t> _rejected{0};
+};
+
+} // namespace lsm
@@ -2,207 +2,1449 @@
 #include <iostream>
 #include <filesystem>
 #include <chrono>
-#include <fstream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <tuple>
+#include "compaction.h"
+#include "core/sstable/table.h"
 #include "core/sstable/table_builder.h"
+#include "core/blob/blob_writer.h"
+#include "util/clock.h"
+#include "util/hash.h"
 
 namespace lsm {
 
 namespace fs = std::filesystem;
 
-DB::DB(const std::string& path, const Options& options) 
-    : _path(path), _options(options), _stop_sync(false) {
-    if (!fs::exists(path)) {
-        fs::create_directories(path);
-    }
-    
-    std::string wal_path = path + "/wal.log";
-    
-    _memtable = std::make_unique<MemTable>();
-    _versions = std::make_unique<VersionSet>(path);
-    _versions->Recover();
-    
-    Recover(wal_path);
-    
-    _wal = std::make_unique<WAL>(wal_path);
-    
+namespace {
+
+// PURGED_SEQUENCE holds DB::_purged_sequence as text
+uint64_t LoadPurgedSequence(Env* env, const std::string& dir) {
+    InputFileStream in(env, dir + "/PURGED_SEQUENCE");
+    uint64_t sequence = 0;
+    in >> sequence;
+    return in ? sequence : 0;
+}
+
+void CheckWriteOptions(const WriteOptions& write_options) {
+    if (write_options.sync && write_options.disable_wal) {
+        throw std::invalid_argument("a write cannot both skip the WAL and sync it");
+    }
+}
+
+bool SavePurgedSequence(Env* env, const std::string& dir, uint64_t sequence) {
+    std::string tmp = dir + "/PURGED_SEQUENCE.tmp";
+    {
+        OutputFileStream out(env, tmp);
+        out << sequence << "\n";
+        out.flush();
+        if (!out) return false;
+    }
+    return env->RenameFile(tmp, dir + "/PURGED_SEQUENCE");
+}
+
+} // namespace
+
+DB::DB(const std::string& path, const Options& options)
+    : _path(path), _options(options), _env(options.env ? options.env.get() : Env::Default()), _stop_sync(false),
+      _write_controller(options.delayed_write_rate) {
+    _env->CreateDirs(path);
+    if (_options.num_shards < 1) {
+        _options.num_shards = 1;
+    }
+    if (!_options.comparator) {
+        _options.comparator = BytewiseComparator();
+    }
+    _write_buffer_manager = _options.write_buffer_manager;
+    if (!_write_buffer_manager && _options.db_write_buffer_size > 0) {
+        _write_buffer_manager = std::make_shared<WriteBufferManager>(_options.db_write_buffer_size);
+    }
+    _row_cache = _options.row_cache;
+    if (!_row_cache && _options.row_cache_size > 0) {
+        std::shared_ptr<CompressedSecondaryCache> secondary;
+        if (_options.row_cache_compressed_size > 0) {
+            secondary = std::make_shared<CompressedSecondaryCache>(_options.row_cache_compressed_size);
+        }
+        _row_cache = std::make_shared<RowCache>(_options.row_cache_size, std::move(secondary));
+    }
+
+    for (int i = 0; i < _options.num_shards; ++i) {
+        auto shard = std::make_unique<Shard>();
+        shard->index = i;
+        shard->wal_path = WALPath(i);
+        shard->imm_wal_path = _path + "/wal_imm_" + std::to_string(i) + ".log";
+        _shards.push_back(std::move(shard));
+    }
+    OpenColumnFamilies();
+
+    // Sequence numbers continue after the last one of any write, whether
+    // its record is still in a WAL or was deleted
+    _purged_sequence = LoadPurgedSequence(_env, _path);
+    uint64_t last_sequence = _purged_sequence;
+    for (const WALFile& wal : ArchivedWALs()) {
+        last_sequence = std::max(last_sequence, wal.last_sequence);
+    }
+    std::vector<WALFile> wals;
+    bool recovered = Recover(&wals);
+    for (const WALFile& wal : wals) {
+        last_sequence = std::max(last_sequence, wal.last_sequence);
+    }
+    _last_sequence = last_sequence;
+
+    if (!recovered) {
+        // The WAL files no longer match the memtables. Persist everything
+        // and start with fresh WALs.
+        for (auto& shard : _shards) {
+            for (ColumnFamilyHandle* cf : LiveColumnFamilies()) {
+                VersionEdit edit;
+                if (WriteLevel0Table(cf, cf->_mems[shard->index].get(), &edit)) {
+                    cf->_versions->LogAndApply(edit);
+                }
+                cf->_mems[shard->index] = cf->NewMemTable();
+            }
+        }
+        std::lock_guard<std::mutex> lock(_wal_mutex);
+        for (const WALFile& wal : wals) {
+            RetireWAL(wal);
+        }
+        std::vector<std::string> children;
+        _env->GetChildren(_path, &children);
+        for (const auto& name : children) {
+            if (name.rfind("wal", 0) == 0 && fs::path(name).extension() == ".log") {
+                _env->RemoveFile(_path + "/" + name);
+            }
+        }
+    } else {
+        for (const WALFile& wal : wals) {
+            if (wal.shard < _options.num_shards &&
+                fs::path(wal.path).filename() == fs::path(_shards[wal.shard]->wal_path).filename()) {
+                _shards[wal.shard]->wal_last_sequence = wal.last_sequence;
+            }
+        }
+    }
+    {
+        // wal_retention_size may have shrunk since the archive was written
+        std::lock_guard<std::mutex> lock(_wal_mutex);
+        PurgeArchive();
+    }
+
+    for (auto& shard : _shards) {
+        shard->wal = std::make_unique<WAL>(_env, shard->wal_path);
+    }
+
     if (!_options.sync) {
         _sync_thread = std::thread(&DB::BackgroundSync, this);
     }
-    
+    _flush_pool = std::make_unique<ThreadPool>(_options.max_background_flushes);
+    _compaction_pool = std::make_unique<ThreadPool>(_options.max_background_compactions);
+    _async_pool = std::make_unique<ThreadPool>(std::max(1, _options.max_async_workers));
+    if (_write_buffer_manager) {
+        _write_buffer_member = _write_buffer_manager->Register(
+            [this] {
+                Shard* shard;
+                return LargestMemTableShard(&shard);
+            },
+            [this] { FlushLargestMemTableShard(); });
+    }
+    MaybeScheduleCompaction();
+    RecalculateWriteStall();
+
     std::cout << "[C++] DB opened at " << _path << std::endl;
 }
 
 DB::~DB() {
+    // Queued async requests may write, so they finish while flushes still run
+    _async_pool.reset();
+    // Writes that skipped the WAL would otherwise be lost with the memtables
+    for (auto& shard : _shards) {
+        std::unique_lock<std::mutex> lock(shard->mutex);
+        if (shard->has_unlogged_writes) {
+            FlushShard(shard.get(), lock);
+        }
+    }
+    if (_write_buffer_manager) {
+        _write_buffer_manager->Unregister(_write_buffer_member);
+    }
+    EndTrace();
+    {
+        std::lock_guard<std::mutex> lock(_bg_mutex);
+        _shutting_down = true;
+    }
+    _bg_cv.notify_all();
+    // Queued flushes still run; compaction stops after the current job
+    _flush_pool.reset();
+    _compaction_pool.reset();
     _stop_sync = true;
     if (_sync_thread.joinable()) {
         _sync_thread.join();
     }
     // Force final sync on close
-    if (_wal) {
-        _wal->Sync();
+    for (auto& shard : _shards) {
+        if (shard->wal) {
+            shard->wal->Sync();
+        }
     }
     std::cout << "[C++] DB closed" << std::endl;
 }
 
-void DB::Put(const std::string& key, const std::string& value) {
-    std::lock_guard<std::mutex> lock(_mutex);
-    
-    if (_memtable->MemoryUsage() >= kMemTableSizeLimit) {
-        Flush();
+DB::Shard* DB::ShardFor(const std::string& key) {
+    if (_shards.size() == 1) return _shards[0].get();
+    return _shards[Hash(key) % _shards.size()].get();
+}
+
+std::string DB::WALPath(int shard) const {
+    // Shard 0 keeps the historical name so unsharded DBs open unchanged
+    if (shard == 0) return _path + "/wal.log";
+    return _path + "/wal_" + std::to_string(shard) + ".log";
+}
+
+void DB::Put(const std::string& key, const std::string& value, const WriteOptions& write_options) {
+    Put(_default_cf, key, value, write_options);
+}
+
+bool DB::Get(const std::string& key, std::string* value) {
+    return Get(_default_cf, key, value);
+}
+
+void DB::Delete(const std::string& key, const WriteOptions& write_options) {
+    Delete(_default_cf, key, write_options);
+}
+
+void DB::Put(ColumnFamilyHandle* cf, const std::string& key, const std::string& value,
+             const WriteOptions& write_options) {
+    if (cf == nullptr) cf = _default_cf;
+    if (auto tracer = std::atomic_load(&_tracer)) {
+        tracer->Record(cf, TraceOp::kPut, key, value.size());
     }
+    WALRecord record;
+    record.cf_id = cf->_id;
+    record.key = key;
+    record.value = value;
+    Write(cf, record, write_options);
+}
 
-    _wal->Append(key, value, false);
-    if (_options.sync) {
-        _wal->Sync();
+void DB::PutWithExpiry(const std::string& key, const std::string& value, uint64_t expire_at_ms,
+                       const WriteOptions& write_options) {
+    PutWithExpiry(_default_cf, key, value, expire_at_ms, write_options);
+}
+
+void DB::PutWithExpiry(ColumnFamilyHandle* cf, const std::string& key, const std::string& value,
+                       uint64_t expire_at_ms, const WriteOptions& write_options) {
+    if (cf == nullptr) cf = _default_cf;
+    if (auto tracer = std::atomic_load(&_tracer)) {
+        tracer->RecordPutWithExpiry(cf, key, value.size(), expire_at_ms);
     }
-    _memtable->Put(key, value);
+    WALRecord record;
+    record.cf_id = cf->_id;
+    record.key = key;
+    record.value = value;
+    record.expire_at = expire_at_ms;
+    Write(cf, record, write_options);
 }
 
-bool DB::Get(const std::string& key, std::string* value) {
-    std::lock_guard<std::mutex> lock(_mutex);
-    if (_memtable->Get(key, value)) {
-        return true;
+bool DB::Get(ColumnFamilyHandle* cf, const std::string& key, std::string* value) {
+    if (cf == nullptr) cf = _default_cf;
+    if (auto tracer = std::atomic_load(&_tracer)) {
+        tracer->Record(cf, TraceOp::kGet, key, 0);
+    }
+    uint64_t now_ms = NowMillis();
+    Shard* shard = ShardFor(key);
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        CheckLive(cf);
+        int result = cf->_mems[shard->index]->Get(key, value, now_ms);
+        if (result == 0 && cf->_imms[shard->index]) {
+            result = cf->_imms[shard->index]->Get(key, value, now_ms);
+        }
+        if (result == 1) return true; // Found
+        if (result == 2) return false; // Deleted or expired, hides older tables
     }
-    // Check SSTables via Version
-    int result = _versions->current()->Get(key, value);
+    // Check SSTables via Version. A concurrent flush only moves entries from
+    // the memtable into a newer Version, so nothing can be missed here.
+    int result = cf->_versions->current()->Get(key, value, now_ms);
     if (result == 1) return true; // Found
     if (result == 2) return false; // Deleted
     return false; // Not found
 }
 
-void DB::Delete(const std::string& key) {
-    std::lock_guard<std::mutex> lock(_mutex);
-    
-    if (_memtable->MemoryUsage() >= kMemTableSizeLimit) {
-        Flush();
+std::vector<bool> DB::MultiGet(const std::vector<std::string>& keys, std::vector<std::string>* values,
+                               ColumnFamilyHandle* cf) {
+    if (cf == nullptr) cf = _default_cf;
+    if (auto tracer = std::atomic_load(&_tracer)) {
+        for (const auto& key : keys) tracer->Record(cf, TraceOp::kGet, key, 0);
+    }
+    uint64_t now_ms = NowMillis();
+    std::vector<bool> found(keys.size(), false);
+    values->assign(keys.size(), std::string());
+
+    // Memtables first, as in Get; only keys they know nothing about go to the tables
+    std::vector<std::string> table_keys;
+    std::vector<size_t> table_index;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        Shard* shard = ShardFor(keys[i]);
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        CheckLive(cf);
+        int result = cf->_mems[shard->index]->Get(keys[i], &(*values)[i], now_ms);
+        if (result == 0 && cf->_imms[shard->index]) {
+            result = cf->_imms[shard->index]->Get(keys[i], &(*values)[i], now_ms);
+        }
+        if (result == 1) {
+            found[i] = true;
+        } else if (result == 0) {
+            table_keys.push_back(keys[i]);
+            table_index.push_back(i);
+        }
+    }
+    if (table_keys.empty()) return found;
+
+    std::vector<std::string> table_values;
+    std::vector<int> results;
+    cf->_versions->current()->MultiGet(table_keys, &table_values, &results, now_ms);
+    for (size_t j = 0; j < table_keys.size(); ++j) {
+        if (results[j] != 1) continue;
+        found[table_index[j]] = true;
+        (*values)[table_index[j]] = std::move(table_values[j]);
+    }
+    return found;
+}
+
+void DB::GetAsync(const std::string& key, GetCallback callback, ColumnFamilyHandle* cf) {
+    if (cf == nullptr) cf = _default_cf;
+    _async_pool->Schedule([this, key, callback = std::move(callback), cf] {
+        std::string value;
+        bool found = false;
+        std::exception_ptr error;
+        try {
+            found = Get(cf, key, &value);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        callback(error, found, std::move(value));
+    });
+}
+
+void DB::PutAsync(const std::string& key, const std::string& value, WriteCallback callback,
+                  ColumnFamilyHandle* cf) {
+    if (cf == nullptr) cf = _default_cf;
+    _async_pool->Schedule([this, key, value, callback = std::move(callback), cf] {
+        std::exception_ptr error;
+        try {
+            Put(cf, key, value);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        callback(error);
+    });
+}
+
+void DB::Delete(ColumnFamilyHandle* cf, const std::string& key, const WriteOptions& write_options) {
+    if (cf == nullptr) cf = _default_cf;
+    if (auto tracer = std::atomic_load(&_tracer)) {
+        tracer->Record(cf, TraceOp::kDelete, key, 0);
+    }
+    WALRecord record;
+    record.cf_id = cf->_id;
+    record.is_delete = true;
+    record.key = key;
+    Write(cf, record, write_options);
+}
+
+void DB::DeleteRange(const std::string& begin, const std::string& end, const WriteOptions& write_options) {
+    DeleteRange(_default_cf, begin, end, write_options);
+}
+
+void DB::DeleteRange(ColumnFamilyHandle* cf, const std::string& begin, const std::string& end,
+                     const WriteOptions& write_options) {
+    if (cf == nullptr) cf = _default_cf;
+    if (auto tracer = std::atomic_load(&_tracer)) {
+        tracer->RecordDeleteRange(cf, begin, end);
+    }
+    CheckWriteOptions(write_options);
+    if (cf->GetOptions()->comparator->Compare(begin, end) >= 0) return;
+    DelayWrite(begin.size() + end.size(), write_options);
+    if (_write_buffer_manager) _write_buffer_manager->WaitForRoom();
+
+    // Every shard may hold keys of the range, so each logs and applies its
+    // own copy, covering only its own keys. All shards are locked so the
+    // copies take consecutive sequence numbers: no write can come between
+    // them, and followers may apply the range delete once.
+    {
+        std::vector<std::unique_lock<std::mutex>> shard_locks;
+        while (true) {
+            // Waits for flushes one shard at a time: the flush thread may be
+            // blocked on any shard locked meanwhile
+            for (auto& shard : _shards) {
+                std::unique_lock<std::mutex> lock(shard->mutex);
+                MakeRoomForWrite(cf, shard.get(), lock);
+            }
+            for (auto& shard : _shards) {
+                shard_locks.emplace_back(shard->mutex);
+            }
+            bool room = true;
+            for (auto& shard : _shards) {
+                if (!TryMakeRoomForWrite(cf, shard.get())) room = false;
+            }
+            if (room) break;
+            shard_locks.clear(); // A shard filled up again in between
+        }
+        for (auto& shard : _shards) {
+            WALRecord record;
+            record.cf_id = cf->_id;
+            record.is_range_delete = true;
+            record.shard = shard->index;
+            record.num_shards = _shards.size();
+            record.key = begin;
+            record.value = end;
+            if (write_options.disable_wal) {
+                shard->has_unlogged_writes = true;
+            } else {
+                record.sequence = _last_sequence.fetch_add(1) + 1;
+                shard->wal->Append(record);
+                shard->wal_last_sequence = record.sequence;
+                if (_options.sync || write_options.sync) {
+                    shard->wal->Sync();
+                }
+            }
+            cf->_mems[shard->index]->DeleteRange({begin, end, record.shard, record.num_shards});
+        }
+    }
+    MaybeFlushForBudget();
+}
+
+int DB::IngestExternalFile(const std::string& file_path, bool move_file) {
+    return IngestExternalFile(_default_cf, file_path, move_file);
+}
+
+int DB::IngestExternalFile(ColumnFamilyHandle* cf, const std::string& file_path, bool move_file) {
+    if (cf == nullptr) cf = _default_cf;
+    CheckLive(cf);
+    std::shared_ptr<const ColumnFamilyOptions> options = cf->GetOptions();
+    const Comparator* cmp = options->comparator.get();
+    std::shared_ptr<Table> table = Table::Open(file_path, cmp);
+    FileMetaData meta;
+    if (!table || !table->KeyRange(&meta.smallest, &meta.largest)) {
+        throw std::invalid_argument("not a valid non-empty SSTable of comparator " + cmp->Name() + ": " +
+                                    file_path);
     }
+    meta.file_size = table->FileSize();
+    table.reset();
 
-    _wal->Append(key, "", true);
-    if (_options.sync) {
-        _wal->Sync();
+    // Stage the file under a table name first: a crash before the edit is
+    // logged leaves an unlisted table, which Recover removes. External files
+    // are on the local file system, whatever the Env of the DB.
+    std::string staged = cf->_dir + "/" + std::to_string(cf->_versions->NewFileNumber()) + ".sst";
+    Env* source_env = Env::Default();
+    // A link fails across file systems
+    if (!move_file || _env != source_env || !_env->LinkFile(file_path, staged)) {
+        if (!CopyFile(source_env, file_path, _env, staged)) {
+            throw std::runtime_error("failed to copy " + file_path + ": " + strerror(errno));
+        }
     }
-    _memtable->Delete(key);
+
+    // Memtable entries of the range are older than the file, but would be
+    // read first, so those shards are flushed before it is installed
+    auto overlaps = [&meta, cmp](const MemTable* mem) {
+        if (!mem) return false;
+        std::unique_ptr<InternalIterator> iter(mem->NewIterator());
+        iter->Seek(meta.smallest);
+        if (iter->Valid() && cmp->Compare(iter->Key(), meta.largest) <= 0) return true;
+        for (const auto& t : iter->RangeTombstones()) {
+            if (cmp->Compare(t.begin, meta.largest) <= 0 && cmp->Compare(t.end, meta.smallest) > 0) return true;
+        }
+        return false;
+    };
+    auto shard_overlaps = [&](Shard* shard) {
+        return overlaps(cf->_mems[shard->index].get()) || overlaps(cf->_imms[shard->index].get());
+    };
+    auto check_live = [&] {
+        if (cf->_dropped) {
+            _env->RemoveFile(staged);
+            CheckLive(cf);
+        }
+    };
+
+    // Writers are held off first, so the range stays clear once flushed.
+    // The flushes wait one shard at a time: the flush thread may be blocked
+    // on any shard locked meanwhile.
+    struct BlockWrites {
+        DB* db;
+        BlockWrites(DB* db) : db(db) {
+            for (auto& shard : db->_shards) {
+                std::lock_guard<std::mutex> lock(shard->mutex);
+                shard->writes_blocked++;
+            }
+        }
+        ~BlockWrites() {
+            for (auto& shard : db->_shards) {
+                {
+                    std::lock_guard<std::mutex> lock(shard->mutex);
+                    shard->writes_blocked--;
+                }
+                shard->flush_cv.notify_all();
+            }
+        }
+    } block_writes(this);
+
+    int level = 0;
+    while (true) {
+        for (auto& shard : _shards) {
+            std::unique_lock<std::mutex> lock(shard->mutex);
+            check_live();
+            if (shard_overlaps(shard.get())) FlushShard(shard.get(), lock);
+        }
+
+        // No compaction may move files while the level is picked, and no
+        // write may land in the range until the file is installed
+        std::lock_guard<std::mutex> compaction_lock(_compaction_mutex);
+        std::vector<std::unique_lock<std::mutex>> shard_locks;
+        for (auto& shard : _shards) {
+            shard_locks.emplace_back(shard->mutex);
+        }
+        check_live();
+        bool overlap = false;
+        for (auto& shard : _shards) {
+            if (shard_overlaps(shard.get())) overlap = true;
+        }
+        if (overlap) continue; // Not expected with writes held off, but never installed under newer entries
+
+        // Numbered after any flush above, so it sorts as the newest L0 file
+        meta.number = cf->_versions->NewFileNumber();
+        if (!_env->RenameFile(staged, cf->_dir + "/" + std::to_string(meta.number) + ".sst")) {
+            std::string error = strerror(errno);
+            _env->RemoveFile(staged);
+            throw std::runtime_error("failed to install " + file_path + ": " + error);
+        }
+
+        std::shared_ptr<Version> v = cf->_versions->current();
+        for (int l = 0; l < kNumLevels; ++l) {
+            if (!v->GetOverlappingInputs(l, meta.smallest, meta.largest).empty()) break;
+            level = l;
+        }
+        VersionEdit edit;
+        edit.AddFile(level, meta);
+        cf->_versions->LogAndApply(edit);
+        break;
+    }
+    RecalculateWriteStall();
+    if (move_file) {
+        source_env->RemoveFile(file_path);
+    }
+    MaybeScheduleCompaction();
+
+    std::cout << "[C++] Ingested " << file_path << " into " << cf->_name << " L" << level << std::endl;
+    return level;
 }
 
-void DB::Flush() {
-    if (_memtable->MemoryUsage() == 0) return;
+void DB::CreateCheckpoint(const std::string& checkpoint_dir) {
+    if (_env->FileExists(checkpoint_dir)) {
+        throw std::invalid_argument("checkpoint directory already exists: " + checkpoint_dir);
+    }
+    if (!_env->CreateDirs(checkpoint_dir)) {
+        throw std::runtime_error("failed to create " + checkpoint_dir + ": " + strerror(errno));
+    }
 
-    int file_num = _versions->NewFileNumber();
-    std::string fname = _path + "/" + std::to_string(file_num) + ".sst";
-    TableBuilder builder(fname);
+    auto fail = [this, &checkpoint_dir](const std::string& what) {
+        _env->RemoveAll(checkpoint_dir);
+        throw std::runtime_error("checkpoint failed: " + what);
+    };
+    {
+        // With every shard locked no write or ingestion is in progress, so
+        // the WALs and the tables below make up one point in time. Flushes
+        // may still finish meanwhile: their entries are then in both a table
+        // and a frozen WAL, which recovery replays harmlessly.
+        std::vector<std::unique_lock<std::mutex>> shard_locks;
+        for (auto& shard : _shards) {
+            shard_locks.emplace_back(shard->mutex);
+        }
+        ColumnFamilyRegistry registry;
+        std::vector<ColumnFamilyHandle*> families;
+        {
+            std::lock_guard<std::mutex> lock(_cf_mutex);
+            registry = _cf_registry;
+            for (const auto& entry : _column_families) {
+                families.push_back(entry.second);
+            }
+        }
 
-    auto iter = _memtable->NewIterator();
+        // The WALs are still appended to, so they are copied rather than linked
+        for (auto& shard : _shards) {
+            for (const std::string& wal_path : {shard->imm_wal_path, shard->wal_path}) {
+                std::string target = checkpoint_dir + "/" + fs::path(wal_path).filename().string();
+                // A frozen WAL is removed once its flush is installed
+                if (!CopyFile(_env, wal_path, _env, target) && _env->FileExists(wal_path)) {
+                    fail("copying " + wal_path + ": " + strerror(errno));
+                }
+            }
+        }
+        for (ColumnFamilyHandle* cf : families) {
+            std::string dir = cf->_id == 0 ? checkpoint_dir : checkpoint_dir + "/cf_" + std::to_string(cf->_id);
+            if (!cf->_versions->CreateCheckpoint(dir)) fail("linking the files of column family " + cf->_name);
+        }
+        if (!registry.Save(_env, checkpoint_dir)) fail("writing the column family registry");
+        // Its sequence numbers continue from this DB's, so a follower cloned
+        // from it tails this DB from GetLatestSequenceNumber() + 1
+        if (!SavePurgedSequence(_env, checkpoint_dir, _last_sequence.load())) fail("writing the sequence number");
+    }
+    std::cout << "[C++] Checkpoint created at " << checkpoint_dir << std::endl;
+}
+
+UpdateIterator* DB::GetUpdatesSince(uint64_t since) {
+    since = std::max<uint64_t>(since, 1);
+    // Every write numbered up to until has its record complete in its WAL
+    std::vector<std::unique_lock<std::mutex>> shard_locks;
+    for (auto& shard : _shards) {
+        shard_locks.emplace_back(shard->mutex);
+    }
+    uint64_t until = _last_sequence.load();
+    std::map<uint32_t, std::string> families;
+    {
+        std::lock_guard<std::mutex> lock(_cf_mutex);
+        for (const auto& entry : _column_families) {
+            families[entry.first] = entry.second->_name;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_wal_mutex);
+    if (since <= _purged_sequence) return nullptr;
+    // Per shard, oldest first. The archive may hold WALs of shards of an
+    // earlier num_shards.
+    std::vector<std::vector<std::string>> wals(_shards.size());
+    for (const WALFile& wal : ArchivedWALs()) {
+        if (wal.last_sequence < since) continue;
+        if (wal.shard >= static_cast<int>(wals.size())) wals.resize(wal.shard + 1);
+        wals[wal.shard].push_back(wal.path);
+    }
+    for (auto& shard : _shards) {
+        // Already archived, and found above, if its flush has finished
+        if (shard->imm_pending && shard->imm_last_sequence >= since && _env->FileExists(shard->imm_wal_path)) {
+            wals[shard->index].push_back(shard->imm_wal_path);
+        }
+        if (shard->wal_last_sequence >= since) {
+            wals[shard->index].push_back(shard->wal_path);
+        }
+    }
+    return new UpdateIterator(_env, since, until, std::move(families), wals);
+}
+
+void DB::RetireWAL(const WALFile& wal) {
+    if (_options.wal_retention_size > 0 && wal.last_sequence > 0) {
+        std::string archived = ArchiveDir() + "/wal_" + std::to_string(wal.shard) + "_" +
+                               std::to_string(wal.last_sequence) + ".log";
+        if (_env->CreateDirs(ArchiveDir()) && _env->RenameFile(wal.path, archived)) {
+            PurgeArchive();
+            return;
+        }
+        std::cerr << "Failed to archive WAL " << wal.path << ": " << strerror(errno) << std::endl;
+    }
+    if (wal.last_sequence > _purged_sequence) {
+        if (!SavePurgedSequence(_env, _path, wal.last_sequence)) {
+            std::cerr << "Failed to persist purged sequence " << wal.last_sequence << std::endl;
+        }
+        _purged_sequence = wal.last_sequence;
+    }
+    _env->RemoveFile(wal.path);
+}
+
+void DB::PurgeArchive() {
+    std::vector<WALFile> archived = ArchivedWALs();
+    std::vector<uint64_t> sizes;
+    uint64_t total = 0;
+    for (const WALFile& wal : archived) {
+        uint64_t size = 0;
+        _env->GetFileSize(wal.path, &size);
+        sizes.push_back(size);
+        total += size;
+    }
+    size_t purged = 0;
+    uint64_t purged_sequence = _purged_sequence;
+    while (purged < archived.size() && total > _options.wal_retention_size) {
+        purged_sequence = std::max(purged_sequence, archived[purged].last_sequence);
+        total -= sizes[purged++];
+    }
+    if (purged == 0) return;
+
+    // Persisted first: a crash in between only makes followers resync early
+    if (purged_sequence > _purged_sequence) {
+        if (!SavePurgedSequence(_env, _path, purged_sequence)) {
+            std::cerr << "Failed to persist purged sequence " << purged_sequence << std::endl;
+        }
+        _purged_sequence = purged_sequence;
+    }
+    for (size_t i = 0; i < purged; ++i) {
+        _env->RemoveFile(archived[i].path);
+    }
+}
+
+std::vector<DB::WALFile> DB::ArchivedWALs() const {
+    std::vector<WALFile> wals;
+    std::vector<std::string> children;
+    if (!_env->GetChildren(ArchiveDir(), &children)) return wals;
+    // Named wal_<shard>_<last sequence>.log
+    for (const auto& name : children) {
+        fs::path entry(name);
+        std::string stem = entry.stem().string();
+        size_t sep = stem.find('_', 4);
+        if (entry.extension() != ".log" || stem.rfind("wal_", 0) != 0 || sep == std::string::npos) continue;
+        try {
+            wals.push_back({std::stoi(stem.substr(4, sep - 4)), ArchiveDir() + "/" + name,
+                            std::stoull(stem.substr(sep + 1))});
+        } catch (...) {
+            continue;
+        }
+    }
+    std::sort(wals.begin(), wals.end(),
+              [](const WALFile& a, const WALFile& b) { return a.last_sequence < b.last_sequence; });
+    return wals;
+}
+
+void DB::Write(ColumnFamilyHandle* cf, WALRecord& record, const WriteOptions& write_options) {
+    CheckWriteOptions(write_options);
+    DelayWrite(record.key.size() + record.value.size(), write_options);
+    if (_write_buffer_manager) _write_buffer_manager->WaitForRoom();
+    Shard* shard = ShardFor(record.key);
+    std::unique_lock<std::mutex> lock(shard->mutex);
+    MakeRoomForWrite(cf, shard, lock);
+
+    if (write_options.disable_wal) {
+        shard->has_unlogged_writes = true;
+    } else {
+        record.sequence = _last_sequence.fetch_add(1) + 1;
+        shard->wal->Append(record);
+        shard->wal_last_sequence = record.sequence;
+        if (_options.sync || write_options.sync) {
+            shard->wal->Sync();
+        }
+    }
+    if (record.is_delete) {
+        cf->_mems[shard->index]->Delete(record.key);
+    } else {
+        cf->_mems[shard->index]->Put(record.key, record.value, record.expire_at);
+    }
+    lock.unlock();
+    MaybeFlushForBudget();
+}
+
+void DB::MaybeFlushForBudget() {
+    if (_write_buffer_manager && _write_buffer_manager->ShouldFlush()) {
+        _write_buffer_manager->MaybeFlush();
+    }
+}
+
+size_t DB::LargestMemTableShard(Shard** largest) {
+    *largest = nullptr;
+    size_t largest_usage = 0;
+    for (auto& shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        if (shard->imm_pending) continue;
+        size_t usage = 0;
+        for (ColumnFamilyHandle* cf : LiveColumnFamilies()) {
+            usage += cf->_mems[shard->index]->MemoryUsage();
+        }
+        if (usage > largest_usage) {
+            *largest = shard.get();
+            largest_usage = usage;
+        }
+    }
+    return largest_usage;
+}
+
+void DB::FlushLargestMemTableShard() {
+    Shard* shard;
+    if (LargestMemTableShard(&shard) == 0) return;
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    if (shard->imm_pending) return;
+    std::cout << "[C++] Write buffer budget reached, flushing shard " << shard->index << std::endl;
+    SwitchMemTable(shard);
+}
+
+void DB::MakeRoomForWrite(ColumnFamilyHandle* cf, Shard* shard, std::unique_lock<std::mutex>& lock) {
+    while (!TryMakeRoomForWrite(cf, shard)) {
+        // Filled up before the previous memtable was flushed, or ingesting
+        bool ingesting = shard->writes_blocked > 0;
+        uint64_t start = SteadyMicros();
+        shard->flush_cv.wait(lock);
+        if (!ingesting) _write_controller.RecordMemTableStall(SteadyMicros() - start);
+    }
+}
+
+bool DB::TryMakeRoomForWrite(ColumnFamilyHandle* cf, Shard* shard) {
+    CheckLive(cf);
+    if (shard->writes_blocked > 0) return false;
+    if (cf->_mems[shard->index]->MemoryUsage() < cf->GetOptions()->write_buffer_size) return true;
+    if (shard->imm_pending) return false;
+    SwitchMemTable(shard);
+    return true;
+}
+
+Iterator* DB::NewIterator(ColumnFamilyHandle* cf) {
+    if (cf == nullptr) cf = _default_cf;
+    return NewIterator(cf, nullptr, std::string());
+}
+
+Iterator* DB::NewPrefixIterator(const std::string& prefix, ColumnFamilyHandle* cf) {
+    if (cf == nullptr) cf = _default_cf;
+    CheckLive(cf);
+    std::shared_ptr<const ColumnFamilyOptions> options = cf->GetOptions();
+    std::shared_ptr<const PrefixExtractor> extractor = options->prefix_extractor;
+    if (!extractor || !extractor->InDomain(prefix) || extractor->Transform(prefix) != prefix) {
+        throw std::invalid_argument("not a prefix of the column family's prefix_extractor");
+    }
+    // The iterator seeks to the prefix itself, the first of its keys only in byte order
+    if (!options->comparator->IsBytewiseOrder()) {
+        throw std::invalid_argument("prefix iterators need a bytewise-ordered comparator");
+    }
+    return NewIterator(cf, extractor.get(), prefix);
+}
+
+Iterator* DB::NewIterator(ColumnFamilyHandle* cf, const PrefixExtractor* prefix_extractor,
+                          const std::string& prefix) {
+    std::vector<std::unique_ptr<InternalIterator>> children;
+
+    // Memtables are copied: the skiplist does not support reads concurrent
+    // with writes. They are captured before the Version, so an entry being
+    // flushed meanwhile is seen in one place or the other. A prefix iterator
+    // only copies that prefix, if the memtable's filter lets it through;
+    // the range tombstones are always needed.
+    const Comparator* cmp = cf->GetOptions()->comparator.get();
+    auto copy = [prefix_extractor, &prefix, cmp](const MemTable& mem) {
+        std::vector<IteratorEntry> entries;
+        std::unique_ptr<InternalIterator> iter(mem.NewIterator());
+        if (!prefix_extractor) {
+            iter->SeekToFirst();
+        } else if (mem.PrefixMayMatch(prefix)) {
+            iter->Seek(prefix);
+        }
+        for (; iter->Valid(); iter->Next()) {
+            if (prefix_extractor && !HasPrefix(iter->Key(), prefix)) break;
+            entries.push_back({iter->Key(), iter->Value(), iter->IsDeleted(), iter->ExpireAt()});
+        }
+        return NewVectorIterator(std::move(entries), iter->RangeTombstones(), cmp);
+    };
+    // Every shard's memtable, then the immutable ones being flushed
+    std::vector<std::unique_ptr<InternalIterator>> imms;
+    for (auto& shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        CheckLive(cf);
+        children.emplace_back(copy(*cf->_mems[shard->index]));
+        if (cf->_imms[shard->index]) {
+            imms.emplace_back(copy(*cf->_imms[shard->index]));
+        }
+    }
+    for (auto& imm : imms) {
+        children.push_back(std::move(imm));
+    }
+
+    std::shared_ptr<Version> version = cf->_versions->current();
+    version->AddIterators(&children, prefix_extractor, prefix);
+
+    std::unique_ptr<InternalIterator> merged(NewMergingIterator(std::move(children), cmp));
+    return new Iterator(std::move(merged), NowMillis(), {version}, version->blob_cache(), prefix);
+}
+
+void DB::CheckLive(ColumnFamilyHandle* cf) const {
+    if (cf == nullptr || cf->_dropped) {
+        throw std::invalid_argument("column family does not exist or was dropped");
+    }
+}
+
+ColumnFamilyHandle* DB::NewColumnFamily(uint32_t id, const std::string& name, const ColumnFamilyOptions& options) {
+    // The default family keeps its files in the DB directory itself
+    std::string dir = id == 0 ? _path : _path + "/cf_" + std::to_string(id);
+    auto handle = std::unique_ptr<ColumnFamilyHandle>(
+        new ColumnFamilyHandle(_env, id, name, dir, options, _options.num_shards, _write_buffer_manager, _row_cache));
+    handle->_versions->Recover();
+
+    ColumnFamilyHandle* cf = handle.get();
+    _cf_handles.push_back(std::move(handle));
+    _column_families[id] = cf;
+    return cf;
+}
+
+void DB::OpenColumnFamilies() {
+    _cf_registry.Load(_env, _path);
+    _default_cf = NewColumnFamily(0, "default", _options);
+    for (const auto& entry : _cf_registry.families) {
+        // Reopened with default options until CreateColumnFamily sets them,
+        // but the comparator must be the one the family was created with
+        ColumnFamilyOptions options;
+        std::string comparator_name =
+            VersionSet::ManifestComparatorName(_env, _path + "/cf_" + std::to_string(entry.first));
+        if (comparator_name == _options.comparator->Name()) {
+            options.comparator = _options.comparator;
+        } else if (auto builtin = BuiltinComparatorByName(comparator_name)) {
+            options.comparator = builtin;
+        } else if (!comparator_name.empty()) {
+            throw std::invalid_argument("column family " + entry.second + " uses comparator " + comparator_name +
+                                        ", which is neither built in nor Options::comparator");
+        }
+        NewColumnFamily(entry.first, entry.second, options);
+    }
+
+    // Directories of families dropped before their removal completed
+    std::vector<std::string> children;
+    _env->GetChildren(_path, &children);
+    for (const auto& name : children) {
+        if (name.rfind("cf_", 0) != 0 || !_env->IsDirectory(_path + "/" + name)) continue;
+        try {
+            if (_column_families.count(std::stoul(name.substr(3))) == 0) {
+                _env->RemoveAll(_path + "/" + name);
+            }
+        } catch (...) {
+            continue;
+        }
+    }
+}
+
+std::vector<ColumnFamilyHandle*> DB::LiveColumnFamilies() {
+    std::lock_guard<std::mutex> lock(_cf_mutex);
+    std::vector<ColumnFamilyHandle*> result;
+    for (const auto& entry : _column_families) {
+        result.push_back(entry.second);
+    }
+    return result;
+}
+
+ColumnFamilyHandle* DB::CreateColumnFamily(const std::string& name) {
+    return CreateOrOpenColumnFamily(name, nullptr);
+}
+
+ColumnFamilyHandle* DB::CreateColumnFamily(const std::string& name, const ColumnFamilyOptions& options) {
+    return CreateOrOpenColumnFamily(name, &options);
+}
+
+ColumnFamilyHandle* DB::CreateOrOpenColumnFamily(const std::string& name, const ColumnFamilyOptions* options) {
+    if (name.empty() || name.find_first_of("\t\n") != std::string::npos) {
+        throw std::invalid_argument("invalid column family name: " + name);
+    }
+
+    std::lock_guard<std::mutex> lock(_cf_mutex);
+    for (const auto& entry : _column_families) {
+        if (entry.second->_name == name) {
+            if (!options) return entry.second;
+            // Memtables and tables already hold keys in the family's order
+            auto comparator = entry.second->GetOptions()->comparator;
+            if (options->comparator && options->comparator->Name() != comparator->Name()) {
+                throw std::invalid_argument("column family " + name + " uses comparator " + comparator->Name());
+            }
+            // Swapped, not assigned: flushes, compactions and writers may be
+            // reading the old options, and keep their snapshot until done
+            ColumnFamilyOptions replaced = *options;
+            replaced.comparator = comparator;
+            entry.second->SetOptions(std::move(replaced));
+            return entry.second;
+        }
+    }
+
+    uint32_t id = _cf_registry.next_id++;
+    _cf_registry.families.push_back({id, name});
+    if (!_cf_registry.Save(_env, _path)) {
+        throw std::runtime_error("failed to persist column family " + name);
+    }
+    std::cout << "[C++] Created column family " << name << " (id " << id << ")" << std::endl;
+    return NewColumnFamily(id, name, options ? *options : ColumnFamilyOptions());
+}
+
+ColumnFamilyHandle* DB::GetColumnFamily(const std::string& name) {
+    std::lock_guard<std::mutex> lock(_cf_mutex);
+    for (const auto& entry : _column_families) {
+        if (entry.second->_name == name) {
+            return entry.second;
+        }
+    }
+    return nullptr;
+}
+
+void DB::DropColumnFamily(ColumnFamilyHandle* cf) {
+    CheckLive(cf);
+    if (cf == _default_cf) {
+        throw std::invalid_argument("cannot drop the default column family");
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_cf_mutex);
+        if (cf->_dropped.exchange(true)) return;
+        _column_families.erase(cf->_id);
+        auto& families = _cf_registry.families;
+        families.erase(std::remove_if(families.begin(), families.end(),
+            [cf](const std::pair<uint32_t, std::string>& f) { return f.first == cf->_id; }), families.end());
+        // Once this is durable the family is gone: WAL records for its id are
+        // skipped on recovery and a leftover directory is removed on open.
+        _cf_registry.Save(_env, _path);
+    }
+
+    // Release the memtables. Writers check _dropped under the shard mutex,
+    // so nobody touches them after this. A pending flush may still be
+    // writing the family's tables.
+    for (auto& shard : _shards) {
+        std::unique_lock<std::mutex> lock(shard->mutex);
+        shard->flush_cv.wait(lock, [&shard] { return !shard->imm_pending; });
+        cf->_mems[shard->index].reset();
+        cf->_imms[shard->index].reset();
+    }
+
+    {
+        std::lock_guard<std::mutex> compaction_lock(_compaction_mutex);
+        _env->RemoveAll(cf->_dir);
+    }
+    // Its files no longer hold writes back
+    RecalculateWriteStall();
+    std::cout << "[C++] Dropped column family " << cf->_name << std::endl;
+}
+
+bool DB::StartTrace(const std::string& trace_path) {
+    auto tracer = std::make_shared<TraceWriter>(trace_path);
+    if (!tracer->ok()) return false;
+    auto old = std::atomic_exchange(&_tracer, tracer);
+    if (old) old->Close();
+    std::cout << "[C++] Trace started: " << trace_path << std::endl;
+    return true;
+}
+
+void DB::EndTrace() {
+    auto old = std::atomic_exchange(&_tracer, std::shared_ptr<TraceWriter>());
+    if (old) {
+        old->Close();
+        std::cout << "[C++] Trace ended, " << old->NumRecords() << " records" << std::endl;
+    }
+}
+
+bool DB::WriteLevel0Table(ColumnFamilyHandle* cf, MemTable* mem, VersionEdit* edit) {
+    if (mem->MemoryUsage() == 0) return false;
+
+    std::unique_ptr<InternalIterator> iter(mem->NewIterator());
+    std::vector<RangeTombstone> tombstones = iter->RangeTombstones();
     iter->SeekToFirst();
-    
-    if (!iter->Valid()) {
-        delete iter;
-        return;
+    if (!iter->Valid() && tombstones.empty()) {
+        return false;
     }
 
-    std::string smallest = iter->Key();
+    std::shared_ptr<const ColumnFamilyOptions> options = cf->GetOptions();
+    int file_num = cf->_versions->NewFileNumber();
+    std::string fname = cf->_dir + "/" + std::to_string(file_num) + ".sst";
+    TableBuilder builder(fname, *options, _env);
+    BlobWriter blobs(cf->_dir, cf->_versions.get(), options->min_blob_size);
+
+    bool empty = true;
+    std::string smallest;
     std::string largest;
+    const Comparator* cmp = options->comparator.get();
+    auto extend = [&](const std::string& lo, const std::string& hi) {
+        if (empty || cmp->Compare(lo, smallest) < 0) smallest = lo;
+        if (empty || cmp->Compare(hi, largest) > 0) largest = hi;
+        empty = false;
+    };
+    uint64_t now_ms = NowMillis();
+    const CompactionFilter* filter = options->compaction_filter.get();
 
     while (iter->Valid()) {
-        largest = iter->Key();
-        builder.Add(iter->Key(), iter->Value(), iter->IsDeleted());
+        extend(iter->Key(), iter->Key());
+        bool hidden = iter->IsDeleted() || IsExpired(iter->ExpireAt(), now_ms);
+        std::string value;
+        if (!hidden) {
+            value = iter->Value();
+            std::string new_value;
+            auto decision = filter ? filter->Filter(0, iter->Key(), value, &new_value)
+                                   : CompactionFilter::Decision::kKeep;
+            if (decision == CompactionFilter::Decision::kRemove) {
+                hidden = true;
+            } else if (decision == CompactionFilter::Decision::kChangeValue) {
+                value.swap(new_value);
+            }
+        }
+        std::string blob_index;
+        if (hidden) {
+            // Keep a tombstone so older tables stay hidden, but drop the value
+            builder.Add(iter->Key(), "", true);
+        } else if (blobs.ShouldSeparate(value) && blobs.Add(iter->Key(), value, &blob_index)) {
+            builder.Add(iter->Key(), blob_index, false, iter->ExpireAt(), true);
+        } else {
+            builder.Add(iter->Key(), value, false, iter->ExpireAt());
+        }
         iter->Next();
     }
-    delete iter;
+    for (const auto& t : tombstones) {
+        builder.AddRangeTombstone(t);
+        extend(t.begin, t.end);
+    }
 
     builder.Finish();
+    if (!blobs.Finish(edit)) {
+        std::cerr << "Failed to close the blob file of " << fname << std::endl;
+    }
 
     FileMetaData meta;
     meta.number = file_num;
     meta.file_size = builder.FileSize();
     meta.smallest = smallest;
     meta.largest = largest;
+    edit->AddFile(0, meta);
 
-    Version* new_version = new Version(*_versions->current());
-    new_version->AddFile(0, meta);
-    _versions->LogAndApply(new_version);
-
-    // Reset MemTable and WAL
-    _memtable = std::make_unique<MemTable>();
-    
-    // Close old WAL
-    _wal.reset();
-    // Remove old WAL file
-    std::string wal_path = _path + "/wal.log";
-    fs::remove(wal_path);
-    // Create new WAL
-    _wal = std::make_unique<WAL>(wal_path);
-    
     std::cout << "[C++] Flushed MemTable to " << fname << std::endl;
+    return true;
+}
+
+void DB::SwitchMemTable(Shard* shard) {
+    // The WAL holds records of every family, so all of them switch together
+    for (ColumnFamilyHandle* cf : LiveColumnFamilies()) {
+        cf->_imms[shard->index] = std::move(cf->_mems[shard->index]);
+        cf->_imms[shard->index]->MarkImmutable();
+        cf->_mems[shard->index] = cf->NewMemTable();
+    }
+    // The frozen WAL is replayed on recovery until the flush has finished
+    shard->wal.reset();
+    if (!_env->RenameFile(shard->wal_path, shard->imm_wal_path)) {
+        std::cerr << "Failed to freeze WAL " << shard->wal_path << ": " << strerror(errno) << std::endl;
+    }
+    shard->wal = std::make_unique<WAL>(_env, shard->wal_path);
+    shard->imm_last_sequence = shard->wal_last_sequence;
+    shard->wal_last_sequence = 0;
+    shard->has_unlogged_writes = false;
+    shard->imm_pending = true;
+
+    {
+        std::lock_guard<std::mutex> lock(_bg_mutex);
+        _pending_flushes++;
+    }
+    _flush_pool->Schedule([this, shard] { BackgroundFlush(shard); });
+}
+
+void DB::BackgroundFlush(Shard* shard) {
+    // Destroyed, releasing their write buffer budget, only once the shard
+    // can be flushed again: the writers the budget lets through may need to
+    // switch the memtable right away
+    std::vector<std::unique_ptr<MemTable>> flushed;
+    for (ColumnFamilyHandle* cf : LiveColumnFamilies()) {
+        MemTable* imm;
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            imm = cf->_imms[shard->index].get();
+        }
+        if (imm == nullptr) continue;
+        // Readers keep finding the entries in imm until the table is installed
+        VersionEdit edit;
+        uint64_t start = SteadyMicros();
+        if (WriteLevel0Table(cf, imm, &edit)) {
+            cf->_versions->LogAndApply(edit);
+            uint64_t micros = std::max<uint64_t>(1, SteadyMicros() - start);
+            double rate = imm->MemoryUsage() * 1e6 / micros;
+            std::lock_guard<std::mutex> lock(_bg_mutex);
+            _flush_rate = _flush_rate == 0 ? rate : 0.7 * _flush_rate + 0.3 * rate;
+        }
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        flushed.push_back(std::move(cf->_imms[shard->index]));
+    }
+    RecalculateWriteStall();
+
+    {
+        std::lock_guard<std::mutex> lock(_wal_mutex);
+        RetireWAL({shard->index, shard->imm_wal_path, shard->imm_last_sequence});
+    }
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->imm_pending = false;
+    }
+    flushed.clear();
+    shard->flush_cv.notify_all();
+
+    // Scheduled before the flush counts as done, so WaitForCompaction
+    // cannot return in between
+    MaybeScheduleCompaction();
+    {
+        std::lock_guard<std::mutex> lock(_bg_mutex);
+        _pending_flushes--;
+    }
+    _bg_cv.notify_all();
+}
+
+void DB::FlushShard(Shard* shard, std::unique_lock<std::mutex>& lock) {
+    shard->flush_cv.wait(lock, [shard] { return !shard->imm_pending; });
+    SwitchMemTable(shard);
+    shard->flush_cv.wait(lock, [shard] { return !shard->imm_pending; });
+}
+
+void DB::MaybeScheduleCompaction() {
+    {
+        std::lock_guard<std::mutex> lock(_bg_mutex);
+        if (_shutting_down) return;
+        _bg_scheduled = true;
+        if (_bg_running) return; // The running job will pick it up
+        _bg_running = true;
+    }
+    _compaction_pool->Schedule([this] { BackgroundCompaction(); });
+}
+
+void DB::BackgroundCompaction() {
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(_bg_mutex);
+            if (!_bg_scheduled || _shutting_down) {
+                _bg_running = false;
+                break;
+            }
+            _bg_scheduled = false;
+        }
+        for (ColumnFamilyHandle* cf : LiveColumnFamilies()) {
+            CompactColumnFamily(cf);
+        }
+    }
+    // notify_all: WaitForCompaction callers share the condition variable
+    _bg_cv.notify_all();
+}
+
+void DB::WaitForCompaction() {
+    std::unique_lock<std::mutex> lock(_bg_mutex);
+    _bg_cv.wait(lock, [this] {
+        return (!_bg_scheduled && !_bg_running && _pending_flushes == 0) || _shutting_down;
+    });
+}
+
+WriteStallStats DB::GetWriteStallStats() const {
+    WriteStallStats stats = _write_controller.GetStats();
+    stats.stopped = _write_stopped.load();
+    stats.delayed = _write_delayed.load();
+    return stats;
+}
+
+void DB::RecalculateWriteStall() {
+    bool stop = false;
+    bool delay = false;
+    bool behind = false;
+    double pressure = 0;
+    for (ColumnFamilyHandle* cf : LiveColumnFamilies()) {
+        std::shared_ptr<const ColumnFamilyOptions> snapshot = cf->GetOptions();
+        const ColumnFamilyOptions& options = *snapshot;
+        std::shared_ptr<Version> v = cf->_versions->current();
+        int l0_files = v->NumFiles(0);
+        uint64_t pending_bytes = v->EstimatedPendingCompactionBytes(options);
+        // Below the compaction trigger nothing would ever lift the stall
+        int slowdown_l0 = options.level0_slowdown_writes_trigger;
+        if (slowdown_l0 > 0) slowdown_l0 = std::max(slowdown_l0, options.level0_file_num_compaction_trigger);
+        int stop_l0 = options.level0_stop_writes_trigger;
+        if (stop_l0 > 0) stop_l0 = std::max(stop_l0, options.level0_file_num_compaction_trigger);
+
+        if (stop_l0 > 0 && l0_files >= stop_l0) stop = true;
+        if (options.hard_pending_compaction_bytes_limit > 0 &&
+            pending_bytes >= options.hard_pending_compaction_bytes_limit) {
+            stop = true;
+        }
+        if (slowdown_l0 > 0 && l0_files >= slowdown_l0) {
+            delay = true;
+            pressure = std::max(pressure, static_cast<double>(l0_files) / slowdown_l0);
+        }
+        if (options.soft_pending_compaction_bytes_limit > 0 &&
+            pending_bytes >= options.soft_pending_compaction_bytes_limit) {
+            delay = true;
+            pressure = std::max(pressure, static_cast<double>(pending_bytes) /
+                                          options.soft_pending_compaction_bytes_limit);
+        }
+        // Well before a stall, so low-priority writes yield early
+        if (options.level0_file_num_compaction_trigger > 0 &&
+            l0_files > options.level0_file_num_compaction_trigger) {
+            behind = true;
+        }
+        if (options.soft_pending_compaction_bytes_limit > 0 &&
+            pending_bytes >= options.soft_pending_compaction_bytes_limit / 4) {
+            behind = true;
+        }
+    }
+    _compaction_behind = behind || delay || stop;
+
+    {
+        std::lock_guard<std::mutex> lock(_bg_mutex);
+        if (delay) {
+            uint64_t rate = _write_controller.delayed_write_rate();
+            if (!_write_delayed) {
+                rate = _write_controller.max_delayed_write_rate();
+                if (_flush_rate > 0) rate = std::min(rate, static_cast<uint64_t>(_flush_rate));
+            } else if (pressure > _stall_pressure) {
+                rate = rate / 5 * 4; // Falling further behind
+            } else if (pressure < _stall_pressure) {
+                rate = rate / 4 * 5; // Catching up
+            }
+            _write_controller.set_delayed_write_rate(rate);
+        }
+        if (stop != _write_stopped) {
+            std::cout << "[C++] Writes " << (stop ? "stopped until compactions catch up" : "resumed") << std::endl;
+        } else if (delay != _write_delayed) {
+            std::cout << "[C++] Writes " << (delay ? "slowed down to " : "no longer slowed down from ")
+                      << _write_controller.delayed_write_rate() << " bytes/s" << std::endl;
+        }
+        _stall_pressure = delay ? pressure : 0;
+        _write_stopped = stop;
+        _write_delayed = delay;
+    }
+    _bg_cv.notify_all();
+}
+
+void DB::DelayWrite(uint64_t num_bytes, const WriteOptions& write_options) {
+    if (write_options.low_pri && _compaction_behind) {
+        uint64_t delay = _low_pri_write_controller.GetDelay(num_bytes);
+        if (delay > 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(delay));
+            _write_controller.RecordDelay(delay);
+        }
+    }
+    if (_write_stopped) {
+        uint64_t start = SteadyMicros();
+        std::unique_lock<std::mutex> lock(_bg_mutex);
+        _bg_cv.wait(lock, [this] { return !_write_stopped || _shutting_down; });
+        lock.unlock();
+        _write_controller.RecordStop(SteadyMicros() - start);
+    }
+    if (_write_delayed) {
+        uint64_t delay = _write_controller.GetDelay(num_bytes);
+        if (delay > 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(delay));
+            _write_controller.RecordDelay(delay);
+        }
+    }
+}
+
+int DB::NumFilesAtLevel(int level, ColumnFamilyHandle* cf) {
+    if (cf == nullptr) cf = _default_cf;
+    CheckLive(cf);
+    return static_cast<int>(cf->_versions->current()->GetFiles(level).size());
+}
+
+void DB::CompactColumnFamily(ColumnFamilyHandle* cf) {
+    std::lock_guard<std::mutex> compaction_lock(_compaction_mutex);
+    Compaction c;
+    std::shared_ptr<const ColumnFamilyOptions> options;
+    while (!cf->_dropped && cf->_versions->PickCompaction(*(options = cf->GetOptions()), &c)) {
+        {
+            std::lock_guard<std::mutex> lock(_bg_mutex);
+            if (_shutting_down) return;
+        }
+
+        VersionEdit edit;
+        CompactionJob job(cf->_dir, cf->_versions.get(), *options, c,
+                          _compaction_pool.get(), _options.max_subcompactions);
+        if (!job.Run(&edit)) {
+            std::cerr << "Compaction of " << cf->_name << " L" << c.level << " failed" << std::endl;
+            return;
+        }
+        cf->_versions->LogAndApply(edit);
+        c.input_version.reset();
+        cf->_versions->DeleteObsoleteFiles();
+        RecalculateWriteStall();
+
+        std::cout << "[C++] Compacted " << c.NumInputFiles()
+                  << " files of " << cf->_name << " L" << c.level << " -> L" << c.output_level
+                  << ", dropped " << job.EntriesDropped() << " entries";
+        if (job.NumSubcompactions() > 1) {
+            std::cout << ", " << job.NumSubcompactions() << " subcompactions";
+        }
+        if (options->compaction_filter) {
+            std::cout << ", " << options->compaction_filter->Name() << " filtered "
+                      << job.EntriesFiltered();
+        }
+        std::cout << std::endl;
+    }
 }
 
 void DB::BackgroundSync() {
     while (!_stop_sync) {
         std::this_thread::sleep_for(std::chrono::seconds(1));
         if (_stop_sync) break;
-        if (_wal) {
-            _wal->Sync();
+        for (auto& shard : _shards) {
+            // WAL::Sync has its own lock; the shard mutex is not needed
+            if (shard->wal) {
+                shard->wal->Sync();
+            }
         }
     }
 }
 
-void DB::Recover(const std::string& wal_path) {
-    if (!fs::exists(wal_path)) return;
+bool DB::Recover(std::vector<WALFile>* wals) {
+    // Collect WAL files as (shard index, frozen first, path): wal.log is
+    // shard 0, wal_N.log is shard N, and wal_imm_N.log is the older WAL of
+    // shard N whose flush did not finish
+    std::vector<std::tuple<int, int, std::string>> found;
+    bool clean = true;
+    std::vector<std::string> children;
+    _env->GetChildren(_path, &children);
+    for (const auto& name : children) {
+        fs::path entry(name);
+        if (entry.extension() != ".log") continue;
+        std::string stem = entry.stem().string();
+        std::string path = _path + "/" + name;
+        try {
+            if (stem == "wal") {
+                found.emplace_back(0, 1, path);
+            } else if (stem.rfind("wal_imm_", 0) == 0) {
+                found.emplace_back(std::stoi(stem.substr(8)), 0, path);
+                clean = false;
+            } else if (stem.rfind("wal_", 0) == 0) {
+                found.emplace_back(std::stoi(stem.substr(4)), 1, path);
+            }
+        } catch (...) {
+            continue;
+        }
+    }
+    std::sort(found.begin(), found.end());
 
-    std::ifstream file(wal_path, std::ios::binary);
-    if (!file.is_open()) return;
+    for (const auto& wal : found) {
+        uint64_t last_sequence = 0;
+        if (!ReplayWAL(std::get<2>(wal), std::get<0>(wal), &last_sequence)) {
+            clean = false;
+        }
+        wals->push_back({std::get<0>(wal), std::get<2>(wal), last_sequence});
+    }
+    return clean;
+}
 
-    std::streampos valid_pos = 0;
+bool DB::ReplayWAL(const std::string& wal_path, int file_shard, uint64_t* last_sequence) {
+    WALReader reader(_env, wal_path);
+    if (!reader.ok()) return true;
 
-    while (file.peek() != EOF) {
-        char type;
-        uint32_t klen;
-        
-        // Read header
-        file.read(&type, 1);
-        if (file.gcount() != 1) break;
-        
-        file.read(reinterpret_cast<char*>(&klen), sizeof(klen));
-        if (file.gcount() != sizeof(klen)) break;
-        
-        // Read key
-        std::string key(klen, '\0');
-        file.read(&key[0], klen);
-        if (file.gcount() != klen) break;
-        
-        // Read value (if not delete)
-        std::string value;
-        if (type == 0) {
-            uint32_t vlen;
-            file.read(reinterpret_cast<char*>(&vlen), sizeof(vlen));
-            if (file.gcount() != sizeof(vlen)) break;
-            
-            value.resize(vlen);
-            file.read(&value[0], vlen);
-            if (file.gcount() != vlen) break;
-        } else {
-            // Skip dummy vlen for delete
-            uint32_t vlen;
-            file.read(reinterpret_cast<char*>(&vlen), sizeof(vlen));
-            if (file.gcount() != sizeof(vlen)) break;
-        }
-        
-        // Apply to memtable
-        if (type == 0) {
-            _memtable->Put(key, value);
+    bool layout_matches = file_shard < static_cast<int>(_shards.size());
+    WALRecord record;
+
+    while (reader.ReadRecord(&record)) {
+        *last_sequence = std::max(*last_sequence, record.sequence);
+        auto cf_it = _column_families.find(record.cf_id);
+        if (cf_it == _column_families.end()) {
+            continue; // Family was dropped
+        }
+        ColumnFamilyHandle* cf = cf_it->second;
+
+        if (record.is_range_delete) {
+            // The copy only covers keys of its writer's shard. Those are all
+            // in one memtable unless the shard layout changed since.
+            RangeTombstone tombstone{record.key, record.value, record.shard, record.num_shards};
+            if (record.num_shards == _shards.size() && record.shard < _shards.size()) {
+                cf->_mems[record.shard]->DeleteRange(tombstone);
+            } else {
+                // Flushed right after recovery (layout_matches is false), so
+                // it cannot hide writes made after the reopen
+                for (auto& mem : cf->_mems) mem->DeleteRange(tombstone);
+                layout_matches = false;
+            }
+            continue;
+        }
+
+        // Apply to the memtable of the shard that owns the key now
+        Shard* shard = ShardFor(record.key);
+        if (layout_matches && shard != _shards[file_shard].get()) {
+            layout_matches = false;
+        }
+        if (!record.is_delete) {
+            cf->_mems[shard->index]->Put(record.key, record.value, record.expire_at);
         } else {
-            _memtable->Delete(key);
+            cf->_mems[shard->index]->Delete(record.key);
         }
-        
-        valid_pos = file.tellg();
     }
-    
-    file.close();
-    
+
     // Truncate partial writes
-    if (fs::file_size(wal_path) != valid_pos) {
-        fs::resize_file(wal_path, valid_pos);
+    uint64_t valid_pos = reader.ValidOffset();
+    uint64_t size = 0;
+    if (_env->GetFileSize(wal_path, &size) && size != valid_pos) {
+        _env->TruncateFile(wal_path, valid_pos);
         std::cout << "[C++] Recovered WAL, truncated to " << valid_pos << " bytes" << std::endl;
     }
+    return layout_matches;
 }
 
 } // namespace lsm
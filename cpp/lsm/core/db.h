@@ -4,41 +4,285 @@
 #include <memory>
 #include <thread>
 #include <atomic>
+#include <vector>
+#include <map>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include "options.h"
 #include "memtable.h"
 #include "wal.h"
+#include "trace.h"
+#include "column_family.h"
+#include "write_controller.h"
+#include "iterator.h"
+#include "update_iterator.h"
 #include "core/version/version.h"
+#include "util/thread_pool.h"
 
 namespace lsm {
 
-struct Options {
-    bool sync = false; // true: fsync on every write, false: rely on background sync
-};
-
 class DB {
 public:
     DB(const std::string& path, const Options& options = Options());
     ~DB();
 
-    void Put(const std::string& key, const std::string& value);
+    // Operate on the default column family. Writes throw
+    // std::invalid_argument for WriteOptions that cannot be honored.
+    void Put(const std::string& key, const std::string& value, const WriteOptions& write_options = WriteOptions());
     bool Get(const std::string& key, std::string* value);
-    void Delete(const std::string& key);
+    void Delete(const std::string& key, const WriteOptions& write_options = WriteOptions());
+
+    // Operate on a specific column family (default if nullptr). Throw if
+    // the family was dropped.
+    void Put(ColumnFamilyHandle* cf, const std::string& key, const std::string& value,
+             const WriteOptions& write_options = WriteOptions());
+    bool Get(ColumnFamilyHandle* cf, const std::string& key, std::string* value);
+    void Delete(ColumnFamilyHandle* cf, const std::string& key, const WriteOptions& write_options = WriteOptions());
+
+    // Get for many keys at once. The table reads of all keys missing from
+    // the memtables are issued together (see AsyncIO), so a batch costs
+    // about one disk round trip instead of one per key. found[i] tells
+    // whether (*values)[i] holds the value of keys[i].
+    std::vector<bool> MultiGet(const std::vector<std::string>& keys, std::vector<std::string>* values,
+                               ColumnFamilyHandle* cf = nullptr);
+
+    // Non-blocking Get and Put. The request is queued to the DB's async
+    // workers (Options::max_async_workers) and callback runs on one of them
+    // once it is done, with error set if the operation threw. Requests still
+    // queued when the DB is closed run before the destructor returns.
+    using GetCallback = std::function<void(std::exception_ptr error, bool found, std::string value)>;
+    using WriteCallback = std::function<void(std::exception_ptr error)>;
+    void GetAsync(const std::string& key, GetCallback callback, ColumnFamilyHandle* cf = nullptr);
+    void PutAsync(const std::string& key, const std::string& value, WriteCallback callback,
+                  ColumnFamilyHandle* cf = nullptr);
+
+    // Delete every key in [begin, end). Costs the same however many keys the
+    // range covers: a range tombstone is logged and kept per write shard.
+    void DeleteRange(const std::string& begin, const std::string& end,
+                     const WriteOptions& write_options = WriteOptions());
+    void DeleteRange(ColumnFamilyHandle* cf, const std::string& begin, const std::string& end,
+                     const WriteOptions& write_options = WriteOptions());
+
+    // Like Put, but the entry reads as absent once the Unix time in ms reaches
+    // expire_at_ms. Flush and compaction reclaim expired entries.
+    void PutWithExpiry(const std::string& key, const std::string& value, uint64_t expire_at_ms,
+                       const WriteOptions& write_options = WriteOptions());
+    void PutWithExpiry(ColumnFamilyHandle* cf, const std::string& key, const std::string& value,
+                       uint64_t expire_at_ms, const WriteOptions& write_options = WriteOptions());
+
+    // Iterate over the live entries of a column family (default if nullptr),
+    // skipping deleted and expired ones. The caller must delete it.
+    Iterator* NewIterator(ColumnFamilyHandle* cf = nullptr);
+    // Same, restricted to the keys starting with prefix, which must be one
+    // the family's prefix_extractor produces, in a family of bytewise order
+    // (throws std::invalid_argument otherwise). Memtables and tables whose
+    // prefix filter rules it out are not read at all.
+    Iterator* NewPrefixIterator(const std::string& prefix, ColumnFamilyHandle* cf = nullptr);
+
+    // Link an SSTable built by SstFileWriter into the family, bypassing the
+    // WAL and the memtable. Its entries are newer than everything already in
+    // the DB. It is placed at the deepest level that has no overlapping data
+    // above it; memtables holding keys of its range are flushed first.
+    // The file is copied into the DB directory, or with move_file hard-linked
+    // (copied if that fails) and then removed from file_path.
+    // Returns the level; throws if the file is unusable.
+    int IngestExternalFile(const std::string& file_path, bool move_file = false);
+    int IngestExternalFile(ColumnFamilyHandle* cf, const std::string& file_path, bool move_file = false);
+
+    // Make checkpoint_dir, which must not exist yet, a DB holding what this
+    // one holds now: tables and blob files are hard-linked (copied if on
+    // another file system), the WALs copied. Opened as a DB, it is
+    // independent of this one. Throws if it cannot be completed.
+    void CreateCheckpoint(const std::string& checkpoint_dir);
+
+    // Every Put, Delete and DeleteRange gets the next sequence number as it
+    // is applied. This is the one of the last write.
+    uint64_t GetLatestSequenceNumber() const { return _last_sequence.load(); }
+    // The writes with sequence numbers from since up to the latest, read
+    // from the WALs, including flushed ones still in the archive (see
+    // Options::wal_retention_size), so that a follower can apply them to a
+    // DB of its own. Ingested files are not in the WAL and not visited.
+    // Returns nullptr if some of those writes are no longer retained: a
+    // follower that far behind starts over from a checkpoint. The caller
+    // must delete the iterator.
+    UpdateIterator* GetUpdatesSince(uint64_t since);
+
+    // Block until background flushes and compactions have caught up with
+    // every memtable switched so far
+    void WaitForCompaction();
+    int NumFilesAtLevel(int level, ColumnFamilyHandle* cf = nullptr);
+    // Whether writes are stopped or slowed down right now, and the time
+    // writes have spent stalled so far
+    WriteStallStats GetWriteStallStats() const;
+    // The row cache lookups go through (Options::row_cache), null if none
+    RowCache* GetRowCache() const { return _row_cache.get(); }
+
+    ColumnFamilyHandle* DefaultColumnFamily() const { return _default_cf; }
+    // Creates the family with default options, or returns the existing one
+    // of that name (e.g. recovered from disk) as it is.
+    ColumnFamilyHandle* CreateColumnFamily(const std::string& name);
+    // Creates the family, or returns the existing one of that name with its
+    // options replaced. Its comparator cannot change.
+    ColumnFamilyHandle* CreateColumnFamily(const std::string& name, const ColumnFamilyOptions& options);
+    // Returns nullptr if no live family has that name
+    ColumnFamilyHandle* GetColumnFamily(const std::string& name);
+    // Forgets the family and deletes its directory. The default family cannot be dropped.
+    void DropColumnFamily(ColumnFamilyHandle* cf);
+
+    // Capture every Put/Get/Delete into a binary trace file (see trace.h)
+    // until EndTrace() is called. Replaces any trace already running.
+    bool StartTrace(const std::string& trace_path);
+    void EndTrace();
 
 private:
+    // One write partition: the WAL shared by every family's memtable for
+    // this shard. The memtables themselves live in ColumnFamilyHandle::_mems.
+    struct Shard {
+        int index;
+        std::mutex mutex;
+        std::unique_ptr<WAL> wal;
+        std::string wal_path;
+        // The full memtables switched out with the WAL wait here for their
+        // flush. At most one flush per shard is pending, so writers that fill
+        // the new memtable first wait on flush_cv.
+        std::string imm_wal_path;
+        bool imm_pending = false;
+        // Sequence numbers of the last records in the WALs, 0 if none
+        uint64_t wal_last_sequence = 0;
+        uint64_t imm_last_sequence = 0;
+        // The mutable memtables hold writes made with WriteOptions::disable_wal,
+        // which only a flush persists
+        bool has_unlogged_writes = false;
+        // Ingestions in progress; writers wait on flush_cv until none is
+        int writes_blocked = 0;
+        std::condition_variable flush_cv;
+    };
+
     std::string _path;
     Options _options;
-    std::unique_ptr<MemTable> _memtable;
-    std::unique_ptr<WAL> _wal;
-    std::unique_ptr<VersionSet> _versions;
-    std::mutex _mutex;
-    
+    Env* _env; // Options::env, or the local file system
+    std::vector<std::unique_ptr<Shard>> _shards;
+    // Taken under the shard mutex, so each WAL is in sequence order
+    std::atomic<uint64_t> _last_sequence{0};
+
+    // WALs whose memtables were flushed are archived or deleted under this.
+    // Every write whose record was deleted has a sequence number up to
+    // _purged_sequence, which is persisted before the deletion.
+    std::mutex _wal_mutex;
+    uint64_t _purged_sequence = 0;
+    struct WALFile {
+        int shard;
+        std::string path;
+        uint64_t last_sequence = 0; // Of its last record, 0 if none
+    };
+    // Archives (see Options::wal_retention_size) or deletes the WAL, then
+    // trims the archive. REQUIRES: _wal_mutex held
+    void RetireWAL(const WALFile& wal);
+    void PurgeArchive(); // REQUIRES: _wal_mutex held
+    // Sorted by last_sequence
+    std::vector<WALFile> ArchivedWALs() const;
+    std::string ArchiveDir() const { return _path + "/archive"; }
+    // Accessed with std::atomic_load/store so ops don't take a lock to trace
+    std::shared_ptr<TraceWriter> _tracer;
+
+    // Lock order: a shard mutex may be held while taking _cf_mutex, never the reverse
+    std::mutex _cf_mutex;
+    std::map<uint32_t, ColumnFamilyHandle*> _column_families; // Live families by id
+    std::vector<std::unique_ptr<ColumnFamilyHandle>> _cf_handles; // Every handle ever created
+    ColumnFamilyHandle* _default_cf = nullptr;
+    ColumnFamilyRegistry _cf_registry;
+
     std::thread _sync_thread;
     std::atomic<bool> _stop_sync;
     void BackgroundSync();
-    
-    void Recover(const std::string& wal_path);
-    void Flush();
-    
-    const size_t kMemTableSizeLimit = 4 * 1024 * 1024; // 4MB
+
+    // Flushes run on _flush_pool. Compactions are picked one at a time by a
+    // job on _compaction_pool, whose other threads run its subcompactions.
+    std::unique_ptr<ThreadPool> _flush_pool;
+    std::unique_ptr<ThreadPool> _compaction_pool;
+    std::unique_ptr<ThreadPool> _async_pool; // GetAsync/PutAsync
+
+    std::shared_ptr<RowCache> _row_cache; // May be null
+
+    std::shared_ptr<WriteBufferManager> _write_buffer_manager; // May be null
+    uint64_t _write_buffer_member = 0;
+    // Bytes of the largest mutable memtable set among the shards with no
+    // flush pending, and that shard (nullptr if none)
+    size_t LargestMemTableShard(Shard** shard);
+    void FlushLargestMemTableShard();
+    // Lets the write buffer manager flush once the budget is used up.
+    // Called after a write, holding no lock.
+    void MaybeFlushForBudget();
+    std::mutex _bg_mutex;
+    std::condition_variable _bg_cv;
+    bool _bg_scheduled = false; // More compaction work may be due
+    bool _bg_running = false;   // A compaction job is queued or running
+    int _pending_flushes = 0;
+    bool _shutting_down = false;
+    // Held while a compaction or ingestion changes a family's files, so that
+    // DropColumnFamily does not remove the directory underneath
+    std::mutex _compaction_mutex;
+    void MaybeScheduleCompaction();
+    void BackgroundCompaction();
+
+    // Write stalls (see ColumnFamilyOptions::level0_slowdown_writes_trigger).
+    // Every write reads the flags without a lock; they change under _bg_mutex
+    // and stopped writers wait on _bg_cv.
+    WriteController _write_controller;
+    std::atomic<bool> _write_stopped{false};
+    std::atomic<bool> _write_delayed{false};
+    // Paces WriteOptions::low_pri writes while compactions are behind
+    WriteController _low_pri_write_controller{WriteOptions::kLowPriWriteRate};
+    std::atomic<bool> _compaction_behind{false};
+    double _stall_pressure = 0; // How far past the slowdown triggers, 1 = at them. Guarded by _bg_mutex
+    double _flush_rate = 0;     // Moving average of flush throughput, bytes/s. Guarded by _bg_mutex
+    // Re-evaluates the triggers after the files of a family changed
+    void RecalculateWriteStall();
+    // Holds a write of num_bytes back while writes are stopped or slowed
+    // down, and a low_pri one also while compactions are behind
+    void DelayWrite(uint64_t num_bytes, const WriteOptions& write_options);
+    void CompactColumnFamily(ColumnFamilyHandle* cf);
+
+    // Stamps record with the next sequence number, unless it skips the WAL
+    void Write(ColumnFamilyHandle* cf, WALRecord& record, const WriteOptions& write_options);
+    // Switches the shard's memtables once cf's is full, waiting for the
+    // previous flush if it is still running, and waits while an ingestion
+    // holds writes off. REQUIRES: lock holds shard->mutex
+    void MakeRoomForWrite(ColumnFamilyHandle* cf, Shard* shard, std::unique_lock<std::mutex>& lock);
+    // Like MakeRoomForWrite, but false instead of waiting for the previous
+    // flush or an ingestion. For callers holding other shards' mutexes,
+    // which the flush thread may need. REQUIRES: shard->mutex held
+    bool TryMakeRoomForWrite(ColumnFamilyHandle* cf, Shard* shard);
+
+    Shard* ShardFor(const std::string& key);
+    // prefix_extractor == nullptr: every key
+    Iterator* NewIterator(ColumnFamilyHandle* cf, const PrefixExtractor* prefix_extractor,
+                          const std::string& prefix);
+    std::string WALPath(int shard) const;
+    std::vector<ColumnFamilyHandle*> LiveColumnFamilies();
+    ColumnFamilyHandle* NewColumnFamily(uint32_t id, const std::string& name, const ColumnFamilyOptions& options);
+    // Both CreateColumnFamily overloads; null options leave an existing family's alone
+    ColumnFamilyHandle* CreateOrOpenColumnFamily(const std::string& name, const ColumnFamilyOptions* options);
+    void CheckLive(ColumnFamilyHandle* cf) const;
+
+    void OpenColumnFamilies();
+    // Replay every WAL in the directory. Returns false if the WAL files
+    // cannot be kept as they are: a record belongs to a different shard than
+    // the WAL it was read from (num_shards changed), or a flush never
+    // finished and left a frozen WAL behind. The files replayed are added
+    // to wals.
+    bool Recover(std::vector<WALFile>* wals);
+    bool ReplayWAL(const std::string& wal_path, int file_shard, uint64_t* last_sequence);
+    // Build an L0 table for cf from mem. Returns false if mem was empty.
+    bool WriteLevel0Table(ColumnFamilyHandle* cf, MemTable* mem, VersionEdit* edit);
+    // Turn every family's memtable of the shard into its immutable one,
+    // start a new WAL and schedule the flush. REQUIRES: shard->mutex held,
+    // no flush of the shard pending
+    void SwitchMemTable(Shard* shard);
+    void BackgroundFlush(Shard* shard);
+    // Switch and wait until the memtables are in L0. REQUIRES: lock holds shard->mutex
+    void FlushShard(Shard* shard, std::unique_lock<std::mutex>& lock);
 };
 
 } // namespace lsm
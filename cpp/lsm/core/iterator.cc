@@ -0,0 +1,186 @@
+#include "iterator.h"
+#include <iostream>
+#include <algorithm>
+#include "memtable.h"
+#include "prefix_extractor.h"
+
+namespace lsm {
+
+namespace {
+
+class VectorIterator : public InternalIterator {
+public:
+    VectorIterator(std::vector<IteratorEntry> entries, std::vector<RangeTombstone> tombstones,
+                   const Comparator* comparator)
+        : _entries(std::move(entries)), _tombstones(std::move(tombstones)), _comparator(comparator),
+          _pos(_entries.size()) {}
+
+    bool Valid() const override { return _pos < _entries.size(); }
+    void SeekToFirst() override { _pos = 0; }
+    void Seek(const std::string& target) override {
+        auto it = std::lower_bound(_entries.begin(), _entries.end(), target,
+            [this](const IteratorEntry& e, const std::string& k) { return _comparator->Compare(e.key, k) < 0; });
+        _pos = it - _entries.begin();
+    }
+    void Next() override { _pos++; }
+    std::string Key() const override { return _entries[_pos].key; }
+    std::string Value() const override { return _entries[_pos].value; }
+    bool IsDeleted() const override { return _entries[_pos].is_deleted; }
+    uint64_t ExpireAt() const override { return _entries[_pos].expire_at; }
+    std::vector<RangeTombstone> RangeTombstones() const override { return _tombstones; }
+
+private:
+    std::vector<IteratorEntry> _entries;
+    std::vector<RangeTombstone> _tombstones;
+    const Comparator* _comparator;
+    size_t _pos;
+};
+
+// A linear scan over the children per step is plenty for the handful of
+// memtables and tables a read or a compaction touches.
+class MergingIterator : public InternalIterator {
+public:
+    MergingIterator(std::vector<std::unique_ptr<InternalIterator>> children, const Comparator* comparator,
+                    std::function<void(const InternalIterator&)> on_skip)
+        : _children(std::move(children)), _comparator(comparator), _on_skip(std::move(on_skip)), _current(-1) {
+        for (const auto& child : _children) {
+            _tombstones.push_back(child->RangeTombstones());
+            _fragments.emplace_back(comparator);
+            for (const auto& t : _tombstones.back()) _fragments.back().Add(t, 1);
+        }
+    }
+
+    bool Valid() const override { return _current >= 0; }
+
+    void SeekToFirst() override {
+        for (auto& child : _children) child->SeekToFirst();
+        FindSmallest();
+    }
+
+    void Seek(const std::string& target) override {
+        for (auto& child : _children) child->Seek(target);
+        FindSmallest();
+    }
+
+    void Next() override {
+        SkipCurrentKey();
+        FindSmallest();
+    }
+
+    std::string Key() const override { return _children[_current]->Key(); }
+    std::string Value() const override { return _children[_current]->Value(); }
+    bool IsDeleted() const override { return _children[_current]->IsDeleted(); }
+    uint64_t ExpireAt() const override { return _children[_current]->ExpireAt(); }
+    bool IsBlobIndex() const override { return _children[_current]->IsBlobIndex(); }
+
+    std::vector<RangeTombstone> RangeTombstones() const override {
+        std::vector<RangeTombstone> result;
+        for (const auto& tombstones : _tombstones) {
+            result.insert(result.end(), tombstones.begin(), tombstones.end());
+        }
+        return result;
+    }
+
+private:
+    std::vector<std::unique_ptr<InternalIterator>> _children;
+    std::vector<std::vector<RangeTombstone>> _tombstones; // Per child
+    std::vector<FragmentedRangeTombstones> _fragments; // The same, for IsCovered
+    const Comparator* _comparator;
+    std::function<void(const InternalIterator&)> _on_skip;
+    int _current;
+
+    // Advance every child positioned on the current key, so older versions
+    // of it are skipped. covered: the current entry is skipped as well.
+    void SkipCurrentKey(bool covered = false) {
+        std::string key = _children[_current]->Key();
+        for (int i = 0; i < static_cast<int>(_children.size()); ++i) {
+            auto& child = _children[i];
+            if (!child->Valid() || child->Key() != key) continue;
+            if (_on_skip && (covered || i != _current)) _on_skip(*child);
+            child->Next();
+        }
+    }
+
+    bool IsCovered(const std::string& key, int child) const {
+        for (int i = 0; i < child; ++i) {
+            if (_fragments[i].MaxCoveringSeq(key) > 0) return true;
+        }
+        return false;
+    }
+
+    void FindSmallest() {
+        while (true) {
+            _current = -1;
+            std::string smallest;
+            for (size_t i = 0; i < _children.size(); ++i) {
+                if (!_children[i]->Valid()) continue;
+                // Strictly smaller only: on ties the earlier (newer) child wins
+                std::string key = _children[i]->Key();
+                if (_current < 0 || _comparator->Compare(key, smallest) < 0) {
+                    _current = static_cast<int>(i);
+                    smallest = std::move(key);
+                }
+            }
+            if (_current < 0 || !IsCovered(smallest, _current)) return;
+            SkipCurrentKey(true);
+        }
+    }
+};
+
+} // namespace
+
+InternalIterator* NewVectorIterator(std::vector<IteratorEntry> entries, std::vector<RangeTombstone> tombstones,
+                                    const Comparator* comparator) {
+    return new VectorIterator(std::move(entries), std::move(tombstones), comparator);
+}
+
+InternalIterator* NewMergingIterator(std::vector<std::unique_ptr<InternalIterator>> children,
+                                     const Comparator* comparator,
+                                     std::function<void(const InternalIterator&)> on_skip) {
+    return new MergingIterator(std::move(children), comparator, std::move(on_skip));
+}
+
+Iterator::Iterator(std::unique_ptr<InternalIterator> merged, uint64_t now_ms,
+                   std::vector<std::shared_ptr<void>> pinned,
+                   std::shared_ptr<BlobFileCache> blob_cache, std::string prefix)
+    : _iter(std::move(merged)), _now_ms(now_ms), _pinned(std::move(pinned)),
+      _blob_cache(std::move(blob_cache)), _prefix(std::move(prefix)) {}
+
+std::string Iterator::Value() const {
+    if (!_iter->IsBlobIndex() || !_blob_cache) return _iter->Value();
+    std::string value;
+    if (!_blob_cache->Get(_iter->Value(), &value)) {
+        std::cerr << "Failed to read blob value of key " << _iter->Key() << std::endl;
+        return "";
+    }
+    return value;
+}
+
+void Iterator::SeekToFirst() {
+    if (_prefix.empty()) {
+        _iter->SeekToFirst();
+    } else {
+        _iter->Seek(_prefix);
+    }
+    SkipHidden();
+}
+
+void Iterator::Seek(const std::string& target) {
+    _iter->Seek(target < _prefix ? _prefix : target);
+    SkipHidden();
+}
+
+void Iterator::Next() {
+    _iter->Next();
+    SkipHidden();
+}
+
+void Iterator::SkipHidden() {
+    while (_iter->Valid() && (_iter->IsDeleted() || IsExpired(_iter->ExpireAt(), _now_ms))) {
+        if (!_prefix.empty() && !HasPrefix(_iter->Key(), _prefix)) break;
+        _iter->Next();
+    }
+    _valid = _iter->Valid() && (_prefix.empty() || HasPrefix(_iter->Key(), _prefix));
+}
+
+} // namespace lsm
@@ -0,0 +1,85 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <functional>
+#include "range_tombstone.h"
+#include "comparator.h"
+#include "core/blob/blob_file.h"
+
+namespace lsm {
+
+// Iterator over raw entries of a memtable or SSTable, including deletions
+// and expired values. Keys are visited in ascending order of the family's
+// comparator, at most once.
+class InternalIterator {
+public:
+    virtual ~InternalIterator() = default;
+    virtual bool Valid() const = 0;
+    virtual void SeekToFirst() = 0;
+    virtual void Seek(const std::string& target) = 0;
+    virtual void Next() = 0;
+    virtual std::string Key() const = 0;
+    virtual std::string Value() const = 0;
+    virtual bool IsDeleted() const = 0;
+    virtual uint64_t ExpireAt() const = 0; // Unix time in ms, 0 = never
+    // Value() is an encoded BlobIndex rather than the value itself
+    virtual bool IsBlobIndex() const { return false; }
+    // Range deletions of this source, hiding entries of older sources only
+    virtual std::vector<RangeTombstone> RangeTombstones() const { return {}; }
+};
+
+// An owned copy of entries, e.g. a memtable snapshot, already sorted by comparator
+struct IteratorEntry {
+    std::string key;
+    std::string value;
+    bool is_deleted;
+    uint64_t expire_at;
+};
+InternalIterator* NewVectorIterator(std::vector<IteratorEntry> entries, std::vector<RangeTombstone> tombstones,
+                                    const Comparator* comparator);
+
+// Merges children into one sorted stream. Children are ordered newest first;
+// when several contain a key only the newest entry is returned, and it is
+// skipped altogether if a newer child's range tombstone covers it.
+// RangeTombstones() returns those of every child. Takes ownership of the
+// children, which are sorted by comparator. on_skip, if set, sees every entry
+// passed over that way (e.g. to account for the blob values they reference).
+InternalIterator* NewMergingIterator(std::vector<std::unique_ptr<InternalIterator>> children,
+                                     const Comparator* comparator,
+                                     std::function<void(const InternalIterator&)> on_skip = nullptr);
+
+// User-facing iterator over a consistent view of the DB: deleted and expired
+// entries are skipped. Obtain one from DB::NewIterator and delete it when done.
+// An iterator with a prefix (DB::NewPrefixIterator) only visits keys that
+// start with it: SeekToFirst goes to the first of them, and it becomes
+// invalid past the last.
+class Iterator {
+public:
+    Iterator(std::unique_ptr<InternalIterator> merged, uint64_t now_ms,
+             std::vector<std::shared_ptr<void>> pinned,
+             std::shared_ptr<BlobFileCache> blob_cache = nullptr,
+             std::string prefix = std::string());
+
+    bool Valid() const { return _valid; }
+    void SeekToFirst();
+    void Seek(const std::string& target);
+    void Next();
+    std::string Key() const { return _iter->Key(); }
+    // Values stored in blob files are read on demand
+    std::string Value() const;
+
+private:
+    std::unique_ptr<InternalIterator> _iter;
+    uint64_t _now_ms; // Expiry is judged against the time the iterator was created
+    // Keeps the Versions (and thus the SSTables) being iterated alive
+    std::vector<std::shared_ptr<void>> _pinned;
+    std::shared_ptr<BlobFileCache> _blob_cache;
+    std::string _prefix;
+    bool _valid = false;
+
+    void SkipHidden();
+};
+
+} // namespace lsm
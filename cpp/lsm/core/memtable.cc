@@ -1,23 +1,132 @@
 #include "memtable.h"
+#include <memory>
 
 namespace lsm {
 
-MemTable::MemTable() {}
+class MemTableIterator : public InternalIterator {
+public:
+    explicit MemTableIterator(const MemTable* mem)
+        : _mem(mem), _iter(mem->_skiplist.NewIterator()) {}
 
-void MemTable::Put(const std::string& key, const std::string& value) {
-    _skiplist.Insert(key, value, false);
+    bool Valid() const override { return _iter->Valid(); }
+    void SeekToFirst() override {
+        _iter->SeekToFirst();
+        SkipCovered();
+    }
+    void Seek(const std::string& target) override {
+        _iter->Seek(target);
+        SkipCovered();
+    }
+    void Next() override {
+        _iter->Next();
+        SkipCovered();
+    }
+    std::string Key() const override { return _iter->Key(); }
+    std::string Value() const override { return _iter->Value(); }
+    bool IsDeleted() const override { return _iter->IsDeleted(); }
+    uint64_t ExpireAt() const override { return _iter->ExpireAt(); }
+
+    std::vector<RangeTombstone> RangeTombstones() const override {
+        return _mem->_range_tombstones;
+    }
+
+private:
+    const MemTable* _mem;
+    std::unique_ptr<SkipList::Iterator> _iter;
+
+    void SkipCovered() {
+        while (_iter->Valid() && _mem->IsCovered(_iter->Key(), _iter->Seq())) {
+            _iter->Next();
+        }
+    }
+};
+
+MemTable::MemTable(const ColumnFamilyOptions& options, std::shared_ptr<WriteBufferManager> write_buffer_manager)
+    : _comparator(options.comparator), _skiplist(_comparator.get()), _fragments(_comparator.get()),
+      _prefix_extractor(options.prefix_extractor), _write_buffer_manager(std::move(write_buffer_manager)) {
+    if (_prefix_extractor) {
+        // One bit per 8 bytes of buffer: entries take a few dozen bytes each,
+        // so even a prefix per key gets several bits
+        _prefix_bloom = std::make_unique<DynamicBloom>(options.write_buffer_size / 8);
+    }
+}
+
+MemTable::~MemTable() {
+    if (_write_buffer_manager) {
+        _write_buffer_manager->FreeMem(_charged, !_immutable);
+    }
+}
+
+void MemTable::MarkImmutable() {
+    if (_write_buffer_manager && !_immutable) {
+        _write_buffer_manager->ScheduleFreeMem(_charged);
+    }
+    _immutable = true;
+}
+
+void MemTable::UpdateCharge() {
+    if (!_write_buffer_manager) return;
+    size_t usage = MemoryUsage();
+    if (usage > _charged) {
+        _write_buffer_manager->ReserveMem(usage - _charged);
+        _charged = usage;
+    }
 }
 
-bool MemTable::Get(const std::string& key, std::string* value) {
-    return _skiplist.Get(key, value);
+void MemTable::Put(const std::string& key, const std::string& value, uint64_t expire_at) {
+    AddPrefix(key);
+    _skiplist.Insert(key, value, false, expire_at, ++_seq);
+    UpdateCharge();
+}
+
+void MemTable::AddPrefix(const std::string& key) {
+    if (_prefix_bloom && _prefix_extractor->InDomain(key)) {
+        _prefix_bloom->Add(_prefix_extractor->Transform(key));
+    }
+}
+
+bool MemTable::PrefixMayMatch(const std::string& prefix) const {
+    return !_prefix_bloom || _prefix_bloom->MayContain(prefix);
+}
+
+int MemTable::Get(const std::string& key, std::string* value, uint64_t now_ms) {
+    bool is_deleted;
+    uint64_t expire_at;
+    uint64_t seq;
+    std::string found;
+    bool may_match = !_prefix_bloom || !_prefix_extractor->InDomain(key) ||
+                     _prefix_bloom->MayContain(_prefix_extractor->Transform(key));
+    if (!may_match || !_skiplist.Get(key, &found, &is_deleted, &expire_at, &seq)) {
+        // Not written here since; a range tombstone still hides older tables
+        return IsCovered(key, 0) ? 2 : 0;
+    }
+    if (is_deleted || IsExpired(expire_at, now_ms) || IsCovered(key, seq)) {
+        return 2;
+    }
+    *value = std::move(found);
+    return 1;
 }
 
 void MemTable::Delete(const std::string& key) {
-    _skiplist.Insert(key, "", true);
+    AddPrefix(key);
+    _skiplist.Insert(key, "", true, 0, ++_seq);
+    UpdateCharge();
+}
+
+void MemTable::DeleteRange(const RangeTombstone& tombstone) {
+    _range_tombstones.push_back(tombstone);
+    _fragments.Add(tombstone, ++_seq);
+    // Kept twice; a tombstone adds at most two fragments' worth of keys
+    _range_del_bytes += 2 * (sizeof(RangeTombstone) + tombstone.begin.size() + tombstone.end.size());
+    UpdateCharge();
+}
+
+bool MemTable::IsCovered(const std::string& key, uint64_t seq) const {
+    return _fragments.MaxCoveringSeq(key) > seq;
 }
 
-SkipList::Iterator* MemTable::NewIterator() const {
-    return _skiplist.NewIterator();
+InternalIterator* MemTable::NewIterator() const {
+    return new MemTableIterator(this);
 }
 
 } // namespace lsm
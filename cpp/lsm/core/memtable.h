@@ -1,23 +1,76 @@
 #pragma once
 #include <string>
+#include <vector>
+#include <memory>
+#include "iterator.h"
+#include "options.h"
+#include "range_tombstone.h"
 #include "util/skiplist.h"
+#include "util/bloom.h"
+#include "write_buffer_manager.h"
 
 namespace lsm {
 
 class MemTable {
 public:
-    MemTable();
-    void Put(const std::string& key, const std::string& value);
-    bool Get(const std::string& key, std::string* value);
+    // With a prefix_extractor, also keeps a Bloom filter of the key prefixes
+    // written, sized to the write buffer. With a write_buffer_manager, the
+    // memory used is charged to it until the memtable is destroyed.
+    explicit MemTable(const ColumnFamilyOptions& options,
+                      std::shared_ptr<WriteBufferManager> write_buffer_manager = nullptr);
+    ~MemTable();
+    // expire_at: Unix time in ms after which the entry reads as absent, 0 = never
+    void Put(const std::string& key, const std::string& value, uint64_t expire_at = 0);
+    // Returns: 0=NotFound, 1=Found, 2=Deleted or expired (shadows older SSTables)
+    int Get(const std::string& key, std::string* value, uint64_t now_ms);
     void Delete(const std::string& key);
+    // Hides the covered entries written to this memtable so far, and the
+    // covered keys of every older table. O(1): nothing is rewritten.
+    void DeleteRange(const RangeTombstone& tombstone);
 
-    // Returns a new iterator. The caller must delete it.
-    SkipList::Iterator* NewIterator() const;
+    // Iterates over the entries not hidden by this memtable's own range
+    // tombstones, which it reports in RangeTombstones(). The caller must delete it.
+    InternalIterator* NewIterator() const;
 
-    size_t MemoryUsage() const { return _skiplist.MemoryUsage(); }
+    // False if no key with this prefix (one produced by the prefix
+    // extractor) was written here. Range tombstones are not taken into account.
+    bool PrefixMayMatch(const std::string& prefix) const;
+
+    size_t MemoryUsage() const { return _skiplist.MemoryUsage() + _range_del_bytes; }
+    // No more writes: it was switched out to be flushed
+    void MarkImmutable();
+
+    const Comparator* comparator() const { return _comparator.get(); }
 
 private:
+    std::shared_ptr<const Comparator> _comparator;
     SkipList _skiplist;
+    uint64_t _seq = 0; // Orders entries against the range tombstones
+
+    std::vector<RangeTombstone> _range_tombstones; // As written, for flushes and iterators
+    FragmentedRangeTombstones _fragments; // The same with their _seq, for lookups
+    size_t _range_del_bytes = 0;
+
+    std::shared_ptr<const PrefixExtractor> _prefix_extractor;
+    std::unique_ptr<DynamicBloom> _prefix_bloom;
+
+    std::shared_ptr<WriteBufferManager> _write_buffer_manager;
+    size_t _charged = 0;
+    bool _immutable = false;
+
+    void AddPrefix(const std::string& key);
+    // Charges the growth since the last call to the write buffer manager
+    void UpdateCharge();
+
+    // True if a tombstone written after the entry with this seq covers key
+    bool IsCovered(const std::string& key, uint64_t seq) const;
+
+    friend class MemTableIterator;
 };
 
+// True if an entry with this deadline is no longer visible at now_ms
+inline bool IsExpired(uint64_t expire_at, uint64_t now_ms) {
+    return expire_at != 0 && expire_at <= now_ms;
+}
+
 } // namespace lsm
@@ -0,0 +1,161 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "comparator.h"
+#include "compaction_filter.h"
+#include "prefix_extractor.h"
+#include "row_cache.h"
+#include "write_buffer_manager.h"
+#include "util/env.h"
+
+namespace lsm {
+
+enum class CompactionStyle {
+    kLeveled,   // Levels of growing size, each one sorted run (low read and space amplification)
+    kUniversal, // Sorted runs of similar size are merged (low write amplification)
+};
+
+// Per-family tuning. Options derives from this, so the values set on Options
+// apply to the default column family.
+struct ColumnFamilyOptions {
+    // Key order of the family. A family that has data cannot be reopened
+    // with a comparator of another name.
+    std::shared_ptr<const Comparator> comparator = BytewiseComparator();
+
+    size_t write_buffer_size = 4 * 1024 * 1024; // MemTable size (per shard) that triggers a flush
+
+    // Leveled compaction: L0 is merged into L1 once it has this many files,
+    // and level N (N >= 1) is compacted into N+1 once it holds more than
+    // max_bytes_for_level_base * 10^(N-1) bytes.
+    int level0_file_num_compaction_trigger = 4;
+    uint64_t max_bytes_for_level_base = 10 * 1024 * 1024;
+    uint64_t target_file_size = 2 * 1024 * 1024; // Compaction output files are split at this size
+
+    // Write stalls, when flushes and compactions fall behind the writers.
+    // Once L0 holds level0_slowdown_writes_trigger files, or the estimated
+    // bytes compactions still have to rewrite reach
+    // soft_pending_compaction_bytes_limit, writes of every family are slowed
+    // down to Options::delayed_write_rate. At the stop triggers they wait
+    // until compactions get below them. L0 triggers below
+    // level0_file_num_compaction_trigger are raised to it; 0 = disabled.
+    int level0_slowdown_writes_trigger = 20;
+    int level0_stop_writes_trigger = 36;
+    uint64_t soft_pending_compaction_bytes_limit = 64ull * 1024 * 1024 * 1024;
+    uint64_t hard_pending_compaction_bytes_limit = 256ull * 1024 * 1024 * 1024;
+    // Flushes and compactions give each table a hash index of its keys, so a
+    // point lookup costs one hash and one key compare instead of a binary
+    // search, for 4-5 bytes per key. Tables written without one still work.
+    bool table_hash_index = false;
+    // Flushes and compactions give each table whose keys are spread evenly
+    // enough (fixed-width or numeric IDs) a learned index: a few linear
+    // segments predicting where a key is, so a lookup scans a small window
+    // instead of searching all keys. Other tables are written without one.
+    bool table_learned_index = false;
+
+    // Optional. Memtables and tables keep Bloom filters of the key prefixes
+    // it extracts (tables with prefix_bloom_bits_per_key bits per prefix),
+    // which DB::NewPrefixIterator uses to skip every source without keys of
+    // its prefix.
+    std::shared_ptr<const PrefixExtractor> prefix_extractor;
+    int prefix_bloom_bits_per_key = 10;
+
+    // Universal compaction treats every L0 file and every non-empty level as
+    // a sorted run, newest first, and starts once there are
+    // level0_file_num_compaction_trigger of them. In order of preference it
+    // - merges all runs once the newer ones hold
+    //   universal_max_size_amplification_percent of the oldest run's bytes,
+    // - merges consecutive runs, each at most universal_size_ratio percent
+    //   larger than the runs before it combined,
+    // - merges the newest runs down to universal_max_sorted_runs.
+    CompactionStyle compaction_style = CompactionStyle::kLeveled;
+    int universal_size_ratio = 1;
+    int universal_max_sorted_runs = 8;
+    int universal_max_size_amplification_percent = 200;
+
+    // Key-value separation: flushes and compactions write values of at least
+    // min_blob_size bytes to blob files and keep only a reference in the
+    // SSTable (0 = disabled). A compaction rewrites the live values of a blob
+    // file once blob_gc_garbage_ratio of its bytes are garbage.
+    uint64_t min_blob_size = 0;
+    double blob_gc_garbage_ratio = 0.5;
+
+    // Optional, applied by flushes and compactions of this family
+    std::shared_ptr<CompactionFilter> compaction_filter;
+};
+
+// DB-wide options. The ColumnFamilyOptions part configures the default family.
+struct Options : ColumnFamilyOptions {
+    bool sync = false; // true: fsync on every write, false: rely on background sync
+    // Number of independent MemTable+WAL pairs. Keys are hashed to a shard, so
+    // writers on different shards never contend. Each shard flushes on its own
+    // into the shared VersionSet.
+    int num_shards = 1;
+    // WALs whose memtables were flushed are moved to the archive directory
+    // instead of being deleted, and the oldest are deleted only once the
+    // archive holds more than this many bytes, so that DB::GetUpdatesSince
+    // can serve followers that fall behind by that much. 0 = no archive.
+    uint64_t wal_retention_size = 0;
+    // Where the DB keeps its files; null = the local file system. With
+    // NewMemEnv() the DB lives in memory only: a cache node or a benchmark
+    // that should not depend on the disk. Reopening the path with the same
+    // Env finds the DB again.
+    std::shared_ptr<Env> env;
+
+    // Background work runs on two thread pools. Flushes get their own, so a
+    // long compaction never delays the flush that writers may be waiting on.
+    int max_background_flushes = 1;
+    // Compactions are picked one at a time; the threads of this pool run
+    // the parallel subcompactions of each
+    int max_background_compactions = 2;
+    // A compaction is split into up to this many key ranges, compacted in
+    // parallel into separate output files (1 = no split)
+    int max_subcompactions = 1;
+    // Threads running GetAsync/PutAsync. However many requests are queued,
+    // no more threads than this block in the engine on their behalf.
+    int max_async_workers = 4;
+
+    // Memtable memory budget. write_buffer_size bounds each memtable; these
+    // bound all of them. A manager shared by several DBs caps the memtables
+    // of all of them together (see WriteBufferManager). Without one, a
+    // non-zero db_write_buffer_size gives this DB a budget of its own.
+    std::shared_ptr<WriteBufferManager> write_buffer_manager;
+    size_t db_write_buffer_size = 0;
+
+    // Caches point lookup results per table (see RowCache), for workloads
+    // that read a small set of hot keys over and over. A cache may be shared
+    // by several DBs; without one, a non-zero row_cache_size gives this DB a
+    // cache of its own, backed by a compressed tier of
+    // row_cache_compressed_size bytes if that is non-zero (see
+    // CompressedSecondaryCache). Off by default.
+    std::shared_ptr<RowCache> row_cache;
+    size_t row_cache_size = 0;
+    size_t row_cache_compressed_size = 0;
+
+    // Upper bound of the write rate while writes are slowed down (see
+    // level0_slowdown_writes_trigger). The rate starts at the measured flush
+    // throughput, if lower, and then drops by a fifth each time compactions
+    // fall further behind and grows by a quarter each time they catch up.
+    uint64_t delayed_write_rate = 16 * 1024 * 1024;
+};
+
+// Per-write options, taken by Put, Delete, PutWithExpiry and DeleteRange
+struct WriteOptions {
+    // fsync the WAL before returning, even if Options::sync is off
+    bool sync = false;
+    // Skip the WAL: faster, but the write is lost if the process dies before
+    // its memtable is flushed (closing the DB flushes it). Such writes take
+    // no sequence number, so GetUpdatesSince and followers never see them,
+    // and checkpoints only hold them once flushed. Cannot be combined with sync.
+    bool disable_wal = false;
+    // Yield to the other writes while compactions are behind: from the point
+    // a family has more L0 files than level0_file_num_compaction_trigger, or
+    // a quarter of soft_pending_compaction_bytes_limit of compaction debt,
+    // these writes are held to kLowPriWriteRate, before any other write is
+    // slowed down. For bulk refills that should not push the DB into a stall.
+    bool low_pri = false;
+
+    static constexpr uint64_t kLowPriWriteRate = 1024 * 1024; // Bytes/s
+};
+
+} // namespace lsm
@@ -0,0 +1,58 @@
+#include "prefix_extractor.h"
+
+namespace lsm {
+
+namespace {
+
+class FixedPrefixExtractor : public PrefixExtractor {
+public:
+    explicit FixedPrefixExtractor(size_t length) : _length(length) {}
+
+    bool InDomain(const std::string& key) const override { return key.size() >= _length; }
+    std::string Transform(const std::string& key) const override { return key.substr(0, _length); }
+    std::string Name() const override { return "lsm.FixedPrefix." + std::to_string(_length); }
+
+private:
+    size_t _length;
+};
+
+class DelimitedPrefixExtractor : public PrefixExtractor {
+public:
+    DelimitedPrefixExtractor(char delimiter, int count) : _delimiter(delimiter), _count(count) {}
+
+    bool InDomain(const std::string& key) const override { return PrefixLength(key) > 0; }
+    std::string Transform(const std::string& key) const override {
+        return key.substr(0, PrefixLength(key));
+    }
+    std::string Name() const override {
+        return "lsm.DelimitedPrefix." + std::to_string(static_cast<unsigned char>(_delimiter)) +
+               "." + std::to_string(_count);
+    }
+
+private:
+    char _delimiter;
+    int _count;
+
+    // 0 if key has fewer than _count delimiters
+    size_t PrefixLength(const std::string& key) const {
+        size_t pos = 0;
+        for (int i = 0; i < _count; ++i) {
+            pos = key.find(_delimiter, pos);
+            if (pos == std::string::npos) return 0;
+            pos++;
+        }
+        return pos;
+    }
+};
+
+} // namespace
+
+std::shared_ptr<const PrefixExtractor> NewFixedPrefixExtractor(size_t length) {
+    return std::make_shared<FixedPrefixExtractor>(length);
+}
+
+std::shared_ptr<const PrefixExtractor> NewDelimitedPrefixExtractor(char delimiter, int count) {
+    return std::make_shared<DelimitedPrefixExtractor>(delimiter, count < 1 ? 1 : count);
+}
+
+} // namespace lsm
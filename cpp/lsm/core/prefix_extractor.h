@@ -0,0 +1,43 @@
+#pragma once
+#include <string>
+#include <memory>
+
+namespace lsm {
+
+// Maps keys to the prefix they are grouped by, e.g. "group:tenant:" of
+// "group:tenant:item". Flushes and compactions record the prefixes of each
+// table in a Bloom filter, and memtables keep one as well, so a prefix
+// iterator (DB::NewPrefixIterator) only visits the sources that may hold
+// its prefix.
+//
+// Tables remember the Name() of the extractor they were built with; their
+// filters are ignored once it changes. Must be thread-safe.
+class PrefixExtractor {
+public:
+    virtual ~PrefixExtractor() = default;
+
+    // False for keys that have no prefix (they are left out of the filters)
+    virtual bool InDomain(const std::string& key) const = 0;
+    // REQUIRES: InDomain(key)
+    virtual std::string Transform(const std::string& key) const = 0;
+    // Identifies the extractor and its parameters
+    virtual std::string Name() const = 0;
+};
+
+// The first length bytes; shorter keys are out of the domain
+std::shared_ptr<const PrefixExtractor> NewFixedPrefixExtractor(size_t length);
+// Everything up to and including the count-th delimiter, e.g. "group:tenant:"
+// for delimiter ':' and count 2. Keys with fewer delimiters are out of the domain.
+std::shared_ptr<const PrefixExtractor> NewDelimitedPrefixExtractor(char delimiter, int count = 1);
+
+// True if key starts with prefix
+inline bool HasPrefix(const std::string& key, const std::string& prefix) {
+    return key.compare(0, prefix.size(), prefix) == 0;
+}
+
+// True if key sorts before some key starting with prefix, or starts with it
+inline bool SortsBeforePrefixEnd(const std::string& key, const std::string& prefix) {
+    return key.compare(0, prefix.size(), prefix) <= 0;
+}
+
+} // namespace lsm
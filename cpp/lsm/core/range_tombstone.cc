@@ -0,0 +1,83 @@
+#include "range_tombstone.h"
+#include <algorithm>
+
+namespace lsm {
+
+void FragmentedRangeTombstones::Add(const RangeTombstone& tombstone, uint64_t seq) {
+    const Comparator* cmp = _comparator;
+    if (cmp->Compare(tombstone.begin, tombstone.end) >= 0) return;
+
+    uint32_t num_shards = std::max<uint32_t>(tombstone.num_shards, 1);
+    uint32_t shard = num_shards > 1 ? tombstone.shard : 0;
+    auto layout = std::find_if(_layouts.begin(), _layouts.end(), [&](const Layout& l) {
+        return l.shard == shard && l.num_shards == num_shards;
+    });
+    if (layout == _layouts.end()) {
+        _layouts.push_back({shard, num_shards, {}});
+        layout = _layouts.end() - 1;
+    }
+
+    // Rebuilt in one pass: fragments outside [begin, end) are kept, those
+    // overlapping it are split at its bounds, and the gaps between them
+    // inside it become fragments of their own
+    const std::string& end = tombstone.end;
+    std::vector<Fragment> result;
+    result.reserve(layout->fragments.size() + 2);
+    std::string cursor = tombstone.begin; // Start of the part of the range not yet emitted
+    bool done = false;
+    for (Fragment& f : layout->fragments) {
+        if (done || cmp->Compare(f.end, cursor) <= 0) {
+            result.push_back(std::move(f));
+            continue;
+        }
+        if (cmp->Compare(end, f.begin) <= 0) {
+            result.push_back({cursor, end, seq});
+            result.push_back(std::move(f));
+            done = true;
+            continue;
+        }
+        if (cmp->Compare(cursor, f.begin) < 0) {
+            result.push_back({cursor, f.begin, seq});
+            cursor = f.begin;
+        } else if (cmp->Compare(f.begin, cursor) < 0) {
+            result.push_back({f.begin, cursor, f.seq});
+        }
+        if (cmp->Compare(end, f.end) < 0) {
+            result.push_back({cursor, end, std::max(seq, f.seq)});
+            result.push_back({end, std::move(f.end), f.seq});
+            done = true;
+        } else {
+            result.push_back({cursor, f.end, std::max(seq, f.seq)});
+            cursor = std::move(f.end);
+            done = cmp->Compare(cursor, end) >= 0;
+        }
+    }
+    if (!done) result.push_back({cursor, end, seq});
+    layout->fragments = std::move(result);
+}
+
+uint64_t FragmentedRangeTombstones::MaxCoveringSeq(const std::string& key) const {
+    uint64_t result = 0;
+    bool hashed = false;
+    uint32_t hash = 0;
+    for (const Layout& layout : _layouts) {
+        if (layout.num_shards > 1) {
+            if (!hashed) {
+                hash = Hash(key);
+                hashed = true;
+            }
+            if (hash % layout.num_shards != layout.shard) continue;
+        }
+        // The last fragment beginning at or before key
+        auto it = std::upper_bound(layout.fragments.begin(), layout.fragments.end(), key,
+                                   [this](const std::string& k, const Fragment& f) {
+                                       return _comparator->Compare(k, f.begin) < 0;
+                                   });
+        if (it == layout.fragments.begin()) continue;
+        --it;
+        if (_comparator->Compare(key, it->end) < 0) result = std::max(result, it->seq);
+    }
+    return result;
+}
+
+} // namespace lsm
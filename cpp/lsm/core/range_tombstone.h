@@ -0,0 +1,60 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "util/hash.h"
+#include "comparator.h"
+
+namespace lsm {
+
+// Deletes every key in [begin, end) held by older sources (an older memtable
+// entry or table). A table's own entries are never covered by its own
+// tombstones: they are always newer.
+//
+// A DeleteRange is recorded once per write shard, and each copy only covers
+// the keys of the shard that wrote it. Shards flush independently into the
+// same levels, so a copy flushed late must not hide a key that another shard
+// rewrote and flushed earlier.
+struct RangeTombstone {
+    std::string begin;
+    std::string end;
+    uint32_t shard = 0;
+    uint32_t num_shards = 1; // Shard layout at write time; 1 = covers every key
+
+    // begin and end are in the order of comparator, the family's
+    bool Covers(const std::string& key, const Comparator* comparator) const {
+        if (comparator->Compare(key, begin) < 0 || comparator->Compare(key, end) >= 0) return false;
+        return num_shards <= 1 || Hash(key) % num_shards == shard;
+    }
+};
+
+// The range tombstones of a memtable or table, indexed for lookups. Per
+// shard layout they are cut into non-overlapping fragments sorted by begin,
+// each with the largest seq of the tombstones over it, so a lookup is a
+// binary search per layout and hashes the key at most once.
+class FragmentedRangeTombstones {
+public:
+    explicit FragmentedRangeTombstones(const Comparator* comparator) : _comparator(comparator) {}
+
+    // Linear in the fragments of the tombstone's layout. Empty ranges are ignored.
+    void Add(const RangeTombstone& tombstone, uint64_t seq);
+    // The largest seq of the tombstones covering key, 0 if none does
+    uint64_t MaxCoveringSeq(const std::string& key) const;
+
+private:
+    struct Fragment {
+        std::string begin;
+        std::string end;
+        uint64_t seq;
+    };
+    struct Layout {
+        uint32_t shard;
+        uint32_t num_shards; // 1: covers every key
+        std::vector<Fragment> fragments;
+    };
+
+    const Comparator* _comparator;
+    std::vector<Layout> _layouts; // Rarely more than one
+};
+
+} // namespace lsm
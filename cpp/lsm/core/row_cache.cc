@@ -0,0 +1,90 @@
+#include "row_cache.h"
+#include <cstring>
+#include <vector>
+#include "util/hash.h"
+
+namespace lsm {
+
+RowCache::RowCache(size_t capacity, std::shared_ptr<CompressedSecondaryCache> secondary)
+    : _capacity(capacity), _secondary(std::move(secondary)) {
+    // Each shard gets an even part of the capacity
+    for (auto& shard : _shards) shard.lru.set_capacity(capacity / kNumShards);
+}
+
+std::string RowCache::CacheKey(uint64_t id, int file_number, const std::string& key) {
+    std::string cache_key(sizeof(id) + sizeof(file_number), '\0');
+    memcpy(&cache_key[0], &id, sizeof(id));
+    memcpy(&cache_key[sizeof(id)], &file_number, sizeof(file_number));
+    cache_key.append(key);
+    return cache_key;
+}
+
+std::string RowCache::EncodeRow(const Row& row) {
+    std::string encoded(1 + sizeof(row.expire_at), '\0');
+    encoded[0] = row.deleted ? 1 : 0;
+    memcpy(&encoded[1], &row.expire_at, sizeof(row.expire_at));
+    encoded.append(row.value);
+    return encoded;
+}
+
+bool RowCache::DecodeRow(const std::string& encoded, Row* row) {
+    if (encoded.size() < 1 + sizeof(row->expire_at)) return false;
+    row->deleted = encoded[0] != 0;
+    memcpy(&row->expire_at, &encoded[1], sizeof(row->expire_at));
+    row->value = encoded.substr(1 + sizeof(row->expire_at));
+    return true;
+}
+
+RowCache::Shard& RowCache::ShardOf(const std::string& cache_key) {
+    return _shards[Hash(cache_key) % kNumShards];
+}
+
+bool RowCache::Lookup(uint64_t id, int file_number, const std::string& key, Row* row) {
+    std::string cache_key = CacheKey(id, file_number, key);
+    {
+        Shard& shard = ShardOf(cache_key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (Entry* entry = shard.lru.Lookup(cache_key)) {
+            entry->read = true;
+            *row = entry->row;
+            _hits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    _misses.fetch_add(1, std::memory_order_relaxed);
+
+    std::string encoded;
+    if (!_secondary || !_secondary->Lookup(cache_key, &encoded) || !DecodeRow(encoded, row)) return false;
+    Entry entry;
+    entry.row = *row;
+    entry.read = true;
+    Insert(cache_key, std::move(entry));
+    return true;
+}
+
+void RowCache::Insert(uint64_t id, int file_number, const std::string& key, const Row& row) {
+    Entry entry;
+    entry.row = row;
+    Insert(CacheKey(id, file_number, key), std::move(entry));
+}
+
+void RowCache::Insert(const std::string& cache_key, Entry entry) {
+    size_t charge = cache_key.size() + entry.row.value.size() + kRowOverhead;
+    std::vector<LRUCache<Entry>::Entry> evicted;
+    {
+        Shard& shard = ShardOf(cache_key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        size_t before = shard.lru.usage();
+        shard.lru.Insert(cache_key, std::move(entry), charge, &evicted);
+        size_t after = shard.lru.usage();
+        _usage.fetch_add(after, std::memory_order_relaxed);
+        _usage.fetch_sub(before, std::memory_order_relaxed);
+    }
+    // Compressed outside the shard lock
+    if (!_secondary) return;
+    for (const auto& e : evicted) {
+        _secondary->Insert(e.first, EncodeRow(e.second.row), e.second.read);
+    }
+}
+
+} // namespace lsm
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "compressed_secondary_cache.h"
+#include "util/lru_cache.h"
+
+namespace lsm {
+
+// Results of point lookups in tables, keyed by (table, key): the value the
+// newest entry of the key in that table resolves to (blob values included),
+// or that it is a deletion. Sits in front of the entry read of Version::Get,
+// so a hit costs the in-memory index search only.
+//
+// Table files are immutable and their numbers never reused, so entries never
+// go stale: those of deleted tables just age out. LRU, bounded by capacity
+// bytes, and may be shared by several DBs (Options::row_cache). Rows it
+// evicts may be kept compressed by a secondary tier. Thread-safe.
+class RowCache {
+public:
+    explicit RowCache(size_t capacity, std::shared_ptr<CompressedSecondaryCache> secondary = nullptr);
+
+    struct Row {
+        bool deleted = false;
+        std::string value;
+        uint64_t expire_at = 0;
+    };
+
+    // Namespace for the tables of one VersionSet, whose numbers may clash
+    // with those of other families and DBs
+    uint64_t NewId() { return _next_id.fetch_add(1, std::memory_order_relaxed); }
+
+    // Falls back to the secondary tier, moving a row found there back here
+    bool Lookup(uint64_t id, int file_number, const std::string& key, Row* row);
+    void Insert(uint64_t id, int file_number, const std::string& key, const Row& row);
+
+    size_t capacity() const { return _capacity; }
+    // Bytes of the cached keys and values, plus a fixed overhead per row
+    size_t usage() const { return _usage.load(std::memory_order_relaxed); }
+    // Of this tier only; see secondary() for the other
+    uint64_t hits() const { return _hits.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return _misses.load(std::memory_order_relaxed); }
+    CompressedSecondaryCache* secondary() const { return _secondary.get(); } // May be null
+
+    static constexpr size_t kRowOverhead = 64;
+
+private:
+    static constexpr int kNumShards = 16;
+
+    struct Entry {
+        Row row;
+        bool read = false; // Looked up since it was inserted
+    };
+
+    // An independent LRU over a slice of the keys, so that readers of
+    // different keys rarely contend
+    struct Shard {
+        std::mutex mutex;
+        LRUCache<Entry> lru;
+    };
+
+    static std::string CacheKey(uint64_t id, int file_number, const std::string& key);
+    // Rows as the secondary tier stores them: deleted(1) expire_at(8) value
+    static std::string EncodeRow(const Row& row);
+    static bool DecodeRow(const std::string& encoded, Row* row);
+    Shard& ShardOf(const std::string& cache_key);
+    void Insert(const std::string& cache_key, Entry entry);
+
+    const size_t _capacity;
+    std::shared_ptr<CompressedSecondaryCache> _secondary;
+    Shard _shards[kNumShards];
+    std::atomic<uint64_t> _next_id{1};
+    std::atomic<size_t> _usage{0};
+    std::atomic<uint64_t> _hits{0};
+    std::atomic<uint64_t> _misses{0};
+};
+
+} // namespace lsm
@@ -0,0 +1,30 @@
+#include "sst_file_writer.h"
+
+namespace lsm {
+
+SstFileWriter::SstFileWriter(const std::string& file_path, const ColumnFamilyOptions& options)
+    : _builder(file_path, options), _comparator(options.comparator) {}
+
+bool SstFileWriter::Put(const std::string& key, const std::string& value) {
+    return Add(key, value, false);
+}
+
+bool SstFileWriter::Delete(const std::string& key) {
+    return Add(key, "", true);
+}
+
+bool SstFileWriter::Add(const std::string& key, const std::string& value, bool is_deleted) {
+    if (!ok()) return false;
+    if (_builder.NumEntries() > 0 && _comparator->Compare(key, _last_key) <= 0) return false;
+    _builder.Add(key, value, is_deleted);
+    _last_key = key;
+    return true;
+}
+
+bool SstFileWriter::Finish() {
+    if (!ok() || _builder.NumEntries() == 0) return false;
+    _finished = true;
+    return _builder.Finish();
+}
+
+} // namespace lsm
@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include "table_builder.h"
+
+namespace lsm {
+
+// Builds an SSTable outside of any DB, to be linked into one with
+// DB::IngestExternalFile. Bulk loads this way skip the WAL, the memtable and
+// the flush. Keys must be added in strictly increasing order of the
+// family's comparator.
+class SstFileWriter {
+public:
+    // options: those of the target family, for its comparator, hash index
+    // and prefix filter
+    explicit SstFileWriter(const std::string& file_path,
+                           const ColumnFamilyOptions& options = ColumnFamilyOptions());
+
+    bool ok() const { return _builder.ok() && !_finished; }
+    // Both return false, and add nothing, if key does not sort after the
+    // previously added key
+    bool Put(const std::string& key, const std::string& value);
+    // The key reads as deleted once ingested, hiding older versions in the DB
+    bool Delete(const std::string& key);
+    // Writes the index. Returns false if nothing was added or the file failed.
+    bool Finish();
+
+    uint64_t NumEntries() const { return _builder.NumEntries(); }
+    uint64_t FileSize() const { return _builder.FileSize(); }
+
+private:
+    bool Add(const std::string& key, const std::string& value, bool is_deleted);
+
+    TableBuilder _builder;
+    std::shared_ptr<const Comparator> _comparator;
+    std::string _last_key;
+    bool _finished = false;
+};
+
+} // namespace lsm
@@ -1,155 +1,397 @@
 #include "table.h"
 #include <iostream>
 #include <algorithm>
+#include <cstring>
+#include "table_builder.h"
+#include "core/memtable.h"
+#include "util/bloom.h"
 
 namespace lsm {
 
-std::shared_ptr<Table> Table::Open(const std::string& file_path) {
-    auto table = std::shared_ptr<Table>(new Table(file_path));
+std::shared_ptr<Table> Table::Open(const std::string& file_path, const Comparator* comparator, Env* env) {
+    auto table = std::shared_ptr<Table>(new Table(file_path, comparator, env));
     if (table->LoadIndex()) {
         return table;
     }
     return nullptr;
 }
 
-Table::Table(const std::string& file_path) : _file_path(file_path) {
-    _file.open(file_path, std::ios::binary | std::ios::ate);
-    _file_size = _file.tellg();
+Table::Table(const std::string& file_path, const Comparator* comparator, Env* env)
+    : _file_path(file_path), _comparator(comparator), _file(env->NewRandomAccessFile(file_path)),
+      _index(comparator), _fragments(comparator) {
+    if (_file) _fd = _file->fd();
+}
+
+Table::~Table() = default;
+
+void Table::SetFile(ReadRequest* req) const {
+    req->fd = _fd;
+    req->file = _file.get();
 }
 
 bool Table::LoadIndex() {
-    if (!_file.is_open() || _file_size < 8) return false;
+    // The metadata is read once, sequentially
+    if (!_file) return false;
+    InputFileStream file(_file.get());
+    _file_size = _file->Size();
+    if (_file_size < 8) return false;
 
     // Read Footer
-    _file.seekg(_file_size - 8);
-    _file.read(reinterpret_cast<char*>(&_index_offset), 8);
+    file.seekg(_file_size - 8);
+    file.read(reinterpret_cast<char*>(&_index_offset), 8);
 
     if (_index_offset >= _file_size) return false;
 
     // Read Index
-    _file.seekg(_index_offset);
+    file.seekg(_index_offset);
     uint32_t index_size;
-    _file.read(reinterpret_cast<char*>(&index_size), sizeof(index_size));
+    file.read(reinterpret_cast<char*>(&index_size), sizeof(index_size));
 
     for (uint32_t i = 0; i < index_size; ++i) {
         uint32_t klen;
-        _file.read(reinterpret_cast<char*>(&klen), sizeof(klen));
+        file.read(reinterpret_cast<char*>(&klen), sizeof(klen));
         std::string key(klen, '\0');
-        _file.read(&key[0], klen);
+        file.read(&key[0], klen);
         uint64_t offset;
-        _file.read(reinterpret_cast<char*>(&offset), sizeof(offset));
+        file.read(reinterpret_cast<char*>(&offset), sizeof(offset));
         
-        _index.push_back({key, offset});
+        // Get and Seek binary search the index, and entry sizes follow from the offsets
+        if (!_index.empty()) {
+            size_t last = _index.size() - 1;
+            if (_comparator->Compare(key, _index.Key(last)) <= 0 || offset <= _index.Offset(last)) return false;
+        }
+        if (offset >= _index_offset) return false;
+        _index.Add(key, offset);
+    }
+    if (!file) return false;
+
+    // Optional range deletion block between the index and the footer
+    if (static_cast<uint64_t>(file.tellg()) + 8 < _file_size) {
+        uint32_t count;
+        file.read(reinterpret_cast<char*>(&count), sizeof(count));
+        for (uint32_t i = 0; i < count && file; ++i) {
+            RangeTombstone t;
+            uint32_t len;
+            file.read(reinterpret_cast<char*>(&len), sizeof(len));
+            t.begin.resize(len);
+            file.read(&t.begin[0], len);
+            file.read(reinterpret_cast<char*>(&len), sizeof(len));
+            t.end.resize(len);
+            file.read(&t.end[0], len);
+            file.read(reinterpret_cast<char*>(&t.shard), sizeof(t.shard));
+            file.read(reinterpret_cast<char*>(&t.num_shards), sizeof(t.num_shards));
+            _fragments.Add(t, 1);
+            _range_tombstones.push_back(std::move(t));
+        }
+        if (!file) return false;
     }
+
+    // Optional hash index after that
+    if (static_cast<uint64_t>(file.tellg()) + 8 < _file_size) {
+        uint32_t num_buckets;
+        file.read(reinterpret_cast<char*>(&num_buckets), sizeof(num_buckets));
+        if (!file ||
+            static_cast<uint64_t>(file.tellg()) + uint64_t(num_buckets) * sizeof(uint32_t) + 8 > _file_size) {
+            return false;
+        }
+        _hash_buckets.resize(num_buckets);
+        file.read(reinterpret_cast<char*>(_hash_buckets.data()), num_buckets * sizeof(uint32_t));
+        if (!file) return false;
+        for (uint32_t bucket : _hash_buckets) {
+            if (bucket < kHashBucketCollision && bucket >= _index.size()) return false;
+        }
+    }
+
+    // Optional prefix filter after that
+    if (static_cast<uint64_t>(file.tellg()) + 8 < _file_size) {
+        uint32_t len;
+        file.read(reinterpret_cast<char*>(&len), sizeof(len));
+        if (!file || static_cast<uint64_t>(file.tellg()) + len + 8 > _file_size) return false;
+        _prefix_extractor_name.resize(len);
+        file.read(&_prefix_extractor_name[0], len);
+        file.read(reinterpret_cast<char*>(&len), sizeof(len));
+        if (!file || static_cast<uint64_t>(file.tellg()) + len + 8 > _file_size) return false;
+        _prefix_filter.resize(len);
+        file.read(&_prefix_filter[0], len);
+        if (!file) return false;
+    }
+
+    // Optional learned index after that
+    if (static_cast<uint64_t>(file.tellg()) + 8 < _file_size) {
+        uint32_t max_error;
+        uint32_t count;
+        file.read(reinterpret_cast<char*>(&max_error), sizeof(max_error));
+        file.read(reinterpret_cast<char*>(&count), sizeof(count));
+        if (!file || static_cast<uint64_t>(file.tellg()) + uint64_t(count) * 20 + 8 > _file_size) return false;
+        std::vector<IndexSegment> segments(count);
+        for (auto& segment : segments) {
+            file.read(reinterpret_cast<char*>(&segment.first_bits), sizeof(segment.first_bits));
+            file.read(reinterpret_cast<char*>(&segment.first_pos), sizeof(segment.first_pos));
+            file.read(reinterpret_cast<char*>(&segment.slope), sizeof(segment.slope));
+        }
+        if (!file || (count > 0 && !_index.SetSegments(std::move(segments), max_error))) return false;
+    }
+
+    // Optional comparator name after that; tables without one are bytewise
+    std::string comparator_name = BytewiseComparator()->Name();
+    if (static_cast<uint64_t>(file.tellg()) + 8 < _file_size) {
+        uint32_t len;
+        file.read(reinterpret_cast<char*>(&len), sizeof(len));
+        if (!file || static_cast<uint64_t>(file.tellg()) + len + 8 > _file_size) return false;
+        comparator_name.resize(len);
+        file.read(&comparator_name[0], len);
+        if (!file) return false;
+    }
+    if (comparator_name != _comparator->Name()) {
+        std::cerr << _file_path << " was written with comparator " << comparator_name << ", not "
+                  << _comparator->Name() << std::endl;
+        return false;
+    }
+
+    // The learned index, if any, replaces the Eytzinger copy
+    _index.Finish(_index.size() >= TableIndex::kEytzingerMinEntries);
     return true;
 }
 
-int Table::Get(const std::string& key, std::string* value) {
-    // Binary search in index
-    auto it = std::lower_bound(_index.begin(), _index.end(), key, 
-        [](const IndexEntry& entry, const std::string& k) {
-            return entry.key < k;
-        });
+size_t Table::FindInIndex(const std::string& key) const {
+    uint32_t bucket = kHashBucketCollision;
+    if (!_hash_buckets.empty()) {
+        bucket = _hash_buckets[HashIndexBucket(key, _hash_buckets.size())];
+    }
+    if (bucket != kHashBucketCollision) {
+        // The only key in the table with this hash, if any
+        if (bucket != kHashBucketEmpty && _index.Key(bucket) == key) return bucket;
+        return _index.size();
+    }
+    return _index.Find(key);
+}
+
+Table::EntryHandle Table::HandleAt(size_t pos) const {
+    uint64_t end = pos + 1 < _index.size() ? _index.Offset(pos + 1) : _index_offset;
+    return {_index.Offset(pos), end - _index.Offset(pos)};
+}
 
-    if (it != _index.end() && it->key == key) {
+int Table::Find(const std::string& key, EntryHandle* handle) const {
+    size_t pos = FindInIndex(key);
+    if (pos < _index.size()) {
         // Found exact match in index (since we index every key in this simple version)
-        // Read from file
-        _file.seekg(it->offset);
-        
-        uint32_t klen, vlen;
-        uint8_t type;
-        
-        _file.read(reinterpret_cast<char*>(&klen), sizeof(klen));
-        _file.seekg(klen, std::ios::cur); // Skip key
-        
-        _file.read(reinterpret_cast<char*>(&vlen), sizeof(vlen));
-        std::string val(vlen, '\0');
-        _file.read(&val[0], vlen);
-        
-        _file.read(reinterpret_cast<char*>(&type), sizeof(type));
-        
-        if (type == 1) return 2; // Deleted
-        *value = val;
-        return 1; // Found
+        *handle = HandleAt(pos);
+        return 1;
     }
-    
+
+    // Entries of this table are newer than its own tombstones, so those
+    // only matter once the key was not found here
+    if (_fragments.MaxCoveringSeq(key) > 0) return 2;
     return 0; // Not found
 }
 
+void Table::PrepareRead(const EntryHandle& handle, ReadRequest* req) const {
+    SetFile(req);
+    req->offset = handle.offset;
+    req->len = handle.size;
+}
+
+namespace {
+
+// One entry as laid out by TableBuilder
+struct ParsedEntry {
+    std::string key;
+    std::string value;
+    uint8_t type;
+    uint64_t expire_at = 0;
+};
+
+bool ParseEntry(const char* data, size_t size, ParsedEntry* entry) {
+    const char* limit = data + size;
+    uint32_t klen, vlen;
+    if (limit - data < 4) return false;
+    memcpy(&klen, data, 4);
+    data += 4;
+    if (static_cast<size_t>(limit - data) < uint64_t(klen) + 4) return false;
+    entry->key.assign(data, klen);
+    data += klen;
+    memcpy(&vlen, data, 4);
+    data += 4;
+    if (static_cast<size_t>(limit - data) < uint64_t(vlen) + 1) return false;
+    entry->value.assign(data, vlen);
+    data += vlen;
+    entry->type = static_cast<uint8_t>(*data++);
+    entry->expire_at = 0;
+    if (entry->type == kEntryValueWithExpiry || entry->type == kEntryBlobIndexWithExpiry) {
+        if (limit - data < 8) return false;
+        memcpy(&entry->expire_at, data, 8);
+    }
+    return true;
+}
+
+} // namespace
+
+int Table::DecodeEntry(const ReadRequest& req, uint64_t now_ms, std::string* value, bool* is_blob_index,
+                       uint64_t* expire_at) {
+    ParsedEntry entry;
+    if (req.error != 0 || !ParseEntry(req.data.data(), req.data.size(), &entry)) {
+        std::cerr << "Failed to read a table entry at offset " << req.offset << std::endl;
+        return 0;
+    }
+    if (entry.type == kEntryDeletion) return 2; // Deleted
+    if (IsExpired(entry.expire_at, now_ms)) return 2; // Expired
+    *value = std::move(entry.value);
+    *is_blob_index = (entry.type == kEntryBlobIndex || entry.type == kEntryBlobIndexWithExpiry);
+    if (expire_at) *expire_at = entry.expire_at;
+    return 1; // Found
+}
+
+int Table::Get(const std::string& key, std::string* value, uint64_t now_ms, bool* is_blob_index) {
+    EntryHandle handle;
+    int result = Find(key, &handle);
+    if (result != 1) return result;
+    ReadRequest req;
+    PrepareRead(handle, &req);
+    ReadFully(&req);
+    return DecodeEntry(req, now_ms, value, is_blob_index);
+}
+
+bool Table::KeyRange(std::string* smallest, std::string* largest) const {
+    bool empty = true;
+    auto extend = [&](const std::string& lo, const std::string& hi) {
+        if (empty || _comparator->Compare(lo, *smallest) < 0) *smallest = lo;
+        if (empty || _comparator->Compare(hi, *largest) > 0) *largest = hi;
+        empty = false;
+    };
+    if (!_index.empty()) extend(std::string(_index.Key(0)), std::string(_index.Key(_index.size() - 1)));
+    for (const auto& t : _range_tombstones) extend(t.begin, t.end);
+    return !empty;
+}
+
+bool Table::PrefixMayMatch(const PrefixExtractor& extractor, const std::string& prefix) const {
+    // Only asked for families in bytewise order (see DB::NewPrefixIterator)
+    // Keys starting with prefix lie in [prefix, end of prefix); a tombstone
+    // covering one of them hides older tables' entries and must be seen
+    for (const auto& t : _range_tombstones) {
+        if (t.end > prefix && SortsBeforePrefixEnd(t.begin, prefix)) return true;
+    }
+    if (_index.empty() || _index.Key(_index.size() - 1) < prefix ||
+        !SortsBeforePrefixEnd(std::string(_index.Key(0)), prefix)) {
+        return false;
+    }
+    if (_prefix_filter.empty() || _prefix_extractor_name != extractor.Name()) return true;
+    return BloomFilterMayMatch(_prefix_filter, prefix);
+}
+
 Table::Iterator* Table::NewIterator() {
     return new Iterator(this);
 }
 
 // Iterator Implementation
-Table::Iterator::Iterator(Table* table) : _table(table), _current_offset(0), _valid(false) {}
+namespace {
+
+const size_t kInitialReadahead = 16 * 1024;
+const size_t kMaxReadahead = 256 * 1024;
+
+} // namespace
+
+Table::Iterator::Iterator(Table* table)
+    : _table(table), _pos(0), _valid(false), _readahead(kInitialReadahead) {}
+
+Table::Iterator::~Iterator() {
+    CancelPrefetch();
+}
 
 bool Table::Iterator::Valid() const {
     return _valid;
 }
 
 void Table::Iterator::SeekToFirst() {
-    _current_offset = 0;
-    if (_table->_index_offset > 0) {
-        ParseCurrent();
-    } else {
-        _valid = false;
-    }
+    _pos = 0;
+    ParseCurrent();
 }
 
 void Table::Iterator::Seek(const std::string& target) {
-    auto it = std::lower_bound(_table->_index.begin(), _table->_index.end(), target, 
-        [](const IndexEntry& entry, const std::string& k) {
-            return entry.key < k;
-        });
-
-    if (it != _table->_index.end()) {
-        _current_offset = it->offset;
-        ParseCurrent();
-    } else {
-        _valid = false;
-    }
+    _pos = _table->_index.LowerBound(target);
+    ParseCurrent();
 }
 
 void Table::Iterator::Next() {
     if (!_valid) return;
-    // Move offset past current entry
-    // Current entry size: 4 + klen + 4 + vlen + 1
-    uint32_t klen = _key.size();
-    uint32_t vlen = _value.size();
-    _current_offset += 4 + klen + 4 + vlen + 1;
-    
-    if (_current_offset >= _table->_index_offset) {
-        _valid = false;
-    } else {
-        ParseCurrent();
-    }
+    _pos++;
+    ParseCurrent();
 }
 
 void Table::Iterator::ParseCurrent() {
-    if (_current_offset >= _table->_index_offset) {
-        _valid = false;
+    _valid = false;
+    if (_pos >= _table->_index.size()) return;
+
+    EntryHandle handle = _table->HandleAt(_pos);
+    if (!Load(handle.offset, handle.size)) return;
+    ParsedEntry entry;
+    if (!ParseEntry(_buffer.data() + (handle.offset - _buffer_offset), handle.size, &entry)) {
+        std::cerr << "Corrupt entry in " << _table->_file_path << " at offset " << handle.offset << std::endl;
         return;
     }
-    
-    _table->_file.seekg(_current_offset);
-    
-    uint32_t klen;
-    _table->_file.read(reinterpret_cast<char*>(&klen), sizeof(klen));
-    _key.resize(klen);
-    _table->_file.read(&_key[0], klen);
-    
-    uint32_t vlen;
-    _table->_file.read(reinterpret_cast<char*>(&vlen), sizeof(vlen));
-    _value.resize(vlen);
-    _table->_file.read(&_value[0], vlen);
-    
-    uint8_t type;
-    _table->_file.read(reinterpret_cast<char*>(&type), sizeof(type));
-    _is_deleted = (type == 1);
-    
+    _key = std::move(entry.key);
+    _value = std::move(entry.value);
+    _is_deleted = (entry.type == kEntryDeletion);
+    _is_blob_index = (entry.type == kEntryBlobIndex || entry.type == kEntryBlobIndexWithExpiry);
+    _expire_at = entry.expire_at;
     _valid = true;
 }
 
+bool Table::Iterator::Load(uint64_t offset, uint64_t size) {
+    uint64_t buffer_end = _buffer_offset + _buffer.size();
+    if (offset >= _buffer_offset && offset + size <= buffer_end) return true;
+
+    if (offset >= _buffer_offset && offset <= buffer_end && _prefetch && _prefetch->offset == buffer_end) {
+        // Reading on sequentially: keep the unread tail and append the prefetched chunk
+        AsyncIO::Default()->Wait(_prefetch.get());
+        std::unique_ptr<ReadRequest> chunk = std::move(_prefetch);
+        _buffer.erase(0, offset - _buffer_offset);
+        _buffer_offset = offset;
+        if (chunk->error == 0) _buffer.append(chunk->data);
+        _readahead = std::min(_readahead * 2, kMaxReadahead);
+    } else {
+        // A jump, e.g. a Seek: drop everything
+        CancelPrefetch();
+        _buffer.clear();
+        _buffer_offset = offset;
+        _readahead = kInitialReadahead;
+    }
+
+    if (_buffer_offset + _buffer.size() < offset + size) {
+        ReadRequest req;
+        _table->SetFile(&req);
+        req.offset = _buffer_offset + _buffer.size();
+        req.len = std::max<uint64_t>(offset + size - req.offset, _readahead);
+        req.len = std::min<uint64_t>(req.len, _table->_index_offset - req.offset);
+        ReadFully(&req);
+        if (req.error != 0) {
+            std::cerr << "Failed to read " << _table->_file_path << ": " << strerror(req.error) << std::endl;
+            return false;
+        }
+        _buffer.append(req.data);
+        if (_buffer_offset + _buffer.size() < offset + size) return false; // Truncated file
+    }
+    StartPrefetch();
+    return true;
+}
+
+void Table::Iterator::StartPrefetch() {
+    uint64_t next = _buffer_offset + _buffer.size();
+    if (_prefetch || next >= _table->_index_offset) return;
+    _prefetch = std::make_unique<ReadRequest>();
+    _table->SetFile(_prefetch.get());
+    _prefetch->offset = next;
+    _prefetch->len = std::min<uint64_t>(_readahead, _table->_index_offset - next);
+    AsyncIO::Default()->Submit({_prefetch.get()});
+}
+
+void Table::Iterator::CancelPrefetch() {
+    if (_prefetch) {
+        // The read must finish before its buffer goes away
+        AsyncIO::Default()->Wait(_prefetch.get());
+        _prefetch.reset();
+    }
+}
+
 std::string Table::Iterator::Key() const {
     return _key;
 }
@@ -162,4 +404,8 @@ bool Table::Iterator::IsDeleted() const {
     return _is_deleted;
 }
 
+uint64_t Table::Iterator::ExpireAt() const {
+    return _expire_at;
+}
+
 } // namespace lsm
@@ -1,59 +1,128 @@
 #pragma once
 #include <string>
 #include <vector>
-#include <fstream>
 #include <memory>
+#include "core/iterator.h"
+#include "core/prefix_extractor.h"
+#include "util/async_io.h"
+#include "util/env.h"
+#include "table_index.h"
 
 namespace lsm {
 
+// An immutable SSTable. The index and the metadata are held in memory, so
+// only entries are read from the file, with pread (or AsyncIO) and no lock.
 class Table {
 public:
-    static std::shared_ptr<Table> Open(const std::string& file_path);
-    
+    // Fails if the table was written with a comparator of another name.
+    // comparator and env must outlive the table.
+    static std::shared_ptr<Table> Open(const std::string& file_path,
+                                       const Comparator* comparator = BytewiseComparator().get(),
+                                       Env* env = Env::Default());
+    ~Table();
+
+    // Where an entry lives in the file
+    struct EntryHandle {
+        uint64_t offset;
+        uint64_t size;
+    };
+
     // Returns true if found. value is populated.
     // If deleted, returns true but value is empty (or we need a way to signal deletion).
     // Let's change signature: 
-    // Result: 0 = Not Found, 1 = Found, 2 = Deleted
-    int Get(const std::string& key, std::string* value);
+    // Result: 0 = Not Found, 1 = Found, 2 = Deleted (or expired at now_ms)
+    // On 1, *is_blob_index tells whether value is an encoded BlobIndex.
+    int Get(const std::string& key, std::string* value, uint64_t now_ms, bool* is_blob_index);
+
+    // Get in two steps, so that the reads of many lookups can be issued
+    // together. Find needs no I/O: it returns 1 and the handle of key's
+    // entry, 2 if a range tombstone of the table covers key, and 0 otherwise.
+    int Find(const std::string& key, EntryHandle* handle) const;
+    // A read of handle's entry for AsyncIO
+    void PrepareRead(const EntryHandle& handle, ReadRequest* req) const;
+    // Decodes an entry read that way, with the result codes of Get. On 1,
+    // *expire_at (if given) is the entry's deadline, 0 for none.
+    static int DecodeEntry(const ReadRequest& req, uint64_t now_ms, std::string* value, bool* is_blob_index,
+                           uint64_t* expire_at = nullptr);
 
-    class Iterator {
+    const std::vector<RangeTombstone>& RangeTombstones() const { return _range_tombstones; }
+    // Smallest and largest key of the entries and range tombstones.
+    // Returns false if the table holds neither.
+    bool KeyRange(std::string* smallest, std::string* largest) const;
+    uint64_t FileSize() const { return _file_size; }
+    bool HasHashIndex() const { return !_hash_buckets.empty(); }
+    bool HasPrefixFilter() const { return !_prefix_filter.empty(); }
+    bool HasLearnedIndex() const { return _index.NumSegments() > 0; }
+    // False if the table certainly holds no entry with this prefix (one
+    // produced by extractor) and no range deletion covering such a key
+    bool PrefixMayMatch(const PrefixExtractor& extractor, const std::string& prefix) const;
+
+    // Reads ahead of the current entry: each refill of the buffer starts the
+    // read of the next chunk, growing up to a few hundred KB for long scans
+    class Iterator : public InternalIterator {
     public:
         Iterator(Table* table);
-        bool Valid() const;
-        void SeekToFirst();
-        void Seek(const std::string& target);
-        void Next();
-        std::string Key() const;
-        std::string Value() const;
-        bool IsDeleted() const; // Need to read type
+        ~Iterator() override;
+        bool Valid() const override;
+        void SeekToFirst() override;
+        void Seek(const std::string& target) override;
+        void Next() override;
+        std::string Key() const override;
+        std::string Value() const override;
+        bool IsDeleted() const override; // Need to read type
+        uint64_t ExpireAt() const override;
+        bool IsBlobIndex() const override { return _is_blob_index; }
+        std::vector<RangeTombstone> RangeTombstones() const override { return _table->_range_tombstones; }
     private:
         Table* _table;
-        uint64_t _current_offset;
+        size_t _pos; // Position in the index
         // Cache current fields
         std::string _key;
         std::string _value;
         bool _is_deleted;
+        bool _is_blob_index;
+        uint64_t _expire_at;
         bool _valid;
-        
+
+        // File bytes [_buffer_offset, _buffer_offset + _buffer.size())
+        std::string _buffer;
+        uint64_t _buffer_offset = 0;
+        size_t _readahead;
+        // The chunk right after the buffer, if being read
+        std::unique_ptr<ReadRequest> _prefetch;
+
         void ParseCurrent();
+        // Makes the buffer hold [offset, offset + size)
+        bool Load(uint64_t offset, uint64_t size);
+        void StartPrefetch();
+        void CancelPrefetch();
     };
 
     Iterator* NewIterator();
 
 private:
-    Table(const std::string& file_path);
+    Table(const std::string& file_path, const Comparator* comparator, Env* env);
     bool LoadIndex();
+    // Points req at the file
+    void SetFile(ReadRequest* req) const;
+    // Position of key in _index, or _index.size()
+    size_t FindInIndex(const std::string& key) const;
+    EntryHandle HandleAt(size_t pos) const;
 
     std::string _file_path;
-    std::ifstream _file;
-    uint64_t _file_size;
-    uint64_t _index_offset;
-    
-    struct IndexEntry {
-        std::string key;
-        uint64_t offset;
-    };
-    std::vector<IndexEntry> _index;
+    const Comparator* _comparator;
+    std::unique_ptr<RandomAccessFile> _file;
+    int _fd = -1; // Of _file, if it has one
+    uint64_t _file_size = 0;
+    uint64_t _index_offset = 0; // Also the end of the entries
+    TableIndex _index;
+    std::vector<RangeTombstone> _range_tombstones;
+    FragmentedRangeTombstones _fragments; // The same, for Find
+    // Optional, see TableBuilder: bucket -> position in _index
+    std::vector<uint32_t> _hash_buckets;
+    // Optional: Bloom filter of the key prefixes, and the extractor that made them
+    std::string _prefix_filter;
+    std::string _prefix_extractor_name;
     
     friend class Iterator;
 };
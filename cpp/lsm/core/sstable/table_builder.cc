@@ -1,11 +1,22 @@
 #include "table_builder.h"
 #include <iostream>
+#include "util/bloom.h"
 
 namespace lsm {
 
-TableBuilder::TableBuilder(const std::string& file_path) 
-    : _file_path(file_path) {
-    _file.open(file_path, std::ios::binary | std::ios::trunc);
+namespace {
+
+// Keys per bucket of the hash index. Lower leaves fewer shared buckets, at
+// 4 bytes per bucket.
+const double kHashIndexUtilRatio = 0.75;
+
+} // namespace
+
+TableBuilder::TableBuilder(const std::string& file_path, const ColumnFamilyOptions& options, Env* env)
+    : _file_path(file_path), _comparator(options.comparator), _hash_index(options.table_hash_index),
+      _learned_index(options.table_learned_index), _prefix_extractor(options.prefix_extractor),
+      _prefix_bloom_bits_per_key(options.prefix_bloom_bits_per_key), _index(_comparator.get()) {
+    _file.open(env, file_path);
 }
 
 TableBuilder::~TableBuilder() {
@@ -14,45 +25,150 @@ TableBuilder::~TableBuilder() {
     }
 }
 
-void TableBuilder::Add(const std::string& key, const std::string& value, bool is_deleted) {
+void TableBuilder::Add(const std::string& key, const std::string& value, bool is_deleted, uint64_t expire_at,
+                       bool is_blob_index) {
     if (!_file.is_open()) return;
     
-    _index.push_back({key, _offset});
+    _index.Add(key, _offset);
+    if (_prefix_extractor && _prefix_extractor->InDomain(key)) {
+        std::string prefix = _prefix_extractor->Transform(key);
+        if (_prefixes.empty() || _prefixes.back() != prefix) _prefixes.push_back(std::move(prefix));
+    }
 
     uint32_t klen = key.size();
     uint32_t vlen = value.size();
-    uint8_t type = is_deleted ? 1 : 0;
+    uint8_t type = kEntryDeletion;
+    if (!is_deleted) {
+        if (is_blob_index) {
+            type = expire_at != 0 ? kEntryBlobIndexWithExpiry : kEntryBlobIndex;
+        } else {
+            type = expire_at != 0 ? kEntryValueWithExpiry : kEntryValue;
+        }
+    }
 
     _file.write(reinterpret_cast<const char*>(&klen), sizeof(klen));
     _file.write(key.data(), klen);
     _file.write(reinterpret_cast<const char*>(&vlen), sizeof(vlen));
     _file.write(value.data(), vlen);
     _file.write(reinterpret_cast<const char*>(&type), sizeof(type));
-
     _offset += sizeof(klen) + klen + sizeof(vlen) + vlen + sizeof(type);
+
+    if (type == kEntryValueWithExpiry || type == kEntryBlobIndexWithExpiry) {
+        _file.write(reinterpret_cast<const char*>(&expire_at), sizeof(expire_at));
+        _offset += sizeof(expire_at);
+    }
     _num_entries++;
 }
 
-void TableBuilder::Finish() {
-    if (!_file.is_open()) return;
+bool TableBuilder::Finish() {
+    if (!_file.is_open()) return false;
 
     // Write Index
     uint64_t index_offset = _offset;
     uint32_t index_size = _index.size();
     
     _file.write(reinterpret_cast<const char*>(&index_size), sizeof(index_size));
-    for (const auto& entry : _index) {
-        uint32_t klen = entry.key.size();
+    for (size_t i = 0; i < _index.size(); ++i) {
+        std::string_view key = _index.Key(i);
+        uint64_t offset = _index.Offset(i);
+        uint32_t klen = key.size();
         _file.write(reinterpret_cast<const char*>(&klen), sizeof(klen));
-        _file.write(entry.key.data(), klen);
-        _file.write(reinterpret_cast<const char*>(&entry.offset), sizeof(entry.offset));
+        _file.write(key.data(), klen);
+        _file.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+    }
+
+    // Only kept if the keys fit a model well enough
+    std::vector<IndexSegment> segments;
+    if (_learned_index) {
+        _index.Finish(false);
+        segments = _index.FitSegments(TableIndex::kLearnedMaxError);
+    }
+    bool learned = !segments.empty();
+    bool named = _comparator->Name() != BytewiseComparator()->Name();
+
+    if (!_range_tombstones.empty() || _hash_index || _prefix_extractor || learned || named) {
+        uint32_t count = _range_tombstones.size();
+        _file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        for (const auto& t : _range_tombstones) {
+            uint32_t blen = t.begin.size();
+            uint32_t elen = t.end.size();
+            _file.write(reinterpret_cast<const char*>(&blen), sizeof(blen));
+            _file.write(t.begin.data(), blen);
+            _file.write(reinterpret_cast<const char*>(&elen), sizeof(elen));
+            _file.write(t.end.data(), elen);
+            _file.write(reinterpret_cast<const char*>(&t.shard), sizeof(t.shard));
+            _file.write(reinterpret_cast<const char*>(&t.num_shards), sizeof(t.num_shards));
+        }
+    }
+
+    if (_hash_index || _prefix_extractor || learned || named) {
+        WriteHashIndex();
+    }
+    if (_prefix_extractor || learned || named) {
+        WritePrefixFilter();
+    }
+    if (learned || named) {
+        WriteLearnedIndex(segments);
+    }
+    if (named) {
+        std::string name = _comparator->Name();
+        uint32_t nlen = name.size();
+        _file.write(reinterpret_cast<const char*>(&nlen), sizeof(nlen));
+        _file.write(name.data(), nlen);
     }
 
     // Write Footer: Index Offset
     _file.write(reinterpret_cast<const char*>(&index_offset), sizeof(index_offset));
     
     _file.flush();
+    bool ok = _file.good();
     _file.close();
+    return ok;
+}
+
+void TableBuilder::WriteHashIndex() {
+    if (!_hash_index) {
+        uint32_t none = 0;
+        _file.write(reinterpret_cast<const char*>(&none), sizeof(none));
+        return;
+    }
+    uint32_t num_buckets = static_cast<uint32_t>(_index.size() / kHashIndexUtilRatio) + 1;
+    std::vector<uint32_t> buckets(num_buckets, kHashBucketEmpty);
+    for (uint32_t i = 0; i < _index.size(); ++i) {
+        uint32_t& bucket = buckets[HashIndexBucket(_index.Key(i), num_buckets)];
+        bucket = bucket == kHashBucketEmpty ? i : kHashBucketCollision;
+    }
+    _file.write(reinterpret_cast<const char*>(&num_buckets), sizeof(num_buckets));
+    _file.write(reinterpret_cast<const char*>(buckets.data()), num_buckets * sizeof(uint32_t));
+}
+
+void TableBuilder::WritePrefixFilter() {
+    if (!_prefix_extractor) {
+        uint32_t none = 0;
+        _file.write(reinterpret_cast<const char*>(&none), sizeof(none));
+        _file.write(reinterpret_cast<const char*>(&none), sizeof(none));
+        return;
+    }
+    std::string name = _prefix_extractor->Name();
+    std::string filter = BuildBloomFilter(_prefixes, _prefix_bloom_bits_per_key);
+    uint32_t nlen = name.size();
+    uint32_t flen = filter.size();
+    _file.write(reinterpret_cast<const char*>(&nlen), sizeof(nlen));
+    _file.write(name.data(), nlen);
+    _file.write(reinterpret_cast<const char*>(&flen), sizeof(flen));
+    _file.write(filter.data(), flen);
+}
+
+void TableBuilder::WriteLearnedIndex(const std::vector<IndexSegment>& segments) {
+    uint32_t max_error = TableIndex::kLearnedMaxError;
+    uint32_t count = segments.size();
+    _file.write(reinterpret_cast<const char*>(&max_error), sizeof(max_error));
+    _file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (const auto& segment : segments) {
+        _file.write(reinterpret_cast<const char*>(&segment.first_bits), sizeof(segment.first_bits));
+        _file.write(reinterpret_cast<const char*>(&segment.first_pos), sizeof(segment.first_pos));
+        _file.write(reinterpret_cast<const char*>(&segment.slope), sizeof(segment.slope));
+    }
 }
 
 uint64_t TableBuilder::FileSize() const {
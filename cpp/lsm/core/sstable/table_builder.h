@@ -1,11 +1,48 @@
 #pragma once
 #include <string>
 #include <vector>
-#include <fstream>
 #include <cstdint>
+#include "core/range_tombstone.h"
+#include "core/options.h"
+#include "util/env.h"
+#include "util/hash.h"
+#include "table_index.h"
 
 namespace lsm {
 
+// Entry type byte. The *WithExpiry types are followed by expire_at(8). For
+// the blob types the value is an encoded BlobIndex (see core/blob/blob_file.h).
+enum EntryType : uint8_t {
+    kEntryValue = 0,
+    kEntryDeletion = 1,
+    kEntryValueWithExpiry = 2,
+    kEntryBlobIndex = 3,
+    kEntryBlobIndexWithExpiry = 4,
+};
+
+// File layout:
+//   entries | index: count(4) { klen(4) key offset(8) }
+//   | [range deletions: count(4) { blen(4) begin elen(4) end shard(4) num_shards(4) }]
+//   | [hash index: num_buckets(4) { bucket(4) }]
+//   | [prefix filter: nlen(4) extractor name flen(4) bloom filter]
+//   | [learned index: max_error(4) count(4) { first_bits(8) first_pos(4) slope(8) }]
+//   | [comparator: nlen(4) name]
+//   | index_offset(8)
+// Tables without range deletions end right after the index, as they always
+// did. Each optional section is preceded by the ones before it, written
+// empty (count 0, num_buckets 0, nlen and flen 0) if unused. Tables in
+// bytewise order leave out the comparator section.
+
+// Hash index buckets hold the position of the one key hashing there in the
+// index, or one of these
+const uint32_t kHashBucketEmpty = 0xFFFFFFFF;
+const uint32_t kHashBucketCollision = 0xFFFFFFFE;
+
+inline uint32_t HashIndexBucket(std::string_view key, uint32_t num_buckets) {
+    // Own seed: keys of a shard's flush share the shard hash modulo num_shards
+    return Hash(key.data(), key.size(), 0x5be0cd19) % num_buckets;
+}
+
 struct BlockHandle {
     uint64_t offset;
     uint64_t size;
@@ -13,27 +50,43 @@ struct BlockHandle {
 
 class TableBuilder {
 public:
-    TableBuilder(const std::string& file_path);
+    // options give the key order, and select the optional hash index, prefix
+    // filter and learned index
+    explicit TableBuilder(const std::string& file_path,
+                          const ColumnFamilyOptions& options = ColumnFamilyOptions(),
+                          Env* env = Env::Default());
     ~TableBuilder();
 
-    void Add(const std::string& key, const std::string& value, bool is_deleted);
-    void Finish();
+    // expire_at: Unix time in ms after which the entry is gone, 0 = never
+    // is_blob_index: value is an encoded BlobIndex
+    void Add(const std::string& key, const std::string& value, bool is_deleted, uint64_t expire_at = 0,
+             bool is_blob_index = false);
+    // Written at Finish; may be called in any order relative to Add
+    void AddRangeTombstone(const RangeTombstone& tombstone) { _range_tombstones.push_back(tombstone); }
+    bool ok() const { return _file.is_open(); }
+    // Returns false if any write failed
+    bool Finish();
     uint64_t FileSize() const;
     uint64_t NumEntries() const { return _num_entries; }
 
 private:
     std::string _file_path;
-    std::ofstream _file;
+    OutputFileStream _file;
+    std::shared_ptr<const Comparator> _comparator;
+    bool _hash_index;
+    bool _learned_index;
+    std::shared_ptr<const PrefixExtractor> _prefix_extractor;
+    int _prefix_bloom_bits_per_key;
     uint64_t _offset = 0;
     uint64_t _num_entries = 0;
-    
-    struct IndexEntry {
-        std::string key;
-        uint64_t offset;
-    };
-    std::vector<IndexEntry> _index;
-    
-    void FlushIndex();
+
+    TableIndex _index;
+    std::vector<RangeTombstone> _range_tombstones;
+    std::vector<std::string> _prefixes; // Distinct, in key order
+
+    void WriteHashIndex();
+    void WritePrefixFilter();
+    void WriteLearnedIndex(const std::vector<IndexSegment>& segments);
 };
 
 } // namespace lsm
@@ -0,0 +1,243 @@
+#include "table_index.h"
+#include <algorithm>
+#include <cmath>
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+namespace lsm {
+
+namespace {
+
+// Windows this small are counted rather than halved
+const size_t kScanWidth = 8;
+// Larger error bounds are taken for a corrupt file
+const uint32_t kMaxLearnedError = 4096;
+
+// Number of values of the sorted run [values, values + n) below bits
+size_t CountLess(const uint64_t* values, size_t n, uint64_t bits) {
+    size_t count = 0;
+    size_t i = 0;
+#if defined(__SSE4_2__)
+    // Unsigned compares via the signed 64-bit compare, with the sign bit flipped
+    const __m128i sign = _mm_set1_epi64x(INT64_MIN);
+    const __m128i target = _mm_xor_si128(_mm_set1_epi64x(static_cast<int64_t>(bits)), sign);
+    for (; i + 2 <= n; i += 2) {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i)), sign);
+        int mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(target, v)));
+        count += __builtin_popcount(mask);
+    }
+#endif
+    for (; i < n; ++i) {
+        count += values[i] < bits;
+    }
+    return count;
+}
+
+// Position of the first of the sorted values [values, values + n) that is
+// >= bits. Halving without branches: the answer stays in [base, base + n].
+size_t SearchSorted(const uint64_t* values, size_t n, uint64_t bits) {
+    const uint64_t* base = values;
+    while (n > kScanWidth) {
+        size_t half = n / 2;
+        base = base[half] < bits ? base + half : base;
+        n -= half;
+    }
+    return (base - values) + CountLess(base, n, bits);
+}
+
+} // namespace
+
+void TableIndex::Add(const std::string& key, uint64_t offset) {
+    _arena.append(key);
+    _key_starts.push_back(_arena.size());
+    _offsets.push_back(offset);
+}
+
+void TableIndex::Finish(bool eytzinger) {
+    size_t n = size();
+    _shared_len = 0;
+    // The packed bytes only order keys the way bytewise comparators do
+    if (!_comparator->IsBytewiseOrder()) return;
+    if (n > 0) {
+        // Sorted, so the first and last keys share what all keys share
+        std::string_view first = Key(0);
+        std::string_view last = Key(n - 1);
+        size_t max = std::min(first.size(), last.size());
+        while (_shared_len < max && first[_shared_len] == last[_shared_len]) _shared_len++;
+    }
+    _bits.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        _bits[i] = Bits(Key(i));
+    }
+
+    _eytzinger.clear();
+    _ranks.clear();
+    if (eytzinger && n > 0 && _segments.empty()) {
+        _eytzinger.resize(n + 1);
+        _ranks.resize(n + 1);
+        size_t pos = 0;
+        FillEytzinger(1, &pos);
+    }
+}
+
+std::vector<IndexSegment> TableIndex::FitSegments(uint32_t max_error) const {
+    // Greedy fit: each segment takes keys while some slope through its first
+    // key keeps all of them within max_error, the slopes left forming a cone
+    std::vector<IndexSegment> segments;
+    size_t n = size();
+    size_t max_segments = n / kMinKeysPerSegment;
+    if (max_segments == 0 || !_comparator->IsBytewiseOrder()) return segments;
+    const double error = max_error;
+    IndexSegment current{_bits[0], 0, 0.0};
+    double slope_lo = 0;
+    double slope_hi = INFINITY;
+    for (size_t i = 1; i <= n; ++i) {
+        // Keys with tied bits are predicted at the first of them, their
+        // lower bound
+        if (i < n && _bits[i] == _bits[i - 1]) continue;
+        if (i < n) {
+            double dx = static_cast<double>(_bits[i] - current.first_bits);
+            double dy = static_cast<double>(i - current.first_pos);
+            double lo = (dy - error) / dx;
+            double hi = (dy + error) / dx;
+            if (lo <= slope_hi && hi >= slope_lo) {
+                slope_lo = std::max(slope_lo, lo);
+                slope_hi = std::min(slope_hi, hi);
+                continue;
+            }
+        }
+        current.slope = slope_hi == INFINITY ? 0.0 : (slope_lo + slope_hi) / 2;
+        segments.push_back(current);
+        if (segments.size() > max_segments) return {};
+        if (i < n) {
+            current = {_bits[i], static_cast<uint32_t>(i), 0.0};
+            slope_lo = 0;
+            slope_hi = INFINITY;
+        }
+    }
+    return segments;
+}
+
+bool TableIndex::SetSegments(std::vector<IndexSegment> segments, uint32_t max_error) {
+    // A model that predicts badly only makes lookups fall back to the
+    // search, but positions and the order of segments are relied on
+    if (segments.empty() || max_error > kMaxLearnedError || !_comparator->IsBytewiseOrder()) return false;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        const IndexSegment& segment = segments[i];
+        if (segment.first_pos >= size() || !(segment.slope >= 0) || std::isinf(segment.slope)) return false;
+        if (i > 0 && segment.first_bits <= segments[i - 1].first_bits) return false;
+    }
+    _segments = std::move(segments);
+    _max_error = max_error;
+    return true;
+}
+
+void TableIndex::FillEytzinger(size_t k, size_t* pos) {
+    // In-order walk of the implicit tree visits the keys in sorted order
+    if (k > size()) return;
+    FillEytzinger(2 * k, pos);
+    _eytzinger[k] = _bits[*pos];
+    _ranks[k] = static_cast<uint32_t>(*pos);
+    (*pos)++;
+    FillEytzinger(2 * k + 1, pos);
+}
+
+uint64_t TableIndex::Bits(std::string_view key) const {
+    uint64_t bits = 0;
+    size_t end = std::min(key.size(), _shared_len + 8);
+    for (size_t i = _shared_len; i < end; ++i) {
+        bits |= uint64_t(static_cast<uint8_t>(key[i])) << (8 * (7 - (i - _shared_len)));
+    }
+    return bits;
+}
+
+size_t TableIndex::BitsLowerBound(uint64_t bits) const {
+    if (!_segments.empty()) {
+        size_t pos = LearnedLowerBound(bits);
+        if (pos != SIZE_MAX) return pos;
+    }
+    if (!_eytzinger.empty()) return EytzingerLowerBound(bits);
+    return SearchSorted(_bits.data(), _bits.size(), bits);
+}
+
+size_t TableIndex::EytzingerLowerBound(uint64_t bits) const {
+    size_t n = size();
+    size_t k = 1;
+    while (k <= n) {
+        // Four levels down: the 16 descendants are 128 contiguous bytes
+        __builtin_prefetch(_eytzinger.data() + std::min(16 * k, n));
+        k = 2 * k + (_eytzinger[k] < bits);
+    }
+    // Undo the right turns taken after the last left turn
+    k >>= __builtin_ffsll(~static_cast<long long>(k));
+    return k == 0 ? n : _ranks[k];
+}
+
+size_t TableIndex::LearnedLowerBound(uint64_t bits) const {
+    auto segment = std::upper_bound(_segments.begin(), _segments.end(), bits,
+                                    [](uint64_t b, const IndexSegment& s) { return b < s.first_bits; });
+    if (segment == _segments.begin()) return 0; // Below the first key
+    --segment;
+    size_t n = size();
+    double predicted = segment->first_pos + segment->slope * static_cast<double>(bits - segment->first_bits);
+    size_t pos = predicted >= static_cast<double>(n) ? n : static_cast<size_t>(predicted);
+    size_t lo = pos > _max_error ? pos - _max_error : 0;
+    size_t hi = std::min(n, pos + _max_error + 2);
+    // The fit bounds the error for the keys of the table; other targets, or
+    // a model from a damaged file, may land outside the window
+    if (lo > 0 && _bits[lo - 1] >= bits) return SIZE_MAX;
+    if (hi < n && _bits[hi] < bits) return SIZE_MAX;
+    return lo + SearchSorted(_bits.data() + lo, hi - lo, bits);
+}
+
+template <typename Order>
+size_t TableIndex::KeyLowerBound(const Order& order, std::string_view target) const {
+    size_t lo = 0;
+    size_t hi = size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (order.Compare(Key(mid), target) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+size_t TableIndex::LowerBound(std::string_view target) const {
+    if (!_comparator->IsBytewiseOrder()) {
+        return WithOrder(_comparator, [&](const auto& order) { return KeyLowerBound(order, target); });
+    }
+    size_t n = size();
+    if (n == 0) return 0;
+    // Outside the shared prefix the answer is one of the ends
+    int cmp = target.substr(0, _shared_len).compare(Key(0).substr(0, _shared_len));
+    if (cmp < 0) return 0;
+    if (cmp > 0) return n;
+
+    uint64_t bits = Bits(target);
+    size_t lo = BitsLowerBound(bits);
+    if (lo == n || _bits[lo] != bits) return lo;
+    // Keys whose bits tie with the target's: full keys decide. Usually a
+    // handful, unless the keys vary only far beyond the shared prefix.
+    size_t hi = bits == UINT64_MAX ? n : BitsLowerBound(bits + 1);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (Key(mid) < target) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+size_t TableIndex::Find(std::string_view key) const {
+    size_t pos = LowerBound(key);
+    if (pos < size() && Key(pos) == key) return pos;
+    return size();
+}
+
+} // namespace lsm
@@ -0,0 +1,105 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "core/comparator.h"
+
+namespace lsm {
+
+// One piece of a learned index: a key whose search bits (see TableIndex)
+// are at least first_bits, and below those of the next segment, sits within
+// the model's error of position first_pos + slope * (bits - first_bits)
+struct IndexSegment {
+    uint64_t first_bits;
+    uint32_t first_pos;
+    double slope;
+};
+
+// In-memory index of a table: the key and file offset of every entry, in
+// the order of the table's comparator.
+//
+// Keys are stored back to back in one arena. Searches run on a packed
+// array holding, per key, the 8 bytes that follow the prefix all keys of
+// the table share, as a big-endian integer: a probe is an integer compare,
+// and neighbouring probes share cache lines. Full keys are compared only
+// among the keys whose 8 bytes tie with the target's. Large indexes also
+// keep that array in Eytzinger (breadth-first) order, where the next probes
+// of a search are adjacent and prefetched. All of this needs keys in
+// bytewise order; under other comparators the search compares full keys,
+// with the comparator's order inlined (see WithOrder).
+//
+// Tables whose keys are evenly spread, like fixed-width IDs, can instead
+// carry a learned index: a piecewise-linear model of position by search
+// bits, so that a lookup predicts where the key is and only searches a
+// window of a few entries around it. Lookups whose window turns out not to hold the
+// answer fall back to the search above.
+class TableIndex {
+public:
+    // comparator must outlive the index
+    explicit TableIndex(const Comparator* comparator = BytewiseComparator().get()) : _comparator(comparator) {}
+
+    // Keys must be added in increasing order
+    void Add(const std::string& key, uint64_t offset);
+    // Builds the search array once every entry was added, and the Eytzinger
+    // copy if eytzinger and there is no learned index
+    void Finish(bool eytzinger);
+
+    // Learned index with positions at most max_error off, fit once Finish
+    // has run. Empty if it would take more than one segment per
+    // kMinKeysPerSegment keys, when it is no better than the search, or if
+    // the keys are not in bytewise order.
+    std::vector<IndexSegment> FitSegments(uint32_t max_error) const;
+    // Uses a learned index made by FitSegments for the same keys. Must come
+    // before Finish. Returns false, and keeps none, if segments are invalid.
+    bool SetSegments(std::vector<IndexSegment> segments, uint32_t max_error);
+    size_t NumSegments() const { return _segments.size(); }
+
+    size_t size() const { return _offsets.size(); }
+    bool empty() const { return _offsets.empty(); }
+    std::string_view Key(size_t pos) const {
+        return std::string_view(_arena.data() + _key_starts[pos], _key_starts[pos + 1] - _key_starts[pos]);
+    }
+    uint64_t Offset(size_t pos) const { return _offsets[pos]; }
+
+    // Position of the first key >= target, size() if none
+    size_t LowerBound(std::string_view target) const;
+    // Position of key, size() if absent
+    size_t Find(std::string_view key) const;
+
+    // From about here the sorted array outgrows the L1 and L2 caches, and
+    // the Eytzinger copy pays for its memory
+    static constexpr size_t kEytzingerMinEntries = 4096;
+    // Error bound of the learned indexes of new tables: a lookup searches a
+    // window of 2 * kLearnedMaxError + 2 entries
+    static constexpr uint32_t kLearnedMaxError = 16;
+    static constexpr size_t kMinKeysPerSegment = 32;
+
+private:
+    const Comparator* _comparator;
+    std::string _arena;
+    std::vector<uint64_t> _key_starts{0}; // Key i is [_key_starts[i], _key_starts[i + 1]) of _arena
+    std::vector<uint64_t> _offsets;
+
+    size_t _shared_len = 0;      // Bytes every key starts with
+    std::vector<uint64_t> _bits; // Per key, the 8 bytes after the shared ones
+    // 1-based: node k has children 2k and 2k + 1, and is key _ranks[k]
+    std::vector<uint64_t> _eytzinger;
+    std::vector<uint32_t> _ranks;
+    std::vector<IndexSegment> _segments;
+    uint32_t _max_error = 0;
+
+    // The 8 bytes of key after the shared ones, zero padded. Keys ordered a
+    // < b have Bits(a) <= Bits(b).
+    uint64_t Bits(std::string_view key) const;
+    // First position whose bits are >= bits
+    size_t BitsLowerBound(uint64_t bits) const;
+    size_t EytzingerLowerBound(uint64_t bits) const;
+    // SIZE_MAX if the answer is outside the predicted window
+    size_t LearnedLowerBound(uint64_t bits) const;
+    void FillEytzinger(size_t k, size_t* pos);
+    template <typename Order>
+    size_t KeyLowerBound(const Order& order, std::string_view target) const;
+};
+
+} // namespace lsm
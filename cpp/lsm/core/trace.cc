@@ -0,0 +1,179 @@
+#include "trace.h"
+#include <cstring>
+#include <iostream>
+#include "column_family.h"
+#include "util/clock.h"
+
+namespace lsm {
+
+namespace {
+
+const char kTraceMagic[8] = {'L', 'S', 'M', 'T', 'R', 'A', 'C', 'E'};
+const uint32_t kTraceVersion = 4;
+
+void PutVarint(std::string* dst, uint64_t v) {
+    while (v >= 0x80) {
+        dst->push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    dst->push_back(static_cast<char>(v));
+}
+
+} // namespace
+
+TraceWriter::TraceWriter(const std::string& path) {
+    _file.open(path, std::ios::binary | std::ios::trunc);
+    if (!_file.is_open()) {
+        std::cerr << "Failed to open trace file: " << path << std::endl;
+        return;
+    }
+
+    _start_us = NowMicros();
+    _last_us = _start_us;
+
+    _file.write(kTraceMagic, sizeof(kTraceMagic));
+    _file.write(reinterpret_cast<const char*>(&kTraceVersion), sizeof(kTraceVersion));
+    _file.write(reinterpret_cast<const char*>(&_start_us), sizeof(_start_us));
+    _buffer.reserve(kBufferSize);
+    _ok = true;
+}
+
+TraceWriter::~TraceWriter() {
+    Close();
+}
+
+void TraceWriter::Record(const ColumnFamilyHandle* cf, TraceOp op, const std::string& key, uint32_t value_size) {
+    Append(cf, op, key, value_size, nullptr);
+}
+
+void TraceWriter::RecordDeleteRange(const ColumnFamilyHandle* cf, const std::string& begin,
+                                    const std::string& end) {
+    Append(cf, TraceOp::kDeleteRange, begin, 0, &end);
+}
+
+void TraceWriter::RecordPutWithExpiry(const ColumnFamilyHandle* cf, const std::string& key, uint32_t value_size,
+                                      uint64_t expire_at_ms) {
+    Append(cf, TraceOp::kPutWithExpiry, key, value_size, nullptr, expire_at_ms);
+}
+
+void TraceWriter::Append(const ColumnFamilyHandle* cf, TraceOp op, const std::string& key, uint32_t value_size,
+                         const std::string* end, uint64_t expire_at_ms) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_ok) return;
+
+    if (cf->GetID() != 0 && _named_families.insert(cf->GetID()).second) {
+        AppendRecord(cf->GetID(), TraceOp::kColumnFamily, cf->GetName(), 0, nullptr, 0);
+    }
+    AppendRecord(cf->GetID(), op, key, value_size, end, expire_at_ms);
+
+    if (_buffer.size() >= kBufferSize) {
+        FlushBuffer();
+    }
+}
+
+void TraceWriter::AppendRecord(uint32_t cf_id, TraceOp op, const std::string& key, uint32_t value_size,
+                               const std::string* end, uint64_t expire_at_ms) {
+    // Clock is read under the lock so deltas are never negative
+    uint64_t now = NowMicros();
+    uint64_t delta = now > _last_us ? now - _last_us : 0;
+    _last_us += delta;
+
+    PutVarint(&_buffer, delta);
+    _buffer.push_back(static_cast<char>(op));
+    PutVarint(&_buffer, cf_id);
+    PutVarint(&_buffer, key.size());
+    _buffer.append(key);
+    PutVarint(&_buffer, value_size);
+    if (end) {
+        PutVarint(&_buffer, end->size());
+        _buffer.append(*end);
+    }
+    if (op == TraceOp::kPutWithExpiry) {
+        PutVarint(&_buffer, expire_at_ms);
+    }
+    _num_records.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TraceWriter::FlushBuffer() {
+    if (_buffer.empty()) return;
+    _file.write(_buffer.data(), _buffer.size());
+    _buffer.clear();
+}
+
+void TraceWriter::Close() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_ok) return;
+    FlushBuffer();
+    _file.flush();
+    _file.close();
+    _ok = false;
+}
+
+TraceReader::TraceReader(const std::string& path) {
+    _file.open(path, std::ios::binary);
+    if (!_file.is_open()) return;
+
+    char magic[sizeof(kTraceMagic)];
+    _file.read(magic, sizeof(magic));
+    _file.read(reinterpret_cast<char*>(&_version), sizeof(_version));
+    _file.read(reinterpret_cast<char*>(&_start_us), sizeof(_start_us));
+    if (!_file || memcmp(magic, kTraceMagic, sizeof(magic)) != 0 || _version < 1 || _version > kTraceVersion) {
+        std::cerr << "Invalid trace file: " << path << std::endl;
+        return;
+    }
+    _ok = true;
+}
+
+bool TraceReader::ReadVarint(uint64_t* v) {
+    uint64_t result = 0;
+    for (int shift = 0; shift <= 63; shift += 7) {
+        int c = _file.get();
+        if (c == EOF) return false;
+        result |= static_cast<uint64_t>(c & 0x7f) << shift;
+        if ((c & 0x80) == 0) {
+            *v = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TraceReader::Next(TraceRecord* record) {
+    if (!_ok) return false;
+
+    uint64_t delta, cf_id = 0, klen, value_size;
+    if (!ReadVarint(&delta)) return false;
+
+    int op = _file.get();
+    if (op == EOF || op > static_cast<int>(TraceOp::kPutWithExpiry)) return false;
+    if (_version >= 3 && !ReadVarint(&cf_id)) return false;
+
+    if (!ReadVarint(&klen)) return false;
+    record->key.resize(klen);
+    _file.read(&record->key[0], klen);
+    if (static_cast<uint64_t>(_file.gcount()) != klen) return false;
+
+    if (!ReadVarint(&value_size)) return false;
+
+    record->end_key.clear();
+    if (op == static_cast<int>(TraceOp::kDeleteRange)) {
+        uint64_t elen;
+        if (!ReadVarint(&elen)) return false;
+        record->end_key.resize(elen);
+        _file.read(&record->end_key[0], elen);
+        if (static_cast<uint64_t>(_file.gcount()) != elen) return false;
+    }
+
+    uint64_t expire_at_ms = 0;
+    if (op == static_cast<int>(TraceOp::kPutWithExpiry) && !ReadVarint(&expire_at_ms)) return false;
+
+    _last_offset_us += delta;
+    record->timestamp_us = _last_offset_us;
+    record->op = static_cast<TraceOp>(op);
+    record->cf_id = static_cast<uint32_t>(cf_id);
+    record->value_size = static_cast<uint32_t>(value_size);
+    record->expire_at_ms = expire_at_ms;
+    return true;
+}
+
+} // namespace lsm
@@ -0,0 +1,103 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <fstream>
+#include <mutex>
+#include <unordered_set>
+#include <cstdint>
+
+namespace lsm {
+
+class ColumnFamilyHandle;
+
+// Operation trace: a compact binary log of the ops a DB served, used by
+// lsm_replay to reproduce production access patterns offline.
+//
+// File format:
+//   header: magic "LSMTRACE" | version(4) | start_time_us(8)
+//   record: time_delta_us(varint) | op(1) | cf_id(varint) | key_len(varint) | key |
+//           value_size(varint) [end_len(varint) | end]   (kDeleteRange only; key is the begin)
+//           [expire_at_ms(varint)]   (kPutWithExpiry only)
+// time_delta_us is relative to the previous record (first record: to start_time_us).
+// Values are never stored, only their size. A column family other than the
+// default is named by a kColumnFamily record (key: its name) before its
+// first op. Version 1 traces predate kDeleteRange, version 2 ones cf_id
+// (every op is on the default family) and version 3 ones kPutWithExpiry
+// (traced as kPut); all are still read.
+
+enum class TraceOp : uint8_t {
+    kPut = 0,
+    kGet = 1,
+    kDelete = 2,
+    kDeleteRange = 3,
+    kColumnFamily = 4,
+    kPutWithExpiry = 5,
+};
+
+struct TraceRecord {
+    uint64_t timestamp_us; // Offset from the start of the trace
+    TraceOp op;
+    uint32_t cf_id; // 0: the default column family
+    std::string key;
+    uint32_t value_size;
+    std::string end_key; // kDeleteRange: the exclusive end of [key, end_key)
+    uint64_t expire_at_ms; // kPutWithExpiry
+};
+
+class TraceWriter {
+public:
+    explicit TraceWriter(const std::string& path);
+    ~TraceWriter();
+
+    bool ok() const { return _ok; }
+
+    // Thread-safe. Records are buffered and written in chunks.
+    void Record(const ColumnFamilyHandle* cf, TraceOp op, const std::string& key, uint32_t value_size);
+    void RecordDeleteRange(const ColumnFamilyHandle* cf, const std::string& begin, const std::string& end);
+    void RecordPutWithExpiry(const ColumnFamilyHandle* cf, const std::string& key, uint32_t value_size,
+                             uint64_t expire_at_ms);
+    void Close();
+
+    uint64_t NumRecords() const { return _num_records.load(std::memory_order_relaxed); }
+
+private:
+    std::mutex _mutex;
+    std::ofstream _file;
+    std::string _buffer;
+    bool _ok = false;
+    uint64_t _start_us = 0;
+    uint64_t _last_us = 0;
+    std::atomic<uint64_t> _num_records{0};
+    std::unordered_set<uint32_t> _named_families; // Those with a kColumnFamily record
+
+    void Append(const ColumnFamilyHandle* cf, TraceOp op, const std::string& key, uint32_t value_size,
+                const std::string* end, uint64_t expire_at_ms = 0);
+    void AppendRecord(uint32_t cf_id, TraceOp op, const std::string& key, uint32_t value_size,
+                      const std::string* end, uint64_t expire_at_ms);
+    void FlushBuffer();
+
+    static const size_t kBufferSize = 64 * 1024;
+};
+
+class TraceReader {
+public:
+    explicit TraceReader(const std::string& path);
+
+    bool ok() const { return _ok; }
+    // Wall-clock time (us since epoch) the trace was started
+    uint64_t StartTime() const { return _start_us; }
+
+    // Returns false at end of trace or on a truncated record
+    bool Next(TraceRecord* record);
+
+private:
+    std::ifstream _file;
+    bool _ok = false;
+    uint32_t _version = 0;
+    uint64_t _start_us = 0;
+    uint64_t _last_offset_us = 0;
+
+    bool ReadVarint(uint64_t* v);
+};
+
+} // namespace lsm
@@ -0,0 +1,72 @@
+#include "update_iterator.h"
+
+namespace lsm {
+
+UpdateIterator::UpdateIterator(Env* env, uint64_t since, uint64_t until,
+                               std::map<uint32_t, std::string> column_families,
+                               const std::vector<std::vector<std::string>>& wals)
+    : _since(since), _until(until), _column_families(std::move(column_families)) {
+    // Opened right away: a WAL may be archived or deleted once flushed
+    _streams.resize(wals.size());
+    for (size_t i = 0; i < wals.size(); ++i) {
+        for (const std::string& path : wals[i]) {
+            auto reader = std::make_unique<WALReader>(env, path);
+            if (reader->ok()) _streams[i].readers.push_back(std::move(reader));
+        }
+        Advance(&_streams[i]);
+    }
+    FindSmallest();
+}
+
+void UpdateIterator::Next() {
+    if (!Valid()) return;
+    Advance(&_streams[_current]);
+    FindSmallest();
+}
+
+void UpdateIterator::Advance(Stream* stream) {
+    stream->valid = false;
+    WALRecord record;
+    while (stream->reader < stream->readers.size()) {
+        // Stops at the first incomplete record, e.g. one being appended
+        if (!stream->readers[stream->reader]->ReadRecord(&record)) {
+            stream->reader++;
+            continue;
+        }
+        if (record.sequence > _until) {
+            stream->reader = stream->readers.size();
+            return;
+        }
+        if (record.sequence < _since) continue;
+        // Each shard logs a copy of a DeleteRange, under all shard locks so
+        // their sequence numbers are consecutive; the one of shard 0, logged
+        // first, stands for all of them
+        if (record.is_range_delete && record.shard != 0) continue;
+        auto cf = _column_families.find(record.cf_id);
+        if (cf == _column_families.end()) continue; // Dropped
+
+        Update& update = stream->update;
+        update.sequence = record.sequence;
+        update.type = record.is_range_delete ? Update::kDeleteRange
+                      : record.is_delete     ? Update::kDelete
+                                             : Update::kPut;
+        update.column_family = cf->second;
+        update.key = std::move(record.key);
+        update.value = std::move(record.value);
+        update.expire_at = record.expire_at;
+        stream->valid = true;
+        return;
+    }
+}
+
+void UpdateIterator::FindSmallest() {
+    _current = -1;
+    for (size_t i = 0; i < _streams.size(); ++i) {
+        if (!_streams[i].valid) continue;
+        if (_current < 0 || _streams[i].update.sequence < _streams[_current].update.sequence) {
+            _current = static_cast<int>(i);
+        }
+    }
+}
+
+} // namespace lsm
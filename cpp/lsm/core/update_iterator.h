@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "wal.h"
+
+namespace lsm {
+
+// One write, as DB::GetUpdatesSince replays it from the WAL
+struct Update {
+    enum Type { kPut, kDelete, kDeleteRange };
+    uint64_t sequence = 0;
+    Type type = kPut;
+    std::string column_family; // Name
+    std::string key;           // The beginning of the range for kDeleteRange
+    std::string value;         // The end of the range for kDeleteRange
+    uint64_t expire_at = 0;    // Unix time in ms, 0 = never
+};
+
+// Writes in ascending sequence order, merged from the WALs of every shard.
+// Obtain one from DB::GetUpdatesSince and delete it when done. It reads the
+// files it was created with: writes made after that are not visited.
+class UpdateIterator {
+public:
+    // wals holds the WAL files of each shard in env, oldest first. Updates
+    // with a sequence in [since, until] of the families in column_families
+    // (by id) are visited.
+    UpdateIterator(Env* env, uint64_t since, uint64_t until, std::map<uint32_t, std::string> column_families,
+                   const std::vector<std::vector<std::string>>& wals);
+
+    bool Valid() const { return _current >= 0; }
+    void Next();
+    const Update& update() const { return _streams[_current].update; }
+
+private:
+    // The writes of one shard, which it logs in sequence order
+    struct Stream {
+        std::vector<std::unique_ptr<WALReader>> readers;
+        size_t reader = 0;
+        bool valid = false;
+        Update update;
+    };
+
+    void Advance(Stream* stream);
+    void FindSmallest();
+
+    const uint64_t _since;
+    const uint64_t _until;
+    const std::map<uint32_t, std::string> _column_families;
+    std::vector<Stream> _streams;
+    int _current = -1;
+};
+
+} // namespace lsm
@@ -1,13 +1,76 @@
 #include "version.h"
 #include <algorithm>
 #include <iostream>
-#include <filesystem>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include "core/memtable.h"
 
 namespace lsm {
 
-namespace fs = std::filesystem;
+namespace {
 
-Version::Version(const std::string& dbname) : _dbname(dbname) {}
+const char kManifestMagic[8] = {'L', 'S', 'M', 'M', 'A', 'N', 'I', 'F'};
+// Version 2 appends the blob file list, version 3 adds the comparator name
+// after the header. Older manifests are still read, as bytewise.
+const uint32_t kManifestVersion = 3;
+
+void WriteString(std::ostream& out, const std::string& s) {
+    uint32_t len = s.size();
+    out.write(reinterpret_cast<const char*>(&len), sizeof(len));
+    out.write(s.data(), len);
+}
+
+bool ReadString(std::istream& in, std::string* s) {
+    uint32_t len;
+    in.read(reinterpret_cast<char*>(&len), sizeof(len));
+    if (!in) return false;
+    s->resize(len);
+    in.read(&(*s)[0], len);
+    return static_cast<bool>(in);
+}
+
+uint64_t MaxBytesForLevel(const ColumnFamilyOptions& options, int level) {
+    uint64_t result = options.max_bytes_for_level_base;
+    while (level > 1) {
+        result *= 10;
+        level--;
+    }
+    return result;
+}
+
+} // namespace
+
+TableCache::TableCache(Env* env, const std::string& dbname, std::shared_ptr<const Comparator> comparator,
+                       std::shared_ptr<RowCache> row_cache)
+    : _env(env), _dbname(dbname), _comparator(std::move(comparator)), _row_cache(std::move(row_cache)) {
+    if (_row_cache) _row_cache_id = _row_cache->NewId();
+}
+
+std::shared_ptr<Table> TableCache::GetTable(int file_number) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _tables.find(file_number);
+    if (it != _tables.end()) {
+        return it->second;
+    }
+
+    std::string path = _dbname + "/" + std::to_string(file_number) + ".sst";
+    auto table = Table::Open(path, _comparator.get(), _env);
+    if (table) {
+        _tables[file_number] = table;
+    }
+    return table;
+}
+
+void TableCache::Evict(int file_number) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _tables.erase(file_number);
+}
+
+Version::Version(const std::string& dbname, std::shared_ptr<const Comparator> comparator,
+                 std::shared_ptr<TableCache> table_cache, std::shared_ptr<BlobFileCache> blob_cache)
+    : _dbname(dbname), _comparator(std::move(comparator)), _table_cache(std::move(table_cache)),
+      _blob_cache(std::move(blob_cache)) {}
 Version::~Version() {}
 
 void Version::AddFile(int level, const FileMetaData& f) {
@@ -20,30 +83,81 @@ void Version::SortL0() {
     });
 }
 
-std::shared_ptr<Table> Version::GetTable(int file_number) {
-    // Simple linear search in cache
-    for (const auto& entry : _table_cache) {
-        if (entry.first == file_number) {
-            return entry.second;
+bool Version::GetCachedRow(int file_number, const std::string& key, std::string* value, uint64_t now_ms,
+                           int* result) {
+    RowCache* row_cache = _table_cache->row_cache();
+    RowCache::Row row;
+    if (!row_cache || !row_cache->Lookup(_table_cache->row_cache_id(), file_number, key, &row)) return false;
+    if (row.deleted || IsExpired(row.expire_at, now_ms)) {
+        *result = 2;
+    } else {
+        *value = std::move(row.value);
+        *result = 1;
+    }
+    return true;
+}
+
+int Version::DecodeEntry(int file_number, const std::string& key, const ReadRequest& req, std::string* value,
+                         uint64_t now_ms) {
+    bool is_blob_index = false;
+    uint64_t expire_at = 0;
+    int result = Table::DecodeEntry(req, now_ms, value, &is_blob_index, &expire_at);
+    if (result == 1 && is_blob_index) {
+        std::string blob_index = std::move(*value);
+        if (!_blob_cache->Get(blob_index, value)) {
+            std::cerr << "Failed to read blob value of key " << key << " in " << _dbname << std::endl;
+            return 0;
         }
     }
-    
-    std::string path = _dbname + "/" + std::to_string(file_number) + ".sst";
-    auto table = Table::Open(path);
-    if (table) {
-        _table_cache.push_back({file_number, table});
+    // An expired entry stays expired, so it is cached as a deletion
+    RowCache* row_cache = _table_cache->row_cache();
+    if (row_cache && result != 0) {
+        RowCache::Row row;
+        row.deleted = result == 2;
+        if (!row.deleted) {
+            row.value = *value;
+            row.expire_at = expire_at;
+        }
+        row_cache->Insert(_table_cache->row_cache_id(), file_number, key, row);
     }
-    return table;
+    return result;
 }
 
-int Version::Get(const std::string& key, std::string* value) {
+int Version::Locate(const std::string& key, std::shared_ptr<Table>* table, int* file_number,
+                    Table::EntryHandle* handle) {
+    return WithOrder(_comparator.get(),
+                     [&](const auto& order) { return Locate(order, key, table, file_number, handle); });
+}
+
+template <typename Order>
+int Version::Locate(const Order& order, const std::string& key, std::shared_ptr<Table>* table, int* file_number,
+                    Table::EntryHandle* handle) {
     // Search L0 files in reverse order (newest first)
     // L0 files can overlap, so we must check all of them that might contain the key
     for (auto it = _files[0].rbegin(); it != _files[0].rend(); ++it) {
-        if (key >= it->smallest && key <= it->largest) {
-            std::shared_ptr<Table> table = GetTable(it->number);
-            if (table) {
-                int result = table->Get(key, value);
+        if (order.Compare(key, it->smallest) >= 0 && order.Compare(key, it->largest) <= 0) {
+            *table = _table_cache->GetTable(it->number);
+            *file_number = it->number;
+            if (*table) {
+                int result = (*table)->Find(key, handle);
+                if (result != 0) {
+                    return result;
+                }
+            }
+        }
+    }
+
+    // Deeper levels are disjoint: one file per level holds the key, or two
+    // when it is also the exclusive end of the previous file's tombstone
+    for (int level = 1; level < kNumLevels; ++level) {
+        const auto& files = _files[level];
+        auto it = std::lower_bound(files.begin(), files.end(), key,
+            [&order](const FileMetaData& f, const std::string& k) { return order.Compare(f.largest, k) < 0; });
+        for (; it != files.end() && order.Compare(it->smallest, key) <= 0; ++it) {
+            *table = _table_cache->GetTable(it->number);
+            *file_number = it->number;
+            if (*table) {
+                int result = (*table)->Find(key, handle);
                 if (result != 0) {
                     return result;
                 }
@@ -53,48 +167,431 @@ int Version::Get(const std::string& key, std::string* value) {
     return 0;
 }
 
+int Version::Get(const std::string& key, std::string* value, uint64_t now_ms) {
+    std::shared_ptr<Table> table;
+    int file_number = 0;
+    Table::EntryHandle handle;
+    int result = Locate(key, &table, &file_number, &handle);
+    if (result != 1 || GetCachedRow(file_number, key, value, now_ms, &result)) return result;
+    ReadRequest req;
+    table->PrepareRead(handle, &req);
+    ReadFully(&req);
+    return DecodeEntry(file_number, key, req, value, now_ms);
+}
+
+void Version::MultiGet(const std::vector<std::string>& keys, std::vector<std::string>* values,
+                       std::vector<int>* results, uint64_t now_ms) {
+    values->resize(keys.size());
+    results->assign(keys.size(), 0);
+    // Tables stay referenced until their reads are done
+    std::vector<std::shared_ptr<Table>> tables(keys.size());
+    std::vector<int> file_numbers(keys.size());
+    std::vector<ReadRequest> reqs(keys.size());
+    std::vector<ReadRequest*> batch;
+    std::vector<size_t> batch_keys;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        Table::EntryHandle handle;
+        (*results)[i] = Locate(keys[i], &tables[i], &file_numbers[i], &handle);
+        if ((*results)[i] != 1 || GetCachedRow(file_numbers[i], keys[i], &(*values)[i], now_ms, &(*results)[i])) {
+            continue;
+        }
+        tables[i]->PrepareRead(handle, &reqs[i]);
+        batch.push_back(&reqs[i]);
+        batch_keys.push_back(i);
+    }
+    AsyncIO::Default()->Read(batch);
+    for (size_t i : batch_keys) {
+        (*results)[i] = DecodeEntry(file_numbers[i], keys[i], reqs[i], &(*values)[i], now_ms);
+    }
+}
+
 std::vector<FileMetaData> Version::GetFiles(int level) const {
-    if (level < 0 || level >= 7) return {};
+    if (level < 0 || level >= kNumLevels) return {};
     return _files[level];
 }
 
-VersionSet::VersionSet(const std::string& dbname) 
-    : _dbname(dbname), _next_file_number(1) {
-    _current = new Version(dbname);
+int Version::NumFiles(int level) const {
+    if (level < 0 || level >= kNumLevels) return 0;
+    return static_cast<int>(_files[level].size());
+}
+
+uint64_t Version::EstimatedPendingCompactionBytes(const ColumnFamilyOptions& options) const {
+    uint64_t pending = 0;
+    if (options.compaction_style == CompactionStyle::kUniversal) {
+        // Once compacting, everything but the oldest run is merged into it eventually
+        std::vector<uint64_t> runs;
+        for (const auto& f : _files[0]) runs.push_back(f.file_size);
+        for (int level = 1; level < kNumLevels; ++level) {
+            if (!_files[level].empty()) runs.push_back(NumLevelBytes(level));
+        }
+        if (static_cast<int>(runs.size()) < options.level0_file_num_compaction_trigger) return 0;
+        for (size_t i = 0; i + 1 < runs.size(); ++i) pending += runs[i];
+        return pending;
+    }
+
+    // L0 is rewritten with L1; the bytes over a level's limit are rewritten
+    // with about ten times as much of the next level, which they then grow
+    uint64_t carried = 0;
+    if (NumFiles(0) >= options.level0_file_num_compaction_trigger) {
+        carried = NumLevelBytes(0);
+        pending += carried + NumLevelBytes(1);
+    }
+    for (int level = 1; level < kNumLevels - 1; ++level) {
+        uint64_t bytes = NumLevelBytes(level) + carried;
+        uint64_t limit = MaxBytesForLevel(options, level);
+        carried = 0;
+        if (bytes > limit) {
+            carried = bytes - limit;
+            pending += carried * 11;
+        }
+    }
+    return pending;
+}
+
+uint64_t Version::NumLevelBytes(int level) const {
+    uint64_t total = 0;
+    for (const auto& f : _files[level]) {
+        total += f.file_size;
+    }
+    return total;
+}
+
+std::vector<FileMetaData> Version::GetOverlappingInputs(int level, const std::string& begin,
+                                                        const std::string& end) const {
+    std::vector<FileMetaData> result;
+    for (const auto& f : _files[level]) {
+        if (_comparator->Compare(f.largest, begin) < 0 || _comparator->Compare(f.smallest, end) > 0) continue;
+        result.push_back(f);
+    }
+    return result;
+}
+
+void Version::AddIterators(std::vector<std::unique_ptr<InternalIterator>>* iters,
+                           const PrefixExtractor* prefix_extractor, const std::string& prefix) {
+    auto add = [&](const FileMetaData& f) {
+        // The key range rules out most files without opening them
+        if (prefix_extractor && (f.largest < prefix || !SortsBeforePrefixEnd(f.smallest, prefix))) {
+            return;
+        }
+        auto table = _table_cache->GetTable(f.number);
+        if (!table) return;
+        if (prefix_extractor && !table->PrefixMayMatch(*prefix_extractor, prefix)) return;
+        iters->emplace_back(table->NewIterator());
+    };
+    for (auto it = _files[0].rbegin(); it != _files[0].rend(); ++it) {
+        add(*it);
+    }
+    for (int level = 1; level < kNumLevels; ++level) {
+        for (const auto& f : _files[level]) {
+            add(f);
+        }
+    }
+}
+
+double Version::BlobGarbageRatio(int number) const {
+    auto it = _blob_files.find(number);
+    return it == _blob_files.end() ? 0.0 : it->second.GarbageRatio();
+}
+
+std::vector<BlobFileMetaData> Version::GetBlobFiles() const {
+    std::vector<BlobFileMetaData> result;
+    for (const auto& entry : _blob_files) {
+        result.push_back(entry.second);
+    }
+    return result;
+}
+
+size_t Compaction::NumInputFiles() const {
+    size_t total = 0;
+    for (const auto& files : inputs) total += files.size();
+    return total;
+}
+
+bool Compaction::IsBaseLevelForKey(const std::string& key) const {
+    const Comparator* cmp = input_version->_comparator.get();
+    for (int level = output_level + 1; level < kNumLevels; ++level) {
+        for (const auto& f : input_version->_files[level]) {
+            if (cmp->Compare(key, f.smallest) >= 0 && cmp->Compare(key, f.largest) <= 0) return false;
+        }
+    }
+    return true;
+}
+
+bool Compaction::IsBaseLevelForRange(const std::string& begin, const std::string& end) const {
+    const Comparator* cmp = input_version->_comparator.get();
+    for (int level = output_level + 1; level < kNumLevels; ++level) {
+        for (const auto& f : input_version->_files[level]) {
+            if (cmp->Compare(f.largest, begin) >= 0 && cmp->Compare(f.smallest, end) < 0) return false;
+        }
+    }
+    return true;
+}
+
+VersionSet::VersionSet(Env* env, const std::string& dbname, std::shared_ptr<const Comparator> comparator,
+                       std::shared_ptr<RowCache> row_cache)
+    : _env(env), _dbname(dbname), _comparator(std::move(comparator)), _next_file_number(1),
+      _table_cache(std::make_shared<TableCache>(env, dbname, _comparator, std::move(row_cache))),
+      _blob_cache(std::make_shared<BlobFileCache>(env, dbname)) {
+    _current = std::make_shared<Version>(dbname, _comparator, _table_cache, _blob_cache);
+}
+
+VersionSet::~VersionSet() {}
+
+std::shared_ptr<Version> VersionSet::current() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _current;
+}
+
+int VersionSet::NewFileNumber() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _next_file_number++;
+}
+
+void VersionSet::Install(std::shared_ptr<Version> v) {
+    _live_versions.erase(std::remove_if(_live_versions.begin(), _live_versions.end(),
+        [](const std::weak_ptr<Version>& w) { return w.expired(); }), _live_versions.end());
+    _live_versions.push_back(_current);
+    _current = std::move(v);
+}
+
+void VersionSet::LogAndApply(const VersionEdit& edit) {
+    // The edit is applied to a copy of current, which is then swapped in.
+    // Readers still holding the old Version keep it alive until they finish.
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto v = std::make_shared<Version>(*_current);
+    for (const auto& del : edit.deleted_files) {
+        auto& files = v->_files[del.first];
+        files.erase(std::remove_if(files.begin(), files.end(), [&](const FileMetaData& f) {
+            return f.number == del.second;
+        }), files.end());
+        _obsolete_files.insert(del.second);
+    }
+    for (const auto& nf : edit.new_files) {
+        v->AddFile(nf.first, nf.second);
+    }
+    for (const auto& bf : edit.new_blob_files) {
+        v->_blob_files[bf.number] = bf;
+    }
+    for (const auto& garbage : edit.blob_garbage) {
+        auto it = v->_blob_files.find(garbage.first);
+        if (it == v->_blob_files.end()) continue;
+        it->second.garbage_count += garbage.second.first;
+        it->second.garbage_bytes += garbage.second.second;
+        if (it->second.garbage_count >= it->second.total_count) {
+            // No table references it anymore
+            _obsolete_blob_files.insert(it->first);
+            v->_blob_files.erase(it);
+        }
+    }
+    // Concurrent flushes may finish out of file-number order
+    v->SortL0();
+    for (int level = 1; level < kNumLevels; ++level) {
+        std::sort(v->_files[level].begin(), v->_files[level].end(), [this](const FileMetaData& a, const FileMetaData& b) {
+            return _comparator->Compare(a.smallest, b.smallest) < 0;
+        });
+    }
+    Install(std::move(v));
+    WriteManifest(_dbname);
 }
 
-VersionSet::~VersionSet() {
-    delete _current;
+bool VersionSet::WriteManifest(const std::string& dir) {
+    std::string tmp = dir + "/MANIFEST.tmp";
+    {
+        OutputFileStream out(_env, tmp);
+        if (!out.is_open()) {
+            std::cerr << "Failed to write manifest: " << tmp << std::endl;
+            return false;
+        }
+
+        uint32_t num_files = 0;
+        for (int level = 0; level < kNumLevels; ++level) {
+            num_files += _current->_files[level].size();
+        }
+        out.write(kManifestMagic, sizeof(kManifestMagic));
+        out.write(reinterpret_cast<const char*>(&kManifestVersion), sizeof(kManifestVersion));
+        out.write(reinterpret_cast<const char*>(&_next_file_number), sizeof(_next_file_number));
+        WriteString(out, _comparator->Name());
+        out.write(reinterpret_cast<const char*>(&num_files), sizeof(num_files));
+        for (int level = 0; level < kNumLevels; ++level) {
+            for (const auto& f : _current->_files[level]) {
+                out.write(reinterpret_cast<const char*>(&level), sizeof(level));
+                out.write(reinterpret_cast<const char*>(&f.number), sizeof(f.number));
+                out.write(reinterpret_cast<const char*>(&f.file_size), sizeof(f.file_size));
+                WriteString(out, f.smallest);
+                WriteString(out, f.largest);
+            }
+        }
+        uint32_t num_blob_files = _current->_blob_files.size();
+        out.write(reinterpret_cast<const char*>(&num_blob_files), sizeof(num_blob_files));
+        for (const auto& entry : _current->_blob_files) {
+            const BlobFileMetaData& b = entry.second;
+            out.write(reinterpret_cast<const char*>(&b.number), sizeof(b.number));
+            out.write(reinterpret_cast<const char*>(&b.total_count), sizeof(b.total_count));
+            out.write(reinterpret_cast<const char*>(&b.total_bytes), sizeof(b.total_bytes));
+            out.write(reinterpret_cast<const char*>(&b.garbage_count), sizeof(b.garbage_count));
+            out.write(reinterpret_cast<const char*>(&b.garbage_bytes), sizeof(b.garbage_bytes));
+        }
+        out.flush();
+        if (!out) return false;
+    }
+    // Atomic replace: a crash leaves either the old or the new manifest
+    return _env->RenameFile(tmp, dir + "/MANIFEST");
 }
 
-void VersionSet::LogAndApply(Version* edit) {
-    // In a real system, we would write to MANIFEST, then update current_.
-    // Here we just swap current (leak old one for now or delete if refcounted)
-    // Actually, 'edit' here is treated as the new version for simplicity.
-    Version* old = _current;
-    _current = edit;
-    delete old;
+namespace {
+
+// Table and blob files are never modified once written, so a link shares
+// them at no cost. A link fails across file systems.
+bool LinkOrCopy(Env* env, const std::string& from, const std::string& to) {
+    if (env->LinkFile(from, to)) return true;
+    if (!CopyFile(env, from, env, to)) {
+        std::cerr << "Failed to checkpoint " << from << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool VersionSet::CreateCheckpoint(const std::string& dir) {
+    // Held throughout, so that no file of _current is deleted meanwhile
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_env->CreateDirs(dir)) return false;
+    for (int level = 0; level < kNumLevels; ++level) {
+        for (const auto& f : _current->_files[level]) {
+            std::string name = "/" + std::to_string(f.number) + ".sst";
+            if (!LinkOrCopy(_env, _dbname + name, dir + name)) return false;
+        }
+    }
+    for (const auto& entry : _current->_blob_files) {
+        if (!LinkOrCopy(_env, BlobFileName(_dbname, entry.first), BlobFileName(dir, entry.first))) return false;
+    }
+    return WriteManifest(dir);
+}
+
+namespace {
+
+// Reads the MANIFEST header up to the file count. Returns false if it is not
+// a manifest this code can read.
+bool ReadManifestHeader(std::istream& in, uint32_t* version, int* next_file_number,
+                        std::string* comparator_name, uint32_t* num_files) {
+    char magic[sizeof(kManifestMagic)];
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(version), sizeof(*version));
+    in.read(reinterpret_cast<char*>(next_file_number), sizeof(*next_file_number));
+    *comparator_name = BytewiseComparator()->Name();
+    if (*version >= 3 && !ReadString(in, comparator_name)) return false;
+    in.read(reinterpret_cast<char*>(num_files), sizeof(*num_files));
+    return in && memcmp(magic, kManifestMagic, sizeof(magic)) == 0 && *version >= 1 && *version <= kManifestVersion;
+}
+
+} // namespace
+
+std::string VersionSet::ManifestComparatorName(Env* env, const std::string& dbname) {
+    InputFileStream in(env, dbname + "/MANIFEST");
+    if (!in.is_open()) return "";
+    uint32_t version = 0, num_files = 0;
+    int next_file_number = 0;
+    std::string comparator_name;
+    if (!ReadManifestHeader(in, &version, &next_file_number, &comparator_name, &num_files)) return "";
+    return comparator_name;
+}
+
+bool VersionSet::ReadManifest() {
+    InputFileStream in(_env, _dbname + "/MANIFEST");
+    if (!in.is_open()) return false;
+
+    uint32_t version = 0, num_files = 0;
+    int next_file_number = 0;
+    std::string comparator_name;
+    if (!ReadManifestHeader(in, &version, &next_file_number, &comparator_name, &num_files)) {
+        std::cerr << "Ignoring invalid manifest in " << _dbname << std::endl;
+        return false;
+    }
+    if (comparator_name != _comparator->Name()) {
+        // Files and key ranges are in another order: rebuilding from the
+        // tables would not help either
+        throw std::invalid_argument("column family in " + _dbname + " was created with comparator " +
+                                    comparator_name + ", not " + _comparator->Name());
+    }
+
+    auto v = std::make_shared<Version>(_dbname, _comparator, _table_cache, _blob_cache);
+    for (uint32_t i = 0; i < num_files; ++i) {
+        int level;
+        FileMetaData f;
+        in.read(reinterpret_cast<char*>(&level), sizeof(level));
+        in.read(reinterpret_cast<char*>(&f.number), sizeof(f.number));
+        in.read(reinterpret_cast<char*>(&f.file_size), sizeof(f.file_size));
+        if (!in || level < 0 || level >= kNumLevels) return false;
+        if (!ReadString(in, &f.smallest) || !ReadString(in, &f.largest)) return false;
+        v->AddFile(level, f);
+    }
+    if (version >= 2) {
+        uint32_t num_blob_files = 0;
+        in.read(reinterpret_cast<char*>(&num_blob_files), sizeof(num_blob_files));
+        for (uint32_t i = 0; i < num_blob_files && in; ++i) {
+            BlobFileMetaData b;
+            in.read(reinterpret_cast<char*>(&b.number), sizeof(b.number));
+            in.read(reinterpret_cast<char*>(&b.total_count), sizeof(b.total_count));
+            in.read(reinterpret_cast<char*>(&b.total_bytes), sizeof(b.total_bytes));
+            in.read(reinterpret_cast<char*>(&b.garbage_count), sizeof(b.garbage_count));
+            in.read(reinterpret_cast<char*>(&b.garbage_bytes), sizeof(b.garbage_bytes));
+            v->_blob_files[b.number] = b;
+        }
+        if (!in) return false;
+    }
+    _next_file_number = next_file_number;
+    _current = v;
+    return true;
 }
 
 void VersionSet::Recover() {
-    if (!fs::exists(_dbname)) return;
+    std::vector<std::string> children;
+    if (!_env->GetChildren(_dbname, &children)) return;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (ReadManifest()) {
+        // Tables and blob files not in the manifest were written by a flush
+        // or compaction that never got installed
+        std::set<int> live;
+        for (int level = 0; level < kNumLevels; ++level) {
+            for (const auto& f : _current->_files[level]) live.insert(f.number);
+        }
+        std::set<int> live_blobs;
+        for (const auto& entry : _current->_blob_files) live_blobs.insert(entry.first);
+        for (const auto& name : children) {
+            size_t dot = name.rfind('.');
+            if (dot == std::string::npos) continue;
+            bool is_blob = name.compare(dot, std::string::npos, ".blob") == 0;
+            if (name.compare(dot, std::string::npos, ".sst") != 0 && !is_blob) continue;
+            try {
+                int file_num = std::stoi(name.substr(0, dot));
+                if ((is_blob ? live_blobs : live).count(file_num) == 0) {
+                    _env->RemoveFile(_dbname + "/" + name);
+                }
+            } catch (...) {
+                continue;
+            }
+        }
+        return;
+    }
 
+    // No manifest yet: every table is treated as L0, ordered by file number
     int max_file_num = 0;
 
-    for (const auto& entry : fs::directory_iterator(_dbname)) {
-        if (entry.path().extension() == ".sst") {
-            std::string filename = entry.path().filename().string();
+    for (const auto& filename : children) {
+        if (filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".sst") == 0) {
             try {
                 int file_num = std::stoi(filename.substr(0, filename.find('.')));
                 if (file_num > max_file_num) max_file_num = file_num;
 
-                auto table = Table::Open(entry.path().string());
+                auto table = _table_cache->GetTable(file_num);
                 if (!table) continue;
 
                 FileMetaData meta;
                 meta.number = file_num;
-                meta.file_size = fs::file_size(entry.path());
-                
+                meta.file_size = table->FileSize();
+
                 auto iter = table->NewIterator();
                 iter->SeekToFirst();
                 if (iter->Valid()) {
@@ -105,7 +602,7 @@ void VersionSet::Recover() {
                     }
                 }
                 delete iter;
-                
+
                 _current->AddFile(0, meta);
             } catch (...) {
                 continue;
@@ -114,6 +611,168 @@ void VersionSet::Recover() {
     }
     _next_file_number = max_file_num + 1;
     _current->SortL0();
+    // Even without tables: the manifest records the comparator from the start
+    WriteManifest(_dbname);
+}
+
+bool VersionSet::PickCompaction(const ColumnFamilyOptions& options, Compaction* c) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    c->inputs.clear();
+    c->input_version = _current;
+    if (options.compaction_style == CompactionStyle::kUniversal) {
+        return PickUniversalCompaction(options, c);
+    }
+    return PickLeveledCompaction(options, c);
+}
+
+bool VersionSet::PickLeveledCompaction(const ColumnFamilyOptions& options, Compaction* c) {
+    const Version& v = *_current;
+    c->inputs.resize(2);
+
+    std::string smallest, largest;
+    if (static_cast<int>(v._files[0].size()) >= options.level0_file_num_compaction_trigger) {
+        // L0 files overlap each other, so all of them go down together
+        c->level = 0;
+        c->inputs[0] = v._files[0];
+    } else {
+        c->level = -1;
+        for (int level = 1; level < kNumLevels - 1; ++level) {
+            if (v.NumLevelBytes(level) <= MaxBytesForLevel(options, level)) continue;
+            // First file past the compact pointer, wrapping around
+            const auto& files = v._files[level];
+            const FileMetaData* pick = &files[0];
+            for (const auto& f : files) {
+                if (_compact_pointer[level].empty() || _comparator->Compare(f.largest, _compact_pointer[level]) > 0) {
+                    pick = &f;
+                    break;
+                }
+            }
+            c->level = level;
+            c->inputs[0].push_back(*pick);
+            break;
+        }
+        if (c->level < 0) return false;
+    }
+    c->output_level = c->level + 1;
+
+    smallest = c->inputs[0][0].smallest;
+    largest = c->inputs[0][0].largest;
+    for (const auto& f : c->inputs[0]) {
+        if (_comparator->Compare(f.smallest, smallest) < 0) smallest = f.smallest;
+        if (_comparator->Compare(f.largest, largest) > 0) largest = f.largest;
+    }
+    c->inputs[1] = v.GetOverlappingInputs(c->level + 1, smallest, largest);
+    _compact_pointer[c->level] = largest;
+    return true;
+}
+
+bool VersionSet::PickUniversalCompaction(const ColumnFamilyOptions& options, Compaction* c) {
+    const Version& v = *_current;
+
+    // Sorted runs, newest first: every L0 file, then every non-empty level
+    struct SortedRun {
+        int level;
+        int file_index; // L0 only
+        uint64_t size;
+    };
+    std::vector<SortedRun> runs;
+    for (int i = static_cast<int>(v._files[0].size()) - 1; i >= 0; --i) {
+        runs.push_back({0, i, v._files[0][i].file_size});
+    }
+    for (int level = 1; level < kNumLevels; ++level) {
+        if (!v._files[level].empty()) runs.push_back({level, -1, v.NumLevelBytes(level)});
+    }
+    if (runs.size() < 2 ||
+        static_cast<int>(runs.size()) < options.level0_file_num_compaction_trigger) {
+        return false;
+    }
+
+    // Merge runs[first..last]
+    size_t first = 0;
+    size_t last = 0;
+    uint64_t newer_bytes = 0;
+    for (size_t i = 0; i + 1 < runs.size(); ++i) newer_bytes += runs[i].size;
+    if (newer_bytes * 100 >= runs.back().size * options.universal_max_size_amplification_percent) {
+        last = runs.size() - 1;
+    }
+    for (size_t start = 0; last == 0 && start + 1 < runs.size(); ++start) {
+        uint64_t total = runs[start].size;
+        size_t end = start;
+        while (end + 1 < runs.size() &&
+               runs[end + 1].size * 100 <= total * (100 + options.universal_size_ratio)) {
+            total += runs[++end].size;
+        }
+        if (end > start) {
+            first = start;
+            last = end;
+        }
+    }
+    if (last == 0 && static_cast<int>(runs.size()) > options.universal_max_sorted_runs) {
+        last = runs.size() - std::max(options.universal_max_sorted_runs, 1);
+    }
+    if (last == 0) return false;
+
+    // The output goes right above the next older run, so reads still find
+    // the runs newest first. It cannot go to L0, where file numbers give the
+    // order, so older runs are taken in until there is room below L0.
+    while (last + 1 < runs.size() && runs[last + 1].level <= 1) {
+        last++;
+    }
+    c->output_level = last + 1 < runs.size() ? runs[last + 1].level - 1 : kNumLevels - 1;
+    c->level = runs[first].level;
+    c->inputs.resize(runs[last].level - c->level + 1);
+    for (size_t i = first; i <= last; ++i) {
+        if (runs[i].level == 0) {
+            c->inputs[0].push_back(v._files[0][runs[i].file_index]);
+        } else {
+            c->inputs[runs[i].level - c->level] = v._files[runs[i].level];
+        }
+    }
+    return true;
+}
+
+void VersionSet::DeleteObsoleteFiles() {
+    std::set<int> in_use;
+    std::set<int> blobs_in_use;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_obsolete_files.empty() && _obsolete_blob_files.empty()) return;
+
+        auto collect = [&in_use, &blobs_in_use](const Version& v) {
+            for (int level = 0; level < kNumLevels; ++level) {
+                for (const auto& f : v._files[level]) in_use.insert(f.number);
+            }
+            for (const auto& entry : v._blob_files) blobs_in_use.insert(entry.first);
+        };
+        collect(*_current);
+        std::vector<std::weak_ptr<Version>> still_live;
+        for (auto& weak : _live_versions) {
+            if (auto v = weak.lock()) {
+                collect(*v);
+                still_live.push_back(weak);
+            }
+        }
+        _live_versions.swap(still_live);
+
+        for (auto it = _obsolete_files.begin(); it != _obsolete_files.end();) {
+            if (in_use.count(*it)) {
+                ++it;
+                continue;
+            }
+            _table_cache->Evict(*it);
+            _env->RemoveFile(_dbname + "/" + std::to_string(*it) + ".sst");
+            it = _obsolete_files.erase(it);
+        }
+        for (auto it = _obsolete_blob_files.begin(); it != _obsolete_blob_files.end();) {
+            if (blobs_in_use.count(*it)) {
+                ++it;
+                continue;
+            }
+            _blob_cache->Evict(*it);
+            _env->RemoveFile(BlobFileName(_dbname, *it));
+            it = _obsolete_blob_files.erase(it);
+        }
+    }
 }
 
 } // namespace lsm
@@ -3,66 +3,228 @@
 #include <vector>
 #include <memory>
 #include <mutex>
+#include <set>
+#include <unordered_map>
+#include <map>
+#include "core/options.h"
+#include "core/blob/blob_file.h"
+#include "core/iterator.h"
 #include "core/sstable/table.h"
 
 namespace lsm {
 
+static const int kNumLevels = 7;
+
 struct FileMetaData {
     int number;
     uint64_t file_size;
-    std::string smallest; // Smallest key
-    std::string largest;  // Largest key
+    // Key range, including the [begin, end] span of its range tombstones. A
+    // tombstone's exclusive end may equal the next file's smallest key.
+    std::string smallest;
+    std::string largest;
+};
+
+// Open tables shared by every Version of a VersionSet, and the row cache
+// their lookups go through, if any. Thread-safe.
+class TableCache {
+public:
+    TableCache(Env* env, const std::string& dbname, std::shared_ptr<const Comparator> comparator,
+               std::shared_ptr<RowCache> row_cache);
+
+    std::shared_ptr<Table> GetTable(int file_number);
+    void Evict(int file_number);
+
+    RowCache* row_cache() const { return _row_cache.get(); } // May be null
+    // This VersionSet's namespace in the row cache
+    uint64_t row_cache_id() const { return _row_cache_id; }
+
+private:
+    Env* _env;
+    std::string _dbname;
+    std::shared_ptr<const Comparator> _comparator;
+    std::shared_ptr<RowCache> _row_cache;
+    uint64_t _row_cache_id = 0;
+    std::mutex _mutex;
+    std::unordered_map<int, std::shared_ptr<Table>> _tables;
+};
+
+// A set of changes applied atomically to the current Version
+struct VersionEdit {
+    std::vector<std::pair<int, FileMetaData>> new_files;  // (level, file)
+    std::vector<std::pair<int, int>> deleted_files;       // (level, file number)
+    std::vector<BlobFileMetaData> new_blob_files;
+    // Per blob file: (count, bytes) of references dropped or relocated
+    std::map<int, std::pair<uint64_t, uint64_t>> blob_garbage;
+
+    void AddFile(int level, const FileMetaData& f) { new_files.push_back({level, f}); }
+    void DeleteFile(int level, int number) { deleted_files.push_back({level, number}); }
+    void AddBlobFile(const BlobFileMetaData& f) { new_blob_files.push_back(f); }
+    void AddBlobGarbage(int number, uint64_t bytes) {
+        auto& garbage = blob_garbage[number];
+        garbage.first++;
+        garbage.second += bytes;
+    }
 };
 
 class Version {
 public:
-    Version(const std::string& dbname);
+    Version(const std::string& dbname, std::shared_ptr<const Comparator> comparator,
+            std::shared_ptr<TableCache> table_cache, std::shared_ptr<BlobFileCache> blob_cache);
     ~Version();
 
     // Add a file to the version
     void AddFile(int level, const FileMetaData& f);
-    
-    // Look up key in the version's files
-    // Returns: 0=NotFound, 1=Found, 2=Deleted
-    int Get(const std::string& key, std::string* value);
+
+    // Look up key in the version's files, newest first
+    // Returns: 0=NotFound, 1=Found, 2=Deleted (or expired at now_ms)
+    int Get(const std::string& key, std::string* value, uint64_t now_ms);
+    // Get for many keys, with the table reads of all of them in flight at
+    // once (see AsyncIO). results[i] is the Get result for keys[i].
+    void MultiGet(const std::vector<std::string>& keys, std::vector<std::string>* values,
+                  std::vector<int>* results, uint64_t now_ms);
 
     std::vector<FileMetaData> GetFiles(int level) const;
-    
+    int NumFiles(int level) const;
+    uint64_t NumLevelBytes(int level) const;
+    // Bytes compactions of options.compaction_style would have to rewrite to
+    // bring every level back within its limits
+    uint64_t EstimatedPendingCompactionBytes(const ColumnFamilyOptions& options) const;
+    // Files of level whose key range intersects [begin, end]
+    std::vector<FileMetaData> GetOverlappingInputs(int level, const std::string& begin,
+                                                   const std::string& end) const;
+
+    // Append an iterator per file, newest data first. The iterators borrow
+    // tables from the cache, so this Version must outlive them.
+    // With a prefix_extractor, only files that may hold keys starting with
+    // prefix (one it produced) are included.
+    void AddIterators(std::vector<std::unique_ptr<InternalIterator>>* iters,
+                      const PrefixExtractor* prefix_extractor = nullptr,
+                      const std::string& prefix = std::string());
+    std::shared_ptr<Table> GetTable(int file_number) { return _table_cache->GetTable(file_number); }
+
+    // Resolves an encoded BlobIndex found in one of the tables
+    bool GetBlob(const std::string& blob_index, std::string* value) { return _blob_cache->Get(blob_index, value); }
+    const std::shared_ptr<BlobFileCache>& blob_cache() const { return _blob_cache; }
+    // Garbage ratio of a live blob file, 0 if unknown
+    double BlobGarbageRatio(int number) const;
+    std::vector<BlobFileMetaData> GetBlobFiles() const;
+
     void SortL0();
 
 private:
+    friend class VersionSet;
+    friend struct Compaction;
+
+    // The newest table entry of key, found without I/O: returns 1 with its
+    // table, file number and handle, or the final result (0 or 2)
+    int Locate(const std::string& key, std::shared_ptr<Table>* table, int* file_number,
+               Table::EntryHandle* handle);
+    template <typename Order>
+    int Locate(const Order& order, const std::string& key, std::shared_ptr<Table>* table, int* file_number,
+               Table::EntryHandle* handle);
+    // Result of key's entry in file_number from the row cache. Returns
+    // false if the cache is off or does not hold it.
+    bool GetCachedRow(int file_number, const std::string& key, std::string* value, uint64_t now_ms,
+                      int* result);
+    // Decodes an entry of file_number read for key, resolving a blob index
+    // into its value, and adds the outcome to the row cache
+    int DecodeEntry(int file_number, const std::string& key, const ReadRequest& req, std::string* value,
+                    uint64_t now_ms);
+
     std::string _dbname;
-    // For now, just support Level 0
-    std::vector<FileMetaData> _files[7]; // 7 levels
-    
-    // Simple cache for open tables to avoid re-opening
-    // Key: file_number, Value: Table
-    // Mutable because Get is const but we might want to cache tables
-    mutable std::vector<std::pair<int, std::shared_ptr<Table>>> _table_cache;
-    
-    std::shared_ptr<Table> GetTable(int file_number);
+    std::shared_ptr<const Comparator> _comparator;
+    // L0 files may overlap and are kept in file-number (age) order. Deeper
+    // levels hold disjoint files sorted by smallest key.
+    std::vector<FileMetaData> _files[kNumLevels];
+
+    // Live blob files by number
+    std::map<int, BlobFileMetaData> _blob_files;
+
+    // Open tables and blob files, shared with the other Versions of the same VersionSet
+    std::shared_ptr<TableCache> _table_cache;
+    std::shared_ptr<BlobFileCache> _blob_cache;
 };
 
+// Inputs of one compaction. Leveled: files from level and the overlapping
+// files of level + 1. Universal: whole sorted runs, i.e. consecutive L0 files
+// and entire levels.
+struct Compaction {
+    int level; // Shallowest input level
+    int output_level;
+    // inputs[i]: input files of level + i
+    std::vector<std::vector<FileMetaData>> inputs;
+    std::shared_ptr<Version> input_version;
+
+    size_t NumInputFiles() const;
+    // True if no level below the output can hold key, so deletions and
+    // expired entries can be dropped instead of being carried down
+    bool IsBaseLevelForKey(const std::string& key) const;
+    // Same for every key of the range tombstone [begin, end)
+    bool IsBaseLevelForRange(const std::string& begin, const std::string& end) const;
+};
+
+// Thread-safe: current() hands out a reference-counted Version, so readers
+// keep using it safely while a concurrent LogAndApply installs a new one.
+//
+// The file list is persisted in MANIFEST, rewritten on every LogAndApply,
+// along with the name of the comparator the files are sorted by.
+// Files removed by an edit, and blob files that became all garbage, are only
+// deleted from disk once no live Version references them (see DeleteObsoleteFiles).
 class VersionSet {
 public:
-    VersionSet(const std::string& dbname);
+    // The files are those of env; row_cache may be null
+    VersionSet(Env* env, const std::string& dbname, std::shared_ptr<const Comparator> comparator,
+               std::shared_ptr<RowCache> row_cache = nullptr);
     ~VersionSet();
 
-    Version* current() const { return _current; }
-    
+    std::shared_ptr<Version> current() const;
+    Env* env() const { return _env; }
+
     // Allocate a new file number
-    int NewFileNumber() { return _next_file_number++; }
-    
-    // Apply a change (e.g. add a new SSTable)
-    void LogAndApply(Version* edit); // Simplified
+    int NewFileNumber();
 
-    // Recover from disk (scan .sst files)
+    // Apply a change (e.g. add a new SSTable) on top of the current version
+    void LogAndApply(const VersionEdit& edit);
+
+    // Recover from MANIFEST, or from the .sst files of a DB that predates it.
+    // Throws std::invalid_argument if the MANIFEST names another comparator.
     void Recover();
+    // Comparator name recorded in the MANIFEST of dbname, empty without one
+    static std::string ManifestComparatorName(Env* env, const std::string& dbname);
+
+    // Choose the next compaction of options.compaction_style. Returns false
+    // if nothing needs it.
+    bool PickCompaction(const ColumnFamilyOptions& options, Compaction* c);
+
+    // Delete files dropped by earlier edits that no live Version uses anymore
+    void DeleteObsoleteFiles();
+
+    // Hard-links (or copies) every file of the current Version into dir and
+    // writes a manifest listing them there, making dir a copy of the family
+    bool CreateCheckpoint(const std::string& dir);
 
 private:
+    Env* _env;
     std::string _dbname;
+    std::shared_ptr<const Comparator> _comparator;
+    mutable std::mutex _mutex;
     int _next_file_number;
-    Version* _current;
+    std::shared_ptr<TableCache> _table_cache;
+    std::shared_ptr<BlobFileCache> _blob_cache;
+    std::shared_ptr<Version> _current;
+    // Every Version handed out, to know which files readers may still use
+    std::vector<std::weak_ptr<Version>> _live_versions;
+    std::set<int> _obsolete_files;
+    std::set<int> _obsolete_blob_files;
+    // Per level, the largest key of the last compaction, so that compactions
+    // rotate through the key space
+    std::string _compact_pointer[kNumLevels];
+
+    void Install(std::shared_ptr<Version> v); // REQUIRES: _mutex held
+    bool PickLeveledCompaction(const ColumnFamilyOptions& options, Compaction* c); // REQUIRES: _mutex held
+    bool PickUniversalCompaction(const ColumnFamilyOptions& options, Compaction* c); // REQUIRES: _mutex held
+    bool WriteManifest(const std::string& dir); // REQUIRES: _mutex held
+    bool ReadManifest();
 };
 
 } // namespace lsm
@@ -1,42 +1,60 @@
 #include "wal.h"
 #include <iostream>
-#include <fcntl.h>
-#include <unistd.h>
 #include <cstring>
 #include <vector>
 
 namespace lsm {
 
-    WAL::WAL(const std::string& path) : _path(path), _fd(-1) {
-        _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
-        if (_fd < 0) {
+    WAL::WAL(Env* env, const std::string& path) : _path(path) {
+        _file = env->NewWritableFile(path, true);
+        if (!_file) {
             std::cerr << "Failed to open WAL file: " << path << " Error: " << strerror(errno) << std::endl;
         }
     }
 
-    WAL::~WAL() {
-        if (_fd >= 0) {
-            ::close(_fd);
-        }
-    }
-
-    void WAL::Append(const std::string& key, const std::string& value, bool is_delete) {
+    void WAL::Append(const WALRecord& record) {
         std::lock_guard<std::mutex> lock(_mutex);
-        if (_fd < 0) return;
+        if (!_file) return;
 
-        // Simple format: type(1) | key_len(4) | key | val_len(4) | val
-        // type: 0 = put, 1 = delete
+        // Simple format: type(1) | [cf_id(4)] | [expire_at(8)] | [shard(4) num_shards(4)]
+        //                | [sequence(8)] | key_len(4) | key | val_len(4) | val
+        // type: see WALRecordType; optional fields are present only when flagged
         
-        char type = is_delete ? 1 : 0;
+        const std::string& key = record.key;
+        const std::string& value = record.value;
+        bool is_delete = record.is_delete;
+        char type = is_delete ? kTypeDeletion : kTypeValue;
+        if (record.cf_id != 0) type |= kFlagColumnFamily;
+        if (record.expire_at != 0 && !is_delete) type |= kFlagExpiry;
+        if (record.is_range_delete && !is_delete) type |= kFlagRangeDeletion;
+        if (record.sequence != 0) type |= kFlagSequence;
         uint32_t klen = key.size();
         uint32_t vlen = value.size();
 
         // Use a buffer to minimize syscalls
         std::vector<char> buffer;
-        // Estimate size: 1 + 4 + klen + 4 + vlen
-        buffer.reserve(1 + 4 + klen + 4 + vlen);
+        // Estimate size: 1 + 4 + 8 + 8 + 8 + 4 + klen + 4 + vlen
+        buffer.reserve(1 + 4 + 8 + 8 + 8 + 4 + klen + 4 + vlen);
 
         buffer.push_back(type);
+        if (type & kFlagColumnFamily) {
+            const char* cf_ptr = reinterpret_cast<const char*>(&record.cf_id);
+            buffer.insert(buffer.end(), cf_ptr, cf_ptr + 4);
+        }
+        if (type & kFlagExpiry) {
+            const char* exp_ptr = reinterpret_cast<const char*>(&record.expire_at);
+            buffer.insert(buffer.end(), exp_ptr, exp_ptr + 8);
+        }
+        if (type & kFlagRangeDeletion) {
+            const char* shard_ptr = reinterpret_cast<const char*>(&record.shard);
+            buffer.insert(buffer.end(), shard_ptr, shard_ptr + 4);
+            const char* num_ptr = reinterpret_cast<const char*>(&record.num_shards);
+            buffer.insert(buffer.end(), num_ptr, num_ptr + 4);
+        }
+        if (type & kFlagSequence) {
+            const char* seq_ptr = reinterpret_cast<const char*>(&record.sequence);
+            buffer.insert(buffer.end(), seq_ptr, seq_ptr + 8);
+        }
         
         const char* klen_ptr = reinterpret_cast<const char*>(&klen);
         buffer.insert(buffer.end(), klen_ptr, klen_ptr + 4);
@@ -53,8 +71,7 @@ namespace lsm {
             buffer.insert(buffer.end(), zero_ptr, zero_ptr + 4);
         }
         
-        ssize_t written = ::write(_fd, buffer.data(), buffer.size());
-        if (written < 0 || static_cast<size_t>(written) != buffer.size()) {
+        if (!_file->Append(buffer.data(), buffer.size())) {
              std::cerr << "Failed to write to WAL: " << strerror(errno) << std::endl;
         }
         // No fsync here by default, relying on OS cache (Scheme A)
@@ -62,9 +79,67 @@ namespace lsm {
 
     void WAL::Sync() {
         std::lock_guard<std::mutex> lock(_mutex);
-        if (_fd >= 0) {
-            ::fsync(_fd);
+        if (_file) {
+            _file->Sync();
+        }
+    }
+
+    WALReader::WALReader(Env* env, const std::string& path) : _file(env, path) {}
+
+    bool WALReader::ReadRecord(WALRecord* record) {
+        if (!_file.is_open() || _file.peek() == EOF) return false;
+
+        char type;
+        uint32_t klen, vlen;
+
+        // Read header
+        _file.read(&type, 1);
+        if (_file.gcount() != 1) return false;
+        if (type & ~(kTypeDeletion | kFlagColumnFamily | kFlagExpiry | kFlagRangeDeletion | kFlagSequence)) return false;
+
+        record->cf_id = 0;
+        if (type & kFlagColumnFamily) {
+            _file.read(reinterpret_cast<char*>(&record->cf_id), sizeof(record->cf_id));
+            if (_file.gcount() != sizeof(record->cf_id)) return false;
+        }
+        record->expire_at = 0;
+        if (type & kFlagExpiry) {
+            _file.read(reinterpret_cast<char*>(&record->expire_at), sizeof(record->expire_at));
+            if (_file.gcount() != sizeof(record->expire_at)) return false;
+        }
+        record->is_range_delete = (type & kFlagRangeDeletion) != 0;
+        record->shard = 0;
+        record->num_shards = 1;
+        if (record->is_range_delete) {
+            _file.read(reinterpret_cast<char*>(&record->shard), sizeof(record->shard));
+            _file.read(reinterpret_cast<char*>(&record->num_shards), sizeof(record->num_shards));
+            if (_file.gcount() != sizeof(record->num_shards)) return false;
+        }
+        record->sequence = 0;
+        if (type & kFlagSequence) {
+            _file.read(reinterpret_cast<char*>(&record->sequence), sizeof(record->sequence));
+            if (_file.gcount() != sizeof(record->sequence)) return false;
         }
+        record->is_delete = (type & kTypeDeletion) != 0;
+
+        _file.read(reinterpret_cast<char*>(&klen), sizeof(klen));
+        if (_file.gcount() != sizeof(klen)) return false;
+
+        // Read key
+        record->key.resize(klen);
+        _file.read(&record->key[0], klen);
+        if (_file.gcount() != klen) return false;
+
+        // Read value (a delete carries a dummy zero vlen)
+        _file.read(reinterpret_cast<char*>(&vlen), sizeof(vlen));
+        if (_file.gcount() != sizeof(vlen)) return false;
+
+        record->value.resize(vlen);
+        _file.read(&record->value[0], vlen);
+        if (_file.gcount() != vlen) return false;
+
+        _valid_offset = _file.tellg();
+        return true;
     }
 
 } // namespace lsm
@@ -1,21 +1,64 @@
 #pragma once
 #include <string>
 #include <mutex>
+#include <memory>
+#include <cstdint>
+#include "util/env.h"
 
 namespace lsm {
 
+// WAL record type byte: a put or a delete plus flags for optional fields.
+// A plain put (0) or delete (1) in the default family has no flags set, so
+// logs written before the flags existed replay unchanged.
+enum WALRecordType : char {
+    kTypeValue = 0,
+    kTypeDeletion = 1,
+    kFlagColumnFamily = 0x2,  // cf_id(4) follows the type byte
+    kFlagExpiry = 0x4,        // expire_at(8) follows cf_id (puts only)
+    kFlagRangeDeletion = 0x8, // shard(4) num_shards(4) follow; deletes [key, value)
+    kFlagSequence = 0x10,     // sequence(8) follows the other optional fields
+};
+
+struct WALRecord {
+    uint32_t cf_id = 0;
+    bool is_delete = false;
+    // A DeleteRange of [key, value) over the keys of one write shard (see
+    // RangeTombstone). Each shard logs its own copy.
+    bool is_range_delete = false;
+    uint32_t shard = 0;
+    uint32_t num_shards = 1;
+    uint64_t expire_at = 0; // Unix time in ms, 0 = never
+    uint64_t sequence = 0;  // See DB::GetLatestSequenceNumber; 0 in logs that predate it
+    std::string key;
+    std::string value;
+};
+
 class WAL {
 public:
-    WAL(const std::string& path);
-    ~WAL();
+    WAL(Env* env, const std::string& path);
 
-    void Append(const std::string& key, const std::string& value, bool is_delete);
+    void Append(const WALRecord& record);
     void Sync();
     
 private:
     std::string _path;
-    int _fd;
+    std::unique_ptr<WritableFile> _file;
     std::mutex _mutex;
 };
 
+// Sequential reader used for recovery. Stops at the first incomplete record.
+class WALReader {
+public:
+    WALReader(Env* env, const std::string& path);
+
+    bool ok() const { return _file.is_open(); }
+    bool ReadRecord(WALRecord* record);
+    // Offset just past the last complete record
+    uint64_t ValidOffset() const { return _valid_offset; }
+
+private:
+    InputFileStream _file;
+    uint64_t _valid_offset = 0;
+};
+
 } // namespace lsm
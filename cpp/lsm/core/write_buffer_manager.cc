@@ -0,0 +1,75 @@
+#include "write_buffer_manager.h"
+#include <chrono>
+
+namespace lsm {
+
+WriteBufferManager::WriteBufferManager(size_t buffer_size)
+    : _buffer_size(buffer_size), _mutable_limit(buffer_size - buffer_size / 8) {}
+
+bool WriteBufferManager::ShouldFlush() const {
+    size_t mutable_used = mutable_memtable_memory_usage();
+    if (mutable_used >= _mutable_limit) return true;
+    // Flushes already running will bring the total down; only add another
+    // if most of it is still being written to
+    return memory_usage() >= _buffer_size && mutable_used >= _buffer_size / 2;
+}
+
+void WriteBufferManager::ReserveMem(size_t bytes) {
+    _memory_used.fetch_add(bytes, std::memory_order_relaxed);
+    _mutable_used.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void WriteBufferManager::ScheduleFreeMem(size_t bytes) {
+    _mutable_used.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void WriteBufferManager::FreeMem(size_t bytes, bool is_mutable) {
+    _memory_used.fetch_sub(bytes, std::memory_order_relaxed);
+    if (is_mutable) {
+        _mutable_used.fetch_sub(bytes, std::memory_order_relaxed);
+        return;
+    }
+    { std::lock_guard<std::mutex> lock(_stall_mutex); }
+    _stall_cv.notify_all();
+}
+
+uint64_t WriteBufferManager::Register(std::function<size_t()> largest, std::function<void()> flush_largest) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint64_t id = _next_id++;
+    _members[id] = {std::move(largest), std::move(flush_largest)};
+    return id;
+}
+
+void WriteBufferManager::Unregister(uint64_t id) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _members.erase(id);
+}
+
+void WriteBufferManager::MaybeFlush() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    // Checked again: a concurrent writer may have flushed already
+    if (!ShouldFlush()) return;
+    Member* target = nullptr;
+    size_t target_usage = 0;
+    for (auto& member : _members) {
+        size_t usage = member.second.largest();
+        if (usage > target_usage) {
+            target = &member.second;
+            target_usage = usage;
+        }
+    }
+    if (target) target->flush_largest();
+}
+
+void WriteBufferManager::WaitForRoom() {
+    if (memory_usage() < _buffer_size) return;
+    MaybeFlush();
+    std::unique_lock<std::mutex> lock(_stall_mutex);
+    // Nothing to wait for once only mutable memtables are left: the write
+    // goes ahead and its MaybeFlush switches one of them
+    while (memory_usage() >= _buffer_size && memory_usage() > mutable_memtable_memory_usage()) {
+        _stall_cv.wait_for(lock, std::chrono::milliseconds(10));
+    }
+}
+
+} // namespace lsm
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <map>
+
+namespace lsm {
+
+// Caps the memory of the memtables of every DB it is shared with
+// (Options::write_buffer_manager). Memtables charge the bytes they take as
+// they grow and release them when destroyed after their flush.
+//
+// Once the memtables still being written hold more than 7/8 of the budget,
+// or all memtables together the whole budget with half of it still being
+// written, the largest memtable set of any member DB is switched and
+// flushed. Memtables are flushed per write shard, all column families of
+// the shard together, since they share its WAL. Writers that find the whole
+// budget used wait for the running flushes to free some of it.
+class WriteBufferManager {
+public:
+    explicit WriteBufferManager(size_t buffer_size);
+
+    size_t buffer_size() const { return _buffer_size; }
+    // Bytes of every charged memtable, including those being flushed
+    size_t memory_usage() const { return _memory_used.load(std::memory_order_relaxed); }
+    // Bytes of the memtables still accepting writes
+    size_t mutable_memtable_memory_usage() const { return _mutable_used.load(std::memory_order_relaxed); }
+
+    bool ShouldFlush() const;
+
+    // Memtable accounting
+    void ReserveMem(size_t bytes);
+    // The memtable stopped taking writes; its bytes are freed by its flush
+    void ScheduleFreeMem(size_t bytes);
+    // mutable: the bytes were not passed to ScheduleFreeMem
+    void FreeMem(size_t bytes, bool is_mutable);
+
+    // A member DB. largest() returns the bytes of its largest mutable
+    // memtable set, flush_largest() switches that set to be flushed.
+    uint64_t Register(std::function<size_t()> largest, std::function<void()> flush_largest);
+    // Once this returns, neither function of the member is running or called again
+    void Unregister(uint64_t id);
+
+    // Flushes the largest memtable set of all members if still ShouldFlush().
+    // Called by writers after their write, holding no DB lock.
+    void MaybeFlush();
+    // Blocks while the memtables use the whole budget and a flush is under
+    // way to free some of it. Called by writers before their write, holding
+    // no DB lock.
+    void WaitForRoom();
+
+private:
+    struct Member {
+        std::function<size_t()> largest;
+        std::function<void()> flush_largest;
+    };
+
+    const size_t _buffer_size;
+    const size_t _mutable_limit;
+    std::atomic<size_t> _memory_used{0};
+    std::atomic<size_t> _mutable_used{0};
+
+    // Serializes the choice of what to flush with membership changes
+    std::mutex _mutex;
+    std::map<uint64_t, Member> _members;
+    uint64_t _next_id = 1;
+
+    // Wakes stalled writers when a flushed memtable is freed
+    std::mutex _stall_mutex;
+    std::condition_variable _stall_cv;
+};
+
+} // namespace lsm
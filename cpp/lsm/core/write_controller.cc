@@ -0,0 +1,56 @@
+#include "write_controller.h"
+#include <algorithm>
+#include <chrono>
+
+namespace lsm {
+
+uint64_t SteadyMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+WriteController::WriteController(uint64_t max_delayed_write_rate)
+    : _max_rate(std::max(max_delayed_write_rate, kMinDelayedWriteRate)), _rate(_max_rate) {}
+
+uint64_t WriteController::GetDelay(uint64_t num_bytes) {
+    uint64_t cost = num_bytes * 1000000 / delayed_write_rate();
+    uint64_t now = SteadyMicros();
+    std::lock_guard<std::mutex> lock(_mutex);
+    // An idle bucket does not save up credit for a burst
+    uint64_t start = std::max(_next_free_us, now);
+    _next_free_us = start + cost;
+    return start - now;
+}
+
+void WriteController::set_delayed_write_rate(uint64_t rate) {
+    _rate.store(std::min(std::max(rate, kMinDelayedWriteRate), _max_rate), std::memory_order_relaxed);
+}
+
+void WriteController::RecordDelay(uint64_t micros) {
+    _num_delayed.fetch_add(1, std::memory_order_relaxed);
+    _delay_micros.fetch_add(micros, std::memory_order_relaxed);
+}
+
+void WriteController::RecordStop(uint64_t micros) {
+    _num_stopped.fetch_add(1, std::memory_order_relaxed);
+    _stop_micros.fetch_add(micros, std::memory_order_relaxed);
+}
+
+void WriteController::RecordMemTableStall(uint64_t micros) {
+    _num_memtable_stalls.fetch_add(1, std::memory_order_relaxed);
+    _memtable_stall_micros.fetch_add(micros, std::memory_order_relaxed);
+}
+
+WriteStallStats WriteController::GetStats() const {
+    WriteStallStats stats;
+    stats.delayed_write_rate = delayed_write_rate();
+    stats.num_delayed_writes = _num_delayed.load(std::memory_order_relaxed);
+    stats.delay_micros = _delay_micros.load(std::memory_order_relaxed);
+    stats.num_stopped_writes = _num_stopped.load(std::memory_order_relaxed);
+    stats.stop_micros = _stop_micros.load(std::memory_order_relaxed);
+    stats.num_memtable_stalls = _num_memtable_stalls.load(std::memory_order_relaxed);
+    stats.memtable_stall_micros = _memtable_stall_micros.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace lsm
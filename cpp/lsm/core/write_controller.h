@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+
+namespace lsm {
+
+struct WriteStallStats {
+    // Current state
+    bool stopped = false;
+    bool delayed = false;
+    uint64_t delayed_write_rate = 0; // Bytes/s while delayed
+
+    // Writes slowed down, and the time they spent sleeping
+    uint64_t num_delayed_writes = 0;
+    uint64_t delay_micros = 0;
+    // Writes held at a stop trigger (L0 files or compaction debt)
+    uint64_t num_stopped_writes = 0;
+    uint64_t stop_micros = 0;
+    // Writes that filled the memtable while the previous one of the shard
+    // was still being flushed
+    uint64_t num_memtable_stalls = 0;
+    uint64_t memtable_stall_micros = 0;
+};
+
+// Paces delayed writes of a DB: a token bucket refilled at
+// delayed_write_rate bytes/s, which the DB lowers while compactions fall
+// further behind and raises while they catch up. Also keeps the stall
+// counters. Thread-safe.
+class WriteController {
+public:
+    explicit WriteController(uint64_t max_delayed_write_rate);
+
+    // Microseconds the caller must wait before writing num_bytes. Callers
+    // reserve their share in turn, so together they write at the rate.
+    uint64_t GetDelay(uint64_t num_bytes);
+
+    uint64_t max_delayed_write_rate() const { return _max_rate; }
+    uint64_t delayed_write_rate() const { return _rate.load(std::memory_order_relaxed); }
+    // Clamped to [kMinDelayedWriteRate, max_delayed_write_rate]
+    void set_delayed_write_rate(uint64_t rate);
+
+    void RecordDelay(uint64_t micros);
+    void RecordStop(uint64_t micros);
+    void RecordMemTableStall(uint64_t micros);
+    // The counters; the current state fields are left to the caller
+    WriteStallStats GetStats() const;
+
+    static constexpr uint64_t kMinDelayedWriteRate = 16 * 1024;
+
+private:
+    const uint64_t _max_rate;
+    std::atomic<uint64_t> _rate;
+
+    std::mutex _mutex;
+    uint64_t _next_free_us = 0; // Time the bucket is empty again; steady clock
+
+    std::atomic<uint64_t> _num_delayed{0};
+    std::atomic<uint64_t> _delay_micros{0};
+    std::atomic<uint64_t> _num_stopped{0};
+    std::atomic<uint64_t> _stop_micros{0};
+    std::atomic<uint64_t> _num_memtable_stalls{0};
+    std::atomic<uint64_t> _memtable_stall_micros{0};
+};
+
+// Monotonic microseconds, for measuring stalls
+uint64_t SteadyMicros();
+
+} // namespace lsm
@@ -11,15 +11,124 @@ extern "C" {
     // Opaque handles for engine and options
     typedef struct lsm_db_t lsm_db_t;
     typedef struct lsm_options_t lsm_options_t;
+    typedef struct lsm_writeoptions_t lsm_writeoptions_t;
     typedef struct lsm_writebatch_t lsm_writebatch_t;
     typedef struct lsm_iterator_t lsm_iterator_t;
+    typedef struct lsm_column_family_t lsm_column_family_t;
+    typedef struct lsm_compactionfilter_t lsm_compactionfilter_t;
+    typedef struct lsm_sstfilewriter_t lsm_sstfilewriter_t;
+    typedef struct lsm_completion_queue_t lsm_completion_queue_t;
+    typedef struct lsm_write_buffer_manager_t lsm_write_buffer_manager_t;
+    typedef struct lsm_update_iterator_t lsm_update_iterator_t;
 
     // ======== Options ========
     lsm_options_t* lsm_options_create();
     void lsm_options_destroy(lsm_options_t* options);
     void lsm_options_set_create_if_missing(lsm_options_t* options, uint8_t value);
+    // Fsync the WAL on every write instead of in the background (default 0)
+    void lsm_options_set_sync(lsm_options_t* options, uint8_t value);
+    // Number of independent memtable+WAL write shards (default 1)
+    void lsm_options_set_num_shards(lsm_options_t* options, int value);
+    // Threads of the flush pool and of the compaction pool (defaults 1 and 2)
+    void lsm_options_set_max_background_flushes(lsm_options_t* options, int value);
+    void lsm_options_set_max_background_compactions(lsm_options_t* options, int value);
+    void lsm_options_set_max_async_workers(lsm_options_t* options, int value);
+    // Key ranges a compaction is split into and run in parallel (default 1)
+    void lsm_options_set_max_subcompactions(lsm_options_t* options, int value);
+    // MemTable size (per shard) that triggers a flush; applies per column family
+    void lsm_options_set_write_buffer_size(lsm_options_t* options, size_t value);
+    // Write stalls: writes slow down to the delayed write rate (bytes/s) at the
+    // slowdown triggers and wait for compactions at the stop triggers (0 = off)
+    void lsm_options_set_level0_slowdown_writes_trigger(lsm_options_t* options, int value);
+    void lsm_options_set_level0_stop_writes_trigger(lsm_options_t* options, int value);
+    void lsm_options_set_soft_pending_compaction_bytes_limit(lsm_options_t* options, uint64_t value);
+    void lsm_options_set_hard_pending_compaction_bytes_limit(lsm_options_t* options, uint64_t value);
+    void lsm_options_set_delayed_write_rate(lsm_options_t* options, uint64_t value);
+    // LSM_COMPACTION_LEVELED (default) or LSM_COMPACTION_UNIVERSAL, which merges
+    // sorted runs of similar size for lower write amplification
+    #define LSM_COMPACTION_LEVELED 0
+    #define LSM_COMPACTION_UNIVERSAL 1
+    void lsm_options_set_compaction_style(lsm_options_t* options, int style);
+    // Key order: LSM_COMPARATOR_BYTEWISE (default), LSM_COMPARATOR_REVERSE_BYTEWISE,
+    // or LSM_COMPARATOR_UINT64 for 8-byte big-endian integer keys. A family
+    // must always be opened with the comparator it was created with.
+    #define LSM_COMPARATOR_BYTEWISE 0
+    #define LSM_COMPARATOR_REVERSE_BYTEWISE 1
+    #define LSM_COMPARATOR_UINT64 2
+    void lsm_options_set_comparator(lsm_options_t* options, int comparator);
+    // Universal compaction tuning (defaults 1, 8 and 200), see Options
+    void lsm_options_set_universal_size_ratio(lsm_options_t* options, int percent);
+    void lsm_options_set_universal_max_sorted_runs(lsm_options_t* options, int value);
+    void lsm_options_set_universal_max_size_amplification_percent(lsm_options_t* options, int percent);
+    // Applies to the default family, or to the family created with these options.
+    // The options keep their own reference; the filter handle can be destroyed.
+    void lsm_options_set_compaction_filter(lsm_options_t* options, lsm_compactionfilter_t* filter);
+    // Give every table a hash index for faster point lookups (default off)
+    void lsm_options_set_table_hash_index(lsm_options_t* options, uint8_t value);
+    // Give tables of evenly spread keys (fixed-width IDs) a learned index (default off)
+    void lsm_options_set_table_learned_index(lsm_options_t* options, uint8_t value);
+    // Prefixes for prefix Bloom filters and prefix iterators: the first length
+    // bytes, or everything up to and including the count-th delimiter
+    void lsm_options_set_prefix_extractor_fixed(lsm_options_t* options, size_t length);
+    void lsm_options_set_prefix_extractor_delimited(lsm_options_t* options, char delimiter, int count);
+    // Values of at least this many bytes are stored in blob files (0 = disabled)
+    void lsm_options_set_min_blob_size(lsm_options_t* options, uint64_t value);
+    // Memtable memory budget shared by every DB opened with the same manager.
+    // The options keep their own reference; the manager handle can be destroyed.
+    void lsm_options_set_write_buffer_manager(lsm_options_t* options, lsm_write_buffer_manager_t* manager);
+    // Budget of this DB's memtables alone, if no manager is set (0 = none)
+    void lsm_options_set_db_write_buffer_size(lsm_options_t* options, size_t value);
+    // Bytes of the cache of point lookup results of this DB's tables (0 = off)
+    void lsm_options_set_row_cache_size(lsm_options_t* options, size_t value);
+    // Bytes of a second tier of that cache, holding the rows it evicts compressed (0 = off)
+    void lsm_options_set_row_cache_compressed_size(lsm_options_t* options, size_t value);
+    // Bytes of flushed WALs kept for lsm_get_updates_since (0 = none)
+    void lsm_options_set_wal_retention_size(lsm_options_t* options, uint64_t value);
+    // Where the DB keeps its files: LSM_ENV_DEFAULT (the local file system) or
+    // LSM_ENV_MEMORY, a fresh in-memory file system owned by the options, so
+    // the DB is gone once it is closed and the options destroyed. Opening the
+    // same path again with the same options finds it.
+    #define LSM_ENV_DEFAULT 0
+    #define LSM_ENV_MEMORY 1
+    void lsm_options_set_env(lsm_options_t* options, int env);
     // Add more options like compression, cache size, etc.
 
+    // ======== Write Options ========
+    // Per write, for the lsm_*_opt variants of the write operations
+    lsm_writeoptions_t* lsm_writeoptions_create();
+    void lsm_writeoptions_destroy(lsm_writeoptions_t* options);
+    // Fsync the WAL before returning, even if lsm_options_set_sync is off
+    void lsm_writeoptions_set_sync(lsm_writeoptions_t* options, uint8_t value);
+    // Skip the WAL: lost on a crash, kept on lsm_db_close, not returned by
+    // lsm_get_updates_since. Cannot be combined with sync.
+    void lsm_writeoptions_set_disable_wal(lsm_writeoptions_t* options, uint8_t value);
+    // Slowed down while compactions are behind, before writes in general are
+    void lsm_writeoptions_set_low_pri(lsm_writeoptions_t* options, uint8_t value);
+
+    // ======== Write Buffer Manager ========
+    // Once the memtables of its DBs use buffer_size bytes, the largest is flushed
+    lsm_write_buffer_manager_t* lsm_write_buffer_manager_create(size_t buffer_size);
+    void lsm_write_buffer_manager_destroy(lsm_write_buffer_manager_t* manager);
+    size_t lsm_write_buffer_manager_memory_usage(const lsm_write_buffer_manager_t* manager);
+
+    // ======== Compaction Filter ========
+    // filter is called for every live value written by a flush (level 0) or a
+    // compaction (its output level), possibly from several threads at once.
+    // It returns LSM_FILTER_KEEP, LSM_FILTER_REMOVE, or LSM_FILTER_CHANGE_VALUE
+    // after storing a malloc()ed replacement in *new_value / *new_vallen,
+    // which the engine frees. destructor(state) runs when the last reference
+    // to the filter goes away.
+    #define LSM_FILTER_KEEP 0
+    #define LSM_FILTER_REMOVE 1
+    #define LSM_FILTER_CHANGE_VALUE 2
+    lsm_compactionfilter_t* lsm_compactionfilter_create(
+        void* state,
+        void (*destructor)(void* state),
+        int (*filter)(void* state, int level, const char* key, size_t keylen,
+                      const char* value, size_t vallen, char** new_value, size_t* new_vallen),
+        const char* (*name)(void* state));
+    void lsm_compactionfilter_destroy(lsm_compactionfilter_t* filter);
+
     // ======== Database Operations ========
     lsm_db_t* lsm_db_open(const lsm_options_t* options, const char* path, char** errptr);
     void lsm_db_close(lsm_db_t* db);
@@ -27,7 +136,67 @@ extern "C" {
     void lsm_put(lsm_db_t* db, const char* key, size_t keylen, const char* val, size_t vallen, char** errptr);
     // Returned value must be freed with lsm_free()
     char* lsm_get(lsm_db_t* db, const char* key, size_t keylen, size_t* vallen, char** errptr);
+    // Looks up num_keys keys with their table reads issued together. values_list[i]
+    // is set to the value of keys_list[i], to be freed with lsm_free(), or to
+    // NULL if the key was not found.
+    void lsm_multi_get(lsm_db_t* db, size_t num_keys, const char* const* keys_list, const size_t* keys_list_sizes,
+                       char** values_list, size_t* values_list_sizes, char** errptr);
     void lsm_delete(lsm_db_t* db, const char* key, size_t keylen, char** errptr);
+    // Deletes every key in [begin, end), at a cost independent of how many keys it covers
+    void lsm_delete_range(lsm_db_t* db, const char* begin, size_t beginlen, const char* end, size_t endlen, char** errptr);
+    // The value reads as absent once the Unix time in ms reaches expire_at_ms
+    void lsm_put_with_expiry(lsm_db_t* db, const char* key, size_t keylen, const char* val, size_t vallen, uint64_t expire_at_ms, char** errptr);
+    // As above, with write options; NULL options are the defaults
+    void lsm_put_opt(lsm_db_t* db, const lsm_writeoptions_t* options, const char* key, size_t keylen, const char* val, size_t vallen, char** errptr);
+    void lsm_delete_opt(lsm_db_t* db, const lsm_writeoptions_t* options, const char* key, size_t keylen, char** errptr);
+    void lsm_delete_range_opt(lsm_db_t* db, const lsm_writeoptions_t* options, const char* begin, size_t beginlen, const char* end, size_t endlen, char** errptr);
+    void lsm_put_with_expiry_opt(lsm_db_t* db, const lsm_writeoptions_t* options, const char* key, size_t keylen, const char* val, size_t vallen, uint64_t expire_at_ms, char** errptr);
+
+    // ======== Async Operations ========
+    // lsm_get_async and lsm_put_async return at once. The operation runs on one
+    // of the DB's async workers (lsm_options_set_max_async_workers), so any
+    // number of callers share a bounded set of threads, and its result is
+    // pushed to the completion queue under the caller's tag.
+    typedef struct {
+        uint64_t tag;
+        // lsm_get_async: the value, to be freed with lsm_free(), or NULL if not found
+        char* value;
+        size_t vallen;
+        // NULL on success, else to be freed with lsm_free()
+        char* err;
+    } lsm_completion_t;
+
+    lsm_completion_queue_t* lsm_completion_queue_create();
+    // Every operation submitted with the queue must have completed (e.g. the
+    // DB was closed) and been polled
+    void lsm_completion_queue_destroy(lsm_completion_queue_t* cq);
+    // Moves up to max completions into completions and returns their number.
+    // Waits up to timeout_ms (forever if negative) for the first one; returns 0
+    // on timeout, or once the queue is shut down and drained.
+    size_t lsm_completion_queue_poll(lsm_completion_queue_t* cq, lsm_completion_t* completions, size_t max, int timeout_ms);
+    // Wakes the pollers; polls no longer wait once the queue is empty
+    void lsm_completion_queue_shutdown(lsm_completion_queue_t* cq);
+
+    void lsm_get_async(lsm_db_t* db, const char* key, size_t keylen, lsm_completion_queue_t* cq, uint64_t tag);
+    void lsm_put_async(lsm_db_t* db, const char* key, size_t keylen, const char* val, size_t vallen,
+                       lsm_completion_queue_t* cq, uint64_t tag);
+
+    // ======== Column Families ========
+    // Creates the family or opens the existing one of that name. Only the
+    // column family options (e.g. write_buffer_size) of options are used;
+    // they replace an existing family's, which a null options leaves alone.
+    // The handle must be released with lsm_column_family_handle_destroy().
+    lsm_column_family_t* lsm_create_column_family(lsm_db_t* db, const lsm_options_t* options, const char* name, char** errptr);
+    // Deletes every file of the family. The handle must still be destroyed.
+    void lsm_drop_column_family(lsm_db_t* db, lsm_column_family_t* cf, char** errptr);
+    void lsm_column_family_handle_destroy(lsm_column_family_t* cf);
+
+    void lsm_put_cf(lsm_db_t* db, lsm_column_family_t* cf, const char* key, size_t keylen, const char* val, size_t vallen, char** errptr);
+    // Returned value must be freed with lsm_free()
+    char* lsm_get_cf(lsm_db_t* db, lsm_column_family_t* cf, const char* key, size_t keylen, size_t* vallen, char** errptr);
+    void lsm_delete_cf(lsm_db_t* db, lsm_column_family_t* cf, const char* key, size_t keylen, char** errptr);
+    void lsm_delete_range_cf(lsm_db_t* db, lsm_column_family_t* cf, const char* begin, size_t beginlen, const char* end, size_t endlen, char** errptr);
+    void lsm_put_cf_with_expiry(lsm_db_t* db, lsm_column_family_t* cf, const char* key, size_t keylen, const char* val, size_t vallen, uint64_t expire_at_ms, char** errptr);
 
     // ======== Write Batch for atomic writes ========
     lsm_writebatch_t* lsm_writebatch_create();
@@ -38,7 +207,12 @@ extern "C" {
     void lsm_writebatch_clear(lsm_writebatch_t* b);
 
     // ======== Iterator (Optional but Recommended) ========
+    // Iterates over the default column family. Key/value pointers stay valid
+    // until the iterator is moved or destroyed.
     lsm_iterator_t* lsm_iterator_create(lsm_db_t* db);
+    // Only visits keys starting with prefix, which must be one the prefix
+    // extractor produces; skips the tables whose prefix filter rules it out
+    lsm_iterator_t* lsm_iterator_create_prefix(lsm_db_t* db, const char* prefix, size_t prefixlen, char** errptr);
     void lsm_iterator_destroy(lsm_iterator_t* iter);
     uint8_t lsm_iterator_valid(const lsm_iterator_t* iter);
     void lsm_iterator_seek_to_first(lsm_iterator_t* iter);
@@ -47,6 +221,83 @@ extern "C" {
     const char* lsm_iterator_key(const lsm_iterator_t* iter, size_t* keylen);
     const char* lsm_iterator_value(const lsm_iterator_t* iter, size_t* vallen);
 
+    // ======== Bulk Loading ========
+    // Builds an SSTable offline. Keys must be added in strictly increasing
+    // order; an out-of-order key sets *errptr and is not added.
+    lsm_sstfilewriter_t* lsm_sstfilewriter_open(const char* path, char** errptr);
+    void lsm_sstfilewriter_put(lsm_sstfilewriter_t* writer, const char* key, size_t keylen, const char* val, size_t vallen, char** errptr);
+    void lsm_sstfilewriter_delete(lsm_sstfilewriter_t* writer, const char* key, size_t keylen, char** errptr);
+    void lsm_sstfilewriter_finish(lsm_sstfilewriter_t* writer, char** errptr);
+    uint64_t lsm_sstfilewriter_file_size(const lsm_sstfilewriter_t* writer);
+    void lsm_sstfilewriter_destroy(lsm_sstfilewriter_t* writer);
+    // Links a finished file into the DB without going through the WAL or the
+    // memtable. move_file != 0 hard-links it and removes path; otherwise it is copied.
+    void lsm_ingest_external_file(lsm_db_t* db, const char* path, uint8_t move_file, char** errptr);
+    void lsm_ingest_external_file_cf(lsm_db_t* db, lsm_column_family_t* cf, const char* path, uint8_t move_file, char** errptr);
+
+    // ======== Checkpoints ========
+    // Makes checkpoint_dir (which must not exist) an openable copy of the DB
+    // as of now. Table files are hard-linked, so it takes little time or space.
+    void lsm_create_checkpoint(lsm_db_t* db, const char* checkpoint_dir, char** errptr);
+
+    // ======== Replication ========
+    // Every Put, Delete and DeleteRange gets the next sequence number
+    uint64_t lsm_get_latest_sequence_number(lsm_db_t* db);
+    // Iterates over the writes numbered since or later, in sequence order,
+    // for a follower to apply to a DB of its own. Returns NULL without
+    // setting *errptr if some of them are no longer retained (see
+    // lsm_options_set_wal_retention_size): the follower has to start over
+    // from a checkpoint. Pointers stay valid until the iterator is moved or
+    // destroyed.
+    #define LSM_UPDATE_PUT 0
+    #define LSM_UPDATE_DELETE 1
+    #define LSM_UPDATE_DELETE_RANGE 2 // Deletes [key, value)
+    lsm_update_iterator_t* lsm_get_updates_since(lsm_db_t* db, uint64_t since, char** errptr);
+    void lsm_update_iterator_destroy(lsm_update_iterator_t* iter);
+    uint8_t lsm_update_iterator_valid(const lsm_update_iterator_t* iter);
+    void lsm_update_iterator_next(lsm_update_iterator_t* iter);
+    uint64_t lsm_update_iterator_sequence(const lsm_update_iterator_t* iter);
+    int lsm_update_iterator_type(const lsm_update_iterator_t* iter);
+    const char* lsm_update_iterator_column_family(const lsm_update_iterator_t* iter);
+    const char* lsm_update_iterator_key(const lsm_update_iterator_t* iter, size_t* keylen);
+    const char* lsm_update_iterator_value(const lsm_update_iterator_t* iter, size_t* vallen);
+    uint64_t lsm_update_iterator_expire_at(const lsm_update_iterator_t* iter); // Unix ms, 0 = never
+
+    // ======== Tracing ========
+    // Capture Put/Get/Delete/DeleteRange (key, value size, timestamp) into a binary trace
+    // file that can be replayed with the lsm_replay tool.
+    void lsm_start_trace(lsm_db_t* db, const char* trace_path, char** errptr);
+    void lsm_end_trace(lsm_db_t* db);
+
+    // ======== Statistics ========
+    typedef struct {
+        uint8_t stopped;
+        uint8_t delayed;
+        uint64_t delayed_write_rate;
+        uint64_t num_delayed_writes;
+        uint64_t delay_micros;
+        uint64_t num_stopped_writes;
+        uint64_t stop_micros;
+        uint64_t num_memtable_stalls;
+        uint64_t memtable_stall_micros;
+    } lsm_write_stall_stats_t;
+    // Current stall state and the time writes have spent stalled since open
+    void lsm_get_write_stall_stats(lsm_db_t* db, lsm_write_stall_stats_t* stats);
+    typedef struct {
+        size_t capacity;
+        size_t usage;
+        uint64_t hits;
+        uint64_t misses;
+        // The compressed tier: its hits are table reads saved
+        size_t compressed_capacity;
+        size_t compressed_usage;
+        uint64_t compressed_hits;
+        uint64_t compressed_admitted;
+        uint64_t compressed_rejected;
+    } lsm_row_cache_stats_t;
+    // All zero if the DB has no row cache (or tier)
+    void lsm_get_row_cache_stats(lsm_db_t* db, lsm_row_cache_stats_t* stats);
+
     // ======== Memory Management ========
     void lsm_free(void* ptr);
 
@@ -7,6 +7,7 @@
 #include <random>
 #include <filesystem>
 #include <iomanip>
+#include <algorithm>
 
 namespace fs = std::filesystem;
 using namespace lsm;
@@ -22,86 +23,115 @@ struct Stats {
     std::atomic<uint64_t> total_latency_ns{0};
 };
 
-void Benchmark(const std::string& name, int num_threads, int num_ops, int value_size, bool is_write) {
+void Benchmark(const std::string& name, int num_threads, int num_ops, int value_size, bool is_write, int num_shards = 1,
+               uint64_t min_blob_size = 0, int max_subcompactions = 1,
+               CompactionStyle compaction_style = CompactionStyle::kLeveled, bool table_hash_index = false,
+               int multi_get_batch = 0, std::shared_ptr<Env> env = nullptr) {
     std::string db_path = "/tmp/lsm_bench_" + name;
     CleanDB(db_path);
     
     // Disable sync for pure throughput test, enable for durability test
     Options options;
     options.sync = false; 
-    DB db(db_path, options);
-
-    // Pre-fill for read test
-    if (!is_write) {
-        std::cout << "Pre-filling DB for read benchmark..." << std::endl;
-        std::vector<std::thread> fill_threads;
-        int fill_threads_count = 4;
-        int ops_per_fill = num_ops / fill_threads_count;
-        for (int i = 0; i < fill_threads_count; ++i) {
-            fill_threads.emplace_back([&db, i, ops_per_fill, value_size]() {
-                std::string val(value_size, 'x');
-                for (int j = 0; j < ops_per_fill; ++j) {
-                    std::string key = "key_" + std::to_string(i * ops_per_fill + j); // Unique keys
-                    db.Put(key, val);
-                }
-            });
-        }
-        for (auto& t : fill_threads) t.join();
+    options.num_shards = num_shards;
+    options.min_blob_size = min_blob_size;
+    options.compaction_style = compaction_style;
+    options.table_hash_index = table_hash_index;
+    options.env = env;
+    if (max_subcompactions > 1) {
+        options.max_background_compactions = max_subcompactions;
+        options.max_subcompactions = max_subcompactions;
     }
+    // Closed before the files are removed: flushes and compactions run in the background
+    {
+        DB db(db_path, options);
+
+        // Pre-fill for read test
+        if (!is_write) {
+            std::cout << "Pre-filling DB for read benchmark..." << std::endl;
+            std::vector<std::thread> fill_threads;
+            int fill_threads_count = 4;
+            int ops_per_fill = num_ops / fill_threads_count;
+            for (int i = 0; i < fill_threads_count; ++i) {
+                fill_threads.emplace_back([&db, i, ops_per_fill, value_size]() {
+                    std::string val(value_size, 'x');
+                    for (int j = 0; j < ops_per_fill; ++j) {
+                        std::string key = "key_" + std::to_string(i * ops_per_fill + j); // Unique keys
+                        db.Put(key, val);
+                    }
+                });
+            }
+            for (auto& t : fill_threads) t.join();
+        }
 
-    std::cout << "Starting Benchmark: " << name << " (Threads: " << num_threads 
-              << ", Ops: " << num_ops << ", ValSize: " << value_size << "B)" << std::endl;
-
-    Stats stats;
-    std::vector<std::thread> threads;
-    auto start_time = std::chrono::high_resolution_clock::now();
-
-    int ops_per_thread = num_ops / num_threads;
-
-    for (int i = 0; i < num_threads; ++i) {
-        threads.emplace_back([&db, &stats, i, ops_per_thread, value_size, is_write, num_ops]() {
-            std::string val(value_size, 'v');
-            // Random read generator
-            std::mt19937 rng(i);
-            std::uniform_int_distribution<int> dist(0, num_ops - 1);
-
-            for (int j = 0; j < ops_per_thread; ++j) {
-                auto op_start = std::chrono::high_resolution_clock::now();
+        std::cout << "Starting Benchmark: " << name << " (Threads: " << num_threads 
+                  << ", Ops: " << num_ops << ", ValSize: " << value_size << "B, Shards: " << num_shards << ")" << std::endl;
+
+        Stats stats;
+        std::vector<std::thread> threads;
+        auto start_time = std::chrono::high_resolution_clock::now();
+
+        int ops_per_thread = num_ops / num_threads;
+
+        for (int i = 0; i < num_threads; ++i) {
+            threads.emplace_back([&db, &stats, i, ops_per_thread, value_size, is_write, num_ops, multi_get_batch]() {
+                std::string val(value_size, 'v');
+                // Random read generator
+                std::mt19937 rng(i);
+                std::uniform_int_distribution<int> dist(0, num_ops - 1);
+
+                for (int j = 0; j < ops_per_thread; ++j) {
+                    if (multi_get_batch > 0) {
+                        // Random reads, a batch at a time
+                        int batch = std::min(multi_get_batch, ops_per_thread - j);
+                        std::vector<std::string> keys;
+                        for (int k = 0; k < batch; ++k) keys.push_back("key_" + std::to_string(dist(rng)));
+                        std::vector<std::string> values;
+                        auto op_start = std::chrono::high_resolution_clock::now();
+                        db.MultiGet(keys, &values);
+                        auto op_end = std::chrono::high_resolution_clock::now();
+                        stats.total_latency_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(op_end - op_start).count();
+                        stats.ops_completed += batch;
+                        j += batch - 1;
+                        continue;
+                    }
+                    auto op_start = std::chrono::high_resolution_clock::now();
                 
-                if (is_write) {
-                    // Write unique keys to avoid overwriting too much (or random keys)
-                    // Let's use sequential keys per thread to ensure uniqueness for verification if needed
-                    std::string key = "key_" + std::to_string(i) + "_" + std::to_string(j);
-                    db.Put(key, val);
-                } else {
-                    // Random read
-                    std::string key = "key_" + std::to_string(dist(rng));
-                    std::string res;
-                    db.Get(key, &res);
+                    if (is_write) {
+                        // Write unique keys to avoid overwriting too much (or random keys)
+                        // Let's use sequential keys per thread to ensure uniqueness for verification if needed
+                        std::string key = "key_" + std::to_string(i) + "_" + std::to_string(j);
+                        db.Put(key, val);
+                    } else {
+                        // Random read
+                        std::string key = "key_" + std::to_string(dist(rng));
+                        std::string res;
+                        db.Get(key, &res);
+                    }
+
+                    auto op_end = std::chrono::high_resolution_clock::now();
+                    stats.total_latency_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(op_end - op_start).count();
+                    stats.ops_completed++;
                 }
+            });
+        }
 
-                auto op_end = std::chrono::high_resolution_clock::now();
-                stats.total_latency_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(op_end - op_start).count();
-                stats.ops_completed++;
-            }
-        });
-    }
-
-    for (auto& t : threads) t.join();
+        for (auto& t : threads) t.join();
 
-    auto end_time = std::chrono::high_resolution_clock::now();
-    auto duration_sec = std::chrono::duration_cast<std::chrono::duration<double>>(end_time - start_time).count();
+        auto end_time = std::chrono::high_resolution_clock::now();
+        auto duration_sec = std::chrono::duration_cast<std::chrono::duration<double>>(end_time - start_time).count();
 
-    uint64_t total_ops = stats.ops_completed;
-    double throughput = total_ops / duration_sec;
-    double avg_latency_us = (double)stats.total_latency_ns / total_ops / 1000.0;
+        uint64_t total_ops = stats.ops_completed;
+        double throughput = total_ops / duration_sec;
+        double avg_latency_us = (double)stats.total_latency_ns / total_ops / 1000.0;
 
-    std::cout << "------------------------------------------------" << std::endl;
-    std::cout << "Results for " << name << ":" << std::endl;
-    std::cout << "  Duration:     " << std::fixed << std::setprecision(2) << duration_sec << " s" << std::endl;
-    std::cout << "  Throughput:   " << std::fixed << std::setprecision(2) << throughput << " ops/sec" << std::endl;
-    std::cout << "  Avg Latency:  " << std::fixed << std::setprecision(2) << avg_latency_us << " us" << std::endl;
-    std::cout << "------------------------------------------------" << std::endl;
+        std::cout << "------------------------------------------------" << std::endl;
+        std::cout << "Results for " << name << ":" << std::endl;
+        std::cout << "  Duration:     " << std::fixed << std::setprecision(2) << duration_sec << " s" << std::endl;
+        std::cout << "  Throughput:   " << std::fixed << std::setprecision(2) << throughput << " ops/sec" << std::endl;
+        std::cout << "  Avg Latency:  " << std::fixed << std::setprecision(2) << avg_latency_us << " us" << std::endl;
+        std::cout << "------------------------------------------------" << std::endl;
+    }
 
     CleanDB(db_path);
 }
@@ -110,11 +140,41 @@ int main() {
     // 1. Write Benchmark (High Concurrency)
     Benchmark("Write_HighConcurrency", 8, 100000, 100, true);
 
+    // 1b. Same write load spread over independent memtable/WAL shards
+    Benchmark("Write_HighConcurrency_Sharded", 8, 100000, 100, true, 8);
+
+    // 1c. Same write load with compactions split across the compaction pool
+    Benchmark("Write_HighConcurrency_Subcompactions", 8, 100000, 100, true, 8, 0,
+              std::max(2u, std::thread::hardware_concurrency()));
+
+    // 1d. Same write load with universal compaction, trading reads for write amplification
+    Benchmark("Write_HighConcurrency_Universal", 8, 100000, 100, true, 8, 0, 1,
+              CompactionStyle::kUniversal);
+
+    // 1e. Same write load with every file in memory: no disk in the way
+    Benchmark("Write_HighConcurrency_MemEnv", 8, 100000, 100, true, 1, 0, 1,
+              CompactionStyle::kLeveled, false, 0, NewMemEnv());
+
     // 2. Read Benchmark (High Concurrency)
     Benchmark("Read_HighConcurrency", 8, 100000, 100, false);
 
+    // 2b. Same reads with table lookups through the hash index
+    Benchmark("Read_HighConcurrency_HashIndex", 8, 100000, 100, false, 1, 0, 1,
+              CompactionStyle::kLeveled, true);
+
+    // 2c. Same reads in batches of 32 keys, their table reads issued together
+    Benchmark("Read_HighConcurrency_MultiGet", 8, 100000, 100, false, 1, 0, 1,
+              CompactionStyle::kLeveled, false, 32);
+
+    // 2d. Same reads from tables in memory
+    Benchmark("Read_HighConcurrency_MemEnv", 8, 100000, 100, false, 1, 0, 1,
+              CompactionStyle::kLeveled, false, 0, NewMemEnv());
+
     // 3. Mixed / Larger Value
     Benchmark("Write_LargeValue", 4, 50000, 4096, true);
 
+    // 3b. Same values kept in blob files, so compactions only move references
+    Benchmark("Write_LargeValue_Blob", 4, 50000, 4096, true, 1, 1024);
+
     return 0;
 }
@@ -5,8 +5,23 @@
 #include <vector>
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include <chrono>
 #include <cstdlib>
+#include <cstdio>
+#include <stdexcept>
+#include <algorithm>
+#include <random>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include "core/sstable/sst_file_writer.h"
+#include "core/sstable/table_builder.h"
+#include "core/sstable/table_index.h"
+#include "util/clock.h"
+#include "util/async_io.h"
+#include "util/compression.h"
 
 namespace fs = std::filesystem;
 using namespace lsm;
@@ -234,6 +249,2112 @@ void TestReadWriteConcurrency() {
     std::cout << "TestReadWriteConcurrency Passed!" << std::endl;
 }
 
+void TestShards() {
+    std::cout << "Running TestShards..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_shards";
+    CleanDB(db_path);
+
+    Options options;
+    options.num_shards = 4;
+    const int num_threads = 4;
+    const int ops_per_thread = 2000;
+    std::string large_value(1024, 'a'); // Large enough to flush several shards
+
+    {
+        DB db(db_path, options);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < num_threads; ++i) {
+            threads.emplace_back([&db, i, ops_per_thread, &large_value]() {
+                for (int j = 0; j < ops_per_thread; ++j) {
+                    std::string key = "key_" + std::to_string(i) + "_" + std::to_string(j);
+                    db.Put(key, key + large_value);
+                }
+            });
+        }
+        for (auto& t : threads) t.join();
+        db.Delete("key_0_0");
+        db.Put("tail", "in_wal");
+    }
+
+    // Reopen with the same layout, then with a different shard count
+    for (int shards : {4, 3, 1}) {
+        options.num_shards = shards;
+        DB db(db_path, options);
+        std::string val;
+        assert(!db.Get("key_0_0", &val));
+        assert(db.Get("tail", &val) && val == "in_wal");
+        for (int i = 0; i < num_threads; ++i) {
+            for (int j = 1; j < ops_per_thread; j += 97) {
+                std::string key = "key_" + std::to_string(i) + "_" + std::to_string(j);
+                assert(db.Get(key, &val) && val == key + large_value);
+            }
+        }
+    }
+
+    CleanDB(db_path);
+    std::cout << "TestShards Passed!" << std::endl;
+}
+
+void TestColumnFamilies() {
+    std::cout << "Running TestColumnFamilies..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_column_families";
+    CleanDB(db_path);
+
+    Options options;
+    options.num_shards = 2;
+    ColumnFamilyOptions small;
+    small.write_buffer_size = 64 * 1024;
+    std::string value(512, 'c');
+
+    {
+        DB db(db_path, options);
+        ColumnFamilyHandle* users = db.CreateColumnFamily("users", small);
+        ColumnFamilyHandle* orders = db.CreateColumnFamily("orders");
+        assert(db.CreateColumnFamily("users", small) == users);
+
+        db.Put("k", "default");
+        db.Put(users, "k", "user");
+        db.Put(orders, "k", "order");
+        for (int i = 0; i < 1000; ++i) {
+            db.Put(users, "u" + std::to_string(i), value); // Flushes several times
+        }
+
+        std::string val;
+        assert(db.Get("k", &val) && val == "default");
+        assert(db.Get(users, "k", &val) && val == "user");
+        assert(db.Get(orders, "k", &val) && val == "order");
+        assert(!db.Get("u1", &val));
+        // A null handle is the default family
+        db.Put(nullptr, "null", "1");
+        db.PutWithExpiry(nullptr, "null_ttl", "2", 0);
+        assert(db.Get(nullptr, "k", &val) && val == "default");
+        assert(db.Get("null", &val) && val == "1" && db.Get("null_ttl", &val));
+        db.Delete(nullptr, "null");
+        db.DeleteRange(nullptr, "null_", "null_z");
+        assert(!db.Get("null", &val) && !db.Get("null_ttl", &val));
+
+        db.DropColumnFamily(orders);
+        assert(!fs::exists(db_path + "/cf_" + std::to_string(orders->GetID())));
+        bool threw = false;
+        try {
+            db.Get(orders, "k", &val);
+        } catch (const std::exception&) {
+            threw = true;
+        }
+        assert(threw);
+    }
+
+    {
+        DB db(db_path, options);
+        ColumnFamilyHandle* users = db.GetColumnFamily("users");
+        assert(users != nullptr);
+        assert(db.GetColumnFamily("orders") == nullptr);
+
+        std::string val;
+        assert(db.Get("k", &val) && val == "default");
+        assert(db.Get(users, "k", &val) && val == "user");
+        assert(db.Get(users, "u0", &val) && val == value);
+        assert(db.Get(users, "u999", &val) && val == value);
+
+        // A re-created family starts empty even though the WAL still holds
+        // records of the dropped one
+        ColumnFamilyHandle* orders = db.CreateColumnFamily("orders", small);
+        assert(!db.Get(orders, "k", &val));
+
+        // Opened again without options, it keeps the ones it was given: its
+        // writes still fill 64KB memtables and get flushed
+        assert(db.CreateColumnFamily("orders") == orders);
+        for (int i = 0; i < 300; ++i) {
+            db.Put(orders, "o" + std::to_string(i), value);
+        }
+        db.WaitForCompaction();
+        int files = 0;
+        for (int level = 0; level < kNumLevels; ++level) files += db.NumFilesAtLevel(level, orders);
+        assert(files > 0);
+
+        // Options replaced while the family is written to and flushed
+        std::atomic<bool> done{false};
+        std::thread reopener([&] {
+            for (int i = 0; !done; ++i) {
+                db.CreateColumnFamily("users", i % 2 ? small : ColumnFamilyOptions());
+            }
+        });
+        for (int i = 0; i < 1000; ++i) {
+            db.Put(users, "w" + std::to_string(i), value);
+        }
+        done = true;
+        reopener.join();
+        assert(db.Get(users, "w0", &val) && val == value);
+        assert(db.Get(users, "w999", &val) && val == value);
+    }
+
+    CleanDB(db_path);
+    std::cout << "TestColumnFamilies Passed!" << std::endl;
+}
+
+void TestTrace() {
+    std::cout << "Running TestTrace..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_trace";
+    std::string trace_path = "/tmp/lsm_test_trace.trace";
+    CleanDB(db_path);
+
+    {
+        DB db(db_path);
+        assert(db.StartTrace(trace_path));
+        db.Put("key1", "value1");
+        std::string val;
+        db.Get("key1", &val);
+        db.Delete("key1");
+        db.DeleteRange("a", "b");
+        ColumnFamilyHandle* users = db.CreateColumnFamily("users");
+        db.Put(users, "u1", "v");
+        db.Delete(users, "u1");
+        db.PutWithExpiry("ttl", "v", 1234);
+        db.EndTrace();
+        db.Put("untraced", "x");
+    }
+
+    TraceReader reader(trace_path);
+    assert(reader.ok());
+    TraceRecord rec;
+    assert(reader.Next(&rec) && rec.op == TraceOp::kPut && rec.key == "key1" && rec.value_size == 6);
+    uint64_t last_ts = rec.timestamp_us;
+    assert(reader.Next(&rec) && rec.op == TraceOp::kGet && rec.key == "key1");
+    assert(rec.timestamp_us >= last_ts);
+    assert(reader.Next(&rec) && rec.op == TraceOp::kDelete && rec.key == "key1" && rec.end_key.empty());
+    assert(reader.Next(&rec) && rec.op == TraceOp::kDeleteRange && rec.key == "a" && rec.end_key == "b");
+    assert(rec.cf_id == 0);
+    // The family is named once, before its first op
+    assert(reader.Next(&rec) && rec.op == TraceOp::kColumnFamily && rec.key == "users" && rec.cf_id != 0);
+    uint32_t users_id = rec.cf_id;
+    assert(reader.Next(&rec) && rec.op == TraceOp::kPut && rec.key == "u1" && rec.cf_id == users_id);
+    assert(reader.Next(&rec) && rec.op == TraceOp::kDelete && rec.key == "u1" && rec.cf_id == users_id);
+    assert(reader.Next(&rec) && rec.op == TraceOp::kPutWithExpiry && rec.key == "ttl" && rec.value_size == 1);
+    assert(rec.expire_at_ms == 1234 && rec.cf_id == 0);
+    assert(!reader.Next(&rec));
+
+    CleanDB(db_path);
+    fs::remove(trace_path);
+    std::cout << "TestTrace Passed!" << std::endl;
+}
+
+void TestTTL() {
+    std::cout << "Running TestTTL..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_ttl";
+    CleanDB(db_path);
+
+    {
+        DB db(db_path);
+        uint64_t now = NowMillis();
+        db.Put("k", "old");
+        db.Put("flushed", "old");
+        db.PutWithExpiry("live", "v", now + 3600 * 1000);
+        db.PutWithExpiry("gone", "v", now - 1);
+        db.PutWithExpiry("k", "new", now + 200);
+
+        std::string val;
+        assert(db.Get("live", &val) && val == "v");
+        assert(!db.Get("gone", &val));
+        assert(db.Get("k", &val) && val == "new");
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        // The expired entry must not resurrect the older value
+        assert(!db.Get("k", &val));
+    }
+
+    {
+        // Recovered from the WAL with the expiry intact
+        DB db(db_path);
+        std::string val;
+        assert(!db.Get("k", &val));
+        assert(!db.Get("gone", &val));
+        assert(db.Get("live", &val) && val == "v");
+    }
+
+    CleanDB(db_path);
+    std::cout << "TestTTL Passed!" << std::endl;
+}
+
+void TestCompaction() {
+    std::cout << "Running TestCompaction..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_compaction";
+    CleanDB(db_path);
+
+    Options options;
+    options.write_buffer_size = 32 * 1024;
+    options.target_file_size = 32 * 1024;
+    options.max_bytes_for_level_base = 128 * 1024;
+    std::string value(256, 'v');
+    const int num_keys = 3000;
+
+    {
+        DB db(db_path, options);
+        // Several rounds over the same keys, so compaction has versions to merge
+        for (int round = 0; round < 3; ++round) {
+            for (int i = 0; i < num_keys; ++i) {
+                db.Put("key" + std::to_string(i), value + std::to_string(round));
+            }
+        }
+        for (int i = 0; i < num_keys; i += 10) {
+            db.Delete("key" + std::to_string(i));
+        }
+        uint64_t now = NowMillis();
+        for (int i = 1; i < num_keys; i += 10) {
+            db.PutWithExpiry("key" + std::to_string(i), value, now - 1);
+        }
+        db.WaitForCompaction();
+        assert(db.NumFilesAtLevel(0) < options.level0_file_num_compaction_trigger);
+        assert(db.NumFilesAtLevel(1) > 0);
+    }
+
+    {
+        DB db(db_path, options);
+        std::string val;
+        for (int i = 0; i < num_keys; ++i) {
+            bool found = db.Get("key" + std::to_string(i), &val);
+            if (i % 10 == 0 || i % 10 == 1) {
+                assert(!found);
+            } else {
+                assert(found && val == value + "2");
+            }
+        }
+    }
+
+    CleanDB(db_path);
+    std::cout << "TestCompaction Passed!" << std::endl;
+}
+
+void TestIterator() {
+    std::cout << "Running TestIterator..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_iterator";
+    CleanDB(db_path);
+
+    Options options;
+    options.num_shards = 2;
+    options.write_buffer_size = 16 * 1024;
+    std::string value(128, 'i');
+
+    {
+        DB db(db_path, options);
+        for (int i = 0; i < 1000; ++i) {
+            char key[16];
+            snprintf(key, sizeof(key), "key%04d", i);
+            db.Put(key, value);
+        }
+        db.Delete("key0500");
+        db.PutWithExpiry("key0501", value, NowMillis() - 1);
+        db.Put("key0502", "updated");
+
+        std::unique_ptr<Iterator> iter(db.NewIterator());
+        int count = 0;
+        std::string prev;
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            assert(iter->Key() > prev);
+            prev = iter->Key();
+            count++;
+        }
+        assert(count == 998);
+
+        iter->Seek("key0500");
+        assert(iter->Valid() && iter->Key() == "key0502" && iter->Value() == "updated");
+    }
+
+    CleanDB(db_path);
+    std::cout << "TestIterator Passed!" << std::endl;
+}
+
+// Drops the "retired:" tenant and truncates values over 16 bytes
+class TestFilter : public CompactionFilter {
+public:
+    Decision Filter(int level, const std::string& key, const std::string& existing_value,
+                    std::string* new_value) const override {
+        if (key.rfind("retired:", 0) == 0) return Decision::kRemove;
+        if (existing_value.size() > 16) {
+            *new_value = existing_value.substr(0, 16);
+            return Decision::kChangeValue;
+        }
+        return Decision::kKeep;
+    }
+    const char* Name() const override { return "TestFilter"; }
+};
+
+void TestCompactionFilter() {
+    std::cout << "Running TestCompactionFilter..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_compaction_filter";
+    CleanDB(db_path);
+
+    std::string big(100, 'b');
+    Options options;
+    options.write_buffer_size = 16 * 1024;
+    {
+        // Written without a filter, so the data reaches SSTables unfiltered
+        DB db(db_path, options);
+        for (int i = 0; i < 100; ++i) {
+            db.Put("retired:" + std::to_string(i), "v");
+            db.Put("active:" + std::to_string(i), big);
+        }
+        for (int i = 0; i < 2000; ++i) {
+            db.Put("padding:" + std::to_string(i), "p");
+        }
+        db.WaitForCompaction();
+    }
+
+    options.compaction_filter = std::make_shared<TestFilter>();
+    {
+        DB db(db_path, options);
+        // Filler keys sort inside the range of the existing tables, so the
+        // compactions they trigger rewrite (and filter) the old data
+        for (int i = 0; i < 2000; ++i) {
+            db.Put("filler:" + std::to_string(i), "f");
+        }
+        db.WaitForCompaction();
+
+        std::string val;
+        for (int i = 0; i < 100; ++i) {
+            assert(!db.Get("retired:" + std::to_string(i), &val));
+            assert(db.Get("active:" + std::to_string(i), &val) && val == big.substr(0, 16));
+        }
+    }
+
+    CleanDB(db_path);
+    std::cout << "TestCompactionFilter Passed!" << std::endl;
+}
+
+void TestDeleteRange() {
+    std::cout << "Running TestDeleteRange..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_delete_range";
+    CleanDB(db_path);
+
+    Options options;
+    options.num_shards = 2;
+    options.write_buffer_size = 16 * 1024;
+    options.target_file_size = 16 * 1024;
+    std::string value(64, 'r');
+    auto key = [](int i) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "key%04d", i);
+        return std::string(buf);
+    };
+    // [100, 200) deleted, then 150 written again
+    auto check = [&](DB& db) {
+        std::string val;
+        for (int i = 0; i < 1000; ++i) {
+            bool found = db.Get(key(i), &val);
+            if (i == 150) {
+                assert(found && val == "again");
+            } else if (i >= 100 && i < 200) {
+                assert(!found);
+            } else {
+                assert(found && val == value);
+            }
+        }
+        std::unique_ptr<Iterator> iter(db.NewIterator());
+        int count = 0;
+        for (iter->Seek("key"); iter->Valid() && iter->Key() < "kez"; iter->Next()) count++;
+        assert(count == 901);
+        iter->Seek(key(100));
+        assert(iter->Valid() && iter->Key() == key(150));
+    };
+
+    {
+        DB db(db_path, options);
+        for (int i = 0; i < 1000; ++i) {
+            db.Put(key(i), value);
+        }
+        db.WaitForCompaction();
+
+        // Covers keys in both memtables and tables
+        db.DeleteRange(key(100), key(200));
+        db.Put(key(150), "again");
+        check(db);
+
+        // Push the tombstones through flushes and compactions
+        for (int i = 0; i < 1000; ++i) {
+            db.Put("zz" + std::to_string(i), value);
+        }
+        db.WaitForCompaction();
+        check(db);
+
+        db.DeleteRange(key(500), key(500)); // Empty range, no-op
+    }
+
+    {
+        DB db(db_path, options);
+        check(db);
+    }
+
+    // A different shard layout re-routes the unflushed records
+    options.num_shards = 3;
+    {
+        DB db(db_path, options);
+        db.DeleteRange(key(900), key(2000));
+        db.Put(key(950), value);
+    }
+    {
+        DB db(db_path, options);
+        std::string val;
+        assert(!db.Get(key(900), &val));
+        assert(db.Get(key(950), &val) && val == value);
+        assert(db.Get(key(899), &val) && val == value);
+        assert(db.Get(key(150), &val) && val == "again");
+    }
+
+    // Overlapping tombstones of mixed shard layouts, cut into fragments,
+    // answer as a scan over them all would
+    std::mt19937 rng(31);
+    std::vector<std::pair<RangeTombstone, uint64_t>> added;
+    FragmentedRangeTombstones fragments(BytewiseComparator().get());
+    std::vector<uint64_t> seqs(300);
+    for (size_t i = 0; i < seqs.size(); ++i) seqs[i] = i + 1;
+    std::shuffle(seqs.begin(), seqs.end(), rng); // Not only ever newer ones
+    for (uint64_t seq : seqs) {
+        int begin = rng() % 1000;
+        RangeTombstone t{key(begin), key(begin + rng() % 100), 0, 1};
+        if (seq % 3 == 0) {
+            t.num_shards = 2;
+            t.shard = rng() % 2;
+        }
+        fragments.Add(t, seq);
+        added.push_back({t, seq});
+    }
+    for (int i = 0; i < 2200; ++i) {
+        std::string k = key(i / 2) + (i % 2 ? "x" : "");
+        uint64_t expected = 0;
+        for (const auto& entry : added) {
+            if (entry.first.Covers(k, BytewiseComparator().get())) expected = std::max(expected, entry.second);
+        }
+        assert(fragments.MaxCoveringSeq(k) == expected);
+    }
+
+    CleanDB(db_path);
+    std::cout << "TestDeleteRange Passed!" << std::endl;
+}
+
+int CountBlobFiles(const std::string& path) {
+    int count = 0;
+    for (const auto& entry : fs::directory_iterator(path)) {
+        if (entry.path().extension() == ".blob") count++;
+    }
+    return count;
+}
+
+void TestBlobFiles() {
+    std::cout << "Running TestBlobFiles..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_blob_files";
+    CleanDB(db_path);
+
+    Options options;
+    options.write_buffer_size = 16 * 1024;
+    options.level0_file_num_compaction_trigger = 1;
+    options.min_blob_size = 256;
+    auto key = [](int i) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "blob%04d", i);
+        return std::string(buf);
+    };
+    auto large = [](int i) { return std::string(1000, static_cast<char>('a' + i % 26)); };
+    auto check_large = [&](DB& db) {
+        std::string val;
+        for (int i = 0; i < 200; ++i) {
+            assert(db.Get(key(i), &val) && val == large(i));
+        }
+        assert(db.Get("small", &val) && val == "inline");
+    };
+
+    {
+        DB db(db_path, options);
+        db.Put("small", "inline");
+        for (int i = 0; i < 200; ++i) {
+            db.Put(key(i), large(i));
+        }
+        db.WaitForCompaction();
+        assert(CountBlobFiles(db_path) > 0);
+        check_large(db);
+
+        std::unique_ptr<Iterator> iter(db.NewIterator());
+        iter->Seek(key(42));
+        assert(iter->Valid() && iter->Key() == key(42) && iter->Value() == large(42));
+    }
+
+    {
+        // Blob files are tracked by the MANIFEST
+        DB db(db_path, options);
+        check_large(db);
+
+        // Once every reference is overwritten, compaction deletes the files
+        for (int i = 0; i < 200; ++i) {
+            db.Put(key(i), "small" + std::to_string(i));
+        }
+        for (int i = 0; i < 2000; ++i) {
+            db.Put("pad" + std::to_string(i), "p");
+        }
+        db.WaitForCompaction();
+        assert(CountBlobFiles(db_path) == 0);
+
+        std::string val;
+        for (int i = 0; i < 200; ++i) {
+            assert(db.Get(key(i), &val) && val == "small" + std::to_string(i));
+        }
+    }
+
+    CleanDB(db_path);
+    std::cout << "TestBlobFiles Passed!" << std::endl;
+}
+
+// Slows flushes down, so writers often find the previous flush still running
+class SlowFlushFilter : public CompactionFilter {
+public:
+    Decision Filter(int level, const std::string&, const std::string&, std::string*) const override {
+        if (level == 0) std::this_thread::sleep_for(std::chrono::microseconds(100));
+        return Decision::kKeep;
+    }
+    const char* Name() const override { return "SlowFlushFilter"; }
+};
+
+void TestIngestExternalFile() {
+    std::cout << "Running TestIngestExternalFile..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_ingest";
+    std::string sst_path = "/tmp/lsm_test_ingest_external.sst";
+    CleanDB(db_path);
+    auto key = [](int i) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "ing%04d", i);
+        return std::string(buf);
+    };
+    auto write_file = [&](int begin, int end, const std::string& value) {
+        SstFileWriter writer(sst_path);
+        assert(writer.ok());
+        for (int i = begin; i < end; ++i) {
+            assert(writer.Put(key(i), value));
+        }
+        assert(!writer.Put(key(begin), value)); // Out of order
+        assert(writer.Finish());
+    };
+
+    {
+        DB db(db_path);
+        write_file(0, 1000, "bulk");
+        // Nothing to overlap: straight to the last level
+        assert(db.IngestExternalFile(sst_path) == 6);
+        assert(fs::exists(sst_path));
+
+        // Newer than the memtable write it overlaps
+        db.Put(key(500), "memtable");
+        write_file(400, 600, "newer");
+        assert(db.IngestExternalFile(sst_path, true) == 0);
+        assert(!fs::exists(sst_path));
+
+        std::string val;
+        assert(db.Get(key(0), &val) && val == "bulk");
+        assert(db.Get(key(500), &val) && val == "newer");
+        db.Put(key(501), "latest");
+        assert(db.Get(key(501), &val) && val == "latest");
+
+        bool threw = false;
+        try {
+            db.IngestExternalFile("/tmp/lsm_test_ingest_missing.sst");
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        assert(threw);
+    }
+
+    {
+        DB db(db_path);
+        std::string val;
+        assert(db.Get(key(999), &val) && val == "bulk");
+        assert(db.Get(key(400), &val) && val == "newer");
+        assert(db.Get(key(501), &val) && val == "latest");
+    }
+
+    // Ingesting while writers keep filling every shard, partly in the range
+    // of the file, and flushes are slow
+    CleanDB(db_path);
+    {
+        Options options;
+        options.num_shards = 2;
+        options.write_buffer_size = 32 * 1024;
+        options.compaction_filter = std::make_shared<SlowFlushFilter>();
+        DB db(db_path, options);
+        std::atomic<bool> done{false};
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; ++t) {
+            writers.emplace_back([&, t] {
+                for (int i = 0; !done; ++i) {
+                    db.Put(key(i % 20) + "_" + std::to_string(t) + "_" + std::to_string(i), std::string(100, 'w'));
+                }
+            });
+        }
+        for (int round = 0; round < 10; ++round) {
+            write_file(0, 10, "round" + std::to_string(round));
+            db.IngestExternalFile(sst_path);
+        }
+        done = true;
+        for (auto& w : writers) w.join();
+        std::string val;
+        assert(db.Get(key(5), &val) && val == "round9");
+        assert(db.Get(key(5) + "_0_5", &val) && val == std::string(100, 'w'));
+    }
+
+    CleanDB(db_path);
+    fs::remove(sst_path);
+    std::cout << "TestIngestExternalFile Passed!" << std::endl;
+}
+
+void TestSubcompactions() {
+    std::cout << "Running TestSubcompactions..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_subcompactions";
+    CleanDB(db_path);
+
+    Options options;
+    options.num_shards = 2;
+    options.write_buffer_size = 16 * 1024;
+    options.target_file_size = 8 * 1024;
+    options.max_background_flushes = 2;
+    options.max_background_compactions = 4;
+    options.max_subcompactions = 4;
+    auto key = [](int i) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "sub%05d", i);
+        return std::string(buf);
+    };
+    auto value = [](int i, int round) { return std::string(64, 'a' + (i + round) % 26); };
+
+    {
+        DB db(db_path, options);
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; ++t) {
+            writers.emplace_back([&, t]() {
+                for (int round = 0; round < 3; ++round) {
+                    for (int i = t; i < 4000; i += 4) {
+                        db.Put(key(i), value(i, round));
+                    }
+                }
+            });
+        }
+        for (auto& w : writers) w.join();
+        db.DeleteRange(key(1000), key(1100));
+        db.WaitForCompaction();
+        assert(db.NumFilesAtLevel(0) < options.level0_file_num_compaction_trigger);
+    }
+
+    {
+        // A flush that never finished leaves a frozen WAL behind, older
+        // than the live one
+        WAL frozen(Env::Default(), db_path + "/wal_imm_0.log");
+        WAL live(Env::Default(), db_path + "/wal.log");
+        WALRecord record;
+        record.key = key(0);
+        record.value = "stale";
+        frozen.Append(record);
+        record.value = value(0, 2);
+        live.Append(record);
+        record.key = "frozen";
+        record.value = "only";
+        frozen.Append(record);
+    }
+
+    {
+        DB db(db_path, options);
+        std::string val;
+        for (int i = 0; i < 4000; ++i) {
+            bool found = db.Get(key(i), &val);
+            if (i >= 1000 && i < 1100) {
+                assert(!found);
+            } else {
+                assert(found && val == value(i, 2));
+            }
+        }
+        assert(db.Get("frozen", &val) && val == "only");
+        assert(!fs::exists(db_path + "/wal_imm_0.log"));
+
+        std::unique_ptr<Iterator> iter(db.NewIterator());
+        int count = 0;
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) count++;
+        assert(count == 3901);
+    }
+
+    CleanDB(db_path);
+    std::cout << "TestSubcompactions Passed!" << std::endl;
+}
+
+void TestUniversalCompaction() {
+    std::cout << "Running TestUniversalCompaction..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_universal";
+    CleanDB(db_path);
+
+    Options options;
+    options.compaction_style = CompactionStyle::kUniversal;
+    options.write_buffer_size = 16 * 1024;
+    options.target_file_size = 8 * 1024;
+    options.universal_max_sorted_runs = 5;
+    auto key = [](int i) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "uni%05d", i);
+        return std::string(buf);
+    };
+    auto value = [](int i, int round) { return std::string(48, 'a' + (i + round) % 26); };
+    auto num_sorted_runs = [](DB& db) {
+        int runs = db.NumFilesAtLevel(0);
+        for (int level = 1; level < kNumLevels; ++level) {
+            if (db.NumFilesAtLevel(level) > 0) runs++;
+        }
+        return runs;
+    };
+
+    {
+        DB db(db_path, options);
+        for (int round = 0; round < 4; ++round) {
+            for (int i = 0; i < 3000; ++i) {
+                db.Put(key(i), value(i, round));
+            }
+            for (int i = round; i < 3000; i += 10) {
+                db.Delete(key(i));
+            }
+            db.WaitForCompaction();
+            assert(num_sorted_runs(db) <= options.universal_max_sorted_runs);
+        }
+
+        // Newer runs always shadow older ones
+        std::string val;
+        for (int i = 0; i < 3000; ++i) {
+            bool found = db.Get(key(i), &val);
+            if (i % 10 == 3) {
+                assert(!found);
+            } else {
+                assert(found && val == value(i, 3));
+            }
+        }
+    }
+
+    {
+        DB db(db_path, options);
+        std::string val;
+        std::unique_ptr<Iterator> iter(db.NewIterator());
+        int count = 0;
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            assert(iter->Value() == value(std::stoi(iter->Key().substr(3)), 3));
+            count++;
+        }
+        assert(count == 2700);
+        assert(!db.Get(key(3), &val));
+    }
+
+    CleanDB(db_path);
+    std::cout << "TestUniversalCompaction Passed!" << std::endl;
+}
+
+void TestHashIndex() {
+    std::cout << "Running TestHashIndex..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_hash_index";
+    CleanDB(db_path);
+    fs::create_directories(db_path);
+    auto key = [](int i) { return "hash" + std::to_string(i); };
+
+    Options options;
+    options.table_hash_index = true;
+    {
+        // Range tombstones and the hash index share the tail of the file
+        TableBuilder builder(db_path + "/table.sst", options);
+        std::vector<std::string> keys;
+        for (int i = 0; i < 2000; ++i) keys.push_back(key(i));
+        std::sort(keys.begin(), keys.end());
+        for (const auto& k : keys) {
+            builder.Add(k, "v" + k, k == key(7));
+        }
+        RangeTombstone t;
+        t.begin = "zz";
+        t.end = "zzz";
+        builder.AddRangeTombstone(t);
+        assert(builder.Finish());
+
+        auto table = Table::Open(db_path + "/table.sst");
+        assert(table && table->HasHashIndex());
+        assert(table->RangeTombstones().size() == 1);
+        std::string val;
+        bool is_blob_index;
+        for (int i = 0; i < 2000; ++i) {
+            int result = table->Get(key(i), &val, 0, &is_blob_index);
+            if (i == 7) {
+                assert(result == 2);
+            } else {
+                assert(result == 1 && val == "v" + key(i));
+            }
+        }
+        for (int i = 2000; i < 4000; ++i) {
+            assert(table->Get(key(i), &val, 0, &is_blob_index) == 0);
+        }
+        assert(table->Get("zz1", &val, 0, &is_blob_index) == 2);
+    }
+
+    options.write_buffer_size = 32 * 1024;
+    {
+        DB db(db_path, options);
+        for (int i = 0; i < 3000; ++i) {
+            db.Put(key(i), std::string(64, 'h'));
+        }
+        db.Delete(key(5));
+        db.WaitForCompaction();
+    }
+
+    {
+        // Tables with and without a hash index mix freely
+        options.table_hash_index = false;
+        DB db(db_path, options);
+        for (int i = 0; i < 3000; i += 2) {
+            db.Put(key(i), "even");
+        }
+        std::string val;
+        for (int i = 0; i < 3000; ++i) {
+            bool found = db.Get(key(i), &val);
+            if (i == 5) {
+                assert(!found);
+            } else {
+                assert(found && val == (i % 2 == 0 ? "even" : std::string(64, 'h')));
+            }
+        }
+        assert(!db.Get(key(3000), &val));
+    }
+
+    CleanDB(db_path);
+    std::cout << "TestHashIndex Passed!" << std::endl;
+}
+
+void TestPrefixIterator() {
+    std::cout << "Running TestPrefixIterator..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_prefix";
+    CleanDB(db_path);
+
+    auto extractor = NewDelimitedPrefixExtractor(':', 2);
+    assert(extractor->InDomain("g:t1:x") && extractor->Transform("g:t1:x") == "g:t1:");
+    assert(!extractor->InDomain("g:t1"));
+
+    // Table filters: tenants are written one table each
+    Options options;
+    options.prefix_extractor = extractor;
+    options.write_buffer_size = 16 * 1024;
+    options.level0_file_num_compaction_trigger = 100;
+    auto tenant = [](int t) { return "g:t" + std::to_string(t) + ":"; };
+    {
+        TableBuilder builder(db_path + "_table.sst", options);
+        builder.Add(tenant(1) + "a", "1", false);
+        builder.Add(tenant(3) + "a", "3", false);
+        builder.Add("nodelim", "x", false);
+        assert(builder.Finish());
+        auto table = Table::Open(db_path + "_table.sst");
+        assert(table && table->HasPrefixFilter());
+        assert(table->PrefixMayMatch(*extractor, tenant(1)));
+        assert(table->PrefixMayMatch(*extractor, tenant(3)));
+        assert(!table->PrefixMayMatch(*extractor, tenant(2)));
+        // Outside the key range
+        assert(!table->PrefixMayMatch(*extractor, "a:b:"));
+        // Filters of another extractor are not trusted
+        assert(table->PrefixMayMatch(*NewFixedPrefixExtractor(5), tenant(2)));
+        fs::remove(db_path + "_table.sst");
+    }
+
+    {
+        DB db(db_path, options);
+        for (int t = 0; t < 8; t += 2) {
+            for (int i = 0; i < 300; ++i) {
+                db.Put(tenant(t) + std::to_string(1000 + i), std::string(64, 'a' + t));
+            }
+        }
+        db.Delete(tenant(2) + "1005");
+        // Range deletions count even where the prefix filter has no key of tenant 4
+        db.Put("g:u", "unrelated");
+        db.DeleteRange(tenant(4) + "1000", tenant(4) + "1010");
+        db.Put(tenant(6) + "memtable", "fresh");
+        db.Put(tenant(7) + "memtable", "fresh");
+
+        auto count = [&db](const std::string& prefix) {
+            std::unique_ptr<Iterator> iter(db.NewPrefixIterator(prefix));
+            int n = 0;
+            for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+                assert(HasPrefix(iter->Key(), prefix));
+                n++;
+            }
+            return n;
+        };
+        assert(count(tenant(0)) == 300);
+        assert(count(tenant(1)) == 0);
+        assert(count(tenant(2)) == 299);
+        assert(count(tenant(4)) == 290);
+        assert(count(tenant(6)) == 301);
+        assert(count(tenant(7)) == 1);
+        assert(count(tenant(9)) == 0);
+
+        std::unique_ptr<Iterator> iter(db.NewPrefixIterator(tenant(6)));
+        iter->Seek(tenant(6) + "1299");
+        assert(iter->Valid() && iter->Key() == tenant(6) + "1299");
+        iter->Next();
+        assert(iter->Valid() && iter->Key() == tenant(6) + "memtable" && iter->Value() == "fresh");
+        iter->Next();
+        assert(!iter->Valid());
+
+        bool threw = false;
+        try {
+            delete db.NewPrefixIterator("g:");
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        assert(threw);
+
+        std::string val;
+        assert(!db.Get(tenant(1) + "1000", &val));
+        assert(db.Get(tenant(0) + "1000", &val) && val == std::string(64, 'a'));
+    }
+
+    CleanDB(db_path);
+    std::cout << "TestPrefixIterator Passed!" << std::endl;
+}
+
+void TestMultiGet() {
+    std::cout << "Running TestMultiGet..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_multiget";
+    CleanDB(db_path);
+
+    // Both read engines return the same bytes, short at end of file
+    {
+        fs::create_directories(db_path);
+        std::string file_path = db_path + "/data";
+        std::string content;
+        for (int i = 0; i < 100000; ++i) content += static_cast<char>('a' + i % 26);
+        {
+            std::ofstream out(file_path, std::ios::binary);
+            out << content;
+        }
+        int fd = open(file_path.c_str(), O_RDONLY);
+        assert(fd >= 0);
+        std::vector<std::unique_ptr<AsyncIO>> engines;
+        engines.push_back(AsyncIO::NewThreadPool(2));
+        if (auto uring = AsyncIO::NewIoUring(4)) engines.push_back(std::move(uring));
+        for (auto& engine : engines) {
+            // More requests than the ring holds
+            std::vector<ReadRequest> reqs(20);
+            std::vector<ReadRequest*> batch;
+            for (size_t i = 0; i < reqs.size(); ++i) {
+                reqs[i].fd = fd;
+                reqs[i].offset = i * 5000 + i;
+                reqs[i].len = 1000 + i;
+                batch.push_back(&reqs[i]);
+            }
+            reqs.back().offset = content.size() - 10;
+            engine->Read(batch);
+            for (size_t i = 0; i + 1 < reqs.size(); ++i) {
+                assert(reqs[i].error == 0 && reqs[i].data == content.substr(reqs[i].offset, reqs[i].len));
+            }
+            assert(reqs.back().data == content.substr(content.size() - 10));
+        }
+        close(fd);
+        CleanDB(db_path);
+    }
+
+    Options options;
+    options.write_buffer_size = 16 * 1024;
+    options.level0_file_num_compaction_trigger = 2;
+    options.min_blob_size = 512;
+    auto key = [](int i) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "mget%04d", i);
+        return std::string(buf);
+    };
+    auto value = [](int i) { return std::string(i % 10 == 0 ? 600 : 50, static_cast<char>('a' + i % 26)); };
+    {
+        DB db(db_path, options);
+        for (int i = 0; i < 1000; ++i) {
+            db.Put(key(i), value(i));
+        }
+        db.WaitForCompaction();
+        db.Delete(key(1));
+        db.DeleteRange(key(100), key(110));
+        db.PutWithExpiry(key(2), "gone", NowMillis() - 1);
+        db.Put(key(3), "fresh");
+
+        std::vector<std::string> keys;
+        for (int i = 0; i < 1000; i += 7) keys.push_back(key(i));
+        for (int i = 0; i < 4; ++i) keys.push_back(key(i));
+        keys.push_back(key(105));
+        keys.push_back("missing");
+        keys.push_back(key(0)); // Duplicates are fine
+        std::vector<std::string> values;
+        std::vector<bool> found = db.MultiGet(keys, &values);
+        assert(found.size() == keys.size() && values.size() == keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            std::string expected;
+            bool expected_found = db.Get(keys[i], &expected);
+            assert(found[i] == expected_found);
+            if (found[i]) assert(values[i] == expected);
+        }
+        size_t n = keys.size();
+        assert(found[n - 7] && values[n - 7] == value(0));
+        assert(!found[n - 6] && !found[n - 5]);
+        assert(found[n - 4] && values[n - 4] == "fresh");
+        assert(!found[n - 3] && !found[n - 2] && found[n - 1]);
+        assert(db.MultiGet({}, &values).empty());
+
+        // A full scan goes through the tables' read-ahead
+        std::unique_ptr<Iterator> iter(db.NewIterator());
+        int count = 0;
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            int i = std::stoi(iter->Key().substr(4));
+            assert(iter->Value() == (i == 3 ? "fresh" : value(i)));
+            count++;
+        }
+        assert(count == 1000 - 2 - 10);
+    }
+
+    CleanDB(db_path);
+    std::cout << "TestMultiGet Passed!" << std::endl;
+}
+
+void TestAsync() {
+    std::cout << "Running TestAsync..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_async";
+    CleanDB(db_path);
+
+    Options options;
+    options.max_async_workers = 2;
+    std::atomic<int> puts_done{0};
+    {
+        DB db(db_path, options);
+        std::atomic<int> gets_done{0};
+        std::mutex mutex;
+        std::condition_variable cv;
+        for (int i = 0; i < 1000; ++i) {
+            std::string key = "async" + std::to_string(i);
+            db.PutAsync(key, "v" + std::to_string(i), [&](std::exception_ptr error) {
+                assert(!error);
+                std::lock_guard<std::mutex> lock(mutex);
+                puts_done++;
+                cv.notify_all();
+            });
+        }
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return puts_done == 1000; });
+        }
+        for (int i = 0; i < 1000; ++i) {
+            db.GetAsync("async" + std::to_string(i), [&, i](std::exception_ptr error, bool found, std::string value) {
+                assert(!error && found && value == "v" + std::to_string(i));
+                std::lock_guard<std::mutex> lock(mutex);
+                gets_done++;
+                cv.notify_all();
+            });
+        }
+        db.GetAsync("missing", [&](std::exception_ptr error, bool found, std::string) {
+            assert(!error && !found);
+            std::lock_guard<std::mutex> lock(mutex);
+            gets_done++;
+            cv.notify_all();
+        });
+
+        // Errors reach the callback instead of being thrown
+        ColumnFamilyHandle* cf = db.CreateColumnFamily("dropped");
+        db.DropColumnFamily(cf);
+        db.GetAsync("k", [&](std::exception_ptr error, bool, std::string) {
+            assert(error);
+            std::lock_guard<std::mutex> lock(mutex);
+            gets_done++;
+            cv.notify_all();
+        }, cf);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return gets_done == 1002; });
+        lock.unlock();
+
+        // Still queued when the DB closes: runs before the destructor returns
+        for (int i = 0; i < 100; ++i) {
+            db.PutAsync("late" + std::to_string(i), "x", [&](std::exception_ptr) { puts_done++; });
+        }
+    }
+    assert(puts_done == 1100);
+    {
+        DB db(db_path, options);
+        std::string val;
+        assert(db.Get("late99", &val) && val == "x");
+        assert(db.Get("async999", &val) && val == "v999");
+    }
+
+    CleanDB(db_path);
+    std::cout << "TestAsync Passed!" << std::endl;
+}
+
+void TestWriteBufferManager() {
+    std::cout << "Running TestWriteBufferManager..." << std::endl;
+    std::string path_a = "/tmp/lsm_test_wbm_a";
+    std::string path_b = "/tmp/lsm_test_wbm_b";
+    CleanDB(path_a);
+    CleanDB(path_b);
+
+    auto manager = std::make_shared<WriteBufferManager>(512 * 1024);
+    Options options;
+    options.write_buffer_size = 4 * 1024 * 1024; // Never reached: the budget decides
+    options.level0_file_num_compaction_trigger = 100;
+    options.write_buffer_manager = manager;
+    std::string value(1000, 'v');
+    {
+        DB a(path_a, options);
+        DB b(path_b, options);
+        for (int i = 0; i < 300; ++i) a.Put("a" + std::to_string(i), value);
+        assert(manager->memory_usage() > 300 * 1000);
+        assert(a.NumFilesAtLevel(0) == 0);
+
+        // Going over the budget through b flushes a, the larger of the two
+        for (int i = 0; i < 150; ++i) b.Put("b" + std::to_string(i), value);
+        a.WaitForCompaction();
+        b.WaitForCompaction();
+        assert(a.NumFilesAtLevel(0) == 1);
+        assert(b.NumFilesAtLevel(0) == 0);
+        assert(manager->memory_usage() < 512 * 1024);
+
+        // Memory stays near the budget however much is written: writers wait
+        // for the running flush once it is all used
+        for (int i = 0; i < 3000; ++i) b.Put("c" + std::to_string(i), value);
+        b.WaitForCompaction();
+        assert(b.NumFilesAtLevel(0) > 1);
+        assert(manager->memory_usage() < 1024 * 1024);
+
+        std::string val;
+        assert(a.Get("a299", &val) && val == value);
+        assert(b.Get("c2999", &val) && val == value);
+    }
+    // Everything released with the memtables
+    assert(manager->memory_usage() == 0);
+    assert(manager->mutable_memtable_memory_usage() == 0);
+
+    // A DB-local budget without a shared manager
+    CleanDB(path_a);
+    {
+        Options local;
+        local.db_write_buffer_size = 256 * 1024;
+        local.level0_file_num_compaction_trigger = 100;
+        DB db(path_a, local);
+        for (int i = 0; i < 1000; ++i) db.Put("k" + std::to_string(i), value);
+        db.WaitForCompaction();
+        assert(db.NumFilesAtLevel(0) > 1);
+    }
+
+    // A range delete that takes the memtables over the budget flushes too
+    CleanDB(path_a);
+    {
+        Options ranged;
+        ranged.write_buffer_manager = std::make_shared<WriteBufferManager>(256 * 1024);
+        ranged.level0_file_num_compaction_trigger = 100;
+        ranged.num_shards = 2;
+        DB db(path_a, ranged);
+        for (int i = 0; i < 200; ++i) db.Put("r" + std::to_string(i), value);
+        // 3KB bounds, covering r1 to r50 in byte order
+        db.DeleteRange("r" + std::string(3000, '0'), "r5" + std::string(3000, '0'));
+        db.WaitForCompaction();
+        assert(db.NumFilesAtLevel(0) >= 1);
+        std::string val;
+        assert(!db.Get("r1", &val) && !db.Get("r199", &val) && !db.Get("r50", &val));
+        assert(db.Get("r0", &val) && db.Get("r55", &val) && db.Get("r99", &val));
+    }
+
+    CleanDB(path_a);
+    CleanDB(path_b);
+    std::cout << "TestWriteBufferManager Passed!" << std::endl;
+}
+
+// Holds compactions (not flushes) until released, so L0 piles up
+class BlockingFilter : public CompactionFilter {
+public:
+    std::atomic<bool> released{false};
+
+    Decision Filter(int level, const std::string&, const std::string&, std::string*) const override {
+        while (level > 0 && !released) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return Decision::kKeep;
+    }
+    const char* Name() const override { return "BlockingFilter"; }
+};
+
+void TestWriteStall() {
+    std::cout << "Running TestWriteStall..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_write_stall";
+    CleanDB(db_path);
+
+    {
+        // The bucket paces writes to the rate
+        WriteController controller(1024 * 1024);
+        assert(controller.GetDelay(1024 * 1024) == 0);
+        uint64_t delay = controller.GetDelay(1024);
+        assert(delay > 900 * 1000 && delay <= 1000 * 1000);
+        controller.set_delayed_write_rate(1);
+        assert(controller.delayed_write_rate() == WriteController::kMinDelayedWriteRate);
+    }
+
+    auto filter = std::make_shared<BlockingFilter>();
+    Options options;
+    options.write_buffer_size = 16 * 1024;
+    options.level0_file_num_compaction_trigger = 2;
+    options.level0_slowdown_writes_trigger = 3;
+    options.level0_stop_writes_trigger = 5;
+    options.delayed_write_rate = 1024 * 1024;
+    options.compaction_filter = filter;
+    std::string value(1000, 'v');
+    {
+        DB db(db_path, options);
+        std::atomic<int> written{0};
+        std::thread writer([&] {
+            for (int i = 0; i < 300; ++i) {
+                db.Put("key" + std::to_string(i), value);
+                written++;
+            }
+        });
+
+        // The first compaction is stuck: flushes pile up in L0 until writes stop
+        while (!db.GetWriteStallStats().stopped) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        assert(db.NumFilesAtLevel(0) >= 5);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20)); // A write already past the check
+        int before = written;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        assert(written == before && before < 300);
+
+        filter->released = true;
+        writer.join();
+        db.WaitForCompaction();
+
+        WriteStallStats stats = db.GetWriteStallStats();
+        assert(!stats.stopped && !stats.delayed);
+        assert(stats.num_delayed_writes > 0 && stats.delay_micros > 0);
+        assert(stats.num_stopped_writes > 0 && stats.stop_micros >= 100 * 1000);
+        assert(stats.delayed_write_rate <= 1024 * 1024);
+        std::string val;
+        assert(db.Get("key299", &val) && val == value);
+    }
+
+    CleanDB(db_path);
+    std::cout << "TestWriteStall Passed!" << std::endl;
+}
+
+void TestTableIndex() {
+    std::cout << "Running TestTableIndex..." << std::endl;
+    std::mt19937 rng(42);
+    auto random_bytes = [&rng](size_t max_len) {
+        std::string s(rng() % (max_len + 1), '\0');
+        for (char& c : s) c = static_cast<char>(rng() % 4 == 0 ? "\0\xff"[rng() % 2] : 'a' + rng() % 4);
+        return s;
+    };
+
+    std::vector<std::vector<std::string>> key_sets;
+    key_sets.push_back({});
+    key_sets.push_back({"only"});
+    {
+        // Short keys, zero bytes and a shared prefix
+        std::vector<std::string> keys;
+        for (int i = 0; i < 5000; ++i) keys.push_back("user:" + random_bytes(12));
+        key_sets.push_back(keys);
+    }
+    {
+        // Keys that only differ far past the shared prefix tie on the packed bytes
+        std::vector<std::string> keys;
+        for (int i = 0; i < 3000; ++i) keys.push_back("t:" + std::string(i % 3, 'x') + "0123456789" + random_bytes(6));
+        key_sets.push_back(keys);
+    }
+
+    for (auto& keys : key_sets) {
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        std::vector<std::string> probes = keys;
+        for (int i = 0; i < 2000; ++i) {
+            probes.push_back(random_bytes(3));
+            probes.push_back("user:" + random_bytes(14));
+            probes.push_back("t:x0123456789" + random_bytes(8));
+        }
+        probes.push_back("");
+        probes.push_back("user");
+        probes.push_back("\xff\xff");
+
+        for (bool eytzinger : {false, true}) {
+            TableIndex index;
+            for (size_t i = 0; i < keys.size(); ++i) index.Add(keys[i], i * 10);
+            index.Finish(eytzinger);
+            assert(index.size() == keys.size());
+            for (const auto& probe : probes) {
+                size_t expected = std::lower_bound(keys.begin(), keys.end(), probe) - keys.begin();
+                assert(index.LowerBound(probe) == expected);
+                bool present = expected < keys.size() && keys[expected] == probe;
+                assert(index.Find(probe) == (present ? expected : keys.size()));
+                if (present) assert(index.Key(expected) == probe && index.Offset(expected) == expected * 10);
+            }
+        }
+    }
+
+    std::cout << "TestTableIndex Passed!" << std::endl;
+}
+
+void TestLearnedIndex() {
+    std::cout << "Running TestLearnedIndex..." << std::endl;
+    std::mt19937 rng(7);
+    auto decimal_id = [](uint64_t id) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "user:%09llu", static_cast<unsigned long long>(id));
+        return std::string(buf);
+    };
+    auto binary_id = [](uint64_t id) {
+        std::string key = "id:";
+        for (int i = 7; i >= 0; --i) key.push_back(static_cast<char>(id >> (8 * i)));
+        return key;
+    };
+
+    std::vector<std::string> decimal_keys, binary_keys, skewed_keys;
+    uint64_t id = 123456;
+    for (int i = 0; i < 20000; ++i) {
+        id += 1 + rng() % 3; // Monotonic IDs with small gaps
+        decimal_keys.push_back(decimal_id(id));
+        binary_keys.push_back(binary_id(id));
+    }
+    // Runs of 20 IDs far apart: each run needs a segment of its own
+    for (int i = 0; i < 20000; ++i) {
+        skewed_keys.push_back(binary_id((uint64_t(i / 20) << 40) + i % 20));
+    }
+
+    auto build = [](const std::vector<std::string>& keys, bool learned) {
+        auto index = std::make_unique<TableIndex>();
+        for (size_t i = 0; i < keys.size(); ++i) index->Add(keys[i], i * 10);
+        index->Finish(false);
+        if (!learned) return index;
+        std::vector<IndexSegment> segments = index->FitSegments(TableIndex::kLearnedMaxError);
+        auto fitted = std::make_unique<TableIndex>();
+        for (size_t i = 0; i < keys.size(); ++i) fitted->Add(keys[i], i * 10);
+        if (!segments.empty()) assert(fitted->SetSegments(segments, TableIndex::kLearnedMaxError));
+        fitted->Finish(true);
+        return fitted;
+    };
+
+    // Binary IDs are one line; decimal ones bend at every carry
+    assert(build(binary_keys, true)->NumSegments() < 10);
+    assert(build(decimal_keys, true)->NumSegments() > 0);
+    assert(build(decimal_keys, true)->NumSegments() < decimal_keys.size() / TableIndex::kMinKeysPerSegment);
+    assert(build(skewed_keys, true)->NumSegments() == 0);
+
+    for (const auto* keys : {&decimal_keys, &binary_keys}) {
+        auto index = build(*keys, true);
+        std::vector<std::string> probes = *keys;
+        for (int i = 0; i < 5000; ++i) {
+            probes.push_back(decimal_id(rng() % 300000));
+            probes.push_back(binary_id(rng() % 300000));
+            probes.push_back((*keys)[rng() % keys->size()] + "x");
+        }
+        probes.push_back("");
+        probes.push_back("\xff");
+        for (const auto& probe : probes) {
+            size_t expected = std::lower_bound(keys->begin(), keys->end(), probe) - keys->begin();
+            assert(index->LowerBound(probe) == expected);
+        }
+    }
+
+    // A damaged model still finds every key, through the fallback search
+    {
+        std::vector<IndexSegment> segments = {{0, 0, 0.0}, {1ull << 62, 5, 1e-9}};
+        TableIndex index;
+        for (size_t i = 0; i < decimal_keys.size(); ++i) index.Add(decimal_keys[i], i * 10);
+        assert(!index.SetSegments({{0, 100000, 0.0}}, TableIndex::kLearnedMaxError));
+        assert(index.SetSegments(segments, TableIndex::kLearnedMaxError));
+        index.Finish(false);
+        for (size_t i = 0; i < decimal_keys.size(); i += 7) assert(index.Find(decimal_keys[i]) == i);
+    }
+
+    std::string db_path = "/tmp/lsm_test_learned_index";
+    CleanDB(db_path);
+    fs::create_directories(db_path);
+    Options options;
+    options.table_learned_index = true;
+    {
+        TableBuilder builder(db_path + "/ids.sst", options);
+        for (const auto& key : decimal_keys) builder.Add(key, "v" + key, false);
+        assert(builder.Finish());
+        TableBuilder skewed_builder(db_path + "/skewed.sst", options);
+        for (const auto& key : skewed_keys) skewed_builder.Add(key, "v", false);
+        assert(skewed_builder.Finish());
+
+        auto table = Table::Open(db_path + "/ids.sst");
+        assert(table && table->HasLearnedIndex() && !table->HasHashIndex() && !table->HasPrefixFilter());
+        auto skewed_table = Table::Open(db_path + "/skewed.sst");
+        assert(skewed_table && !skewed_table->HasLearnedIndex());
+
+        std::string val;
+        bool is_blob_index;
+        for (const auto& key : decimal_keys) {
+            assert(table->Get(key, &val, 0, &is_blob_index) == 1 && val == "v" + key);
+        }
+        assert(table->Get(decimal_id(1), &val, 0, &is_blob_index) == 0);
+        std::unique_ptr<Table::Iterator> it(table->NewIterator());
+        it->Seek(decimal_keys[12345] + "0");
+        assert(it->Valid() && it->Key() == decimal_keys[12346]);
+    }
+    CleanDB(db_path);
+
+    options.write_buffer_size = 64 * 1024;
+    {
+        DB db(db_path, options);
+        for (const auto& key : decimal_keys) db.Put(key, "v");
+        db.WaitForCompaction();
+        std::string val;
+        for (size_t i = 0; i < decimal_keys.size(); i += 3) assert(db.Get(decimal_keys[i], &val) && val == "v");
+        assert(!db.Get(decimal_id(100), &val));
+    }
+
+    CleanDB(db_path);
+    std::cout << "TestLearnedIndex Passed!" << std::endl;
+}
+
+void TestComparator() {
+    std::cout << "Running TestComparator..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_comparator";
+    std::string sst_path = "/tmp/lsm_test_comparator_external.sst";
+    CleanDB(db_path);
+    auto key = [](int i) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "cmp%05d", i);
+        return std::string(buf);
+    };
+    auto uint64_key = [](uint64_t id) {
+        std::string key;
+        for (int i = 7; i >= 0; --i) key.push_back(static_cast<char>(id >> (8 * i)));
+        return key;
+    };
+
+    assert(ReverseBytewiseComparator()->Compare("b", "a") < 0);
+    assert(Uint64Comparator()->Compare(uint64_key(255), uint64_key(256)) < 0);
+    assert(Uint64Comparator()->Compare(uint64_key(7), uint64_key(7)) == 0);
+    assert(BuiltinComparatorByName(Uint64Comparator()->Name()) == Uint64Comparator());
+    assert(!BuiltinComparatorByName("no.SuchComparator"));
+
+    Options options;
+    options.comparator = ReverseBytewiseComparator();
+    options.write_buffer_size = 16 * 1024;
+    options.target_file_size = 8 * 1024;
+    options.prefix_extractor = NewFixedPrefixExtractor(3);
+    // Keys in descending byte order, with [2000, 1900) deleted
+    auto check = [&](DB& db) {
+        std::string val;
+        assert(db.Get(key(2500), &val) && val == "v2500");
+        assert(!db.Get(key(1950), &val));
+        assert(db.Get(key(1900), &val) && val == "v1900");
+        std::unique_ptr<Iterator> iter(db.NewIterator());
+        int expected = 2999;
+        for (iter->Seek(key(2999)); iter->Valid(); iter->Next()) {
+            assert(iter->Key() == key(expected));
+            expected = expected == 2001 ? 1900 : expected - 1;
+        }
+        assert(expected == -1);
+        iter->Seek(key(1500) + "x");
+        assert(iter->Valid() && iter->Key() == key(1500));
+    };
+
+    {
+        DB db(db_path, options);
+        for (int i = 0; i < 3000; ++i) db.Put(key(i), "v" + std::to_string(i));
+        db.DeleteRange(key(1900), key(2000)); // Empty in this order
+        db.DeleteRange(key(2000), key(1900));
+        db.WaitForCompaction();
+        assert(db.NumFilesAtLevel(0) < options.level0_file_num_compaction_trigger);
+        check(db);
+
+        bool threw = false;
+        try {
+            delete db.NewPrefixIterator("cmp");
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        assert(threw);
+
+        // External files are written in the family's order
+        SstFileWriter writer(sst_path, options);
+        assert(writer.Put(key(5001), "ext") && writer.Put(key(5000), "ext"));
+        assert(!writer.Put(key(5002), "ext"));
+        assert(writer.Finish());
+        assert(!Table::Open(sst_path));
+        assert(Table::Open(sst_path, ReverseBytewiseComparator().get()));
+        db.IngestExternalFile(sst_path);
+        std::string val;
+        assert(db.Get(key(5001), &val) && val == "ext");
+
+        ColumnFamilyOptions id_options;
+        id_options.comparator = Uint64Comparator();
+        ColumnFamilyHandle* ids = db.CreateColumnFamily("ids", id_options);
+        for (uint64_t id = 0; id < 2000; ++id) db.Put(ids, uint64_key(id * 1000003 % 2000), "id");
+    }
+
+    {
+        DB db(db_path, options);
+        std::string val;
+        assert(db.Get(key(5000), &val) && val == "ext");
+        // Reopened with default options, but still in integer order
+        ColumnFamilyHandle* ids = db.GetColumnFamily("ids");
+        assert(ids);
+        std::unique_ptr<Iterator> iter(db.NewIterator(ids));
+        uint64_t expected = 0;
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) assert(iter->Key() == uint64_key(expected++));
+        assert(expected == 2000);
+
+        bool threw = false;
+        try {
+            db.CreateColumnFamily("ids", ColumnFamilyOptions());
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        assert(threw);
+    }
+
+    // Sorted by another comparator: the DB refuses to open
+    bool threw = false;
+    try {
+        DB db(db_path);
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    assert(threw);
+    {
+        DB db(db_path, options);
+        check(db);
+    }
+
+    CleanDB(db_path);
+    fs::remove(sst_path);
+    std::cout << "TestComparator Passed!" << std::endl;
+}
+
+void TestRowCache() {
+    std::cout << "Running TestRowCache..." << std::endl;
+    {
+        RowCache cache(16 * 4096);
+        uint64_t id = cache.NewId();
+        RowCache::Row row;
+        row.value = std::string(100, 'r');
+        for (int i = 0; i < 2000; ++i) cache.Insert(id, i, "key", row);
+        assert(cache.usage() <= cache.capacity());
+        assert(cache.Lookup(id, 1999, "key", &row) && row.value == std::string(100, 'r'));
+        assert(!cache.Lookup(id, 0, "key", &row));      // Evicted
+        assert(!cache.Lookup(id + 1, 1999, "key", &row)); // Another namespace
+        assert(cache.hits() == 1 && cache.misses() == 2);
+        row.value = std::string(8192, 'x'); // Larger than a shard
+        cache.Insert(id, 1, "big", row);
+        assert(!cache.Lookup(id, 1, "big", &row));
+    }
+
+    std::string db_path = "/tmp/lsm_test_row_cache";
+    std::string other_path = "/tmp/lsm_test_row_cache_other";
+    CleanDB(db_path);
+    CleanDB(other_path);
+    Options options;
+    options.write_buffer_size = 16 * 1024;
+    options.min_blob_size = 512;
+    options.row_cache = std::make_shared<RowCache>(1024 * 1024);
+    auto key = [](int i) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "row%04d", i);
+        return std::string(buf);
+    };
+    auto value = [](int i) { return std::string(i % 10 == 0 ? 600 : 50, static_cast<char>('a' + i % 26)); };
+    // Pushes the memtables out to tables
+    auto fill = [](DB& db) {
+        for (int i = 0; i < 400; ++i) db.Put("filler" + std::to_string(i), std::string(100, 'f'));
+        db.WaitForCompaction();
+    };
+    {
+        DB db(db_path, options);
+        DB other(other_path, options);
+        assert(db.GetRowCache() == options.row_cache.get());
+        for (int i = 0; i < 1000; ++i) {
+            db.Put(key(i), value(i));
+            other.Put(key(i), "other");
+        }
+        db.PutWithExpiry(key(1000), "short-lived", NowMillis() + 300);
+        db.Delete(key(5));
+        fill(db);
+        fill(other);
+
+        // The second read of a key is served by the cache, with the same result
+        std::string val;
+        uint64_t hits = options.row_cache->hits();
+        for (int round = 0; round < 2; ++round) {
+            for (int i = 0; i < 1000; i += 3) {
+                assert(db.Get(key(i), &val) && val == value(i));
+                assert(other.Get(key(i), &val) && val == "other");
+            }
+            assert(!db.Get(key(5), &val));
+        }
+        assert(options.row_cache->hits() >= hits + 2 * 334);
+        assert(options.row_cache->usage() > 0);
+
+        std::vector<std::string> values;
+        hits = options.row_cache->hits();
+        std::vector<bool> found = db.MultiGet({key(0), key(3), key(5)}, &values);
+        assert(found[0] && values[0] == value(0) && found[1] && values[1] == value(3) && !found[2]);
+        assert(options.row_cache->hits() >= hits + 2);
+
+        // Newer tables hide the cached rows of older ones
+        db.Put(key(3), "new");
+        db.DeleteRange(key(6), key(10));
+        fill(db);
+        assert(db.Get(key(3), &val) && val == "new");
+        assert(!db.Get(key(6), &val) && !db.Get(key(9), &val));
+
+        // A cached row still expires
+        assert(db.Get(key(1000), &val) && val == "short-lived");
+        std::this_thread::sleep_for(std::chrono::milliseconds(400));
+        assert(!db.Get(key(1000), &val));
+    }
+
+    CleanDB(db_path);
+    CleanDB(other_path);
+    std::cout << "TestRowCache Passed!" << std::endl;
+}
+
+void TestCompressedSecondaryCache() {
+    std::cout << "Running TestCompressedSecondaryCache..." << std::endl;
+    std::mt19937 rng(11);
+    std::string random_bytes;
+    for (int i = 0; i < 100000; ++i) random_bytes.push_back(static_cast<char>(rng()));
+    std::string text;
+    for (int i = 0; i < 5000; ++i) text += "{\"user\":" + std::to_string(i % 97) + ",\"name\":\"n" + std::to_string(i) + "\"}";
+    std::string compressed, restored;
+    for (const std::string& data : {std::string(), std::string("abc"), std::string(1000, 'v'), text, random_bytes}) {
+        LZCompress(data.data(), data.size(), &compressed);
+        assert(LZUncompress(compressed.data(), compressed.size(), &restored) && restored == data);
+    }
+    LZCompress(text.data(), text.size(), &compressed);
+    assert(compressed.size() < text.size() / 3);
+    assert(!LZUncompress(compressed.data(), compressed.size() - 1, &restored));
+    assert(!LZUncompress(compressed.data(), 2, &restored));
+
+    {
+        CompressedSecondaryCache secondary(1024 * 1024);
+        std::string value(1000, 'v');
+        assert(!secondary.Insert("unread", value, false)); // Never read while cached
+        assert(!secondary.Insert("random", random_bytes.substr(0, 1000), true));
+        assert(secondary.Insert("hot", value, true));
+        assert(secondary.usage() > 0 && secondary.usage() < 200);
+        assert(secondary.Lookup("hot", &restored) && restored == value);
+        assert(!secondary.Lookup("hot", &restored)); // Moved back to the primary tier
+        assert(secondary.admitted() == 1 && secondary.rejected() == 2 && secondary.hits() == 1);
+        assert(secondary.usage() == 0);
+    }
+
+    // Rows evicted from a small primary tier are found in the compressed one
+    {
+        auto secondary = std::make_shared<CompressedSecondaryCache>(1024 * 1024);
+        RowCache cache(16 * 4096, secondary);
+        uint64_t id = cache.NewId();
+        RowCache::Row row;
+        for (int i = 0; i < 500; ++i) {
+            row.value = std::to_string(i) + std::string(1000, 'x');
+            cache.Insert(id, i, "key", row);
+            assert(cache.Lookup(id, i, "key", &row));
+        }
+        assert(cache.usage() <= cache.capacity());
+        assert(secondary->admitted() > 400 && secondary->usage() < secondary->admitted() * 200);
+        for (int i = 0; i < 500; ++i) {
+            assert(cache.Lookup(id, i, "key", &row) && row.value == std::to_string(i) + std::string(1000, 'x'));
+        }
+        assert(secondary->hits() > 400);
+    }
+
+    std::string db_path = "/tmp/lsm_test_compressed_cache";
+    CleanDB(db_path);
+    Options options;
+    options.write_buffer_size = 16 * 1024;
+    options.row_cache_size = 16 * 4096;
+    options.row_cache_compressed_size = 1024 * 1024;
+    auto key = [](int i) { return "ccache" + std::to_string(i); };
+    auto value = [](int i) { return "value of " + std::to_string(i) + std::string(500, '.'); };
+    {
+        DB db(db_path, options);
+        for (int i = 0; i < 1000; ++i) db.Put(key(i), value(i));
+        for (int i = 0; i < 400; ++i) db.Put("filler" + std::to_string(i), std::string(100, 'f'));
+        db.WaitForCompaction();
+        std::string val;
+        // Read twice: only rows read while cached are worth keeping compressed
+        for (int i = 0; i < 1000; ++i) {
+            assert(db.Get(key(i), &val) && val == value(i));
+            assert(db.Get(key(i), &val) && val == value(i));
+        }
+        for (int round = 0; round < 2; ++round) {
+            for (int i = 0; i < 1000; ++i) assert(db.Get(key(i), &val) && val == value(i));
+        }
+        CompressedSecondaryCache* secondary = db.GetRowCache()->secondary();
+        assert(secondary && secondary->hits() > 1000);
+    }
+    CleanDB(db_path);
+    std::cout << "TestCompressedSecondaryCache Passed!" << std::endl;
+}
+
+void TestCheckpoint() {
+    std::cout << "Running TestCheckpoint..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_checkpoint";
+    std::string checkpoint_path = "/tmp/lsm_test_checkpoint_clone";
+    CleanDB(db_path);
+    CleanDB(checkpoint_path);
+    Options options;
+    options.write_buffer_size = 16 * 1024;
+    options.min_blob_size = 256;
+    options.num_shards = 2;
+    auto key = [](int i) { return "ckpt" + std::to_string(i); };
+    auto value = [](int i) { return std::to_string(i) + std::string(i % 2 ? 300 : 20, 'c'); }; // Odd ones in blobs
+
+    {
+        DB db(db_path, options);
+        ColumnFamilyHandle* users = db.CreateColumnFamily("users");
+        for (int i = 0; i < 2000; ++i) db.Put(key(i), value(i));
+        db.Put(users, "alice", "1");
+        db.WaitForCompaction();
+        // Only in the memtables and WALs
+        db.Put("unflushed", "yes");
+        db.Delete(key(7));
+        db.Put(users, "bob", "2");
+
+        db.CreateCheckpoint(checkpoint_path);
+        assert(fs::exists(checkpoint_path + "/MANIFEST"));
+        int linked = 0;
+        for (const auto& entry : fs::recursive_directory_iterator(checkpoint_path)) {
+            if (entry.path().extension() == ".sst" || entry.path().extension() == ".blob") {
+                assert(fs::hard_link_count(entry.path()) >= 2);
+                linked++;
+            }
+        }
+        assert(linked > 0);
+
+        bool threw = false;
+        try {
+            db.CreateCheckpoint(checkpoint_path);
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        assert(threw);
+
+        // Not seen by the checkpoint
+        db.Put(key(0), "after");
+        db.Put(users, "carol", "3");
+        for (int i = 2000; i < 3000; ++i) db.Put(key(i), value(i));
+        db.WaitForCompaction();
+    }
+
+    {
+        DB clone(checkpoint_path, options);
+        ColumnFamilyHandle* users = clone.CreateColumnFamily("users");
+        std::string val;
+        for (int i = 0; i < 2000; ++i) {
+            if (i == 7) {
+                assert(!clone.Get(key(i), &val));
+            } else {
+                assert(clone.Get(key(i), &val) && val == value(i));
+            }
+        }
+        assert(!clone.Get(key(2500), &val));
+        assert(clone.Get("unflushed", &val) && val == "yes");
+        assert(clone.Get(users, "alice", &val) && val == "1");
+        assert(clone.Get(users, "bob", &val) && val == "2");
+        assert(!clone.Get(users, "carol", &val));
+        clone.Put(key(1), "clone only");
+        clone.WaitForCompaction();
+    }
+
+    {
+        DB db(db_path, options);
+        std::string val;
+        assert(db.Get(key(0), &val) && val == "after");
+        assert(db.Get(key(1), &val) && val == value(1));
+        assert(db.Get(key(2500), &val) && val == value(2500));
+    }
+    CleanDB(db_path);
+    CleanDB(checkpoint_path);
+    std::cout << "TestCheckpoint Passed!" << std::endl;
+}
+
+void TestGetUpdatesSince() {
+    std::cout << "Running TestGetUpdatesSince..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_updates";
+    std::string follower_path = "/tmp/lsm_test_updates_follower";
+    CleanDB(db_path);
+    CleanDB(follower_path);
+    Options options;
+    options.write_buffer_size = 16 * 1024;
+    options.num_shards = 2;
+    options.wal_retention_size = 64 * 1024 * 1024;
+    auto key = [](int i) { return "upd" + std::to_string(i); };
+
+    // Applies what the iterator visits, as a follower would
+    auto apply = [](UpdateIterator* iter, DB* follower, uint64_t* applied) {
+        int count = 0;
+        for (; iter->Valid(); iter->Next()) {
+            const Update& u = iter->update();
+            assert(u.sequence > *applied);
+            *applied = u.sequence;
+            ColumnFamilyHandle* cf = u.column_family == "default" ? follower->DefaultColumnFamily()
+                                                                   : follower->CreateColumnFamily(u.column_family);
+            if (u.type == Update::kPut) {
+                follower->PutWithExpiry(cf, u.key, u.value, u.expire_at);
+            } else if (u.type == Update::kDelete) {
+                follower->Delete(cf, u.key);
+            } else {
+                follower->DeleteRange(cf, u.key, u.value);
+            }
+            count++;
+        }
+        delete iter;
+        return count;
+    };
+
+    uint64_t applied = 0;
+    {
+        DB db(db_path, options);
+        DB follower(follower_path);
+        ColumnFamilyHandle* users = db.CreateColumnFamily("users");
+        for (int i = 0; i < 3000; ++i) db.Put(key(i), std::string(100, 'a' + i % 26));
+        db.Delete(key(1));
+        db.DeleteRange(key(20), key(30));
+        db.Put(users, "alice", "1");
+        db.PutWithExpiry(key(3), "gone", NowMillis() - 1);
+        db.WaitForCompaction();
+        // The DeleteRange takes a number per shard, but is visited once
+        assert(db.GetLatestSequenceNumber() == 3005);
+
+        // Flushed WALs are read from the archive
+        assert(fs::exists(db_path + "/archive"));
+        assert(apply(db.GetUpdatesSince(1), &follower, &applied) == 3004);
+        assert(applied == 3005);
+
+        db.Put(key(0), "newer");
+        db.Delete(users, "alice");
+        assert(apply(db.GetUpdatesSince(applied + 1), &follower, &applied) == 2);
+        assert(apply(db.GetUpdatesSince(applied + 1), &follower, &applied) == 0);
+
+        std::string val;
+        ColumnFamilyHandle* follower_users = follower.GetColumnFamily("users");
+        assert(follower.Get(key(0), &val) && val == "newer");
+        assert(!follower.Get(key(1), &val) && !follower.Get(key(25), &val) && !follower.Get(key(3), &val));
+        assert(follower.Get(key(999), &val) && val == std::string(100, 'a' + 999 % 26));
+        assert(follower_users && !follower.Get(follower_users, "alice", &val));
+    }
+
+    // Sequence numbers and the archive survive a reopen
+    {
+        DB db(db_path, options);
+        assert(db.GetLatestSequenceNumber() == applied);
+        db.Put(key(5), "after reopen");
+        UpdateIterator* iter = db.GetUpdatesSince(1);
+        assert(iter && iter->Valid() && iter->update().sequence == 1);
+        delete iter;
+        iter = db.GetUpdatesSince(applied + 1);
+        assert(iter->Valid() && iter->update().sequence == applied + 1 && iter->update().value == "after reopen");
+        delete iter;
+    }
+
+    // Without an archive, flushed writes are gone
+    options.wal_retention_size = 0;
+    {
+        DB db(db_path, options);
+        assert(!fs::exists(db_path + "/archive") || fs::is_empty(db_path + "/archive"));
+        assert(db.GetUpdatesSince(1) == nullptr);
+        uint64_t latest = db.GetLatestSequenceNumber();
+        assert(latest == applied + 1);
+        db.Put(key(6), "unflushed");
+        UpdateIterator* iter = db.GetUpdatesSince(latest + 1);
+        assert(iter && iter->Valid() && iter->update().key == key(6));
+        delete iter;
+        for (int i = 0; i < 3000; ++i) db.Put(key(i), std::string(100, 'z'));
+        db.WaitForCompaction();
+        assert(db.GetUpdatesSince(latest + 1) == nullptr);
+    }
+    {
+        DB db(db_path, options);
+        assert(db.GetLatestSequenceNumber() == applied + 3002);
+    }
+    CleanDB(db_path);
+    CleanDB(follower_path);
+
+    // Puts racing with DeleteRanges on other shards: the follower must end
+    // up with exactly what the source has. Each round deletes its own range,
+    // so a put that lands on the wrong side of a delete stays visible.
+    // Small memtables and slow flushes make the range deletes wait for
+    // flushes of one shard while the others are being written.
+    options.num_shards = 4;
+    options.write_buffer_size = 32 * 1024;
+    options.wal_retention_size = 64 * 1024 * 1024;
+    options.compaction_filter = std::make_shared<SlowFlushFilter>();
+    {
+        DB db(db_path, options);
+        DB follower(follower_path);
+        auto range = [](int round) { return "race" + std::to_string(1000 + round); };
+        std::atomic<int> round{0};
+        std::atomic<bool> done{false};
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 2; ++t) {
+            writers.emplace_back([&, t] {
+                for (int i = 0; !done; ++i) {
+                    db.Put(range(round) + "/" + std::to_string(t) + "_" + std::to_string(i % 64), "v");
+                }
+            });
+        }
+        for (int r = 0; r < 2000; ++r) {
+            round = r;
+            db.DeleteRange(range(r) + "/", range(r) + "0");
+        }
+        done = true;
+        for (auto& w : writers) w.join();
+        applied = 0;
+        assert(apply(db.GetUpdatesSince(1), &follower, &applied) > 2000);
+
+        std::unique_ptr<Iterator> source(db.NewIterator());
+        std::unique_ptr<Iterator> copy(follower.NewIterator());
+        for (source->SeekToFirst(), copy->SeekToFirst(); source->Valid(); source->Next(), copy->Next()) {
+            assert(copy->Valid() && copy->Key() == source->Key() && copy->Value() == source->Value());
+        }
+        assert(!copy->Valid());
+    }
+    CleanDB(db_path);
+    CleanDB(follower_path);
+    std::cout << "TestGetUpdatesSince Passed!" << std::endl;
+}
+
+void TestMemEnv() {
+    std::cout << "Running TestMemEnv..." << std::endl;
+    std::shared_ptr<Env> env = NewMemEnv();
+
+    // The file system itself
+    assert(!env->FileExists("/mem"));
+    assert(!env->NewWritableFile("/mem/a"));
+    assert(env->CreateDirs("/mem/dir/"));
+    assert(env->IsDirectory("/mem") && env->IsDirectory("/mem//dir"));
+    {
+        auto file = env->NewWritableFile("/mem/dir/a");
+        assert(file && file->Append("hello ") && file->Append("world") && file->Close());
+    }
+    auto reader = env->NewRandomAccessFile("/mem/dir/./a");
+    char buf[16];
+    assert(reader && reader->Size() == 11);
+    assert(reader->Read(6, sizeof(buf), buf) == 5 && std::string(buf, 5) == "world");
+    assert(reader->Read(11, sizeof(buf), buf) == 0);
+    assert(env->LinkFile("/mem/dir/a", "/mem/b") && !env->LinkFile("/mem/dir/a", "/mem/b"));
+    assert(env->RenameFile("/mem/b", "/mem/dir/c") && !env->FileExists("/mem/b"));
+    std::vector<std::string> names;
+    assert(env->GetChildren("/mem/dir", &names));
+    std::sort(names.begin(), names.end());
+    assert((names == std::vector<std::string>{"a", "c"}));
+    assert(env->TruncateFile("/mem/dir/c", 5));
+    uint64_t size = 0;
+    assert(env->GetFileSize("/mem/dir/a", &size) && size == 5); // A link shares the contents
+    assert(env->RemoveAll("/mem") && !env->FileExists("/mem/dir/a"));
+    // Files stay readable once removed, as on POSIX
+    assert(reader->Read(0, sizeof(buf), buf) == 5 && std::string(buf, 5) == "hello");
+
+    // A whole DB, never touching the disk
+    std::string db_path = "/tmp/lsm_test_mem_env";
+    CleanDB(db_path);
+    Options options;
+    options.env = env;
+    options.write_buffer_size = 16 * 1024;
+    options.min_blob_size = 256;
+    options.num_shards = 2;
+    options.wal_retention_size = 1 << 20;
+    auto key = [](int i) { return "mem" + std::to_string(i); };
+    auto value = [](int i) { return std::to_string(i) + std::string(i % 2 ? 300 : 20, 'm'); }; // Odd ones in blobs
+    {
+        DB db(db_path, options);
+        ColumnFamilyHandle* users = db.CreateColumnFamily("users");
+        for (int i = 0; i < 3000; ++i) db.Put(key(i), value(i));
+        db.Put(users, "alice", "1");
+        db.DeleteRange("mem10", "mem11");
+        db.WaitForCompaction();
+        db.Put("unflushed", "yes");
+        std::unique_ptr<UpdateIterator> updates(db.GetUpdatesSince(1));
+        assert(updates && updates->Valid() && updates->update().key == key(0));
+        db.CreateCheckpoint(db_path + "_clone");
+    }
+    assert(!fs::exists(db_path) && !fs::exists(db_path + "_clone"));
+    assert(env->FileExists(db_path + "/MANIFEST") && env->FileExists(db_path + "_clone/MANIFEST"));
+
+    for (const std::string& path : {db_path, db_path + "_clone"}) {
+        DB db(path, options);
+        ColumnFamilyHandle* users = db.CreateColumnFamily("users");
+        std::string val;
+        for (int i = 0; i < 3000; i += 7) {
+            bool deleted = key(i) >= "mem10" && key(i) < "mem11";
+            assert(db.Get(key(i), &val) == !deleted);
+            if (!deleted) assert(val == value(i));
+        }
+        assert(db.Get("unflushed", &val) && val == "yes");
+        assert(db.Get(users, "alice", &val) && val == "1");
+        std::unique_ptr<Iterator> iter(db.NewIterator());
+        int count = 0;
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) count++;
+        assert(count == 3000 - 111 + 1);
+    }
+
+    // Another Env starts out empty
+    Options other = options;
+    other.env = NewMemEnv();
+    {
+        DB db(db_path, other);
+        std::string val;
+        assert(!db.Get(key(0), &val));
+    }
+    assert(!fs::exists(db_path));
+    std::cout << "TestMemEnv Passed!" << std::endl;
+}
+
+void TestWriteOptions() {
+    std::cout << "Running TestWriteOptions..." << std::endl;
+    std::string db_path = "/tmp/lsm_test_write_options";
+    CleanDB(db_path);
+    Options options;
+    options.num_shards = 2;
+
+    WriteOptions synced;
+    synced.sync = true;
+    WriteOptions unlogged;
+    unlogged.disable_wal = true;
+    WriteOptions low_pri;
+    low_pri.low_pri = true;
+    {
+        DB db(db_path, options);
+        db.Put("logged", "1", synced);
+        uint64_t sequence = db.GetLatestSequenceNumber();
+        for (int i = 0; i < 100; ++i) db.Put("unlogged" + std::to_string(i), "2", unlogged);
+        db.Delete("logged", unlogged);
+        db.PutWithExpiry("expiring", "3", 4102444800000ULL, unlogged); // 2100
+        db.DeleteRange("unlogged1", "unlogged2", unlogged);
+        // Not in the WAL, so no sequence numbers and nothing for followers
+        assert(db.GetLatestSequenceNumber() == sequence);
+
+        bool threw = false;
+        try {
+            WriteOptions both = synced;
+            both.disable_wal = true;
+            db.Put("both", "x", both);
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        assert(threw);
+
+        // Compactions are not behind, so low-priority writes go at full speed
+        for (int i = 0; i < 100; ++i) db.Put("low" + std::to_string(i), "4", low_pri);
+        assert(db.GetWriteStallStats().num_delayed_writes == 0);
+    }
+    // A clean close flushes what the WAL does not have
+    {
+        DB db(db_path, options);
+        std::string value;
+        assert(!db.Get("logged", &value));
+        assert(db.Get("unlogged0", &value) && value == "2");
+        assert(!db.Get("unlogged1", &value) && !db.Get("unlogged15", &value));
+        assert(db.Get("unlogged99", &value) && value == "2");
+        assert(db.Get("expiring", &value) && value == "3");
+        assert(db.Get("low99", &value) && value == "4");
+        assert(!db.Get("both", &value));
+    }
+    CleanDB(db_path);
+    std::cout << "TestWriteOptions Passed!" << std::endl;
+}
+
 int main() {
     TestBasic();
     TestRecovery();
@@ -241,6 +2362,33 @@ int main() {
     TestFlush();
     TestFlushRecovery();
     TestReadWriteConcurrency();
+    TestShards();
+    TestColumnFamilies();
+    TestTrace();
+    TestTTL();
+    TestCompaction();
+    TestIterator();
+    TestCompactionFilter();
+    TestDeleteRange();
+    TestBlobFiles();
+    TestIngestExternalFile();
+    TestSubcompactions();
+    TestUniversalCompaction();
+    TestHashIndex();
+    TestPrefixIterator();
+    TestMultiGet();
+    TestAsync();
+    TestWriteBufferManager();
+    TestWriteStall();
+    TestTableIndex();
+    TestLearnedIndex();
+    TestComparator();
+    TestRowCache();
+    TestCompressedSecondaryCache();
+    TestCheckpoint();
+    TestGetUpdatesSince();
+    TestMemEnv();
+    TestWriteOptions();
     std::cout << "All Correctness Tests Passed!" << std::endl;
     return 0;
 }
@@ -0,0 +1,251 @@
+// lsm_replay: replay an operation trace (see core/trace.h) against a fresh DB.
+//
+// Usage: lsm_replay <trace_file> <db_path> [--speed=N] [--threads=N]
+//   --speed=N    Replay at N times the original rate. 0 replays as fast as
+//                possible, ignoring timestamps. Default: 1.
+//   --threads=N  Number of replay threads. Default: 4.
+//
+// The trace is streamed, not loaded: records are partitioned across threads
+// by key hash into bounded queues, so ops on the same key are always applied
+// in their original order; ops on different keys may be reordered across
+// threads. A range delete covers keys of every thread, so all threads finish
+// the records before it, it is applied, and then they go on: per-key order
+// holds for range deletes too. Ops on a column family
+// other than the default go to one of the same name, created on the fly.
+// Expiry times are moved along with the op, keeping the time it had left.
+#include "core/db.h"
+#include "core/trace.h"
+#include "util/clock.h"
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <functional>
+#include <filesystem>
+#include <iomanip>
+#include <algorithm>
+#include <cstring>
+
+namespace fs = std::filesystem;
+using namespace lsm;
+
+struct ReplayStats {
+    std::atomic<uint64_t> puts{0};
+    std::atomic<uint64_t> gets{0};
+    std::atomic<uint64_t> get_hits{0};
+    std::atomic<uint64_t> deletes{0};
+    std::atomic<uint64_t> range_deletes{0};
+    std::atomic<uint64_t> total_latency_ns{0};
+};
+
+struct ReplayOp {
+    ColumnFamilyHandle* cf;
+    TraceRecord record;
+};
+
+// The records of one replay thread. The reader blocks while it is full, so
+// memory stays bounded however long the trace is.
+class ReplayQueue {
+public:
+    void Push(ReplayOp op) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [this] { return _ops.size() < kCapacity; });
+        _ops.push_back(std::move(op));
+        _unfinished++;
+        _cv.notify_all();
+    }
+
+    // False once closed and drained
+    bool Pop(ReplayOp* op) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [this] { return !_ops.empty() || _closed; });
+        if (_ops.empty()) return false;
+        *op = std::move(_ops.front());
+        _ops.pop_front();
+        _cv.notify_all();
+        return true;
+    }
+
+    // Called once a popped op has been applied
+    void Done() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (--_unfinished == 0) _cv.notify_all();
+    }
+
+    // Until every op pushed so far has been applied
+    void WaitIdle() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [this] { return _unfinished == 0; });
+    }
+
+    void Close() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closed = true;
+        _cv.notify_all();
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::deque<ReplayOp> _ops;
+    size_t _unfinished = 0; // Pushed, not yet applied
+    bool _closed = false;
+
+    static const size_t kCapacity = 1024;
+};
+
+static void Usage() {
+    std::cerr << "Usage: lsm_replay <trace_file> <db_path> [--speed=N] [--threads=N]" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        Usage();
+        return 1;
+    }
+    std::string trace_path = argv[1];
+    std::string db_path = argv[2];
+    double speed = 1.0;
+    int num_threads = 4;
+
+    for (int i = 3; i < argc; ++i) {
+        if (strncmp(argv[i], "--speed=", 8) == 0) {
+            speed = std::stod(argv[i] + 8);
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            num_threads = std::stoi(argv[i] + 10);
+        } else {
+            Usage();
+            return 1;
+        }
+    }
+    if (num_threads < 1 || speed < 0) {
+        Usage();
+        return 1;
+    }
+
+    TraceReader reader(trace_path);
+    if (!reader.ok()) {
+        std::cerr << "Cannot read trace: " << trace_path << std::endl;
+        return 1;
+    }
+
+    if (fs::exists(db_path)) {
+        fs::remove_all(db_path);
+    }
+    DB db(db_path);
+
+    ReplayStats stats;
+    auto start_time = std::chrono::steady_clock::now();
+    auto wait_until_due = [speed, start_time](const TraceRecord& rec) {
+        if (speed > 0) {
+            auto due = start_time + std::chrono::microseconds(
+                static_cast<uint64_t>(rec.timestamp_us / speed));
+            std::this_thread::sleep_until(due);
+        }
+    };
+    uint64_t trace_start_ms = reader.StartTime() / 1000;
+    auto expiry_now = [trace_start_ms](const TraceRecord& rec) -> uint64_t {
+        int64_t left_ms = static_cast<int64_t>(rec.expire_at_ms - trace_start_ms - rec.timestamp_us / 1000);
+        return std::max<int64_t>(static_cast<int64_t>(NowMillis()) + left_ms, 1);
+    };
+
+    std::vector<ReplayQueue> queues(num_threads);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back([&db, &stats, &queues, i, &wait_until_due, &expiry_now]() {
+            std::string value;
+            std::string result;
+            ReplayOp op;
+            while (queues[i].Pop(&op)) {
+                const TraceRecord& rec = op.record;
+                wait_until_due(rec);
+
+                auto op_start = std::chrono::steady_clock::now();
+                switch (rec.op) {
+                case TraceOp::kPut:
+                    value.assign(rec.value_size, 'v');
+                    db.Put(op.cf, rec.key, value);
+                    stats.puts++;
+                    break;
+                case TraceOp::kPutWithExpiry:
+                    value.assign(rec.value_size, 'v');
+                    db.PutWithExpiry(op.cf, rec.key, value, rec.expire_at_ms ? expiry_now(rec) : 0);
+                    stats.puts++;
+                    break;
+                case TraceOp::kGet:
+                    if (db.Get(op.cf, rec.key, &result)) stats.get_hits++;
+                    stats.gets++;
+                    break;
+                case TraceOp::kDelete:
+                    db.Delete(op.cf, rec.key);
+                    stats.deletes++;
+                    break;
+                case TraceOp::kDeleteRange:
+                case TraceOp::kColumnFamily:
+                    break; // Applied by the reader
+                }
+                auto op_end = std::chrono::steady_clock::now();
+                stats.total_latency_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(op_end - op_start).count();
+                queues[i].Done();
+            }
+        });
+    }
+
+    std::unordered_map<uint32_t, ColumnFamilyHandle*> families = {{0, db.DefaultColumnFamily()}};
+    TraceRecord record;
+    uint64_t num_records = 0;
+    bool failed = false;
+    while (reader.Next(&record)) {
+        if (record.op == TraceOp::kColumnFamily) {
+            families[record.cf_id] = db.CreateColumnFamily(record.key);
+            continue;
+        }
+        auto family = families.find(record.cf_id);
+        if (family == families.end()) {
+            std::cerr << "Trace names no column family " << record.cf_id << std::endl;
+            failed = true;
+            break;
+        }
+        num_records++;
+
+        if (record.op == TraceOp::kDeleteRange) {
+            for (auto& queue : queues) queue.WaitIdle();
+            wait_until_due(record);
+            auto op_start = std::chrono::steady_clock::now();
+            db.DeleteRange(family->second, record.key, record.end_key);
+            stats.range_deletes++;
+            auto op_end = std::chrono::steady_clock::now();
+            stats.total_latency_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(op_end - op_start).count();
+            continue;
+        }
+        size_t shard = std::hash<std::string>()(record.key) % num_threads;
+        queues[shard].Push({family->second, record});
+    }
+
+    for (auto& queue : queues) queue.Close();
+    for (auto& t : threads) t.join();
+    if (failed) return 1;
+
+    auto end_time = std::chrono::steady_clock::now();
+    double duration_sec = std::chrono::duration_cast<std::chrono::duration<double>>(end_time - start_time).count();
+    double avg_latency_us = num_records ? (double)stats.total_latency_ns / num_records / 1000.0 : 0;
+
+    std::cout << "------------------------------------------------" << std::endl;
+    std::cout << "Replay of " << trace_path << " (Threads: " << num_threads << ", Speed: ";
+    if (speed > 0) std::cout << speed << "x)"; else std::cout << "max)";
+    std::cout << std::endl;
+    std::cout << "  Puts:         " << stats.puts << std::endl;
+    std::cout << "  Gets:         " << stats.gets << " (" << stats.get_hits << " hits)" << std::endl;
+    std::cout << "  Deletes:      " << stats.deletes << std::endl;
+    std::cout << "  Range Deletes: " << stats.range_deletes << std::endl;
+    std::cout << "  Duration:     " << std::fixed << std::setprecision(2) << duration_sec << " s" << std::endl;
+    std::cout << "  Throughput:   " << std::fixed << std::setprecision(2) << num_records / duration_sec << " ops/sec" << std::endl;
+    std::cout << "  Avg Latency:  " << std::fixed << std::setprecision(2) << avg_latency_us << " us" << std::endl;
+    std::cout << "------------------------------------------------" << std::endl;
+    return 0;
+}
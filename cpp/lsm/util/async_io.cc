@@ -0,0 +1,326 @@
+#include "async_io.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <condition_variable>
+#include <iostream>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "env.h"
+#include "thread_pool.h"
+
+namespace lsm {
+
+void ReadFully(ReadRequest* req) {
+    req->data.resize(req->len);
+    while (req->filled < req->len) {
+        ssize_t n = req->fd >= 0 ? pread(req->fd, &req->data[req->filled], req->len - req->filled,
+                                         static_cast<off_t>(req->offset + req->filled))
+                                 : req->file->Read(req->offset + req->filled, req->len - req->filled,
+                                                   &req->data[req->filled]);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            req->error = errno;
+            break;
+        }
+        if (n == 0) break; // End of file
+        req->filled += static_cast<size_t>(n);
+    }
+    req->data.resize(req->filled);
+}
+
+void AsyncIO::Read(const std::vector<ReadRequest*>& reqs) {
+    Submit(reqs);
+    for (ReadRequest* req : reqs) {
+        Wait(req);
+    }
+}
+
+namespace {
+
+class ThreadPoolIO : public AsyncIO {
+public:
+    explicit ThreadPoolIO(int num_threads) : _pool(num_threads) {}
+
+    void Submit(const std::vector<ReadRequest*>& reqs) override {
+        for (ReadRequest* req : reqs) {
+            req->done = false;
+            req->filled = 0;
+            req->error = 0;
+            _pool.Schedule([this, req]() {
+                ReadFully(req);
+                std::lock_guard<std::mutex> lock(_mutex);
+                req->done = true;
+                _cv.notify_all();
+            });
+        }
+    }
+
+    void Wait(ReadRequest* req) override {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [req] { return req->done; });
+    }
+
+    const char* Name() const override { return "pread thread pool"; }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    ThreadPool _pool; // Last: its destructor runs the queued reads, which use the above
+};
+
+// io_uring through the raw system calls, so there is no liburing dependency.
+// Submissions go through the SQ ring under _mutex. Completions are reaped by
+// one waiting thread at a time, which wakes the others through _cv.
+class IoUringIO : public AsyncIO {
+public:
+    ~IoUringIO() override {
+        if (_sqes) munmap(_sqes, _sqes_size);
+        if (_cq_ptr && _cq_ptr != _sq_ptr) munmap(_cq_ptr, _cq_size);
+        if (_sq_ptr) munmap(_sq_ptr, _sq_size);
+        if (_ring_fd >= 0) close(_ring_fd);
+    }
+
+    bool Init(unsigned queue_depth) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        _ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, queue_depth, &params));
+        if (_ring_fd < 0) return false;
+
+        _sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        _cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) _sq_size = _cq_size = std::max(_sq_size, _cq_size);
+
+        _sq_ptr = mmap(nullptr, _sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       _ring_fd, IORING_OFF_SQ_RING);
+        if (_sq_ptr == MAP_FAILED) {
+            _sq_ptr = nullptr;
+            return false;
+        }
+        if (single_mmap) {
+            _cq_ptr = _sq_ptr;
+        } else {
+            _cq_ptr = mmap(nullptr, _cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           _ring_fd, IORING_OFF_CQ_RING);
+            if (_cq_ptr == MAP_FAILED) {
+                _cq_ptr = nullptr;
+                return false;
+            }
+        }
+        _sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          _ring_fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) return false;
+        _sqes = static_cast<io_uring_sqe*>(sqes);
+
+        char* sq = static_cast<char*>(_sq_ptr);
+        _sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        _sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        _sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        _sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        _sq_entries = params.sq_entries;
+        char* cq = static_cast<char*>(_cq_ptr);
+        _cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        _cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        _cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        _cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        _cq_entries = params.cq_entries;
+        return true;
+    }
+
+    void Submit(const std::vector<ReadRequest*>& reqs) override {
+        std::unique_lock<std::mutex> lock(_mutex);
+        unsigned pending = 0;
+        for (ReadRequest* req : reqs) {
+            req->done = false;
+            req->filled = 0;
+            req->error = 0;
+            req->data.resize(req->len);
+            if (req->len == 0) {
+                req->done = true;
+                continue;
+            }
+            if (req->fd < 0) {
+                // No descriptor to hand to the kernel: read it here
+                ReadFully(req);
+                req->done = true;
+                continue;
+            }
+            // Never more in flight than the completion ring holds
+            while (_in_flight >= _cq_entries) {
+                SubmitPending(&pending);
+                WaitForCompletions(lock);
+            }
+            unsigned tail = *_sq_tail;
+            if (tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) == _sq_entries) {
+                SubmitPending(&pending);
+                tail = *_sq_tail;
+            }
+            unsigned index = tail & _sq_mask;
+            io_uring_sqe* sqe = &_sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = req->fd;
+            sqe->off = req->offset;
+            sqe->addr = reinterpret_cast<uint64_t>(&req->data[0]);
+            sqe->len = static_cast<uint32_t>(req->len);
+            sqe->user_data = reinterpret_cast<uint64_t>(req);
+            _sq_array[index] = index;
+            __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+            _in_flight++;
+            pending++;
+        }
+        SubmitPending(&pending);
+    }
+
+    void Wait(ReadRequest* req) override {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (!req->done) {
+            WaitForCompletions(lock);
+        }
+    }
+
+    const char* Name() const override { return "io_uring"; }
+
+private:
+    int _ring_fd = -1;
+    void* _sq_ptr = nullptr;
+    void* _cq_ptr = nullptr;
+    size_t _sq_size = 0;
+    size_t _cq_size = 0;
+    size_t _sqes_size = 0;
+    io_uring_sqe* _sqes = nullptr;
+    unsigned* _sq_head = nullptr;
+    unsigned* _sq_tail = nullptr;
+    unsigned* _sq_array = nullptr;
+    unsigned _sq_mask = 0;
+    unsigned _sq_entries = 0;
+    unsigned* _cq_head = nullptr;
+    unsigned* _cq_tail = nullptr;
+    io_uring_cqe* _cqes = nullptr;
+    unsigned _cq_mask = 0;
+    unsigned _cq_entries = 0;
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    unsigned _in_flight = 0; // Submitted and not yet reaped
+    bool _reaping = false;   // A thread is blocked in io_uring_enter for completions
+
+    // REQUIRES: _mutex held
+    void SubmitPending(unsigned* pending) {
+        while (*pending > 0) {
+            long ret = syscall(__NR_io_uring_enter, _ring_fd, *pending, 0, 0, nullptr, 0);
+            if (ret < 0) {
+                if (errno == EINTR) continue;
+                // Out of kernel resources: complete with pread when reaped
+                std::cerr << "io_uring submit failed: " << strerror(errno) << std::endl;
+                FailUnsubmitted();
+                *pending = 0;
+                return;
+            }
+            *pending -= static_cast<unsigned>(ret);
+        }
+    }
+
+    // Takes back the entries the kernel did not accept and reads them
+    // synchronously. REQUIRES: _mutex held
+    void FailUnsubmitted() {
+        unsigned head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+        unsigned tail = *_sq_tail;
+        for (unsigned i = head; i != tail; ++i) {
+            auto* req = reinterpret_cast<ReadRequest*>(_sqes[_sq_array[i & _sq_mask]].user_data);
+            ReadFully(req);
+            req->done = true;
+            _in_flight--;
+        }
+        __atomic_store_n(_sq_tail, head, __ATOMIC_RELEASE);
+        _cv.notify_all();
+    }
+
+    // Reaps at least one completion, or waits for the thread doing so.
+    // REQUIRES: lock holds _mutex
+    void WaitForCompletions(std::unique_lock<std::mutex>& lock) {
+        if (_reaping) {
+            _cv.wait(lock);
+            return;
+        }
+        if (!HasCompletions()) {
+            if (_in_flight == 0) {
+                // Being finished with pread by the previous reaper
+                _cv.wait(lock);
+                return;
+            }
+            _reaping = true;
+            lock.unlock();
+            long ret = syscall(__NR_io_uring_enter, _ring_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            int err = errno;
+            lock.lock();
+            _reaping = false;
+            if (ret < 0 && err != EINTR && err != EAGAIN && err != EBUSY) {
+                std::cerr << "io_uring wait failed: " << strerror(err) << std::endl;
+            }
+        }
+
+        // Reads that came back short or failed are finished with pread,
+        // outside the lock
+        std::vector<ReadRequest*> incomplete;
+        unsigned head = *_cq_head;
+        unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = _cqes[head & _cq_mask];
+            auto* req = reinterpret_cast<ReadRequest*>(cqe.user_data);
+            _in_flight--;
+            if (cqe.res == 0) {
+                req->data.resize(0); // End of file
+                req->done = true;
+            } else if (cqe.res > 0 && static_cast<size_t>(cqe.res) == req->len) {
+                req->filled = req->len;
+                req->done = true;
+            } else {
+                if (cqe.res > 0) req->filled = static_cast<size_t>(cqe.res);
+                incomplete.push_back(req);
+            }
+        }
+        __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+        if (!incomplete.empty()) {
+            lock.unlock();
+            for (ReadRequest* req : incomplete) ReadFully(req);
+            lock.lock();
+            for (ReadRequest* req : incomplete) req->done = true;
+        }
+        _cv.notify_all();
+    }
+
+    bool HasCompletions() const {
+        return *_cq_head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+    }
+};
+
+} // namespace
+
+std::unique_ptr<AsyncIO> AsyncIO::NewIoUring(unsigned queue_depth) {
+    auto io = std::make_unique<IoUringIO>();
+    if (!io->Init(queue_depth)) return nullptr;
+    return io;
+}
+
+std::unique_ptr<AsyncIO> AsyncIO::NewThreadPool(int num_threads) {
+    return std::make_unique<ThreadPoolIO>(num_threads);
+}
+
+AsyncIO* AsyncIO::Default() {
+    // Never destroyed: iterators of DBs that outlive static destruction may still use it
+    static AsyncIO* io = []() -> AsyncIO* {
+        std::unique_ptr<AsyncIO> engine = NewIoUring(256);
+        if (!engine) engine = NewThreadPool(8);
+        std::cout << "[C++] Async reads use " << engine->Name() << std::endl;
+        return engine.release();
+    }();
+    return io;
+}
+
+} // namespace lsm
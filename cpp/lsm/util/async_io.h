@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace lsm {
+
+class RandomAccessFile;
+
+// One positioned read of len bytes at offset of fd, or of file if fd is -1
+// (a file of an Env that has no descriptor, read synchronously)
+struct ReadRequest {
+    int fd = -1;
+    const RandomAccessFile* file = nullptr;
+    uint64_t offset = 0;
+    size_t len = 0;
+
+    // Results, valid after Wait: the bytes read (fewer at end of file), or
+    // the errno of a failed read
+    std::string data;
+    int error = 0;
+
+    // Engine state between Submit and Wait
+    bool done = false;
+    size_t filled = 0;
+};
+
+// Asynchronous positioned reads, so that a caller can have many reads in
+// flight at once: a batch of lookups submits all of them together, and an
+// iterator reads ahead while it works through the current buffer.
+//
+// Default() uses io_uring when the kernel allows it, and otherwise a small
+// pool of threads issuing pread. Thread-safe.
+class AsyncIO {
+public:
+    // Shared by every DB of the process, created on first use
+    static AsyncIO* Default();
+    // nullptr if io_uring is not available (old kernel, seccomp, ...)
+    static std::unique_ptr<AsyncIO> NewIoUring(unsigned queue_depth);
+    static std::unique_ptr<AsyncIO> NewThreadPool(int num_threads);
+
+    virtual ~AsyncIO() = default;
+
+    // Starts the reads and returns. Every submitted request must be passed
+    // to Wait before it is destroyed or reused.
+    virtual void Submit(const std::vector<ReadRequest*>& reqs) = 0;
+    // Blocks until req has completed
+    virtual void Wait(ReadRequest* req) = 0;
+    // Submits reqs and waits for all of them
+    void Read(const std::vector<ReadRequest*>& reqs);
+
+    virtual const char* Name() const = 0;
+};
+
+// Blocking pread (or RandomAccessFile::Read) of req->len bytes into
+// req->data from req->filled on, retrying short reads until end of file
+void ReadFully(ReadRequest* req);
+
+} // namespace lsm
@@ -0,0 +1,78 @@
+#include "bloom.h"
+#include <algorithm>
+#include "hash.h"
+
+namespace lsm {
+
+namespace {
+
+uint32_t BloomHash(const std::string& key) {
+    return Hash(key, 0x9e3779b9);
+}
+
+} // namespace
+
+std::string BuildBloomFilter(const std::vector<std::string>& keys, int bits_per_key) {
+    // k = ln 2 * bits_per_key minimizes the false positive rate
+    int num_probes = std::clamp(static_cast<int>(bits_per_key * 0.69), 1, 30);
+    // Small filters would see a high false positive rate
+    size_t bits = std::max<size_t>(keys.size() * std::max(bits_per_key, 1), 64);
+    size_t bytes = (bits + 7) / 8;
+    bits = bytes * 8;
+
+    std::string filter(bytes, '\0');
+    filter.push_back(static_cast<char>(num_probes));
+    for (const auto& key : keys) {
+        uint32_t h = BloomHash(key);
+        const uint32_t delta = (h >> 17) | (h << 15);
+        for (int i = 0; i < num_probes; ++i) {
+            uint32_t bit = h % bits;
+            filter[bit / 8] |= static_cast<char>(1 << (bit % 8));
+            h += delta;
+        }
+    }
+    return filter;
+}
+
+bool BloomFilterMayMatch(const std::string& filter, const std::string& key) {
+    if (filter.size() < 2) return true;
+    size_t bits = (filter.size() - 1) * 8;
+    int num_probes = static_cast<uint8_t>(filter.back());
+    if (num_probes < 1 || num_probes > 30) return true;
+
+    uint32_t h = BloomHash(key);
+    const uint32_t delta = (h >> 17) | (h << 15);
+    for (int i = 0; i < num_probes; ++i) {
+        uint32_t bit = h % bits;
+        if ((filter[bit / 8] & (1 << (bit % 8))) == 0) return false;
+        h += delta;
+    }
+    return true;
+}
+
+DynamicBloom::DynamicBloom(size_t num_bits, int num_probes)
+    : _words((std::max<size_t>(num_bits, 64) + 63) / 64, 0),
+      _num_bits(static_cast<uint32_t>(_words.size() * 64)), _num_probes(num_probes) {}
+
+void DynamicBloom::Add(const std::string& key) {
+    uint32_t h = BloomHash(key);
+    const uint32_t delta = (h >> 17) | (h << 15);
+    for (int i = 0; i < _num_probes; ++i) {
+        uint32_t bit = h % _num_bits;
+        _words[bit / 64] |= uint64_t(1) << (bit % 64);
+        h += delta;
+    }
+}
+
+bool DynamicBloom::MayContain(const std::string& key) const {
+    uint32_t h = BloomHash(key);
+    const uint32_t delta = (h >> 17) | (h << 15);
+    for (int i = 0; i < _num_probes; ++i) {
+        uint32_t bit = h % _num_bits;
+        if ((_words[bit / 64] & (uint64_t(1) << (bit % 64))) == 0) return false;
+        h += delta;
+    }
+    return true;
+}
+
+} // namespace lsm
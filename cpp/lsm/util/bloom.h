@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace lsm {
+
+// Bloom filters: "may contain" answers with no false negatives. Probes are
+// derived from a single Hash by double hashing, as in LevelDB.
+
+// Builds an immutable filter over keys with about bits_per_key bits per key
+// (10 gives ~1% false positives). The probe count is stored in the last byte,
+// so readers need no parameters.
+std::string BuildBloomFilter(const std::vector<std::string>& keys, int bits_per_key);
+// True if key may be in the filter. Malformed filters match everything.
+bool BloomFilterMayMatch(const std::string& filter, const std::string& key);
+
+// A fixed-size filter that grows one key at a time, for memtables. Not
+// thread-safe; the owner serializes Add against MayContain.
+class DynamicBloom {
+public:
+    explicit DynamicBloom(size_t num_bits, int num_probes = 6);
+
+    void Add(const std::string& key);
+    bool MayContain(const std::string& key) const;
+
+private:
+    std::vector<uint64_t> _words;
+    uint32_t _num_bits;
+    int _num_probes;
+};
+
+} // namespace lsm
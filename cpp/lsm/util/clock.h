@@ -0,0 +1,17 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+namespace lsm {
+
+// Wall-clock time since the Unix epoch
+inline uint64_t NowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+inline uint64_t NowMillis() {
+    return NowMicros() / 1000;
+}
+
+} // namespace lsm
@@ -0,0 +1,103 @@
+#include "compression.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace lsm {
+
+// Format: uncompressed size(4), then operations, each starting with a tag:
+//   0lllllll: a run of l + 1 literal bytes follows
+//   1lllllll offset(2): copy l + kMinMatch bytes from offset bytes back
+namespace {
+
+constexpr int kHashBits = 12;
+constexpr size_t kMinMatch = 4;
+constexpr size_t kMaxMatch = kMinMatch + 127;
+constexpr size_t kMaxLiteralRun = 128;
+constexpr size_t kMaxOffset = 65535;
+constexpr uint32_t kNoPosition = UINT32_MAX;
+
+uint32_t Load32(const char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t HashOf(uint32_t v) {
+    return (v * 2654435761u) >> (32 - kHashBits);
+}
+
+} // namespace
+
+void LZCompress(const char* data, size_t n, std::string* out) {
+    out->clear();
+    uint32_t size = static_cast<uint32_t>(n);
+    out->append(reinterpret_cast<const char*>(&size), sizeof(size));
+
+    std::vector<uint32_t> table(1 << kHashBits, kNoPosition);
+    size_t literal_start = 0;
+    auto flush_literals = [&](size_t end) {
+        while (literal_start < end) {
+            size_t len = std::min(end - literal_start, kMaxLiteralRun);
+            out->push_back(static_cast<char>(len - 1));
+            out->append(data + literal_start, len);
+            literal_start += len;
+        }
+    };
+
+    size_t pos = 0;
+    while (pos + kMinMatch <= n) {
+        uint32_t* slot = &table[HashOf(Load32(data + pos))];
+        size_t candidate = *slot;
+        *slot = static_cast<uint32_t>(pos);
+        if (candidate == kNoPosition || pos - candidate > kMaxOffset ||
+            Load32(data + candidate) != Load32(data + pos)) {
+            pos++;
+            continue;
+        }
+        // The match may run into the bytes it produces, e.g. for a run of one byte
+        size_t len = kMinMatch;
+        while (pos + len < n && len < kMaxMatch && data[candidate + len] == data[pos + len]) len++;
+        flush_literals(pos);
+        size_t offset = pos - candidate;
+        out->push_back(static_cast<char>(0x80 | (len - kMinMatch)));
+        out->push_back(static_cast<char>(offset & 0xff));
+        out->push_back(static_cast<char>(offset >> 8));
+        pos += len;
+        literal_start = pos;
+    }
+    flush_literals(n);
+}
+
+bool LZUncompress(const char* data, size_t n, std::string* out) {
+    out->clear();
+    uint32_t size;
+    if (n < sizeof(size)) return false;
+    memcpy(&size, data, sizeof(size));
+    const char* p = data + sizeof(size);
+    const char* end = data + n;
+    // Bounded by what the input can expand to, should size be corrupt
+    out->reserve(std::min<size_t>(size, n * kMaxMatch));
+    while (p < end) {
+        uint8_t tag = static_cast<uint8_t>(*p++);
+        if (!(tag & 0x80)) {
+            size_t len = tag + 1;
+            if (static_cast<size_t>(end - p) < len) return false;
+            out->append(p, len);
+            p += len;
+        } else {
+            size_t len = (tag & 0x7f) + kMinMatch;
+            if (end - p < 2) return false;
+            size_t offset = static_cast<uint8_t>(p[0]) | (static_cast<size_t>(static_cast<uint8_t>(p[1])) << 8);
+            p += 2;
+            if (offset == 0 || offset > out->size()) return false;
+            size_t from = out->size() - offset;
+            for (size_t i = 0; i < len; ++i) out->push_back((*out)[from + i]);
+        }
+        if (out->size() > size) return false;
+    }
+    return out->size() == size;
+}
+
+} // namespace lsm
@@ -0,0 +1,18 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+namespace lsm {
+
+// A small LZ77 codec for in-memory data: greedy matches found through a
+// hash table of 4-byte sequences, within the last 64 KB. Far from the ratio
+// of a real compressor, but fast, dependency-free, and good at the repeated
+// fields and runs that values tend to have.
+
+// Replaces *out with the compressed form of data[0, n)
+void LZCompress(const char* data, size_t n, std::string* out);
+// Replaces *out with the data LZCompress produced data[0, n) from. Returns
+// false if the input is malformed.
+bool LZUncompress(const char* data, size_t n, std::string* out);
+
+} // namespace lsm
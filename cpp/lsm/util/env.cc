@@ -0,0 +1,554 @@
+#include "env.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace lsm {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const size_t kStreamBufferSize = 64 * 1024;
+
+// ---------------------------------------------------------------------------
+// The local file system
+
+class PosixWritableFile : public WritableFile {
+public:
+    explicit PosixWritableFile(int fd) : _fd(fd) {}
+    ~PosixWritableFile() override { Close(); }
+
+    bool Append(const char* data, size_t n) override {
+        while (n > 0) {
+            ssize_t written = ::write(_fd, data, n);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data += written;
+            n -= written;
+        }
+        return true;
+    }
+
+    bool Sync() override { return ::fsync(_fd) == 0; }
+
+    bool Close() override {
+        if (_fd < 0) return true;
+        bool ok = ::close(_fd) == 0;
+        _fd = -1;
+        return ok;
+    }
+
+private:
+    int _fd;
+};
+
+class PosixRandomAccessFile : public RandomAccessFile {
+public:
+    explicit PosixRandomAccessFile(int fd) : _fd(fd) {}
+    ~PosixRandomAccessFile() override { ::close(_fd); }
+
+    ssize_t Read(uint64_t offset, size_t n, char* buf) const override {
+        ssize_t r;
+        do {
+            r = ::pread(_fd, buf, n, static_cast<off_t>(offset));
+        } while (r < 0 && errno == EINTR);
+        return r;
+    }
+
+    uint64_t Size() const override {
+        struct stat st;
+        return ::fstat(_fd, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+    }
+
+    int fd() const override { return _fd; }
+
+private:
+    int _fd;
+};
+
+class PosixEnv : public Env {
+public:
+    std::unique_ptr<WritableFile> NewWritableFile(const std::string& path, bool append) override {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+        int fd = ::open(path.c_str(), flags, 0644);
+        if (fd < 0) return nullptr;
+        return std::make_unique<PosixWritableFile>(fd);
+    }
+
+    std::unique_ptr<RandomAccessFile> NewRandomAccessFile(const std::string& path) override {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return nullptr;
+        return std::make_unique<PosixRandomAccessFile>(fd);
+    }
+
+    bool FileExists(const std::string& path) override {
+        std::error_code ec;
+        return fs::exists(path, ec);
+    }
+
+    bool IsDirectory(const std::string& path) override {
+        std::error_code ec;
+        return fs::is_directory(path, ec);
+    }
+
+    bool GetFileSize(const std::string& path, uint64_t* size) override {
+        std::error_code ec;
+        uint64_t s = fs::file_size(path, ec);
+        if (ec) return false;
+        *size = s;
+        return true;
+    }
+
+    bool GetChildren(const std::string& dir, std::vector<std::string>* names) override {
+        names->clear();
+        std::error_code ec;
+        for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+            names->push_back(it->path().filename().string());
+        }
+        return !ec;
+    }
+
+    bool CreateDirs(const std::string& dir) override {
+        std::error_code ec;
+        fs::create_directories(dir, ec);
+        return !ec;
+    }
+
+    bool RemoveFile(const std::string& path) override {
+        std::error_code ec;
+        return fs::remove(path, ec) && !ec;
+    }
+
+    bool RemoveAll(const std::string& path) override {
+        std::error_code ec;
+        fs::remove_all(path, ec);
+        return !ec;
+    }
+
+    bool RenameFile(const std::string& from, const std::string& to) override {
+        std::error_code ec;
+        fs::rename(from, to, ec);
+        return !ec;
+    }
+
+    bool LinkFile(const std::string& from, const std::string& to) override {
+        std::error_code ec;
+        fs::create_hard_link(from, to, ec);
+        return !ec;
+    }
+
+    bool TruncateFile(const std::string& path, uint64_t size) override {
+        return ::truncate(path.c_str(), static_cast<off_t>(size)) == 0;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// In memory
+
+// Shared by the links to it and the files open on it, which keep it alive
+// after it is removed, like an inode
+struct MemFile {
+    mutable std::shared_mutex mutex;
+    std::string data;
+};
+
+class MemWritableFile : public WritableFile {
+public:
+    explicit MemWritableFile(std::shared_ptr<MemFile> file) : _file(std::move(file)) {}
+
+    bool Append(const char* data, size_t n) override {
+        std::unique_lock<std::shared_mutex> lock(_file->mutex);
+        _file->data.append(data, n);
+        return true;
+    }
+    bool Sync() override { return true; }
+    bool Close() override { return true; }
+
+private:
+    std::shared_ptr<MemFile> _file;
+};
+
+class MemRandomAccessFile : public RandomAccessFile {
+public:
+    explicit MemRandomAccessFile(std::shared_ptr<MemFile> file) : _file(std::move(file)) {}
+
+    ssize_t Read(uint64_t offset, size_t n, char* buf) const override {
+        std::shared_lock<std::shared_mutex> lock(_file->mutex);
+        if (offset >= _file->data.size()) return 0;
+        n = std::min<uint64_t>(n, _file->data.size() - offset);
+        memcpy(buf, _file->data.data() + offset, n);
+        return static_cast<ssize_t>(n);
+    }
+
+    uint64_t Size() const override {
+        std::shared_lock<std::shared_mutex> lock(_file->mutex);
+        return _file->data.size();
+    }
+
+private:
+    std::shared_ptr<MemFile> _file;
+};
+
+// Paths are normalized lexically ("a//b/./c/" is "a/b/c"), so the same file
+// is found however its path was put together. "" (the working directory)
+// and "/" always exist.
+class MemEnv : public Env {
+public:
+    std::unique_ptr<WritableFile> NewWritableFile(const std::string& path, bool append) override {
+        std::string p = Normalize(path);
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_dirs.count(p) || !DirExists(Parent(p))) {
+            errno = ENOENT;
+            return nullptr;
+        }
+        auto& file = _files[p];
+        if (!file) {
+            file = std::make_shared<MemFile>();
+        } else if (!append) {
+            std::unique_lock<std::shared_mutex> file_lock(file->mutex);
+            file->data.clear();
+        }
+        return std::make_unique<MemWritableFile>(file);
+    }
+
+    std::unique_ptr<RandomAccessFile> NewRandomAccessFile(const std::string& path) override {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _files.find(Normalize(path));
+        if (it == _files.end()) {
+            errno = ENOENT;
+            return nullptr;
+        }
+        return std::make_unique<MemRandomAccessFile>(it->second);
+    }
+
+    bool FileExists(const std::string& path) override {
+        std::string p = Normalize(path);
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _files.count(p) || DirExists(p);
+    }
+
+    bool IsDirectory(const std::string& path) override {
+        std::string p = Normalize(path);
+        std::lock_guard<std::mutex> lock(_mutex);
+        return DirExists(p);
+    }
+
+    bool GetFileSize(const std::string& path, uint64_t* size) override {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _files.find(Normalize(path));
+        if (it == _files.end()) return false;
+        std::shared_lock<std::shared_mutex> file_lock(it->second->mutex);
+        *size = it->second->data.size();
+        return true;
+    }
+
+    bool GetChildren(const std::string& dir, std::vector<std::string>* names) override {
+        names->clear();
+        std::string d = Normalize(dir);
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!DirExists(d)) return false;
+        std::string prefix = Prefix(d);
+        auto add_children = [&](auto begin, auto end) {
+            for (auto it = begin; it != end; ++it) {
+                const std::string& p = Key(*it);
+                if (p.compare(0, prefix.size(), prefix) != 0) break;
+                if (p.size() > prefix.size() && p.find('/', prefix.size()) == std::string::npos) {
+                    names->push_back(p.substr(prefix.size()));
+                }
+            }
+        };
+        add_children(_files.lower_bound(prefix), _files.end());
+        add_children(_dirs.lower_bound(prefix), _dirs.end());
+        return true;
+    }
+
+    bool CreateDirs(const std::string& dir) override {
+        std::string d = Normalize(dir);
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<std::string> missing;
+        for (std::string p = d; !DirExists(p); p = Parent(p)) {
+            if (_files.count(p)) return false;
+            missing.push_back(p);
+        }
+        _dirs.insert(missing.begin(), missing.end());
+        return true;
+    }
+
+    bool RemoveFile(const std::string& path) override {
+        std::string p = Normalize(path);
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_files.erase(p)) return true;
+        // Like remove(3), an empty directory too
+        if (!_dirs.count(p) || HasChildren(p)) return false;
+        _dirs.erase(p);
+        return true;
+    }
+
+    bool RemoveAll(const std::string& path) override {
+        std::string p = Normalize(path);
+        std::lock_guard<std::mutex> lock(_mutex);
+        _files.erase(p);
+        if (_dirs.erase(p)) {
+            std::string prefix = Prefix(p);
+            EraseWithPrefix(&_files, prefix);
+            EraseWithPrefix(&_dirs, prefix);
+        }
+        return true;
+    }
+
+    bool RenameFile(const std::string& from, const std::string& to) override {
+        std::string f = Normalize(from);
+        std::string t = Normalize(to);
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (f == t) return FileOrDirExists(f);
+        if (!DirExists(Parent(t)) || _dirs.count(t)) return false;
+        auto it = _files.find(f);
+        if (it != _files.end()) {
+            auto file = it->second;
+            _files.erase(it);
+            _files[t] = std::move(file);
+            return true;
+        }
+        // A directory, moved with everything below it, to a new name
+        if (!_dirs.count(f) || _files.count(t) || t.compare(0, f.size() + 1, Prefix(f)) == 0) return false;
+        std::string from_prefix = Prefix(f);
+        std::string to_prefix = Prefix(t);
+        std::map<std::string, std::shared_ptr<MemFile>> files;
+        for (auto i = _files.lower_bound(from_prefix);
+             i != _files.end() && i->first.compare(0, from_prefix.size(), from_prefix) == 0;) {
+            files[to_prefix + i->first.substr(from_prefix.size())] = std::move(i->second);
+            i = _files.erase(i);
+        }
+        std::set<std::string> dirs;
+        for (auto i = _dirs.lower_bound(from_prefix);
+             i != _dirs.end() && i->compare(0, from_prefix.size(), from_prefix) == 0;) {
+            dirs.insert(to_prefix + i->substr(from_prefix.size()));
+            i = _dirs.erase(i);
+        }
+        _dirs.erase(f);
+        _dirs.insert(t);
+        _files.insert(files.begin(), files.end());
+        _dirs.insert(dirs.begin(), dirs.end());
+        return true;
+    }
+
+    bool LinkFile(const std::string& from, const std::string& to) override {
+        std::string f = Normalize(from);
+        std::string t = Normalize(to);
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _files.find(f);
+        if (it == _files.end() || FileOrDirExists(t) || !DirExists(Parent(t))) return false;
+        _files[t] = it->second;
+        return true;
+    }
+
+    bool TruncateFile(const std::string& path, uint64_t size) override {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _files.find(Normalize(path));
+        if (it == _files.end()) return false;
+        std::unique_lock<std::shared_mutex> file_lock(it->second->mutex);
+        it->second->data.resize(size);
+        return true;
+    }
+
+private:
+    static std::string Normalize(const std::string& path) {
+        std::string p = fs::path(path).lexically_normal().string();
+        while (p.size() > 1 && p.back() == '/') p.pop_back();
+        return p == "." ? "" : p;
+    }
+    static std::string Parent(const std::string& p) {
+        size_t slash = p.rfind('/');
+        if (slash == std::string::npos) return "";
+        return slash == 0 ? "/" : p.substr(0, slash);
+    }
+    // What the paths of the entries of dir start with
+    static std::string Prefix(const std::string& dir) {
+        if (dir.empty()) return "";
+        return dir == "/" ? dir : dir + "/";
+    }
+    static const std::string& Key(const std::pair<const std::string, std::shared_ptr<MemFile>>& entry) {
+        return entry.first;
+    }
+    static const std::string& Key(const std::string& entry) { return entry; }
+
+    template <typename Container>
+    static void EraseWithPrefix(Container* c, const std::string& prefix) {
+        auto it = c->lower_bound(prefix);
+        while (it != c->end() && Key(*it).compare(0, prefix.size(), prefix) == 0) {
+            it = c->erase(it);
+        }
+    }
+
+    // Callers hold _mutex
+    bool DirExists(const std::string& p) const { return p.empty() || p == "/" || _dirs.count(p) > 0; }
+    bool FileOrDirExists(const std::string& p) const { return _files.count(p) > 0 || DirExists(p); }
+    bool HasChildren(const std::string& dir) const {
+        std::string prefix = Prefix(dir);
+        auto f = _files.lower_bound(prefix);
+        auto d = _dirs.lower_bound(prefix);
+        return (f != _files.end() && f->first.compare(0, prefix.size(), prefix) == 0) ||
+               (d != _dirs.end() && d->compare(0, prefix.size(), prefix) == 0);
+    }
+
+    std::mutex _mutex;
+    // Ordered, so the entries of a directory are adjacent
+    std::map<std::string, std::shared_ptr<MemFile>> _files;
+    std::set<std::string> _dirs;
+};
+
+} // namespace
+
+Env* Env::Default() {
+    static Env* env = new PosixEnv();
+    return env;
+}
+
+std::shared_ptr<Env> NewMemEnv() {
+    return std::make_shared<MemEnv>();
+}
+
+bool CopyFile(Env* from_env, const std::string& from, Env* to_env, const std::string& to) {
+    auto in = from_env->NewRandomAccessFile(from);
+    if (!in) return false;
+    auto out = to_env->NewWritableFile(to);
+    if (!out) return false;
+    std::vector<char> buf(kStreamBufferSize);
+    uint64_t offset = 0;
+    while (true) {
+        ssize_t n = in->Read(offset, buf.size(), buf.data());
+        if (n < 0) return false;
+        if (n == 0) break;
+        if (!out->Append(buf.data(), n)) return false;
+        offset += n;
+    }
+    return out->Close();
+}
+
+// ---------------------------------------------------------------------------
+// Streams
+
+void InputFileStream::Buffer::Reset(const RandomAccessFile* f) {
+    file = f;
+    _offset = 0;
+    setg(_data.data(), _data.data(), _data.data());
+}
+
+InputFileStream::Buffer::int_type InputFileStream::Buffer::underflow() {
+    if (!file) return traits_type::eof();
+    if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+    _offset += egptr() - eback();
+    _data.resize(kStreamBufferSize);
+    ssize_t n = file->Read(_offset, _data.size(), _data.data());
+    if (n <= 0) {
+        setg(_data.data(), _data.data(), _data.data());
+        return traits_type::eof();
+    }
+    setg(_data.data(), _data.data(), _data.data() + n);
+    return traits_type::to_int_type(*gptr());
+}
+
+InputFileStream::Buffer::pos_type InputFileStream::Buffer::seekoff(off_type off, std::ios_base::seekdir dir,
+                                                                   std::ios_base::openmode which) {
+    if (!file || !(which & std::ios_base::in)) return pos_type(off_type(-1));
+    off_type base = 0;
+    if (dir == std::ios_base::cur) {
+        base = static_cast<off_type>(_offset + (gptr() - eback()));
+    } else if (dir == std::ios_base::end) {
+        base = static_cast<off_type>(file->Size());
+    }
+    return seekpos(pos_type(base + off), which);
+}
+
+InputFileStream::Buffer::pos_type InputFileStream::Buffer::seekpos(pos_type pos, std::ios_base::openmode which) {
+    off_type target = off_type(pos);
+    if (!file || !(which & std::ios_base::in) || target < 0) return pos_type(off_type(-1));
+    uint64_t t = static_cast<uint64_t>(target);
+    if (t >= _offset && t <= _offset + (egptr() - eback())) {
+        // Within the buffer: no read needed
+        setg(eback(), eback() + (t - _offset), egptr());
+    } else {
+        _offset = t;
+        setg(_data.data(), _data.data(), _data.data());
+    }
+    return pos;
+}
+
+void InputFileStream::Attach(const RandomAccessFile* file) {
+    _buf.Reset(file);
+    clear();
+}
+
+void InputFileStream::open(Env* env, const std::string& path) {
+    _owned = env->NewRandomAccessFile(path);
+    if (!_owned) {
+        _buf.Reset(nullptr);
+        setstate(std::ios_base::failbit);
+        return;
+    }
+    Attach(_owned.get());
+}
+
+OutputFileStream::Buffer::Buffer() : _data(kStreamBufferSize) {
+    setp(_data.data(), _data.data() + _data.size());
+}
+
+bool OutputFileStream::Buffer::Flush() {
+    size_t n = pptr() - pbase();
+    setp(_data.data(), _data.data() + _data.size());
+    return n == 0 || (file && file->Append(_data.data(), n));
+}
+
+OutputFileStream::Buffer::int_type OutputFileStream::Buffer::overflow(int_type c) {
+    if (!Flush()) return traits_type::eof();
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+std::streamsize OutputFileStream::Buffer::xsputn(const char* s, std::streamsize n) {
+    if (n < epptr() - pptr()) {
+        memcpy(pptr(), s, n);
+        pbump(static_cast<int>(n));
+        return n;
+    }
+    // Larger than the space left: straight to the file
+    if (!Flush() || !file || !file->Append(s, n)) return 0;
+    return n;
+}
+
+int OutputFileStream::Buffer::sync() {
+    return Flush() ? 0 : -1;
+}
+
+void OutputFileStream::open(Env* env, const std::string& path, bool append) {
+    close();
+    _buf.file = env->NewWritableFile(path, append);
+    if (!_buf.file) {
+        setstate(std::ios_base::failbit);
+        return;
+    }
+    clear();
+}
+
+void OutputFileStream::close() {
+    if (!_buf.file) return;
+    if (_buf.pubsync() != 0) setstate(std::ios_base::badbit);
+    if (!_buf.file->Close()) setstate(std::ios_base::badbit);
+    _buf.file.reset();
+}
+
+} // namespace lsm
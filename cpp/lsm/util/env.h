@@ -0,0 +1,150 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace lsm {
+
+// A file being written, sequentially. Not thread-safe.
+class WritableFile {
+public:
+    virtual ~WritableFile() = default;
+
+    // All n bytes or false
+    virtual bool Append(const char* data, size_t n) = 0;
+    bool Append(const std::string& data) { return Append(data.data(), data.size()); }
+    virtual bool Sync() = 0;
+    // Also done by the destructor, which cannot report the error
+    virtual bool Close() = 0;
+};
+
+// A file read at arbitrary offsets. Thread-safe: reads never move a shared
+// file position.
+class RandomAccessFile {
+public:
+    virtual ~RandomAccessFile() = default;
+
+    // Like pread: up to n bytes at offset into buf, 0 at end of file, -1 with
+    // errno set on failure
+    virtual ssize_t Read(uint64_t offset, size_t n, char* buf) const = 0;
+    virtual uint64_t Size() const = 0;
+    // The descriptor of a file of the OS, for io_uring, or -1
+    virtual int fd() const { return -1; }
+};
+
+// Everything the engine does with files and directories goes through an
+// Env, so a DB can run on something other than the local file system.
+// Default() is that file system; NewMemEnv() keeps the files in memory, for
+// cache nodes that need no persistence and for benchmarks that should not
+// depend on the disk. Paths are plain strings, directories separated by '/'.
+// Thread-safe.
+class Env {
+public:
+    // The local file system, shared and never destroyed
+    static Env* Default();
+
+    virtual ~Env() = default;
+
+    // nullptr on failure. append = false truncates an existing file.
+    virtual std::unique_ptr<WritableFile> NewWritableFile(const std::string& path, bool append = false) = 0;
+    virtual std::unique_ptr<RandomAccessFile> NewRandomAccessFile(const std::string& path) = 0;
+
+    virtual bool FileExists(const std::string& path) = 0; // File or directory
+    virtual bool IsDirectory(const std::string& path) = 0;
+    virtual bool GetFileSize(const std::string& path, uint64_t* size) = 0;
+    // Names (not paths) of the entries of dir
+    virtual bool GetChildren(const std::string& dir, std::vector<std::string>* names) = 0;
+
+    // With the missing parents. True if dir already exists.
+    virtual bool CreateDirs(const std::string& dir) = 0;
+    virtual bool RemoveFile(const std::string& path) = 0;
+    // A file, or a directory with everything below it. True if path does not exist.
+    virtual bool RemoveAll(const std::string& path) = 0;
+    // Replaces to if it exists
+    virtual bool RenameFile(const std::string& from, const std::string& to) = 0;
+    // A hard link: to shares the contents of from. Fails if to exists.
+    virtual bool LinkFile(const std::string& from, const std::string& to) = 0;
+    virtual bool TruncateFile(const std::string& path, uint64_t size) = 0;
+};
+
+// Files in a map, gone with the last reference to the Env. Directories
+// must be created before files go in them, as on a real file system.
+std::shared_ptr<Env> NewMemEnv();
+
+// Copies a file, possibly from one Env to another
+bool CopyFile(Env* from_env, const std::string& from, Env* to_env, const std::string& to);
+
+// Buffered streams over the files of an Env, for the code that reads and
+// writes its metadata files through iostreams. Reads and seeks only.
+class InputFileStream : public std::istream {
+public:
+    InputFileStream() : std::istream(nullptr) { rdbuf(&_buf); }
+    InputFileStream(Env* env, const std::string& path) : InputFileStream() { open(env, path); }
+    // Reads file, which must outlive the stream
+    explicit InputFileStream(const RandomAccessFile* file) : InputFileStream() { Attach(file); }
+
+    void open(Env* env, const std::string& path);
+    bool is_open() const { return _buf.file != nullptr; }
+
+private:
+    class Buffer : public std::streambuf {
+    public:
+        const RandomAccessFile* file = nullptr;
+
+        void Reset(const RandomAccessFile* f);
+
+    protected:
+        int_type underflow() override;
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+        pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+    private:
+        std::vector<char> _data;
+        uint64_t _offset = 0; // Of _data[0] in the file
+    };
+
+    void Attach(const RandomAccessFile* file);
+
+    std::unique_ptr<RandomAccessFile> _owned;
+    Buffer _buf;
+};
+
+// Writes only. Like an ofstream, failures set badbit, and close() flushes.
+class OutputFileStream : public std::ostream {
+public:
+    OutputFileStream() : std::ostream(nullptr) { rdbuf(&_buf); }
+    OutputFileStream(Env* env, const std::string& path, bool append = false) : OutputFileStream() {
+        open(env, path, append);
+    }
+    ~OutputFileStream() override { close(); }
+
+    void open(Env* env, const std::string& path, bool append = false);
+    bool is_open() const { return _buf.file != nullptr; }
+    void close();
+
+private:
+    class Buffer : public std::streambuf {
+    public:
+        Buffer();
+        std::unique_ptr<WritableFile> file;
+
+    protected:
+        int_type overflow(int_type c) override;
+        std::streamsize xsputn(const char* s, std::streamsize n) override;
+        int sync() override;
+
+    private:
+        bool Flush();
+        std::vector<char> _data;
+    };
+
+    Buffer _buf;
+};
+
+} // namespace lsm
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace lsm {
+
+// Fast non-cryptographic hash (Murmur-like). Stable across builds and
+// platforms, so it is safe to use for anything persisted or routed on.
+uint32_t Hash(const char* data, size_t n, uint32_t seed);
+
+inline uint32_t Hash(const std::string& s, uint32_t seed = 0xbc9f1d34) {
+    return Hash(s.data(), s.size(), seed);
+}
+
+} // namespace lsm
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace lsm {
+
+// Entries by key, least recently used evicted first once their charges add
+// up to more than capacity. Not thread-safe: the caches built on it keep
+// several of these, each behind its own mutex.
+template <typename Value>
+class LRUCache {
+public:
+    using Entry = std::pair<std::string, Value>;
+
+    explicit LRUCache(size_t capacity = 0) : _capacity(capacity) {}
+
+    void set_capacity(size_t capacity) { _capacity = capacity; }
+    size_t capacity() const { return _capacity; }
+    size_t usage() const { return _usage; }
+
+    // The entry of key, made the most recently used, or nullptr
+    Value* Lookup(const std::string& key) {
+        auto it = _index.find(key);
+        if (it == _index.end()) return nullptr;
+        _lru.splice(_lru.begin(), _lru, it->second.first);
+        return &it->second.first->second;
+    }
+
+    // Inserts or replaces the entry of key. Entries evicted to make room are
+    // appended to evicted, if given. An entry charged more than the whole
+    // capacity is not inserted.
+    void Insert(const std::string& key, Value value, size_t charge, std::vector<Entry>* evicted = nullptr) {
+        Erase(key);
+        if (charge > _capacity) return;
+        while (!_lru.empty() && _usage + charge > _capacity) {
+            auto& last = _lru.back();
+            _usage -= _index[last.first].second;
+            _index.erase(last.first);
+            if (evicted) evicted->push_back(std::move(last));
+            _lru.pop_back();
+        }
+        _lru.emplace_front(key, std::move(value));
+        _index[key] = {_lru.begin(), charge};
+        _usage += charge;
+    }
+
+    // Removes the entry of key, moving its value to *value if given
+    bool Erase(const std::string& key, Value* value = nullptr) {
+        auto it = _index.find(key);
+        if (it == _index.end()) return false;
+        if (value) *value = std::move(it->second.first->second);
+        _usage -= it->second.second;
+        _lru.erase(it->second.first);
+        _index.erase(it);
+        return true;
+    }
+
+private:
+    size_t _capacity;
+    size_t _usage = 0;
+    // Most recently used first
+    std::list<Entry> _lru;
+    // Key -> (position in _lru, charge)
+    std::unordered_map<std::string, std::pair<typename std::list<Entry>::iterator, size_t>> _index;
+};
+
+} // namespace lsm
@@ -3,8 +3,8 @@
 
 namespace lsm {
 
-SkipList::SkipList() : _level(1), _rng(std::time(nullptr)), _dist(0, 1) {
-    _head = new Node("", "", false, kMaxLevel);
+SkipList::SkipList(const Comparator* comparator) : _comparator(comparator), _level(1), _rng(std::time(nullptr)), _dist(0, 1) {
+    _head = new Node("", "", false, 0, 0, kMaxLevel);
 }
 
 SkipList::~SkipList() {
@@ -24,24 +24,34 @@ int SkipList::RandomLevel() {
     return lvl;
 }
 
-void SkipList::Insert(const std::string& key, const std::string& value, bool is_deleted) {
-    std::vector<Node*> update(kMaxLevel);
+template <typename Order>
+Node* SkipList::FindGreaterOrEqual(const Order& order, const std::string& key, Node** prev) const {
     Node* current = _head;
-
     for (int i = _level - 1; i >= 0; i--) {
-        while (current->next[i] && current->next[i]->key < key) {
+        while (current->next[i] && order.Compare(current->next[i]->key, key) < 0) {
             current = current->next[i];
         }
-        update[i] = current;
+        if (prev) prev[i] = current;
     }
+    return current->next[0];
+}
 
-    current = current->next[0];
+Node* SkipList::FindGreaterOrEqual(const std::string& key, Node** prev) const {
+    return WithOrder(_comparator, [&](const auto& order) { return FindGreaterOrEqual(order, key, prev); });
+}
+
+void SkipList::Insert(const std::string& key, const std::string& value, bool is_deleted,
+                      uint64_t expire_at, uint64_t seq) {
+    std::vector<Node*> update(kMaxLevel);
+    Node* current = FindGreaterOrEqual(key, update.data());
 
     if (current && current->key == key) {
         _memory_usage -= current->value.size();
         current->value = value;
         _memory_usage += current->value.size();
         current->is_deleted = is_deleted;
+        current->expire_at = expire_at;
+        current->seq = seq;
     } else {
         // 抛硬币决定新节点有多高
         int new_level = RandomLevel();
@@ -56,7 +66,7 @@ void SkipList::Insert(const std::string& key, const std::string& value, bool is_
             _level = new_level;
         }
 
-        Node* new_node = new Node(key, value, is_deleted, new_level);
+        Node* new_node = new Node(key, value, is_deleted, expire_at, seq, new_level);
         _memory_usage += sizeof(Node) + new_level * sizeof(Node*) + key.size() + value.size();
 
         // 循环每一层，把新节点"缝"进去
@@ -69,20 +79,16 @@ void SkipList::Insert(const std::string& key, const std::string& value, bool is_
     }
 }
 
-bool SkipList::Get(const std::string& key, std::string* value) {
-    Node* current = _head;
-    for (int i = _level - 1; i >= 0; i--) {
-        while (current->next[i] && current->next[i]->key < key) {
-            current = current->next[i];
-        }
-    }
-    current = current->next[0];
-
+bool SkipList::Get(const std::string& key, std::string* value, bool* is_deleted, uint64_t* expire_at,
+                   uint64_t* seq) {
+    Node* current = FindGreaterOrEqual(key, nullptr);
     if (current && current->key == key) {
-        if (current->is_deleted) {
-            return false;
+        *is_deleted = current->is_deleted;
+        *expire_at = current->expire_at;
+        if (seq) *seq = current->seq;
+        if (!current->is_deleted) {
+            *value = current->value;
         }
-        *value = current->value;
         return true;
     }
     return false;
@@ -99,13 +105,7 @@ void SkipList::Iterator::SeekToFirst() {
 }
 
 void SkipList::Iterator::Seek(const std::string& target) {
-    Node* x = _list->_head;
-    for (int i = _list->_level - 1; i >= 0; i--) {
-        while (x->next[i] && x->next[i]->key < target) {
-            x = x->next[i];
-        }
-    }
-    _current = x->next[0];
+    _current = _list->FindGreaterOrEqual(target, nullptr);
 }
 
 void SkipList::Iterator::Next() {
@@ -126,6 +126,14 @@ bool SkipList::Iterator::IsDeleted() const {
     return _current->is_deleted;
 }
 
+uint64_t SkipList::Iterator::ExpireAt() const {
+    return _current->expire_at;
+}
+
+uint64_t SkipList::Iterator::Seq() const {
+    return _current->seq;
+}
+
 SkipList::Iterator* SkipList::NewIterator() const {
     return new Iterator(this);
 }
@@ -3,6 +3,8 @@
 #include <vector>
 #include <random>
 #include <memory>
+#include <cstdint>
+#include "core/comparator.h"
 
 namespace lsm {
 
@@ -10,19 +12,26 @@ struct Node {
     std::string key;
     std::string value;
     bool is_deleted;
+    uint64_t expire_at; // Unix time in ms after which the entry is gone, 0 = never
+    uint64_t seq;       // Write order within the owning memtable
     std::vector<Node*> next;
 
-    Node(const std::string& k, const std::string& v, bool del, int level)
-        : key(k), value(v), is_deleted(del), next(level, nullptr) {}
+    Node(const std::string& k, const std::string& v, bool del, uint64_t exp, uint64_t sq, int level)
+        : key(k), value(v), is_deleted(del), expire_at(exp), seq(sq), next(level, nullptr) {}
 };
 
+// Keys in the order of comparator, which must outlive the list
 class SkipList {
 public:
-    SkipList();
+    explicit SkipList(const Comparator* comparator);
     ~SkipList();
 
-    void Insert(const std::string& key, const std::string& value, bool is_deleted = false);
-    bool Get(const std::string& key, std::string* value);
+    void Insert(const std::string& key, const std::string& value, bool is_deleted = false,
+                uint64_t expire_at = 0, uint64_t seq = 0);
+    // Returns false if the key has no entry. Otherwise fills in the entry,
+    // which may be a deletion (value is then left untouched).
+    bool Get(const std::string& key, std::string* value, bool* is_deleted, uint64_t* expire_at,
+             uint64_t* seq = nullptr);
 
     class Iterator {
     public:
@@ -34,6 +43,8 @@ public:
         const std::string& Key() const;
         const std::string& Value() const;
         bool IsDeleted() const;
+        uint64_t ExpireAt() const;
+        uint64_t Seq() const;
     private:
         const SkipList* _list;
         Node* _current;
@@ -45,6 +56,7 @@ public:
 
 private:
     static const int kMaxLevel = 12;
+    const Comparator* _comparator;
     Node* _head;
     int _level;
     size_t _memory_usage = 0;
@@ -52,6 +64,11 @@ private:
     std::uniform_int_distribution<> _dist;
 
     int RandomLevel();
+    // First node with a key >= key, or null; fills prev[level] with the last
+    // node before it on each level if prev is set
+    Node* FindGreaterOrEqual(const std::string& key, Node** prev) const;
+    template <typename Order>
+    Node* FindGreaterOrEqual(const Order& order, const std::string& key, Node** prev) const;
 };
 
 } // namespace lsm
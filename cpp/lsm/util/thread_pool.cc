@@ -0,0 +1,45 @@
+#include "thread_pool.h"
+
+namespace lsm {
+
+ThreadPool::ThreadPool(int num_threads) {
+    if (num_threads < 1) num_threads = 1;
+    for (int i = 0; i < num_threads; ++i) {
+        _workers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _cv.notify_all();
+    for (auto& worker : _workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::Schedule(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push_back(std::move(job));
+    }
+    _cv.notify_one();
+}
+
+void ThreadPool::WorkerLoop() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cv.wait(lock, [this] { return _stopping || !_queue.empty(); });
+            if (_queue.empty()) return; // Stopping and drained
+            job = std::move(_queue.front());
+            _queue.pop_front();
+        }
+        job();
+    }
+}
+
+} // namespace lsm
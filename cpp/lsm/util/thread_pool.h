@@ -0,0 +1,33 @@
+#pragma once
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+namespace lsm {
+
+// Fixed set of worker threads running jobs in FIFO order. The DB keeps one
+// pool for flushes and one for compactions, so a long compaction never
+// delays the flush that unblocks writers.
+class ThreadPool {
+public:
+    explicit ThreadPool(int num_threads);
+    // Runs the jobs still queued, then joins the workers
+    ~ThreadPool();
+
+    void Schedule(std::function<void()> job);
+    int NumThreads() const { return static_cast<int>(_workers.size()); }
+
+private:
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::deque<std::function<void()>> _queue;
+    bool _stopping = false;
+
+    void WorkerLoop();
+};
+
+} // namespace lsm
@@ -0,0 +1,125 @@
+package bridge
+
+// #include "lsm.h"
+// #include <stdlib.h>
+import "C"
+import (
+	"errors"
+	"time"
+	"unsafe"
+)
+
+// ErrFollowerTooFarBehind 表示源 DB 已不再保留 Follower 尚未应用的写入，
+// 需要从源的 checkpoint（CreateCheckpoint）重新建立副本
+var ErrFollowerTooFarBehind = errors.New("lsm: updates to follow are no longer retained by the source")
+
+// Follower 是一个参考实现的从副本：按 sequence 顺序读取源 LSMStore 的 WAL（GetUpdatesSince），
+// 把其中的写入应用到另一个本地 LSMStore，使其能以秒级延迟提供读取。
+// 源应通过 WithWALRetention 保留已 flush 的 WAL；通过 SSTFileWriter 导入的数据不在 WAL 中，不会被复制。
+// Follower 不能并发使用
+type Follower struct {
+	source  *LSMStore
+	target  *LSMStore
+	applied uint64
+}
+
+// NewFollower 创建从 applied 之后的写入开始跟随 source 的 Follower。新建的空副本 applied 为 0；
+// 从源的 checkpoint 打开的副本用其 LatestSequenceNumber()
+func NewFollower(source, target *LSMStore, applied uint64) *Follower {
+	return &Follower{source: source, target: target, applied: applied}
+}
+
+// LatestSequenceNumber 返回最近一次写入的 sequence number
+func (s *LSMStore) LatestSequenceNumber() uint64 {
+	return uint64(C.lsm_get_latest_sequence_number(s.db))
+}
+
+// Applied 返回已应用的最后一个写入的 sequence number
+func (f *Follower) Applied() uint64 {
+	return f.applied
+}
+
+// CatchUp 应用源上目前已有的全部新写入，返回应用的数量
+func (f *Follower) CatchUp() (int, error) {
+	var cErr *C.char
+	iter := C.lsm_get_updates_since(f.source.db, C.uint64_t(f.applied+1), &cErr)
+	if cErr != nil {
+		defer C.lsm_free(unsafe.Pointer(cErr))
+		return 0, errors.New(C.GoString(cErr))
+	}
+	if iter == nil {
+		return 0, ErrFollowerTooFarBehind
+	}
+	defer C.lsm_update_iterator_destroy(iter)
+
+	n := 0
+	for ; C.lsm_update_iterator_valid(iter) != 0; C.lsm_update_iterator_next(iter) {
+		if err := f.apply(iter); err != nil {
+			return n, err
+		}
+		f.applied = uint64(C.lsm_update_iterator_sequence(iter))
+		n++
+	}
+	return n, nil
+}
+
+// Run 每隔 interval 调用一次 CatchUp，直到 stop 被关闭（返回 nil）或出错
+func (f *Follower) Run(interval time.Duration, stop <-chan struct{}) error {
+	ticker := time.NewTicker(interval)
+	defer ticker.Stop()
+	for {
+		if _, err := f.CatchUp(); err != nil {
+			return err
+		}
+		select {
+		case <-stop:
+			return nil
+		case <-ticker.C:
+		}
+	}
+}
+
+func (f *Follower) apply(iter *C.lsm_update_iterator_t) error {
+	var keyLen, valueLen C.size_t
+	cKey := C.lsm_update_iterator_key(iter, &keyLen)
+	cValue := C.lsm_update_iterator_value(iter, &valueLen)
+
+	var cf *C.lsm_column_family_t
+	if name := C.GoString(C.lsm_update_iterator_column_family(iter)); name != "default" {
+		family, err := f.target.ColumnFamily(name)
+		if err != nil {
+			return err
+		}
+		cf = family.cf
+	}
+
+	var cErr *C.char
+	switch C.lsm_update_iterator_type(iter) {
+	case C.LSM_UPDATE_DELETE:
+		if cf == nil {
+			C.lsm_delete(f.target.db, cKey, keyLen, &cErr)
+		} else {
+			C.lsm_delete_cf(f.target.db, cf, cKey, keyLen, &cErr)
+		}
+	case C.LSM_UPDATE_DELETE_RANGE:
+		if cf == nil {
+			C.lsm_delete_range(f.target.db, cKey, keyLen, cValue, valueLen, &cErr)
+		} else {
+			C.lsm_delete_range_cf(f.target.db, cf, cKey, keyLen, cValue, valueLen, &cErr)
+		}
+	default:
+		// 过期时间点随写入一起复制，为 0 表示永不过期
+		expireAt := C.lsm_update_iterator_expire_at(iter)
+		if cf == nil {
+			C.lsm_put_with_expiry(f.target.db, cKey, keyLen, cValue, valueLen, expireAt, &cErr)
+		} else {
+			C.lsm_put_cf_with_expiry(f.target.db, cf, cKey, keyLen, cValue, valueLen, expireAt, &cErr)
+		}
+	}
+
+	if cErr != nil {
+		defer C.lsm_free(unsafe.Pointer(cErr))
+		return errors.New(C.GoString(cErr))
+	}
+	return nil
+}
@@ -8,18 +8,77 @@ import "C"
 import (
 	"errors"
 	"geecache"
+	"sync"
+	"time"
 	"unsafe"
 )
 
 // LSMStore 实现了 geecache.CentralCache 接口
+//
+// Get/Set 走引擎的异步接口：请求交给引擎自己的固定数量的 worker 线程执行，结果进入
+// completion queue，由一个 goroutine 批量取回后唤醒等待的调用方。调用方 goroutine
+// 只阻塞在 channel 上而不占用 OS 线程，因此无论并发多高，阻塞在存储上的线程数都有上限
 type LSMStore struct {
 	db *C.lsm_db_t
+
+	mu  sync.Mutex
+	cfs map[string]*LSMColumnFamily
+
+	cq         *C.lsm_completion_queue_t
+	pendingMu  sync.Mutex
+	pending    map[uint64]chan asyncResult
+	nextTag    uint64
+	pollerDone chan struct{}
+}
+
+// asyncResult 是一次异步操作的结果，value 为 nil 表示 key 不存在
+type asyncResult struct {
+	value []byte
+	err   error
+}
+
+// completionBatch 是 poller 每次最多取回的完成数
+const completionBatch = 64
+
+// LSMColumnFamily 是 LSMStore 中一个独立的 column family（独立的 memtable、SSTable 与配置，
+// 共享 WAL 和后台线程），通常一个 geecache.Group 对应一个，同样实现 CentralCache 接口
+type LSMColumnFamily struct {
+	store *LSMStore
+	cf    *C.lsm_column_family_t
+	name  string
+}
+
+// StoreOption 调整 NewLSMStore 打开 DB 时使用的选项
+type StoreOption func(opts *C.lsm_options_t)
+
+// WithWALRetention 让已 flush 的 WAL 最多保留 bytes 字节，Follower 落后不超过这些写入时仍可追上
+func WithWALRetention(bytes uint64) StoreOption {
+	return func(opts *C.lsm_options_t) {
+		C.lsm_options_set_wal_retention_size(opts, C.uint64_t(bytes))
+	}
+}
+
+// WithSync 让每次写入都在返回前 fsync WAL，而不是依赖后台定期 sync
+func WithSync() StoreOption {
+	return func(opts *C.lsm_options_t) {
+		C.lsm_options_set_sync(opts, 1)
+	}
 }
 
-func NewLSMStore(path string) (*LSMStore, error) {
+// WithMemEnv 让 DB 的文件全部放在内存里：不落盘，Close 后数据即丢弃，适合纯缓存节点
+func WithMemEnv() StoreOption {
+	return func(opts *C.lsm_options_t) {
+		C.lsm_options_set_env(opts, C.LSM_ENV_MEMORY)
+	}
+}
+
+func NewLSMStore(path string, options ...StoreOption) (*LSMStore, error) {
 	opts := C.lsm_options_create()
 	defer C.lsm_options_destroy(opts)
 	C.lsm_options_set_create_if_missing(opts, 1)
+	for _, option := range options {
+		option(opts)
+	}
 
 	cPath := C.CString(path)
 	defer C.free(unsafe.Pointer(cPath))
@@ -32,19 +91,324 @@ func NewLSMStore(path string) (*LSMStore, error) {
 		return nil, errors.New(C.GoString(cErr))
 	}
 
-	return &LSMStore{db: db}, nil
+	s := &LSMStore{
+		db:         db,
+		cfs:        make(map[string]*LSMColumnFamily),
+		cq:         C.lsm_completion_queue_create(),
+		pending:    make(map[uint64]chan asyncResult),
+		pollerDone: make(chan struct{}),
+	}
+	go s.pollCompletions()
+	return s, nil
+}
+
+// pollCompletions 批量取回 completion queue 中的结果并交给等待的调用方，
+// 队列关闭且取空后退出
+func (s *LSMStore) pollCompletions() {
+	defer close(s.pollerDone)
+	var completions [completionBatch]C.lsm_completion_t
+	for {
+		n := int(C.lsm_completion_queue_poll(s.cq, &completions[0], completionBatch, -1))
+		if n == 0 {
+			return
+		}
+		for i := 0; i < n; i++ {
+			c := &completions[i]
+			var res asyncResult
+			if c.err != nil {
+				res.err = errors.New(C.GoString(c.err))
+				C.lsm_free(unsafe.Pointer(c.err))
+			}
+			if c.value != nil {
+				res.value = C.GoBytes(unsafe.Pointer(c.value), C.int(c.vallen))
+				C.lsm_free(unsafe.Pointer(c.value))
+			}
+			tag := uint64(c.tag)
+			s.pendingMu.Lock()
+			ch := s.pending[tag]
+			delete(s.pending, tag)
+			s.pendingMu.Unlock()
+			ch <- res
+		}
+	}
+}
+
+// submit 分配 tag 并登记等待的 channel，然后调用 start 提交异步操作，阻塞直到结果返回
+func (s *LSMStore) submit(start func(tag C.uint64_t)) asyncResult {
+	ch := make(chan asyncResult, 1)
+	s.pendingMu.Lock()
+	s.nextTag++
+	tag := s.nextTag
+	s.pending[tag] = ch
+	s.pendingMu.Unlock()
+	start(C.uint64_t(tag))
+	return <-ch
 }
 
 func (s *LSMStore) Get(key string) ([]byte, error) {
 	cKey := C.CBytes([]byte(key))
 	defer C.free(unsafe.Pointer(cKey))
 
+	res := s.submit(func(tag C.uint64_t) {
+		C.lsm_get_async(s.db, (*C.char)(cKey), C.size_t(len(key)), s.cq, tag)
+	})
+	return res.value, res.err
+}
+
+// MultiGet 批量查询，所有需要读 SSTable 的 key 一次性提交读请求（io_uring 或线程池），
+// 返回值与 keys 一一对应，未找到的 key 对应 nil
+func (s *LSMStore) MultiGet(keys []string) ([][]byte, error) {
+	n := len(keys)
+	if n == 0 {
+		return nil, nil
+	}
+	// 指针数组必须在 C 内存中，cgo 不允许把含 Go 指针的 Go 内存传给 C
+	ptrSize := C.size_t(unsafe.Sizeof(uintptr(0)))
+	sizeSize := C.size_t(unsafe.Sizeof(C.size_t(0)))
+	cKeysPtr := C.malloc(C.size_t(n) * ptrSize)
+	defer C.free(cKeysPtr)
+	cKeySizesPtr := C.malloc(C.size_t(n) * sizeSize)
+	defer C.free(cKeySizesPtr)
+	cValuesPtr := C.malloc(C.size_t(n) * ptrSize)
+	defer C.free(cValuesPtr)
+	cValueSizesPtr := C.malloc(C.size_t(n) * sizeSize)
+	defer C.free(cValueSizesPtr)
+
+	cKeys := unsafe.Slice((**C.char)(cKeysPtr), n)
+	cKeySizes := unsafe.Slice((*C.size_t)(cKeySizesPtr), n)
+	cValues := unsafe.Slice((**C.char)(cValuesPtr), n)
+	cValueSizes := unsafe.Slice((*C.size_t)(cValueSizesPtr), n)
+	for i, key := range keys {
+		cKeys[i] = (*C.char)(C.CBytes([]byte(key)))
+		cKeySizes[i] = C.size_t(len(key))
+	}
+	defer func() {
+		for i := range cKeys {
+			C.free(unsafe.Pointer(cKeys[i]))
+		}
+	}()
+
 	var cErr *C.char
-	var cValueLen C.size_t
+	C.lsm_multi_get(s.db, C.size_t(n), (**C.char)(cKeysPtr), (*C.size_t)(cKeySizesPtr),
+		(**C.char)(cValuesPtr), (*C.size_t)(cValueSizesPtr), &cErr)
+	if cErr != nil {
+		defer C.lsm_free(unsafe.Pointer(cErr))
+		return nil, errors.New(C.GoString(cErr))
+	}
+
+	values := make([][]byte, n)
+	for i := range values {
+		if cValues[i] == nil {
+			continue // Not found
+		}
+		values[i] = C.GoBytes(unsafe.Pointer(cValues[i]), C.int(cValueSizes[i]))
+		C.lsm_free(unsafe.Pointer(cValues[i]))
+	}
+	return values, nil
+}
+
+func (s *LSMStore) Set(key string, value []byte) error {
+	cKey := C.CBytes([]byte(key))
+	defer C.free(unsafe.Pointer(cKey))
+	cValue := C.CBytes(value)
+	defer C.free(unsafe.Pointer(cValue))
+
+	res := s.submit(func(tag C.uint64_t) {
+		C.lsm_put_async(
+			s.db,
+			(*C.char)(cKey), C.size_t(len(key)),
+			(*C.char)(cValue), C.size_t(len(value)),
+			s.cq, tag,
+		)
+	})
+	return res.err
+}
 
-	cValue := C.lsm_get(
+// SetWithTTL 写入的值在 ttl 之后视为不存在，过期数据由 flush 和 compaction 回收
+func (s *LSMStore) SetWithTTL(key string, value []byte, ttl time.Duration) error {
+	cKey := C.CBytes([]byte(key))
+	defer C.free(unsafe.Pointer(cKey))
+	cValue := C.CBytes(value)
+	defer C.free(unsafe.Pointer(cValue))
+
+	var cErr *C.char
+	C.lsm_put_with_expiry(
 		s.db,
 		(*C.char)(cKey), C.size_t(len(key)),
+		(*C.char)(cValue), C.size_t(len(value)),
+		expireAt(ttl),
+		&cErr,
+	)
+
+	if cErr != nil {
+		defer C.lsm_free(unsafe.Pointer(cErr))
+		return errors.New(C.GoString(cErr))
+	}
+	return nil
+}
+
+// expireAt 把 ttl 换算为 C API 使用的过期时间点（Unix 毫秒）
+func expireAt(ttl time.Duration) C.uint64_t {
+	return C.uint64_t(time.Now().Add(ttl).UnixMilli())
+}
+
+func (s *LSMStore) Delete(key string) error {
+	cKey := C.CBytes([]byte(key))
+	defer C.free(unsafe.Pointer(cKey))
+
+	var cErr *C.char
+	C.lsm_delete(s.db, (*C.char)(cKey), C.size_t(len(key)), &cErr)
+
+	if cErr != nil {
+		defer C.lsm_free(unsafe.Pointer(cErr))
+		return errors.New(C.GoString(cErr))
+	}
+	return nil
+}
+
+// DeleteRange 删除 [begin, end) 内的所有 key，开销与覆盖的 key 数量无关，
+// 适合整组或整个租户的失效
+func (s *LSMStore) DeleteRange(begin, end string) error {
+	cBegin := C.CBytes([]byte(begin))
+	defer C.free(unsafe.Pointer(cBegin))
+	cEnd := C.CBytes([]byte(end))
+	defer C.free(unsafe.Pointer(cEnd))
+
+	var cErr *C.char
+	C.lsm_delete_range(s.db, (*C.char)(cBegin), C.size_t(len(begin)), (*C.char)(cEnd), C.size_t(len(end)), &cErr)
+
+	if cErr != nil {
+		defer C.lsm_free(unsafe.Pointer(cErr))
+		return errors.New(C.GoString(cErr))
+	}
+	return nil
+}
+
+// WriteOptions 控制单次写入的持久化方式，零值与 Set / Delete 相同。
+// 例如 StrategyWriteThrough 可用 Sync 保证返回前已落盘，
+// StrategyWriteBack 的异步回写可用 LowPri 让位于前台写入
+type WriteOptions struct {
+	Sync       bool // 返回前 fsync WAL，即使打开 DB 时未使用 WithSync
+	DisableWAL bool // 不写 WAL：崩溃时丢失，Close 时会 flush 保留；不能与 Sync 同时使用
+	LowPri     bool // compaction 落后时先于其他写入被限速
+}
+
+// withWriteOptions 创建对应的 C 写选项并调用 fn，之后释放
+func withWriteOptions(wo WriteOptions, fn func(opts *C.lsm_writeoptions_t)) {
+	opts := C.lsm_writeoptions_create()
+	defer C.lsm_writeoptions_destroy(opts)
+	C.lsm_writeoptions_set_sync(opts, boolToUint8(wo.Sync))
+	C.lsm_writeoptions_set_disable_wal(opts, boolToUint8(wo.DisableWAL))
+	C.lsm_writeoptions_set_low_pri(opts, boolToUint8(wo.LowPri))
+	fn(opts)
+}
+
+// SetWithOptions 按 wo 写入，在调用方的 goroutine 中同步执行
+func (s *LSMStore) SetWithOptions(key string, value []byte, wo WriteOptions) error {
+	cKey := C.CBytes([]byte(key))
+	defer C.free(unsafe.Pointer(cKey))
+	cValue := C.CBytes(value)
+	defer C.free(unsafe.Pointer(cValue))
+
+	var cErr *C.char
+	withWriteOptions(wo, func(opts *C.lsm_writeoptions_t) {
+		C.lsm_put_opt(
+			s.db, opts,
+			(*C.char)(cKey), C.size_t(len(key)),
+			(*C.char)(cValue), C.size_t(len(value)),
+			&cErr,
+		)
+	})
+
+	if cErr != nil {
+		defer C.lsm_free(unsafe.Pointer(cErr))
+		return errors.New(C.GoString(cErr))
+	}
+	return nil
+}
+
+// DeleteWithOptions 按 wo 删除 key
+func (s *LSMStore) DeleteWithOptions(key string, wo WriteOptions) error {
+	cKey := C.CBytes([]byte(key))
+	defer C.free(unsafe.Pointer(cKey))
+
+	var cErr *C.char
+	withWriteOptions(wo, func(opts *C.lsm_writeoptions_t) {
+		C.lsm_delete_opt(s.db, opts, (*C.char)(cKey), C.size_t(len(key)), &cErr)
+	})
+
+	if cErr != nil {
+		defer C.lsm_free(unsafe.Pointer(cErr))
+		return errors.New(C.GoString(cErr))
+	}
+	return nil
+}
+
+// ColumnFamily 返回名为 name 的 column family，不存在时创建（例如用 Group 名作为 name）；已存在的保持原有选项
+func (s *LSMStore) ColumnFamily(name string) (*LSMColumnFamily, error) {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	if cf, ok := s.cfs[name]; ok {
+		return cf, nil
+	}
+
+	cName := C.CString(name)
+	defer C.free(unsafe.Pointer(cName))
+
+	var cErr *C.char
+	handle := C.lsm_create_column_family(s.db, nil, cName, &cErr)
+
+	if cErr != nil {
+		defer C.lsm_free(unsafe.Pointer(cErr))
+		return nil, errors.New(C.GoString(cErr))
+	}
+
+	cf := &LSMColumnFamily{store: s, cf: handle, name: name}
+	s.cfs[name] = cf
+	return cf, nil
+}
+
+// DropColumnFamily 删除整个 column family 的文件，开销与其中的 key 数量无关
+func (s *LSMStore) DropColumnFamily(name string) error {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	cf, ok := s.cfs[name]
+	if !ok {
+		cName := C.CString(name)
+		defer C.free(unsafe.Pointer(cName))
+
+		// 打开已存在（例如上次运行创建）的 column family 以便删除
+		var cErr *C.char
+		handle := C.lsm_create_column_family(s.db, nil, cName, &cErr)
+		if cErr != nil {
+			defer C.lsm_free(unsafe.Pointer(cErr))
+			return errors.New(C.GoString(cErr))
+		}
+		cf = &LSMColumnFamily{store: s, cf: handle, name: name}
+	}
+	delete(s.cfs, name)
+	defer C.lsm_column_family_handle_destroy(cf.cf)
+
+	var cErr *C.char
+	C.lsm_drop_column_family(s.db, cf.cf, &cErr)
+
+	if cErr != nil {
+		defer C.lsm_free(unsafe.Pointer(cErr))
+		return errors.New(C.GoString(cErr))
+	}
+	return nil
+}
+
+func (c *LSMColumnFamily) Get(key string) ([]byte, error) {
+	cKey := C.CBytes([]byte(key))
+	defer C.free(unsafe.Pointer(cKey))
+
+	var cErr *C.char
+	var cValueLen C.size_t
+
+	cValue := C.lsm_get_cf(
+		c.store.db, c.cf,
+		(*C.char)(cKey), C.size_t(len(key)),
 		&cValueLen,
 		&cErr,
 	)
@@ -61,15 +425,15 @@ func (s *LSMStore) Get(key string) ([]byte, error) {
 	return C.GoBytes(unsafe.Pointer(cValue), C.int(cValueLen)), nil
 }
 
-func (s *LSMStore) Set(key string, value []byte) error {
+func (c *LSMColumnFamily) Set(key string, value []byte) error {
 	cKey := C.CBytes([]byte(key))
 	defer C.free(unsafe.Pointer(cKey))
 	cValue := C.CBytes(value)
 	defer C.free(unsafe.Pointer(cValue))
 
 	var cErr *C.char
-	C.lsm_put(
-		s.db,
+	C.lsm_put_cf(
+		c.store.db, c.cf,
 		(*C.char)(cKey), C.size_t(len(key)),
 		(*C.char)(cValue), C.size_t(len(value)),
 		&cErr,
@@ -82,12 +446,170 @@ func (s *LSMStore) Set(key string, value []byte) error {
 	return nil
 }
 
-func (s *LSMStore) Delete(key string) error {
+// SetWithTTL 同 LSMStore.SetWithTTL，作用于该 column family
+func (c *LSMColumnFamily) SetWithTTL(key string, value []byte, ttl time.Duration) error {
 	cKey := C.CBytes([]byte(key))
 	defer C.free(unsafe.Pointer(cKey))
+	cValue := C.CBytes(value)
+	defer C.free(unsafe.Pointer(cValue))
 
 	var cErr *C.char
-	C.lsm_delete(s.db, (*C.char)(cKey), C.size_t(len(key)), &cErr)
+	C.lsm_put_cf_with_expiry(
+		c.store.db, c.cf,
+		(*C.char)(cKey), C.size_t(len(key)),
+		(*C.char)(cValue), C.size_t(len(value)),
+		expireAt(ttl),
+		&cErr,
+	)
+
+	if cErr != nil {
+		defer C.lsm_free(unsafe.Pointer(cErr))
+		return errors.New(C.GoString(cErr))
+	}
+	return nil
+}
+
+func (c *LSMColumnFamily) Delete(key string) error {
+	cKey := C.CBytes([]byte(key))
+	defer C.free(unsafe.Pointer(cKey))
+
+	var cErr *C.char
+	C.lsm_delete_cf(c.store.db, c.cf, (*C.char)(cKey), C.size_t(len(key)), &cErr)
+
+	if cErr != nil {
+		defer C.lsm_free(unsafe.Pointer(cErr))
+		return errors.New(C.GoString(cErr))
+	}
+	return nil
+}
+
+// DeleteRange 同 LSMStore.DeleteRange，作用于该 column family
+func (c *LSMColumnFamily) DeleteRange(begin, end string) error {
+	cBegin := C.CBytes([]byte(begin))
+	defer C.free(unsafe.Pointer(cBegin))
+	cEnd := C.CBytes([]byte(end))
+	defer C.free(unsafe.Pointer(cEnd))
+
+	var cErr *C.char
+	C.lsm_delete_range_cf(c.store.db, c.cf, (*C.char)(cBegin), C.size_t(len(begin)), (*C.char)(cEnd), C.size_t(len(end)), &cErr)
+
+	if cErr != nil {
+		defer C.lsm_free(unsafe.Pointer(cErr))
+		return errors.New(C.GoString(cErr))
+	}
+	return nil
+}
+
+// SSTFileWriter 离线构建 SSTable，再通过 IngestExternalFile 直接导入，
+// 适合一致性哈希环变更后的数据迁移或新节点预热，写入时 key 必须严格递增
+type SSTFileWriter struct {
+	w *C.lsm_sstfilewriter_t
+}
+
+func NewSSTFileWriter(path string) (*SSTFileWriter, error) {
+	cPath := C.CString(path)
+	defer C.free(unsafe.Pointer(cPath))
+
+	var cErr *C.char
+	w := C.lsm_sstfilewriter_open(cPath, &cErr)
+
+	if cErr != nil {
+		defer C.lsm_free(unsafe.Pointer(cErr))
+		return nil, errors.New(C.GoString(cErr))
+	}
+	return &SSTFileWriter{w: w}, nil
+}
+
+func (w *SSTFileWriter) Put(key string, value []byte) error {
+	cKey := C.CBytes([]byte(key))
+	defer C.free(unsafe.Pointer(cKey))
+	cValue := C.CBytes(value)
+	defer C.free(unsafe.Pointer(cValue))
+
+	var cErr *C.char
+	C.lsm_sstfilewriter_put(
+		w.w,
+		(*C.char)(cKey), C.size_t(len(key)),
+		(*C.char)(cValue), C.size_t(len(value)),
+		&cErr,
+	)
+
+	if cErr != nil {
+		defer C.lsm_free(unsafe.Pointer(cErr))
+		return errors.New(C.GoString(cErr))
+	}
+	return nil
+}
+
+// Delete 写入删除标记，导入后会覆盖 DB 中该 key 的旧值
+func (w *SSTFileWriter) Delete(key string) error {
+	cKey := C.CBytes([]byte(key))
+	defer C.free(unsafe.Pointer(cKey))
+
+	var cErr *C.char
+	C.lsm_sstfilewriter_delete(w.w, (*C.char)(cKey), C.size_t(len(key)), &cErr)
+
+	if cErr != nil {
+		defer C.lsm_free(unsafe.Pointer(cErr))
+		return errors.New(C.GoString(cErr))
+	}
+	return nil
+}
+
+// Finish 写入索引并关闭文件，之后文件即可被导入
+func (w *SSTFileWriter) Finish() error {
+	var cErr *C.char
+	C.lsm_sstfilewriter_finish(w.w, &cErr)
+
+	if cErr != nil {
+		defer C.lsm_free(unsafe.Pointer(cErr))
+		return errors.New(C.GoString(cErr))
+	}
+	return nil
+}
+
+func (w *SSTFileWriter) Close() {
+	C.lsm_sstfilewriter_destroy(w.w)
+}
+
+// IngestExternalFile 将 SSTFileWriter 生成的文件直接放入合适的层级，不经过 WAL 和 memtable，
+// 导入的数据比 DB 中已有的数据更新。moveFile 为 true 时通过硬链接导入并删除原文件，否则复制
+func (s *LSMStore) IngestExternalFile(path string, moveFile bool) error {
+	cPath := C.CString(path)
+	defer C.free(unsafe.Pointer(cPath))
+
+	var cErr *C.char
+	C.lsm_ingest_external_file(s.db, cPath, boolToUint8(moveFile), &cErr)
+
+	if cErr != nil {
+		defer C.lsm_free(unsafe.Pointer(cErr))
+		return errors.New(C.GoString(cErr))
+	}
+	return nil
+}
+
+func (c *LSMColumnFamily) IngestExternalFile(path string, moveFile bool) error {
+	cPath := C.CString(path)
+	defer C.free(unsafe.Pointer(cPath))
+
+	var cErr *C.char
+	C.lsm_ingest_external_file_cf(c.store.db, c.cf, cPath, boolToUint8(moveFile), &cErr)
+
+	if cErr != nil {
+		defer C.lsm_free(unsafe.Pointer(cErr))
+		return errors.New(C.GoString(cErr))
+	}
+	return nil
+}
+
+// CreateCheckpoint 将 DB 当前的状态做成 dir 下一个可直接打开的独立副本（dir 不能已存在），
+// SSTable 通过硬链接共享，几乎不占用时间和额外空间，适合克隆出新的缓存节点
+func (s *LSMStore) CreateCheckpoint(dir string) error {
+	cDir := C.CString(dir)
+	defer C.free(unsafe.Pointer(cDir))
+
+	var cErr *C.char
+	C.lsm_create_checkpoint(s.db, cDir, &cErr)
 
 	if cErr != nil {
 		defer C.lsm_free(unsafe.Pointer(cErr))
@@ -96,9 +618,47 @@ func (s *LSMStore) Delete(key string) error {
 	return nil
 }
 
+func boolToUint8(b bool) C.uint8_t {
+	if b {
+		return 1
+	}
+	return 0
+}
+
+// StartTrace 开始将 Get/Set/Delete/DeleteRange 操作记录到二进制 trace 文件，可用 lsm_replay 回放
+func (s *LSMStore) StartTrace(path string) error {
+	cPath := C.CString(path)
+	defer C.free(unsafe.Pointer(cPath))
+
+	var cErr *C.char
+	C.lsm_start_trace(s.db, cPath, &cErr)
+
+	if cErr != nil {
+		defer C.lsm_free(unsafe.Pointer(cErr))
+		return errors.New(C.GoString(cErr))
+	}
+	return nil
+}
+
+// EndTrace 停止记录并刷新 trace 文件
+func (s *LSMStore) EndTrace() {
+	C.lsm_end_trace(s.db)
+}
+
 func (s *LSMStore) Close() {
+	s.mu.Lock()
+	for name, cf := range s.cfs {
+		C.lsm_column_family_handle_destroy(cf.cf)
+		delete(s.cfs, name)
+	}
+	s.mu.Unlock()
+	// 关闭 DB 会先执行完排队的异步操作，之后 completion queue 中已是全部结果
 	C.lsm_db_close(s.db)
+	C.lsm_completion_queue_shutdown(s.cq)
+	<-s.pollerDone
+	C.lsm_completion_queue_destroy(s.cq)
 }
 
 // 确保 LSMStore 实现了 CentralCache 接口
 var _ geecache.CentralCache = (*LSMStore)(nil)
+var _ geecache.CentralCache = (*LSMColumnFamily)(nil)
@@ -1,8 +1,12 @@
 package bridge
 
 import (
+	"fmt"
 	"os"
+	"runtime/pprof"
+	"sync"
 	"testing"
+	"time"
 )
 
 func TestLSMStore(t *testing.T) {
@@ -76,3 +80,384 @@ func TestLSMPersistence(t *testing.T) {
 		t.Errorf("Get got %s, want %s", got, value)
 	}
 }
+
+func TestLSMColumnFamily(t *testing.T) {
+	path := "/tmp/test_lsm_column_family"
+	os.RemoveAll(path)
+	defer os.RemoveAll(path)
+
+	store, err := NewLSMStore(path)
+	if err != nil {
+		t.Fatalf("Failed to create store: %v", err)
+	}
+	defer store.Close()
+
+	users, err := store.ColumnFamily("users")
+	if err != nil {
+		t.Fatalf("ColumnFamily failed: %v", err)
+	}
+	if err := users.Set("k", []byte("user")); err != nil {
+		t.Fatalf("Set failed: %v", err)
+	}
+	if err := store.Set("k", []byte("default")); err != nil {
+		t.Fatalf("Set failed: %v", err)
+	}
+
+	// Families are separate namespaces
+	got, _ := users.Get("k")
+	if string(got) != "user" {
+		t.Errorf("users Get got %s, want user", got)
+	}
+	got, _ = store.Get("k")
+	if string(got) != "default" {
+		t.Errorf("default Get got %s, want default", got)
+	}
+
+	// 空值存在时不应被当作未找到
+	if err := users.Set("empty", []byte{}); err != nil {
+		t.Fatalf("Set failed: %v", err)
+	}
+	if got, err := users.Get("empty"); err != nil || got == nil || len(got) != 0 {
+		t.Errorf("users Get(empty) got %v, %v, want an empty value", got, err)
+	}
+
+	if err := store.DropColumnFamily("users"); err != nil {
+		t.Fatalf("DropColumnFamily failed: %v", err)
+	}
+	users, err = store.ColumnFamily("users")
+	if err != nil {
+		t.Fatalf("ColumnFamily failed: %v", err)
+	}
+	if got, _ := users.Get("k"); got != nil {
+		t.Errorf("Get after drop should return nil, got %s", got)
+	}
+}
+
+func TestLSMSetWithTTL(t *testing.T) {
+	path := "/tmp/test_lsm_ttl"
+	os.RemoveAll(path)
+	defer os.RemoveAll(path)
+
+	store, err := NewLSMStore(path)
+	if err != nil {
+		t.Fatalf("Failed to create store: %v", err)
+	}
+	defer store.Close()
+
+	if err := store.SetWithTTL("short", []byte("v"), 100*time.Millisecond); err != nil {
+		t.Fatalf("SetWithTTL failed: %v", err)
+	}
+	if err := store.SetWithTTL("long", []byte("v"), time.Hour); err != nil {
+		t.Fatalf("SetWithTTL failed: %v", err)
+	}
+	if got, _ := store.Get("short"); string(got) != "v" {
+		t.Errorf("Get before expiry got %s, want v", got)
+	}
+
+	time.Sleep(200 * time.Millisecond)
+	if got, _ := store.Get("short"); got != nil {
+		t.Errorf("Get after expiry should return nil, got %s", got)
+	}
+	if got, _ := store.Get("long"); string(got) != "v" {
+		t.Errorf("Get got %s, want v", got)
+	}
+}
+
+func TestLSMDeleteRange(t *testing.T) {
+	path := "/tmp/test_lsm_delete_range"
+	os.RemoveAll(path)
+	defer os.RemoveAll(path)
+
+	store, err := NewLSMStore(path)
+	if err != nil {
+		t.Fatalf("Failed to create store: %v", err)
+	}
+	defer store.Close()
+
+	for _, key := range []string{"group1:a", "group1:b", "group2:a"} {
+		if err := store.Set(key, []byte("v")); err != nil {
+			t.Fatalf("Set failed: %v", err)
+		}
+	}
+	if err := store.DeleteRange("group1:", "group1;"); err != nil {
+		t.Fatalf("DeleteRange failed: %v", err)
+	}
+
+	for _, key := range []string{"group1:a", "group1:b"} {
+		if got, _ := store.Get(key); got != nil {
+			t.Errorf("Get %s after DeleteRange should return nil, got %s", key, got)
+		}
+	}
+	if got, _ := store.Get("group2:a"); string(got) != "v" {
+		t.Errorf("Get group2:a got %s, want v", got)
+	}
+}
+
+func TestLSMIngestExternalFile(t *testing.T) {
+	path := "/tmp/test_lsm_ingest"
+	sstPath := "/tmp/test_lsm_ingest.sst"
+	os.RemoveAll(path)
+	defer os.RemoveAll(path)
+	defer os.Remove(sstPath)
+
+	store, err := NewLSMStore(path)
+	if err != nil {
+		t.Fatalf("Failed to create store: %v", err)
+	}
+	defer store.Close()
+
+	if err := store.Set("node:b", []byte("old")); err != nil {
+		t.Fatalf("Set failed: %v", err)
+	}
+
+	w, err := NewSSTFileWriter(sstPath)
+	if err != nil {
+		t.Fatalf("NewSSTFileWriter failed: %v", err)
+	}
+	for _, key := range []string{"node:a", "node:b", "node:c"} {
+		if err := w.Put(key, []byte("bulk")); err != nil {
+			t.Fatalf("Put failed: %v", err)
+		}
+	}
+	if err := w.Put("node:a", []byte("bulk")); err == nil {
+		t.Errorf("out-of-order Put should fail")
+	}
+	if err := w.Finish(); err != nil {
+		t.Fatalf("Finish failed: %v", err)
+	}
+	w.Close()
+
+	if err := store.IngestExternalFile(sstPath, true); err != nil {
+		t.Fatalf("IngestExternalFile failed: %v", err)
+	}
+	for _, key := range []string{"node:a", "node:b", "node:c"} {
+		if got, _ := store.Get(key); string(got) != "bulk" {
+			t.Errorf("Get %s got %s, want bulk", key, got)
+		}
+	}
+	if err := store.IngestExternalFile(sstPath, false); err == nil {
+		t.Errorf("ingesting a moved file should fail")
+	}
+}
+
+func TestLSMMultiGet(t *testing.T) {
+	path := "/tmp/test_lsm_multiget"
+	os.RemoveAll(path)
+	defer os.RemoveAll(path)
+
+	store, err := NewLSMStore(path)
+	if err != nil {
+		t.Fatalf("Failed to create store: %v", err)
+	}
+	defer store.Close()
+
+	for i := 0; i < 100; i++ {
+		key := fmt.Sprintf("key_%03d", i)
+		if err := store.Set(key, []byte("val_"+key)); err != nil {
+			t.Fatalf("Set failed: %v", err)
+		}
+	}
+	if err := store.Delete("key_050"); err != nil {
+		t.Fatalf("Delete failed: %v", err)
+	}
+
+	keys := []string{"key_000", "key_050", "missing", "key_099", "key_000"}
+	values, err := store.MultiGet(keys)
+	if err != nil {
+		t.Fatalf("MultiGet failed: %v", err)
+	}
+	if len(values) != len(keys) {
+		t.Fatalf("MultiGet returned %d values, want %d", len(values), len(keys))
+	}
+	for i, key := range keys {
+		want := "val_" + key
+		if key == "key_050" || key == "missing" {
+			if values[i] != nil {
+				t.Errorf("MultiGet %s got %s, want nil", key, values[i])
+			}
+		} else if string(values[i]) != want {
+			t.Errorf("MultiGet %s got %s, want %s", key, values[i], want)
+		}
+	}
+}
+
+func TestLSMFollower(t *testing.T) {
+	path := "/tmp/test_lsm_follower_source"
+	followerPath := "/tmp/test_lsm_follower_replica"
+	os.RemoveAll(path)
+	os.RemoveAll(followerPath)
+	defer os.RemoveAll(path)
+	defer os.RemoveAll(followerPath)
+
+	source, err := NewLSMStore(path, WithWALRetention(64<<20))
+	if err != nil {
+		t.Fatalf("Failed to create store: %v", err)
+	}
+	defer source.Close()
+	replica, err := NewLSMStore(followerPath)
+	if err != nil {
+		t.Fatalf("Failed to create store: %v", err)
+	}
+	defer replica.Close()
+
+	users, err := source.ColumnFamily("users")
+	if err != nil {
+		t.Fatalf("ColumnFamily failed: %v", err)
+	}
+	for i := 0; i < 100; i++ {
+		if err := source.Set(fmt.Sprintf("key_%03d", i), []byte("v1")); err != nil {
+			t.Fatalf("Set failed: %v", err)
+		}
+	}
+	users.Set("alice", []byte("1"))
+	source.Delete("key_000")
+	source.DeleteRange("key_010", "key_020")
+
+	f := NewFollower(source, replica, 0)
+	n, err := f.CatchUp()
+	if err != nil {
+		t.Fatalf("CatchUp failed: %v", err)
+	}
+	if n != 103 || f.Applied() != source.LatestSequenceNumber() {
+		t.Errorf("CatchUp applied %d updates up to %d, want 103 up to %d", n, f.Applied(), source.LatestSequenceNumber())
+	}
+
+	source.Set("key_001", []byte("v2"))
+	if n, err := f.CatchUp(); err != nil || n != 1 {
+		t.Errorf("second CatchUp applied %d, err %v, want 1", n, err)
+	}
+
+	for key, want := range map[string]string{"key_000": "", "key_001": "v2", "key_015": "", "key_099": "v1"} {
+		got, _ := replica.Get(key)
+		if string(got) != want {
+			t.Errorf("replica Get %s got %q, want %q", key, got, want)
+		}
+	}
+	replicaUsers, _ := replica.ColumnFamily("users")
+	if got, _ := replicaUsers.Get("alice"); string(got) != "1" {
+		t.Errorf("replica users Get alice got %q, want 1", got)
+	}
+}
+
+func TestLSMMemEnv(t *testing.T) {
+	path := "/tmp/test_lsm_mem_env"
+	os.RemoveAll(path)
+
+	store, err := NewLSMStore(path, WithMemEnv())
+	if err != nil {
+		t.Fatalf("Failed to create store: %v", err)
+	}
+	defer store.Close()
+
+	for i := 0; i < 1000; i++ {
+		if err := store.Set(fmt.Sprintf("key_%04d", i), []byte(fmt.Sprintf("value_%d", i))); err != nil {
+			t.Fatalf("Set failed: %v", err)
+		}
+	}
+	got, err := store.Get("key_0500")
+	if err != nil {
+		t.Fatalf("Get failed: %v", err)
+	}
+	if string(got) != "value_500" {
+		t.Errorf("Get got %s, want value_500", got)
+	}
+
+	// 内存中的 DB 不应在磁盘上留下任何文件
+	if _, err := os.Stat(path); !os.IsNotExist(err) {
+		t.Errorf("in-memory store created %s on disk", path)
+	}
+}
+
+func TestLSMWriteOptions(t *testing.T) {
+	path := "/tmp/test_lsm_write_options"
+	os.RemoveAll(path)
+	defer os.RemoveAll(path)
+
+	store, err := NewLSMStore(path, WithSync())
+	if err != nil {
+		t.Fatalf("Failed to create store: %v", err)
+	}
+	if err := store.SetWithOptions("synced", []byte("v1"), WriteOptions{Sync: true}); err != nil {
+		t.Fatalf("SetWithOptions(Sync) failed: %v", err)
+	}
+	if err := store.SetWithOptions("unlogged", []byte("v2"), WriteOptions{DisableWAL: true}); err != nil {
+		t.Fatalf("SetWithOptions(DisableWAL) failed: %v", err)
+	}
+	if err := store.SetWithOptions("low_pri", []byte("v3"), WriteOptions{LowPri: true}); err != nil {
+		t.Fatalf("SetWithOptions(LowPri) failed: %v", err)
+	}
+	if err := store.DeleteWithOptions("low_pri", WriteOptions{LowPri: true}); err != nil {
+		t.Fatalf("DeleteWithOptions failed: %v", err)
+	}
+	if err := store.SetWithOptions("bad", []byte("v"), WriteOptions{Sync: true, DisableWAL: true}); err == nil {
+		t.Errorf("SetWithOptions accepted Sync together with DisableWAL")
+	}
+	store.Close()
+
+	// 不写 WAL 的数据在正常关闭时已 flush，重新打开后仍在
+	store, err = NewLSMStore(path)
+	if err != nil {
+		t.Fatalf("Failed to reopen store: %v", err)
+	}
+	defer store.Close()
+	for key, want := range map[string]string{"synced": "v1", "unlogged": "v2"} {
+		got, err := store.Get(key)
+		if err != nil {
+			t.Fatalf("Get(%s) failed: %v", key, err)
+		}
+		if string(got) != want {
+			t.Errorf("Get(%s) got %s, want %s", key, got, want)
+		}
+	}
+	if got, _ := store.Get("low_pri"); got != nil {
+		t.Errorf("Get(low_pri) got %s after delete", got)
+	}
+}
+
+func TestLSMAsyncConcurrency(t *testing.T) {
+	path := "/tmp/test_lsm_async"
+	os.RemoveAll(path)
+	defer os.RemoveAll(path)
+
+	store, err := NewLSMStore(path)
+	if err != nil {
+		t.Fatalf("Failed to create store: %v", err)
+	}
+	defer store.Close()
+
+	threadsBefore := pprof.Lookup("threadcreate").Count()
+	const goroutines = 500
+	var wg sync.WaitGroup
+	errs := make(chan error, goroutines)
+	for g := 0; g < goroutines; g++ {
+		wg.Add(1)
+		go func(g int) {
+			defer wg.Done()
+			for i := 0; i < 20; i++ {
+				key := fmt.Sprintf("g%d_k%d", g, i)
+				if err := store.Set(key, []byte(key)); err != nil {
+					errs <- err
+					return
+				}
+				got, err := store.Get(key)
+				if err != nil || string(got) != key {
+					errs <- fmt.Errorf("Get %s got %s, %v", key, got, err)
+					return
+				}
+			}
+		}(g)
+	}
+	wg.Wait()
+	close(errs)
+	for err := range errs {
+		t.Error(err)
+	}
+
+	// 调用方只阻塞在 channel 上，线程数不随 goroutine 数增长
+	if created := pprof.Lookup("threadcreate").Count() - threadsBefore; created > goroutines/5 {
+		t.Errorf("%d OS threads created for %d goroutines", created, goroutines)
+	}
+	if got, _ := store.Get("missing"); got != nil {
+		t.Errorf("Get missing got %s, want nil", got)
+	}
+}